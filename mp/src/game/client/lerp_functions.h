@@ -10,6 +10,8 @@
 #pragma once
 #endif
 
+#include "mathlib/ssemath.h"
+
 
 template <class T>
 inline T LoopingLerp( float flPercent, T flFrom, T flTo )
@@ -162,4 +164,74 @@ inline float LoopingLerp_Hermite( float t, float p0, float p1, float p2 )
 // NOTE: C_AnimationLayer has its own versions of these functions in animationlayer.h.
 
 
+//-----------------------------------------------------------------------------
+// Whole row versions for interpolated arrays. Float rows are blended four at
+// a time; any other type returns false and the caller goes element by element.
+// Looping elements always take the element by element path.
+//-----------------------------------------------------------------------------
+template <class T>
+inline bool Lerp_Row( int nCount, float t, const T *pFrom, const T *pTo, T *pOut )
+{
+	return false;
+}
+
+template <class T>
+inline bool Lerp_Hermite_Row( int nCount, float t, const T *p0, const T *p1, const T *p2, T *pOut )
+{
+	return false;
+}
+
+inline bool Lerp_Row( int nCount, float t, const float *pFrom, const float *pTo, float *pOut )
+{
+	fltx4 ft = ReplicateX4( t );
+
+	int i = 0;
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		fltx4 from = LoadUnalignedSIMD( pFrom + i );
+		fltx4 to = LoadUnalignedSIMD( pTo + i );
+		StoreUnalignedSIMD( pOut + i, AddSIMD( from, MulSIMD( SubSIMD( to, from ), ft ) ) );
+	}
+
+	for ( ; i < nCount; i++ )
+	{
+		pOut[i] = Lerp( t, pFrom[i], pTo[i] );
+	}
+
+	return true;
+}
+
+inline bool Lerp_Hermite_Row( int nCount, float t, const float *p0, const float *p1, const float *p2, float *pOut )
+{
+	// Same basis as Lerp_Hermite
+	float tSqr = t*t;
+	float tCube = t*tSqr;
+	fltx4 h1 = ReplicateX4( 2*tCube-3*tSqr+1 );
+	fltx4 h2 = ReplicateX4( -2*tCube+3*tSqr );
+	fltx4 hd1 = ReplicateX4( tCube-2*tSqr+t );
+	fltx4 hd2 = ReplicateX4( tCube-tSqr );
+
+	int i = 0;
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		fltx4 v0 = LoadUnalignedSIMD( p0 + i );
+		fltx4 v1 = LoadUnalignedSIMD( p1 + i );
+		fltx4 v2 = LoadUnalignedSIMD( p2 + i );
+
+		fltx4 out = MulSIMD( v1, h1 );
+		out = AddSIMD( out, MulSIMD( v2, h2 ) );
+		out = AddSIMD( out, MulSIMD( SubSIMD( v1, v0 ), hd1 ) );
+		out = AddSIMD( out, MulSIMD( SubSIMD( v2, v1 ), hd2 ) );
+		StoreUnalignedSIMD( pOut + i, out );
+	}
+
+	for ( ; i < nCount; i++ )
+	{
+		pOut[i] = Lerp_Hermite( t, p0[i], p1[i], p2[i] );
+	}
+
+	return true;
+}
+
+
 #endif // LERP_FUNCTIONS_H
@@ -84,6 +84,7 @@ OUTPUTS:
 #include "tier1/strtools.h"
 #include "datacache/imdlcache.h"
 #include "env_debughistory.h"
+#include "tickprofiler.h"
 
 #include "tier0/vprof.h"
 
@@ -915,6 +916,9 @@ void CEventQueue::ServiceEvents( void )
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		CTickProfileScope tickProfile( TICKPROFILE_EVENTQUEUE, STRING( pe->m_iTargetInput ),
+			pe->m_pCaller ? STRING( pe->m_pCaller->m_iClassname ) : NULL );
+
 		bool targetFound = false;
 
 		// find the targets
@@ -0,0 +1,180 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compressed stream benchmark. Runs each codec over the save games
+//			and demos on disk, streaming a block at a time and across the
+//			thread pool, and reports the ratio and the memory each way holds.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/compressedstream.h"
+#include "tier1/utlbuffer.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define COMPRESSEDSTREAM_BENCHMARK_MAX_BYTES	( 64 * 1024 * 1024 )
+#define COMPRESSEDSTREAM_BENCHMARK_WRITE_SIZE	( 16 * 1024 )	// roughly what the save and demo writers hand over at a time
+
+//-----------------------------------------------------------------------------
+// Purpose: Appends the files matching a wildcard to one sample, up to the cap
+//-----------------------------------------------------------------------------
+static int LoadCompressedStreamBenchmarkFiles( const char *pszDirectory, const char *pszExtension, CUtlBuffer &sample )
+{
+	char szWildcard[MAX_PATH];
+	V_snprintf( szWildcard, sizeof( szWildcard ), "%s*.%s", pszDirectory, pszExtension );
+
+	int nFiles = 0;
+	FileFindHandle_t hFind;
+	for ( const char *pszName = filesystem->FindFirstEx( szWildcard, "MOD", &hFind ); pszName; pszName = filesystem->FindNext( hFind ) )
+	{
+		if ( filesystem->FindIsDirectory( hFind ) || sample.TellPut() >= COMPRESSEDSTREAM_BENCHMARK_MAX_BYTES )
+			continue;
+
+		char szPath[MAX_PATH];
+		V_snprintf( szPath, sizeof( szPath ), "%s%s", pszDirectory, pszName );
+
+		int nMaxBytes = COMPRESSEDSTREAM_BENCHMARK_MAX_BYTES - sample.TellPut();
+		if ( filesystem->ReadFile( szPath, "MOD", sample, nMaxBytes ) )
+		{
+			++nFiles;
+		}
+	}
+	filesystem->FindClose( hFind );
+
+	return nFiles;
+}
+
+static double CompressedStreamBenchmarkMBs( int nBytes, const CCycleCount &duration )
+{
+	return nBytes / ( 1024.0 * 1024.0 ) / MAX( duration.GetSeconds(), 0.000001 );
+}
+
+static void RunCompressedStreamBenchmark( const char *pszName, CUtlBuffer &sample, int nBlockSize )
+{
+	int nBytes = sample.TellPut();
+	if ( !nBytes )
+	{
+		Msg( "  %s: nothing to compress\n", pszName );
+		return;
+	}
+
+	Msg( "  %s: %d KB in %d KB blocks\n", pszName, nBytes / 1024, nBlockSize / 1024 );
+
+	for ( int iCodec = COMPRESSEDSTREAM_CODEC_LZSS; iCodec < COMPRESSEDSTREAM_CODEC_COUNT; ++iCodec )
+	{
+		CompressedStreamCodec_t codec = (CompressedStreamCodec_t)iCodec;
+		const byte *pData = (const byte *)sample.Base();
+		CFastTimer timer;
+
+		// Streamed the way a save or demo is written, a piece at a time
+		CUtlBuffer compressed;
+		compressed.EnsureCapacity( ( nBytes / nBlockSize + 1 ) * CompressedStreamMaxFrameSize( codec, nBlockSize ) + 64 );
+		CCompressedStreamWriter writer( compressed, codec, nBlockSize );
+		timer.Start();
+		for ( int nPos = 0; nPos < nBytes; nPos += COMPRESSEDSTREAM_BENCHMARK_WRITE_SIZE )
+		{
+			writer.Write( pData + nPos, MIN( COMPRESSEDSTREAM_BENCHMARK_WRITE_SIZE, nBytes - nPos ) );
+		}
+		writer.Finish();
+		timer.End();
+		CCycleCount timeStreamCompress = timer.GetDuration();
+
+		// Read back a block at a time, checking each against the original
+		bool bMatch = writer.IsValid();
+		CCompressedStreamReader reader( compressed );
+		int nRead = 0;
+		int nBlockBytes;
+		CCycleCount timeStreamDecompress;
+		for ( ;; )
+		{
+			timer.Start();
+			const void *pBlock = reader.NextBlock( &nBlockBytes );
+			timer.End();
+			timeStreamDecompress += timer.GetDuration();
+
+			if ( !pBlock )
+				break;
+
+			bMatch = bMatch && ( nRead + nBlockBytes <= nBytes ) && !V_memcmp( pBlock, pData + nRead, nBlockBytes );
+			nRead += nBlockBytes;
+		}
+		bMatch = bMatch && reader.IsValid() && ( nRead == nBytes );
+
+		// Whole buffers across the thread pool
+		CUtlBuffer parallelCompressed;
+		sample.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+		timer.Start();
+		bMatch = CompressStreamParallel( sample, parallelCompressed, codec, nBlockSize ) && bMatch;
+		timer.End();
+		CCycleCount timeParallelCompress = timer.GetDuration();
+
+		CUtlBuffer decompressed;
+		timer.Start();
+		bMatch = DecompressStreamParallel( parallelCompressed, decompressed ) && bMatch;
+		timer.End();
+		CCycleCount timeParallelDecompress = timer.GetDuration();
+
+		bMatch = bMatch && ( decompressed.TellPut() == nBytes ) && !V_memcmp( decompressed.Base(), pData, nBytes );
+
+		Msg( "    %-6s %5.1f%%  streamed %7.1f / %7.1f MB/s  parallel %7.1f / %7.1f MB/s (compress / decompress)\n",
+			CompressedStreamCodecName( codec ), 100.0 * compressed.TellPut() / nBytes,
+			CompressedStreamBenchmarkMBs( nBytes, timeStreamCompress ), CompressedStreamBenchmarkMBs( nBytes, timeStreamDecompress ),
+			CompressedStreamBenchmarkMBs( nBytes, timeParallelCompress ), CompressedStreamBenchmarkMBs( nBytes, timeParallelDecompress ) );
+		Msg( "           memory: streamed %d KB writing, %d KB reading; whole buffer %d KB\n",
+			writer.GetMemoryUsed() / 1024, reader.GetMemoryUsed() / 1024, ( nBytes + parallelCompressed.TellPut() ) / 1024 );
+
+		if ( !bMatch )
+		{
+			Warning( "    %s didn't round trip\n", CompressedStreamCodecName( codec ) );
+		}
+	}
+}
+
+CON_COMMAND( compressedstream_benchmark, "Times LZSS and Snappy compressed streams over the save games and demos on disk. Usage: compressedstream_benchmark [block size KB] [file ...]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nBlockSize = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, COMPRESSEDSTREAM_MAX_BLOCK_SIZE / 1024 ) * 1024 : COMPRESSEDSTREAM_DEFAULT_BLOCK_SIZE;
+
+	Msg( "compressedstream_benchmark: %d threads\n", ( g_pThreadPool ? g_pThreadPool->NumThreads() : 0 ) + 1 );
+
+	if ( args.ArgC() > 2 )
+	{
+		for ( int i = 2; i < args.ArgC(); ++i )
+		{
+			CUtlBuffer sample;
+			if ( !filesystem->ReadFile( args.Arg( i ), "MOD", sample, COMPRESSEDSTREAM_BENCHMARK_MAX_BYTES ) )
+			{
+				Warning( "  couldn't read %s\n", args.Arg( i ) );
+				continue;
+			}
+			RunCompressedStreamBenchmark( args.Arg( i ), sample, nBlockSize );
+		}
+		return;
+	}
+
+	CUtlBuffer saves;
+	int nSaves = LoadCompressedStreamBenchmarkFiles( "save/", "sav", saves );
+
+	CUtlBuffer demos;
+	int nDemos = LoadCompressedStreamBenchmarkFiles( "", "dem", demos );
+	nDemos += LoadCompressedStreamBenchmarkFiles( "demos/", "dem", demos );
+
+	if ( !nSaves && !nDemos )
+	{
+		Msg( "No save games or demos found; pass files to benchmark instead\n" );
+		return;
+	}
+
+	char szName[64];
+	V_snprintf( szName, sizeof( szName ), "%d save games", nSaves );
+	RunCompressedStreamBenchmark( szName, saves, nBlockSize );
+
+	V_snprintf( szName, sizeof( szName ), "%d demos", nDemos );
+	RunCompressedStreamBenchmark( szName, demos, nBlockSize );
+}
@@ -0,0 +1,247 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Concurrent hash benchmark. Runs the same read-mostly mix of
+//			lookups, inserts and removes against CUtlConcurrentHash and
+//			CUtlTSHash, on one thread and across the thread pool. CUtlTSHash
+//			can't remove, so it looks its removes up instead.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/utlconcurrenthash.h"
+#include "tier1/utltshash.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define CONCURRENTHASH_BENCHMARK_BUCKETS	16384
+
+typedef CUtlConcurrentHash< intp, int > ConcurrentHashBenchmark_t;
+typedef CUtlTSHash< int, CONCURRENTHASH_BENCHMARK_BUCKETS > TSHashBenchmark_t;
+
+struct ConcurrentHashBenchmarkJob_t
+{
+	ConcurrentHashBenchmark_t *m_pHash;
+	TSHashBenchmark_t *m_pTSHash;
+	int m_nKeys;
+	int m_nOperations;
+	int m_nWritePercent;
+	int m_nRemovePercent;
+	intp m_nChurnKeys;		// keys past m_nKeys that the jobs insert and remove
+	intp m_nNextKey;		// this job's keys to insert
+	intp m_nNextRemove;		// oldest of them still in the table
+	uint32 m_nSeed;
+	int m_nInserted;
+	int m_nRemoved;
+	int m_nMismatches;
+};
+
+enum ConcurrentHashBenchmarkOp_t
+{
+	CONCURRENTHASH_BENCHMARK_FIND,			// a preloaded key, which must be there
+	CONCURRENTHASH_BENCHMARK_FIND_CHURNED,	// a key other jobs may be inserting or removing
+	CONCURRENTHASH_BENCHMARK_INSERT,
+	CONCURRENTHASH_BENCHMARK_REMOVE,
+};
+
+static int ConcurrentHashBenchmarkValue( intp nKey )
+{
+	return (int)nKey ^ 0x5bd1e995;
+}
+
+// Inserts and removes work through the job's own keys, oldest removed
+// first. With removes on, half the lookups go to keys the jobs are churning.
+static ConcurrentHashBenchmarkOp_t NextConcurrentHashBenchmarkOp( ConcurrentHashBenchmarkJob_t &job, intp &nKey )
+{
+	job.m_nSeed = job.m_nSeed * 1664525u + 1013904223u;
+	int nRoll = ( job.m_nSeed >> 8 ) % 100;
+	if ( nRoll < job.m_nWritePercent )
+	{
+		nKey = job.m_nNextKey++;
+		return CONCURRENTHASH_BENCHMARK_INSERT;
+	}
+
+	if ( nRoll < job.m_nWritePercent + job.m_nRemovePercent && job.m_nNextRemove < job.m_nNextKey )
+	{
+		nKey = job.m_nNextRemove++;
+		return CONCURRENTHASH_BENCHMARK_REMOVE;
+	}
+
+	if ( job.m_nRemovePercent && ( job.m_nSeed & 0x10000 ) )
+	{
+		nKey = job.m_nKeys + ( job.m_nSeed >> 4 ) % job.m_nChurnKeys;
+		return CONCURRENTHASH_BENCHMARK_FIND_CHURNED;
+	}
+
+	nKey = ( job.m_nSeed >> 4 ) % job.m_nKeys;
+	return CONCURRENTHASH_BENCHMARK_FIND;
+}
+
+static void RunConcurrentHashBenchmarkJob( ConcurrentHashBenchmarkJob_t &job )
+{
+	for ( int i = 0; i < job.m_nOperations; ++i )
+	{
+		intp nKey;
+		ConcurrentHashBenchmarkOp_t op = NextConcurrentHashBenchmarkOp( job, nKey );
+		if ( op == CONCURRENTHASH_BENCHMARK_INSERT )
+		{
+			if ( job.m_pHash->Insert( nKey, ConcurrentHashBenchmarkValue( nKey ) ) )
+			{
+				++job.m_nInserted;
+			}
+			continue;
+		}
+
+		if ( op == CONCURRENTHASH_BENCHMARK_REMOVE )
+		{
+			if ( job.m_pHash->Remove( nKey ) )
+			{
+				++job.m_nRemoved;
+			}
+			else
+			{
+				++job.m_nMismatches;
+			}
+			continue;
+		}
+
+		// A churned key may come and go, but never with the wrong value
+		int nValue;
+		bool bFound = job.m_pHash->Find( nKey, &nValue );
+		if ( bFound ? ( nValue != ConcurrentHashBenchmarkValue( nKey ) ) : ( op == CONCURRENTHASH_BENCHMARK_FIND ) )
+		{
+			++job.m_nMismatches;
+		}
+	}
+}
+
+static void RunTSHashBenchmarkJob( ConcurrentHashBenchmarkJob_t &job )
+{
+	for ( int i = 0; i < job.m_nOperations; ++i )
+	{
+		intp nKey;
+		ConcurrentHashBenchmarkOp_t op = NextConcurrentHashBenchmarkOp( job, nKey );
+		if ( op == CONCURRENTHASH_BENCHMARK_INSERT )
+		{
+			job.m_pTSHash->Insert( nKey, ConcurrentHashBenchmarkValue( nKey ) );
+			++job.m_nInserted;
+			continue;
+		}
+
+		UtlTSHashHandle_t h = job.m_pTSHash->Find( nKey );
+		bool bFound = ( h != TSHashBenchmark_t::InvalidHandle() );
+		if ( bFound ? ( job.m_pTSHash->Element( h ) != ConcurrentHashBenchmarkValue( nKey ) ) : ( op == CONCURRENTHASH_BENCHMARK_FIND ) )
+		{
+			++job.m_nMismatches;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fills both tables with the same keys and times the jobs against
+//			one of them, returning operations per second. Afterwards
+//			CUtlConcurrentHash must hold exactly what the jobs left in it;
+//			CUtlTSHash counts pooled blocks, so it can't be checked.
+//-----------------------------------------------------------------------------
+static double TimeConcurrentHashBenchmark( CUtlVector< ConcurrentHashBenchmarkJob_t > &jobs, bool bTSHash, bool bParallel, int &nMismatches )
+{
+	ConcurrentHashBenchmark_t hash;
+	TSHashBenchmark_t tsHash( jobs[0].m_nKeys );
+	for ( intp nKey = 0; nKey < jobs[0].m_nKeys; ++nKey )
+	{
+		if ( bTSHash )
+		{
+			tsHash.Insert( nKey, ConcurrentHashBenchmarkValue( nKey ) );
+		}
+		else
+		{
+			hash.Insert( nKey, ConcurrentHashBenchmarkValue( nKey ) );
+		}
+	}
+	tsHash.Commit();
+
+	int nOperations = 0;
+	for ( int i = 0; i < jobs.Count(); ++i )
+	{
+		jobs[i].m_pHash = &hash;
+		jobs[i].m_pTSHash = &tsHash;
+		jobs[i].m_nChurnKeys = (intp)jobs.Count() * jobs[i].m_nOperations;
+		jobs[i].m_nNextKey = jobs[0].m_nKeys + (intp)i * jobs[i].m_nOperations;
+		jobs[i].m_nNextRemove = jobs[i].m_nNextKey;
+		jobs[i].m_nSeed = 0x9e3779b9 * ( i + 1 );
+		jobs[i].m_nInserted = 0;
+		jobs[i].m_nRemoved = 0;
+		jobs[i].m_nMismatches = 0;
+		nOperations += jobs[i].m_nOperations;
+	}
+
+	void (*pfnJob)( ConcurrentHashBenchmarkJob_t & ) = bTSHash ? &RunTSHashBenchmarkJob : &RunConcurrentHashBenchmarkJob;
+
+	CFastTimer timer;
+	timer.Start();
+	if ( bParallel )
+	{
+		ParallelProcess( "concurrenthash_benchmark", jobs.Base(), jobs.Count(), pfnJob );
+	}
+	else
+	{
+		for ( int i = 0; i < jobs.Count(); ++i )
+		{
+			pfnJob( jobs[i] );
+		}
+	}
+	timer.End();
+
+	int nExpected = jobs[0].m_nKeys;
+	for ( int i = 0; i < jobs.Count(); ++i )
+	{
+		nMismatches += jobs[i].m_nMismatches;
+		nExpected += jobs[i].m_nInserted - jobs[i].m_nRemoved;
+	}
+
+	if ( !bTSHash && hash.Count() != nExpected )
+	{
+		Warning( "  CUtlConcurrentHash holds %d keys, expected %d\n", hash.Count(), nExpected );
+		++nMismatches;
+	}
+	return nOperations / timer.GetDuration().GetSeconds();
+}
+
+CON_COMMAND( concurrenthash_benchmark, "Times CUtlConcurrentHash against CUtlTSHash under a read-mostly load from every pool thread. Usage: concurrenthash_benchmark [keys] [operations per thread] [insert percent] [remove percent]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nKeys = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, 4 * 1024 * 1024 ) : 65536;
+	int nOperations = ( args.ArgC() > 2 ) ? clamp( atoi( args.Arg( 2 ) ), 1, 16 * 1024 * 1024 ) : 1000000;
+	int nWritePercent = ( args.ArgC() > 3 ) ? clamp( atoi( args.Arg( 3 ) ), 0, 100 ) : 2;
+	int nRemovePercent = ( args.ArgC() > 4 ) ? clamp( atoi( args.Arg( 4 ) ), 0, 100 - nWritePercent ) : nWritePercent / 2;
+	int nThreads = ( g_pThreadPool ? g_pThreadPool->NumThreads() : 0 ) + 1;
+
+	CUtlVector< ConcurrentHashBenchmarkJob_t > jobs;
+	jobs.SetCount( nThreads );
+	for ( int i = 0; i < jobs.Count(); ++i )
+	{
+		jobs[i].m_nKeys = nKeys;
+		jobs[i].m_nOperations = nOperations;
+		jobs[i].m_nWritePercent = nWritePercent;
+		jobs[i].m_nRemovePercent = nRemovePercent;
+	}
+
+	int nMismatches = 0;
+	double flHashSerial = TimeConcurrentHashBenchmark( jobs, false, false, nMismatches );
+	double flHashParallel = TimeConcurrentHashBenchmark( jobs, false, true, nMismatches );
+	double flTSHashSerial = TimeConcurrentHashBenchmark( jobs, true, false, nMismatches );
+	double flTSHashParallel = TimeConcurrentHashBenchmark( jobs, true, true, nMismatches );
+
+	Msg( "concurrenthash_benchmark: %d keys, %d threads of %d operations, %d%% inserts, %d%% removes\n", nKeys, nThreads, nOperations, nWritePercent, nRemovePercent );
+	Msg( "  CUtlConcurrentHash: one thread %.2f Mops/s, %d threads %.2f Mops/s\n", flHashSerial / 1000000.0, nThreads, flHashParallel / 1000000.0 );
+	Msg( "  CUtlTSHash: one thread %.2f Mops/s, %d threads %.2f Mops/s\n", flTSHashSerial / 1000000.0, nThreads, flTSHashParallel / 1000000.0 );
+
+	if ( nMismatches )
+	{
+		Warning( "  %d lookups, removes or counts came out wrong\n", nMismatches );
+	}
+}
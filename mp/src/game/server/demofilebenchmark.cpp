@@ -0,0 +1,273 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Demo reader benchmark. Reads the demos on disk mapped, from a
+//			buffer and across worker threads, checks that all three see the
+//			same commands, and reports how fast each one gets through them.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "demofile/demoreader.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/checksum_crc.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define DEMOFILE_BENCHMARK_MAX_FILES	256
+
+//-----------------------------------------------------------------------------
+// Purpose: What a reader saw in one demo, so the ways of reading it can be
+//			compared
+//-----------------------------------------------------------------------------
+struct DemoFileBenchmarkResult_t
+{
+	DemoFileBenchmarkResult_t() : m_nCommands( 0 ), m_nPackets( 0 ), m_nLastTick( 0 ), m_nPayloadBytes( 0 ), m_bComplete( false )
+	{
+		CRC32_Init( &m_CRC );
+	}
+
+	void AddCommand( const DemoCommand_t &cmd )
+	{
+		++m_nCommands;
+		if ( cmd.IsPacket() )
+		{
+			++m_nPackets;
+		}
+		m_nLastTick = MAX( m_nLastTick, cmd.m_nTick );
+		m_nPayloadBytes += cmd.m_nDataLength;
+
+		CRC32_ProcessBuffer( &m_CRC, &cmd.m_nCommand, sizeof( cmd.m_nCommand ) );
+		CRC32_ProcessBuffer( &m_CRC, &cmd.m_nTick, sizeof( cmd.m_nTick ) );
+		if ( cmd.m_nDataLength )
+		{
+			CRC32_ProcessBuffer( &m_CRC, cmd.m_pData, cmd.m_nDataLength );
+		}
+	}
+
+	bool operator==( const DemoFileBenchmarkResult_t &other ) const
+	{
+		return m_nCommands == other.m_nCommands && m_nPayloadBytes == other.m_nPayloadBytes &&
+			m_CRC == other.m_CRC && m_bComplete == other.m_bComplete;
+	}
+
+	int			m_nCommands;
+	int			m_nPackets;
+	int			m_nLastTick;
+	int64		m_nPayloadBytes;
+	CRC32_t		m_CRC;
+	bool		m_bComplete;
+};
+
+static bool ReadDemoFileBenchmark( CDemoFileReader &reader, DemoFileBenchmarkResult_t &result )
+{
+	DemoCommand_t cmd;
+	while ( reader.NextCommand( cmd ) )
+	{
+		// Packets must be readable in place
+		if ( cmd.IsPacket() )
+		{
+			bf_read buf;
+			cmd.StartReading( buf );
+			if ( buf.GetNumBytesLeft() != cmd.m_nDataLength )
+				return false;
+		}
+		result.AddCommand( cmd );
+	}
+	result.m_bComplete = !reader.IsCorrupt();
+	return result.m_bComplete;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects what each worker saw; every demo has its own slot
+//-----------------------------------------------------------------------------
+class CDemoFileBenchmarkVisitor : public IDemoFileVisitor
+{
+public:
+	CDemoFileBenchmarkVisitor( int nFiles )
+	{
+		m_Results.SetCount( nFiles );
+	}
+
+	virtual bool OnDemoStart( int iDemo, const char *pszFilename, const demoheader_t &header )
+	{
+		return true;
+	}
+
+	virtual bool OnCommand( int iDemo, const DemoCommand_t &cmd )
+	{
+		m_Results[iDemo].AddCommand( cmd );
+		return true;
+	}
+
+	virtual void OnDemoEnd( int iDemo, bool bComplete )
+	{
+		m_Results[iDemo].m_bComplete = bComplete;
+	}
+
+	CUtlVector< DemoFileBenchmarkResult_t > m_Results;
+};
+
+static void FindDemoFileBenchmarkFiles( const char *pszDirectory, CUtlVector< CUtlString > &files )
+{
+	char szWildcard[MAX_PATH];
+	V_snprintf( szWildcard, sizeof( szWildcard ), "%s*.dem", pszDirectory );
+
+	FileFindHandle_t hFind;
+	for ( const char *pszName = filesystem->FindFirstEx( szWildcard, "MOD", &hFind ); pszName; pszName = filesystem->FindNext( hFind ) )
+	{
+		if ( filesystem->FindIsDirectory( hFind ) || files.Count() >= DEMOFILE_BENCHMARK_MAX_FILES )
+			continue;
+
+		char szPath[MAX_PATH];
+		V_snprintf( szPath, sizeof( szPath ), "%s%s", pszDirectory, pszName );
+		files.AddToTail( szPath );
+	}
+	filesystem->FindClose( hFind );
+}
+
+static double DemoFileBenchmarkMBs( int64 nBytes, const CCycleCount &duration )
+{
+	return nBytes / ( 1024.0 * 1024.0 ) / MAX( duration.GetSeconds(), 0.000001 );
+}
+
+CON_COMMAND( demofile_benchmark, "Reads the demos on disk mapped, from memory and across threads, checks they agree, and times each. Usage: demofile_benchmark [threads] [demo ...]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nThreads = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, 32 ) : 4;
+
+	CUtlVector< CUtlString > files;
+	if ( args.ArgC() > 2 )
+	{
+		for ( int i = 2; i < args.ArgC(); ++i )
+		{
+			files.AddToTail( args.Arg( i ) );
+		}
+	}
+	else
+	{
+		FindDemoFileBenchmarkFiles( "", files );
+		FindDemoFileBenchmarkFiles( "demos/", files );
+	}
+
+	// The reader maps files itself, so it needs paths on disk
+	CUtlVector< CUtlString > fullPaths;
+	for ( int i = 0; i < files.Count(); ++i )
+	{
+		char szFullPath[MAX_PATH];
+		if ( filesystem->RelativePathToFullPath( files[i], "MOD", szFullPath, sizeof( szFullPath ) ) )
+		{
+			fullPaths.AddToTail( szFullPath );
+		}
+		else
+		{
+			Warning( "  couldn't find %s\n", files[i].Get() );
+		}
+	}
+
+	if ( !fullPaths.Count() )
+	{
+		Msg( "No demos found; pass demos to read instead\n" );
+		return;
+	}
+
+	Msg( "demofile_benchmark: %d demos, %d threads\n", fullPaths.Count(), nThreads );
+
+	CFastTimer timer;
+	CCycleCount timeMapped, timeAttached;
+	int64 nFileBytes = 0;
+	int nFailures = 0;
+
+	CUtlVector< DemoFileBenchmarkResult_t > mapped;
+	mapped.SetCount( fullPaths.Count() );
+	for ( int i = 0; i < fullPaths.Count(); ++i )
+	{
+		const char *pszFilename = fullPaths[i];
+
+		CDemoFileReader reader;
+		timer.Start();
+		bool bOpened = reader.Open( pszFilename );
+		bool bComplete = bOpened && ReadDemoFileBenchmark( reader, mapped[i] );
+		timer.End();
+		timeMapped += timer.GetDuration();
+
+		if ( !bOpened )
+		{
+			Warning( "  %s: not a demo this reader understands\n", files[i].Get() );
+			++nFailures;
+			continue;
+		}
+
+		nFileBytes += reader.GetSize();
+		Msg( "  %s: %d KB, %d commands, %d packets, last tick %d (header says %d)\n", V_GetFileName( pszFilename ), reader.GetSize() / 1024,
+			mapped[i].m_nCommands, mapped[i].m_nPackets, mapped[i].m_nLastTick, reader.GetHeader().playback_ticks );
+
+		if ( !bComplete )
+		{
+			Warning( "  %s: corrupt at or after command %d\n", V_GetFileName( pszFilename ), mapped[i].m_nCommands );
+			++nFailures;
+		}
+
+		// The same bytes handed over in memory must read the same way
+		CUtlBuffer buf;
+		if ( !filesystem->ReadFile( pszFilename, NULL, buf ) )
+		{
+			Warning( "  %s: couldn't read into memory\n", V_GetFileName( pszFilename ) );
+			++nFailures;
+			continue;
+		}
+
+		DemoFileBenchmarkResult_t attached;
+		timer.Start();
+		if ( reader.Attach( buf.Base(), buf.TellPut() ) )
+		{
+			ReadDemoFileBenchmark( reader, attached );
+		}
+		timer.End();
+		timeAttached += timer.GetDuration();
+
+		if ( !( attached == mapped[i] ) )
+		{
+			Warning( "  %s: read differently from memory than mapped\n", V_GetFileName( pszFilename ) );
+			++nFailures;
+		}
+	}
+
+	CUtlVector< const char * > filenames;
+	for ( int i = 0; i < fullPaths.Count(); ++i )
+	{
+		filenames.AddToTail( fullPaths[i].Get() );
+	}
+
+	CDemoFileBenchmarkVisitor visitor( filenames.Count() );
+	timer.Start();
+	DemoFile_ProcessParallel( filenames.Base(), filenames.Count(), &visitor, nThreads );
+	timer.End();
+	CCycleCount timeParallel = timer.GetDuration();
+
+	for ( int i = 0; i < fullPaths.Count(); ++i )
+	{
+		if ( mapped[i].m_nCommands && !( visitor.m_Results[i] == mapped[i] ) )
+		{
+			Warning( "  %s: read differently across threads\n", V_GetFileName( fullPaths[i] ) );
+			++nFailures;
+		}
+	}
+
+	Msg( "  mapped %.1f MB/s, from memory %.1f MB/s, %d threads %.1f MB/s\n",
+		DemoFileBenchmarkMBs( nFileBytes, timeMapped ), DemoFileBenchmarkMBs( nFileBytes, timeAttached ),
+		nThreads, DemoFileBenchmarkMBs( nFileBytes, timeParallel ) );
+
+	if ( nFailures )
+	{
+		Warning( "demofile_benchmark: %d failures\n", nFailures );
+	}
+	else
+	{
+		Msg( "demofile_benchmark: every demo read the same way three times\n" );
+	}
+}
@@ -11,6 +11,7 @@
 #include "igamesystem.h"
 #include "collisionutils.h"
 #include "UtlSortVector.h"
+#include "tier1/utlmovingaverage.h"
 #include "tier0/vprof.h"
 #include "mapentities.h"
 #include "client.h"
@@ -127,12 +128,36 @@ void AimTarget_ForceRepopulateList()
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+//
+// Entities that simulate game physics run every tick and live on a single list.
+// Entities that only think are hashed by their next think tick into a timing
+// wheel so each tick only visits the buckets that came due since the last one.
+// Once an entity's think tick has been reached it moves to the overdue list,
+// where it stays (and is returned every tick) until it schedules a new think.
+#define SIMTHINK_WHEEL_BITS		9
+#define SIMTHINK_WHEEL_SIZE		(1 << SIMTHINK_WHEEL_BITS)
+#define SIMTHINK_WHEEL_MASK		(SIMTHINK_WHEEL_SIZE - 1)
+#define SIMTHINK_LIST_SIMULATE	SIMTHINK_WHEEL_SIZE
+#define SIMTHINK_LIST_OVERDUE	(SIMTHINK_WHEEL_SIZE + 1)
+#define SIMTHINK_LIST_COUNT		(SIMTHINK_WHEEL_SIZE + 2)
+#define SIMTHINK_INVALID		0xFFFF
+
 struct simthinkentry_t
 {
-	unsigned short	entEntry;
+	unsigned short	nextEntry;
+	unsigned short	prevEntry;
+	unsigned short	list;
 	unsigned short	unused0;
 	int				nextThinkTick;
+	unsigned int	serial;		// order the entity joined the list, used to keep think order stable
+};
+
+struct simthinkdue_t
+{
+	unsigned int	serial;
+	unsigned short	entEntry;
 };
+
 class CSimThinkManager : public IEntityListener
 {
 public:
@@ -142,11 +167,24 @@ public:
 	}
 	void Clear()
 	{
-		m_simThinkList.Purge();
-		for ( int i = 0; i < ARRAYSIZE(m_entinfoIndex); i++ )
+		for ( int i = 0; i < ARRAYSIZE(m_entries); i++ )
+		{
+			m_entries[i].nextEntry = SIMTHINK_INVALID;
+			m_entries[i].prevEntry = SIMTHINK_INVALID;
+			m_entries[i].list = SIMTHINK_INVALID;
+			m_entries[i].nextThinkTick = 0;
+			m_entries[i].serial = 0;
+		}
+		for ( int i = 0; i < ARRAYSIZE(m_listHead); i++ )
 		{
-			m_entinfoIndex[i] = 0xFFFF;
+			m_listHead[i] = SIMTHINK_INVALID;
 		}
+		m_dueList.Purge();
+		m_count = 0;
+		m_nextSerial = 0;
+		m_lastServicedTick = -1;
+		m_bucketsVisited = 0;
+		ResetStats();
 	}
 	void LevelInitPreEntity()
 	{
@@ -161,7 +199,7 @@ public:
 
 	void OnEntityCreated( CBaseEntity *pEntity )
 	{
-		Assert( m_entinfoIndex[pEntity->GetRefEHandle().GetEntryIndex()] == 0xFFFF );
+		Assert( m_entries[pEntity->GetRefEHandle().GetEntryIndex()].list == SIMTHINK_INVALID );
 	}
 	void OnEntityDeleted( CBaseEntity *pEntity )
 	{
@@ -170,46 +208,40 @@ public:
 
 	void RemoveEntinfoIndex( int index )
 	{
-		int listHandle = m_entinfoIndex[index];
 		// If this guy is in the active list, remove him
-		if ( listHandle != 0xFFFF )
+		if ( m_entries[index].list != SIMTHINK_INVALID )
 		{
-			Assert(m_simThinkList[listHandle].entEntry == index);
-			m_simThinkList.FastRemove( listHandle );
-			m_entinfoIndex[index] = 0xFFFF;
-			
-			// fast remove shifted someone, update that someone
-			if ( listHandle < m_simThinkList.Count() )
-			{
-				m_entinfoIndex[m_simThinkList[listHandle].entEntry] = listHandle;
-			}
+			Unlink( index );
+			m_count--;
 		}
 	}
 	int ListCount()
 	{
-		return m_simThinkList.Count();
+		return m_count;
 	}
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
 	{
-		int count = MIN(listMax, ListCount());
-		int out = 0;
+		ServiceWheel( gpGlobals->tickcount );
+
+		// everything on the simulate and overdue lists runs this frame
+		m_dueList.RemoveAll();
+		AddListToDue( SIMTHINK_LIST_SIMULATE );
+		AddListToDue( SIMTHINK_LIST_OVERDUE );
+		m_dueList.Sort( DueListCompare );
+
+		int count = MIN(listMax, m_dueList.Count());
 		for ( int i = 0; i < count; i++ )
 		{
-			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
-			{
-				Assert(m_simThinkList[i].nextThinkTick>=0);
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
-			}
+			int entinfoIndex = m_dueList[i].entEntry;
+			Assert(m_entries[entinfoIndex].nextThinkTick <= gpGlobals->tickcount);
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+			pList[i] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert(m_entries[entinfoIndex].nextThinkTick==0 || pList[i]->GetFirstThinkTick()==m_entries[entinfoIndex].nextThinkTick);
+			Assert( gEntList.IsEntityPtr( pList[i] ) );
 		}
 
-		return out;
+		return count;
 	}
 
 	void EntityChanged( CBaseEntity *pEntity )
@@ -226,41 +258,204 @@ public:
 		if ( pEntity->IsEFlagSet( EFL_NO_THINK_FUNCTION ) && pEntity->IsEFlagSet( EFL_NO_GAME_PHYSICS_SIMULATION ) )
 		{
 			RemoveEntinfoIndex( index );
+			return;
+		}
+
+		simthinkentry_t &entry = m_entries[index];
+		if ( entry.list == SIMTHINK_INVALID )
+		{
+			// new to the list (had no think or sim last time)
+			entry.serial = m_nextSerial++;
+			m_count++;
 		}
 		else
 		{
-			// already in the list? (had think or sim last time, now has both - or had both last time, now just one)
-			if ( m_entinfoIndex[index] == 0xFFFF )
+			// updating existing entry, pull it out of whatever list it was on
+			Unlink( index );
+		}
+
+		if ( pEntity->IsEFlagSet(EFL_NO_GAME_PHYSICS_SIMULATION) )
+		{
+			entry.nextThinkTick = pEntity->GetFirstThinkTick();
+			Assert(entry.nextThinkTick>=0);
+			Link( index, ListForThinkTick( entry.nextThinkTick ) );
+		}
+		else
+		{
+			entry.nextThinkTick = 0;
+			Link( index, SIMTHINK_LIST_SIMULATE );
+		}
+	}
+
+	void RecordTickStats( int thinkers, float flMilliseconds )
+	{
+		m_thinkersPerTick.PushValue( thinkers );
+		m_msPerTick.PushValue( flMilliseconds );
+		m_bucketsPerTick.PushValue( m_bucketsVisited );
+		m_peakThinkers = MAX( m_peakThinkers, thinkers );
+		m_peakMilliseconds = MAX( m_peakMilliseconds, flMilliseconds );
+		m_bucketsVisited = 0;
+	}
+
+	void ResetStats()
+	{
+		m_thinkersPerTick.Reset();
+		m_msPerTick.Reset();
+		m_bucketsPerTick.Reset();
+		m_peakThinkers = 0;
+		m_peakMilliseconds = 0.0f;
+	}
+
+	void ReportStats()
+	{
+		int scheduled = 0;
+		for ( int i = 0; i < SIMTHINK_WHEEL_SIZE; i++ )
+		{
+			scheduled += ListLength( i );
+		}
+
+		Msg( "Sim/think entities: %d (%d simulating, %d overdue, %d scheduled)\n",
+			m_count, ListLength( SIMTHINK_LIST_SIMULATE ), ListLength( SIMTHINK_LIST_OVERDUE ), scheduled );
+		Msg( "Over last %u ticks:\n", MIN( m_thinkersPerTick.GetTotalValuesPushed(), (uint32)SIMTHINK_STATS_TICKS ) );
+		Msg( "  thinkers/tick:      %.1f avg, %d peak\n", m_thinkersPerTick.GetAverage(), m_peakThinkers );
+		Msg( "  think time/tick:    %.3f ms avg, %.3f ms peak\n", m_msPerTick.GetAverage(), m_peakMilliseconds );
+		Msg( "  wheel buckets/tick: %.1f avg\n", m_bucketsPerTick.GetAverage() );
+	}
+
+private:
+	enum
+	{
+		SIMTHINK_STATS_TICKS = 128,
+	};
+
+	int ListForThinkTick( int thinkTick )
+	{
+		// already due (or never scheduled properly), run it on the next frame
+		if ( thinkTick <= m_lastServicedTick )
+			return SIMTHINK_LIST_OVERDUE;
+
+		return thinkTick & SIMTHINK_WHEEL_MASK;
+	}
+
+	void Link( int index, int list )
+	{
+		simthinkentry_t &entry = m_entries[index];
+		entry.list = (unsigned short)list;
+		entry.prevEntry = SIMTHINK_INVALID;
+		entry.nextEntry = m_listHead[list];
+		if ( entry.nextEntry != SIMTHINK_INVALID )
+		{
+			m_entries[entry.nextEntry].prevEntry = (unsigned short)index;
+		}
+		m_listHead[list] = (unsigned short)index;
+	}
+
+	void Unlink( int index )
+	{
+		simthinkentry_t &entry = m_entries[index];
+		Assert( entry.list != SIMTHINK_INVALID );
+		if ( entry.prevEntry != SIMTHINK_INVALID )
+		{
+			m_entries[entry.prevEntry].nextEntry = entry.nextEntry;
+		}
+		else
+		{
+			Assert( m_listHead[entry.list] == index );
+			m_listHead[entry.list] = entry.nextEntry;
+		}
+		if ( entry.nextEntry != SIMTHINK_INVALID )
+		{
+			m_entries[entry.nextEntry].prevEntry = entry.prevEntry;
+		}
+		entry.nextEntry = SIMTHINK_INVALID;
+		entry.prevEntry = SIMTHINK_INVALID;
+		entry.list = SIMTHINK_INVALID;
+	}
+
+	int ListLength( int list )
+	{
+		int count = 0;
+		for ( int i = m_listHead[list]; i != SIMTHINK_INVALID; i = m_entries[i].nextEntry )
+		{
+			count++;
+		}
+		return count;
+	}
+
+	// Moves everything in the wheel that has come due by tickcount onto the overdue list
+	void ServiceWheel( int tickcount )
+	{
+		if ( tickcount < m_lastServicedTick )
+		{
+			// time went backwards (save/restore, changelevel), rehash anything that isn't due anymore
+			m_lastServicedTick = tickcount - 1;
+			int next;
+			for ( int i = m_listHead[SIMTHINK_LIST_OVERDUE]; i != SIMTHINK_INVALID; i = next )
 			{
-				MEM_ALLOC_CREDIT();
-				m_entinfoIndex[index] = m_simThinkList.AddToTail();
-				m_simThinkList[m_entinfoIndex[index]].entEntry = (unsigned short)index;
-				m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
-				if ( pEntity->IsEFlagSet(EFL_NO_GAME_PHYSICS_SIMULATION) )
+				next = m_entries[i].nextEntry;
+				if ( m_entries[i].nextThinkTick > m_lastServicedTick )
 				{
-					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = pEntity->GetFirstThinkTick();
-					Assert(m_simThinkList[m_entinfoIndex[index]].nextThinkTick>=0);
+					Unlink( i );
+					Link( i, ListForThinkTick( m_entries[i].nextThinkTick ) );
 				}
 			}
-			else
+		}
+
+		if ( tickcount == m_lastServicedTick )
+			return;
+
+		// visit each bucket at most once even if we skipped a bunch of ticks
+		int firstTick = m_lastServicedTick + 1;
+		int bucketCount = MIN( tickcount - m_lastServicedTick, SIMTHINK_WHEEL_SIZE );
+		for ( int i = 0; i < bucketCount; i++ )
+		{
+			int next;
+			int bucket = ( firstTick + i ) & SIMTHINK_WHEEL_MASK;
+			for ( int entry = m_listHead[bucket]; entry != SIMTHINK_INVALID; entry = next )
 			{
-				// updating existing entry - if no sim, reset think time
-				if ( pEntity->IsEFlagSet(EFL_NO_GAME_PHYSICS_SIMULATION) )
-				{
-					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = pEntity->GetFirstThinkTick();
-					Assert(m_simThinkList[m_entinfoIndex[index]].nextThinkTick>=0);
-				}
-				else
+				next = m_entries[entry].nextEntry;
+				// entries more than a full turn of the wheel out stay where they are
+				if ( m_entries[entry].nextThinkTick <= tickcount )
 				{
-					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
+					Unlink( entry );
+					Link( entry, SIMTHINK_LIST_OVERDUE );
 				}
 			}
 		}
+		m_bucketsVisited += bucketCount;
+		m_lastServicedTick = tickcount;
 	}
 
-private:
-	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
-	CUtlVector<simthinkentry_t>	m_simThinkList;
+	void AddListToDue( int list )
+	{
+		for ( int i = m_listHead[list]; i != SIMTHINK_INVALID; i = m_entries[i].nextEntry )
+		{
+			simthinkdue_t &due = m_dueList[m_dueList.AddToTail()];
+			due.serial = m_entries[i].serial;
+			due.entEntry = (unsigned short)i;
+		}
+	}
+
+	static int DueListCompare( const simthinkdue_t *pLeft, const simthinkdue_t *pRight )
+	{
+		if ( pLeft->serial == pRight->serial )
+			return 0;
+		return ( pLeft->serial < pRight->serial ) ? -1 : 1;
+	}
+
+	simthinkentry_t m_entries[NUM_ENT_ENTRIES];
+	unsigned short	m_listHead[SIMTHINK_LIST_COUNT];
+	CUtlVector<simthinkdue_t> m_dueList;
+	int				m_count;
+	unsigned int	m_nextSerial;
+	int				m_lastServicedTick;
+	int				m_bucketsVisited;
+
+	CUtlMovingAverage<SIMTHINK_STATS_TICKS> m_thinkersPerTick;
+	CUtlMovingAverage<SIMTHINK_STATS_TICKS> m_msPerTick;
+	CUtlMovingAverage<SIMTHINK_STATS_TICKS> m_bucketsPerTick;
+	int				m_peakThinkers;
+	float			m_peakMilliseconds;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -280,6 +475,11 @@ void SimThink_EntityChanged( CBaseEntity *pEntity )
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
+void SimThink_RecordTickStats( int thinkers, float flMilliseconds )
+{
+	g_SimThinkManager.RecordTickStats( thinkers, flMilliseconds );
+}
+
 static CBaseEntityClassList *s_pClassLists = NULL;
 CBaseEntityClassList::CBaseEntityClassList()
 {
@@ -1634,3 +1834,16 @@ CON_COMMAND(report_simthinklist, "Lists all simulating/thinking entities")
 	list.ReportEntityList();
 }
 
+CON_COMMAND(report_simthinkstats, "Reports think scheduler statistics. Pass 'reset' to clear the history.")
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args.Arg(1), "reset" ) )
+	{
+		g_SimThinkManager.ResetStats();
+		return;
+	}
+	g_SimThinkManager.ReportStats();
+}
+
@@ -13,6 +13,7 @@
 
 class CBasePlayer;
 class CUserCmd;
+struct Ray_t;
 
 //-----------------------------------------------------------------------------
 // Purpose: This is also an IServerSystem
@@ -24,6 +25,10 @@ public:
 	virtual void	StartLagCompensation( CBasePlayer *player, CUserCmd *cmd ) = 0;
 	virtual void	FinishLagCompensation( CBasePlayer *player ) = 0;
 	virtual bool	IsCurrentlyDoingLagCompensation() const = 0;
+
+	// Called by hitbox traces. Sets up the bones of the players moved back for
+	// this usercmd that the ray reaches, together, the first time one is traced
+	virtual void	SetupBonesForRay( const Ray_t &ray ) = 0;
 };
 
 extern ILagCompensationManager *lagcompensation;
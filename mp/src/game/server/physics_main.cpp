@@ -2058,6 +2058,8 @@ void Physics_RunThinkFunctions( bool simulating )
 		
 		// UNDONE: This has problems with UTIL_RemoveImmediate() (now disabled during this loop).  
 		// Do we really need UTIL_RemoveImmediate()?
+		CFastTimer timer;
+		timer.Start();
 		int count = SimThink_ListCopy( list, listMax );
 
 		//DevMsg(1, "Count: %d\n", count );
@@ -2069,6 +2071,8 @@ void Physics_RunThinkFunctions( bool simulating )
 			gpGlobals->curtime = starttime;
 			Physics_SimulateEntity( list[i] );
 		}
+		timer.End();
+		SimThink_RecordTickStats( count, timer.GetDuration().GetMillisecondsF() );
 
 		stackfree( list );
 		UTIL_EnableRemoveImmediate();
@@ -0,0 +1,185 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: CSOAContainer benchmark. Times a particle style integrate and
+//			clamp written as a plain float loop against the fused Transform,
+//			on one thread and across the thread pool, and fills a noise
+//			field with NoiseSIMD a row block at a time.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/utlsoacontainer.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+enum SOABenchmarkAttribute_t
+{
+	SOA_BENCHMARK_POSITION = 0,
+	SOA_BENCHMARK_VELOCITY,
+	SOA_BENCHMARK_NOISE,
+	SOA_BENCHMARK_RESULT,
+};
+
+#define SOA_BENCHMARK_DT		( 1.0f / 66.0f )
+#define SOA_BENCHMARK_LIMIT		4096.0f
+
+// position + velocity * dt, clamped to the world, in one pass
+struct SOABenchmarkIntegrateOp_t
+{
+	fltx4 m_DT;
+	fltx4 m_Min;
+	fltx4 m_Max;
+
+	SOABenchmarkIntegrateOp_t() : m_DT( ReplicateX4( SOA_BENCHMARK_DT ) ), m_Min( ReplicateX4( -SOA_BENCHMARK_LIMIT ) ), m_Max( ReplicateX4( SOA_BENCHMARK_LIMIT ) ) {}
+
+	FORCEINLINE fltx4 operator()( fltx4 const &flPosition, fltx4 const &flVelocity, fltx4 const &c ) const
+	{
+		return MinSIMD( m_Max, MaxSIMD( m_Min, MaddSIMD( flVelocity, m_DT, flPosition ) ) );
+	}
+};
+
+static void IntegrateSOABenchmarkScalar( CSOAContainer &soa )
+{
+	for ( int nSlice = 0; nSlice < soa.NumSlices(); ++nSlice )
+	{
+		for ( int nRow = 0; nRow < soa.NumRows(); ++nRow )
+		{
+			float const *pPosition = (float const *)soa.ConstRowPtr( SOA_BENCHMARK_POSITION, nRow, nSlice );
+			float const *pVelocity = (float const *)soa.ConstRowPtr( SOA_BENCHMARK_VELOCITY, nRow, nSlice );
+			float *pResult = (float *)soa.RowPtr( SOA_BENCHMARK_RESULT, nRow, nSlice );
+			for ( int i = 0; i < soa.NumCols(); ++i )
+			{
+				pResult[i] = clamp( pPosition[i] + pVelocity[i] * SOA_BENCHMARK_DT, -SOA_BENCHMARK_LIMIT, SOA_BENCHMARK_LIMIT );
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Samples the noise field for a block of rows, the noise coordinate
+//			being the column, the row and the time in pContext
+//-----------------------------------------------------------------------------
+static void FillSOABenchmarkNoise( CSOAContainer const *pContainer, void *pContext, int nStartRow, int nEndRow )
+{
+	fltx4 flTime = ReplicateX4( *(float const *)pContext );
+	fltx4 flScale = ReplicateX4( 1.0f / 16.0f );
+	for ( int nRow = nStartRow; nRow < nEndRow; ++nRow )
+	{
+		fltx4 *pNoise = (fltx4 *)pContainer->RowPtr( SOA_BENCHMARK_NOISE, nRow % pContainer->NumRows(), nRow / pContainer->NumRows() );
+		fltx4 flY = MulSIMD( ReplicateX4( (float)nRow ), flScale );
+		fltx4 flX = MulSIMD( g_SIMD_0123, flScale );
+		fltx4 flStep = MulSIMD( Four_Fours, flScale );
+		for ( int i = 0; i < pContainer->NumQuadsPerRow(); ++i )
+		{
+			pNoise[i] = NoiseSIMD( flX, flY, flTime );
+			flX = AddSIMD( flX, flStep );
+		}
+	}
+}
+
+static bool CompareSOABenchmarkResult( CSOAContainer &soa, CUtlVector< float > &expected )
+{
+	int nMismatches = 0;
+	int iExpected = 0;
+	for ( int nSlice = 0; nSlice < soa.NumSlices(); ++nSlice )
+	{
+		for ( int nRow = 0; nRow < soa.NumRows(); ++nRow )
+		{
+			float const *pResult = (float const *)soa.ConstRowPtr( SOA_BENCHMARK_RESULT, nRow, nSlice );
+			for ( int i = 0; i < soa.NumCols(); ++i, ++iExpected )
+			{
+				if ( expected.Count() <= iExpected )
+				{
+					expected.AddToTail( pResult[i] );
+				}
+				else if ( fabs( expected[iExpected] - pResult[i] ) > 1e-3f )
+				{
+					++nMismatches;
+				}
+			}
+		}
+	}
+	return nMismatches == 0;
+}
+
+CON_COMMAND( soacontainer_benchmark, "Times fused CSOAContainer operations against plain loops. Usage: soacontainer_benchmark [columns] [rows] [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nColumns = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, 4096 ) : 1024;
+	int nRows = ( args.ArgC() > 2 ) ? clamp( atoi( args.Arg( 2 ) ), 1, 4096 ) : 256;
+	int nIterations = ( args.ArgC() > 3 ) ? MAX( atoi( args.Arg( 3 ) ), 1 ) : 20;
+
+	CSOAContainer soa;
+	soa.SetAttributeType( SOA_BENCHMARK_POSITION, ATTRDATATYPE_FLOAT );
+	soa.SetAttributeType( SOA_BENCHMARK_VELOCITY, ATTRDATATYPE_FLOAT );
+	soa.SetAttributeType( SOA_BENCHMARK_NOISE, ATTRDATATYPE_FLOAT );
+	soa.SetAttributeType( SOA_BENCHMARK_RESULT, ATTRDATATYPE_FLOAT );
+	soa.AllocateData( nColumns, nRows );
+	soa.FillAttrWithInterpolatedValues( SOA_BENCHMARK_POSITION, -5000.0f, 5000.0f, 2000.0f, -2000.0f );
+	soa.FillAttrWithInterpolatedValues( SOA_BENCHMARK_VELOCITY, 300.0f, -300.0f, -1000.0f, 1000.0f );
+
+	CUtlVector< float > expected;
+	bool bMatched = true;
+	CFastTimer timer;
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		IntegrateSOABenchmarkScalar( soa );
+	}
+	timer.End();
+	CCycleCount timeScalar = timer.GetDuration();
+	bMatched &= CompareSOABenchmarkResult( soa, expected );
+
+	SOABenchmarkIntegrateOp_t integrate;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		soa.Transform( SOA_BENCHMARK_RESULT, SOA_BENCHMARK_POSITION, SOA_BENCHMARK_VELOCITY, -1, integrate );
+	}
+	timer.End();
+	CCycleCount timeFused = timer.GetDuration();
+	bMatched &= CompareSOABenchmarkResult( soa, expected );
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		soa.ParallelTransform( SOA_BENCHMARK_RESULT, SOA_BENCHMARK_POSITION, SOA_BENCHMARK_VELOCITY, -1, integrate );
+	}
+	timer.End();
+	CCycleCount timeParallel = timer.GetDuration();
+	bMatched &= CompareSOABenchmarkResult( soa, expected );
+
+	float flTime = 0.0f;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		FillSOABenchmarkNoise( &soa, &flTime, 0, soa.NumRowsAllSlices() );
+		flTime += SOA_BENCHMARK_DT;
+	}
+	timer.End();
+	CCycleCount timeNoise = timer.GetDuration();
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		soa.ParallelForRowBlocks( FillSOABenchmarkNoise, &flTime );
+		flTime += SOA_BENCHMARK_DT;
+	}
+	timer.End();
+	CCycleCount timeNoiseParallel = timer.GetDuration();
+
+	double flElements = (double)nColumns * nRows * nIterations;
+	Msg( "soacontainer_benchmark: %d x %d, %d passes\n", nColumns, nRows, nIterations );
+	Msg( "  integrate: loop %.0f/s, fused %.0f/s, fused parallel %.0f/s\n", flElements / timeScalar.GetSeconds(), flElements / timeFused.GetSeconds(), flElements / timeParallel.GetSeconds() );
+	Msg( "  noise: one thread %.0f/s, row blocks %.0f/s\n", flElements / timeNoise.GetSeconds(), flElements / timeNoiseParallel.GetSeconds() );
+
+	if ( !bMatched )
+	{
+		Warning( "  results didn't match\n" );
+	}
+}
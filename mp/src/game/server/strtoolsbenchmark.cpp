@@ -0,0 +1,311 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: strtools benchmark and differential fuzz test. Times the SSE2
+//			compare, case, search and path kernels against the byte at a
+//			time loops over the entity, model and sound names on the server,
+//			and checks both give the same answers on random strings laid
+//			out to end right at a page boundary.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/strtools.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/random.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define STRTOOLS_BENCHMARK_MIN_NAMES	4096
+#define STRTOOLS_BENCHMARK_PAGE_SIZE	4096
+#define STRTOOLS_FUZZ_MAX_LENGTH		96
+
+struct StrToolsBenchmarkNames_t
+{
+	CUtlVector< char > m_Data;
+	CUtlVector< int > m_Offsets;
+
+	int Count() const						{ return m_Offsets.Count(); }
+	const char *operator[]( int i ) const	{ return &m_Data[ m_Offsets[i] ]; }
+
+	void Add( const char *pszName )
+	{
+		if ( pszName && *pszName )
+		{
+			m_Offsets.AddToTail( m_Data.AddMultipleToTail( V_strlen( pszName ) + 1, pszName ) );
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects class, target and model names from the entities on the
+//			server, and pads them out with made up asset paths
+//-----------------------------------------------------------------------------
+static void BuildStrToolsBenchmarkNames( StrToolsBenchmarkNames_t &names )
+{
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		names.Add( pEntity->GetClassname() );
+		names.Add( STRING( pEntity->GetEntityName() ) );
+		names.Add( STRING( pEntity->GetModelName() ) );
+	}
+
+	static const char *s_pszPrefixes[] = { "materials\\models\\props_c17/", "sound/npc/combine_soldier/vo/", "models/Weapons/", "scripts\\" };
+	static const char *s_pszExtensions[] = { ".vmt", ".wav", ".MDL", ".txt" };
+	for ( int i = 0; names.Count() < STRTOOLS_BENCHMARK_MIN_NAMES; ++i )
+	{
+		char szName[MAX_PATH];
+		int iKind = i % ARRAYSIZE( s_pszPrefixes );
+		V_snprintf( szName, sizeof( szName ), "%s%s_%05d%s", s_pszPrefixes[iKind], ( i % 3 ) ? "Metal_Panel" : "wood", i, s_pszExtensions[iKind] );
+		names.Add( szName );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The same name with every third letter's case flipped, so the
+//			case insensitive compares go the whole way
+//-----------------------------------------------------------------------------
+static void FlipStrToolsBenchmarkCase( const char *pszIn, char *pszOut, int nOutSize )
+{
+	V_strncpy( pszOut, pszIn, nOutSize );
+	for ( int i = 0; pszOut[i]; i += 3 )
+	{
+		char c = pszOut[i];
+		if ( c >= 'a' && c <= 'z' )
+			pszOut[i] = c - 'a' + 'A';
+		else if ( c >= 'A' && c <= 'Z' )
+			pszOut[i] = c - 'A' + 'a';
+	}
+}
+
+static CCycleCount TimeStrTools( const StrToolsBenchmarkNames_t &names, const StrToolsBenchmarkNames_t &flipped, int nIterations, int nTest, int &nResult )
+{
+	char szBuffer[MAX_PATH];
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < names.Count(); ++i )
+		{
+			switch ( nTest )
+			{
+			case 0:
+				nResult += V_stricmp( names[i], flipped[i] );
+				nResult += V_strnicmp( names[i], flipped[i], 24 );
+				break;
+
+			case 1:
+				nResult += ( V_stristr( names[i], "panel" ) != NULL );
+				break;
+
+			case 2:
+				V_strncpy( szBuffer, names[i], sizeof( szBuffer ) );
+				V_strlower( szBuffer );
+				V_FixSlashes( szBuffer );
+				nResult += szBuffer[0];
+				break;
+
+			case 3:
+				V_StripExtension( names[i], szBuffer, sizeof( szBuffer ) );
+				V_ComposeFileName( "gamedir\\custom/", szBuffer, szBuffer, sizeof( szBuffer ) );
+				nResult += szBuffer[0];
+				break;
+			}
+		}
+	}
+	timer.End();
+	return timer.GetDuration();
+}
+
+CON_COMMAND( strtools_benchmark, "Times the SSE2 string compare, search, case and path functions against the byte at a time versions. Usage: strtools_benchmark [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args.Arg( 1 ) ), 1 ) : 100;
+
+	StrToolsBenchmarkNames_t names, flipped;
+	BuildStrToolsBenchmarkNames( names );
+	for ( int i = 0; i < names.Count(); ++i )
+	{
+		char szFlipped[MAX_PATH];
+		FlipStrToolsBenchmarkCase( names[i], szFlipped, sizeof( szFlipped ) );
+		flipped.Add( szFlipped );
+	}
+
+	static const char *s_pszTests[] = { "stricmp/strnicmp", "stristr", "strlower/FixSlashes", "StripExtension/ComposeFileName" };
+
+	int nResult[2] = { 0, 0 };
+	CCycleCount times[2][ ARRAYSIZE( s_pszTests ) ];
+	bool bWasEnabled = V_SetStringSIMDEnabled( false );
+	for ( int iSIMD = 0; iSIMD < 2; ++iSIMD )
+	{
+		V_SetStringSIMDEnabled( iSIMD != 0 );
+		for ( int iTest = 0; iTest < ARRAYSIZE( s_pszTests ); ++iTest )
+		{
+			times[iSIMD][iTest] = TimeStrTools( names, flipped, nIterations, iTest, nResult[iSIMD] );
+		}
+	}
+	V_SetStringSIMDEnabled( bWasEnabled );
+
+	double flCalls = (double)names.Count() * nIterations;
+	Msg( "strtools_benchmark: %d names, %d passes, SSE2 %s\n", names.Count(), nIterations, bWasEnabled ? "available" : "not available" );
+	for ( int iTest = 0; iTest < ARRAYSIZE( s_pszTests ); ++iTest )
+	{
+		Msg( "  %s: bytes %.0f/s, SSE2 %.0f/s\n", s_pszTests[iTest], flCalls / times[0][iTest].GetSeconds(), flCalls / times[1][iTest].GetSeconds() );
+	}
+
+	if ( nResult[0] != nResult[1] )
+	{
+		Warning( "  results didn't match\n" );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Differential fuzz test
+//-----------------------------------------------------------------------------
+struct StrToolsFuzzResult_t
+{
+	int		m_nCompare;
+	int		m_nCompareN;
+	int		m_nFound;
+	char	m_szLower[STRTOOLS_FUZZ_MAX_LENGTH];
+	char	m_szFixed[STRTOOLS_FUZZ_MAX_LENGTH];
+	char	m_szStripped[STRTOOLS_FUZZ_MAX_LENGTH];
+	char	m_szComposed[STRTOOLS_FUZZ_MAX_LENGTH * 2 + 2];
+};
+
+static int StrToolsFuzzSign( int n )
+{
+	return ( n > 0 ) - ( n < 0 );
+}
+
+static char RandomStrToolsFuzzChar( CUniformRandomStream &random )
+{
+	// Mostly printable ASCII, with a bias towards case, slash and locale edge cases
+	static const char s_Interesting[] = "aAzZ@[`{/\\._\xc0\xe0\xff";
+	if ( random.RandomInt( 0, 3 ) == 0 )
+		return s_Interesting[ random.RandomInt( 0, sizeof( s_Interesting ) - 2 ) ];
+	return (char)random.RandomInt( ' ', '~' );
+}
+
+// Copies the string so it ends on the last byte of pPage
+static char *PlaceStrToolsFuzzString( char *pPage, const char *pszString )
+{
+	int nLength = V_strlen( pszString );
+	char *pszPlaced = pPage + STRTOOLS_BENCHMARK_PAGE_SIZE - nLength - 1;
+	V_memcpy( pszPlaced, pszString, nLength + 1 );
+	return pszPlaced;
+}
+
+static void RunStrToolsFuzz( char *pPages, const char *pszA, const char *pszB, const char *pszSearch, int nCompare, char separator, StrToolsFuzzResult_t &result )
+{
+	const char *pszPlacedA = PlaceStrToolsFuzzString( pPages, pszA );
+	const char *pszPlacedB = PlaceStrToolsFuzzString( pPages + STRTOOLS_BENCHMARK_PAGE_SIZE, pszB );
+
+	result.m_nCompare = StrToolsFuzzSign( V_stricmp( pszPlacedA, pszPlacedB ) );
+	result.m_nCompareN = StrToolsFuzzSign( V_strnicmp( pszPlacedA, pszPlacedB, nCompare ) );
+
+	const char *pszFound = V_stristr( pszPlacedA, pszSearch );
+	result.m_nFound = pszFound ? pszFound - pszPlacedA : -1;
+
+	V_StripExtension( pszPlacedA, result.m_szStripped, sizeof( result.m_szStripped ) );
+	V_ComposeFileName( pszPlacedA, pszPlacedB, result.m_szComposed, sizeof( result.m_szComposed ) );
+
+	char *pszInPlace = PlaceStrToolsFuzzString( pPages + STRTOOLS_BENCHMARK_PAGE_SIZE * 2, pszA );
+	V_strlower( pszInPlace );
+	V_strncpy( result.m_szLower, pszInPlace, sizeof( result.m_szLower ) );
+
+	pszInPlace = PlaceStrToolsFuzzString( pPages + STRTOOLS_BENCHMARK_PAGE_SIZE * 2, pszA );
+	V_FixSlashes( pszInPlace, separator );
+	V_strncpy( result.m_szFixed, pszInPlace, sizeof( result.m_szFixed ) );
+}
+
+static bool StrToolsFuzzResultsMatch( const StrToolsFuzzResult_t &a, const StrToolsFuzzResult_t &b )
+{
+	return a.m_nCompare == b.m_nCompare &&
+		a.m_nCompareN == b.m_nCompareN &&
+		a.m_nFound == b.m_nFound &&
+		!V_strcmp( a.m_szLower, b.m_szLower ) &&
+		!V_strcmp( a.m_szFixed, b.m_szFixed ) &&
+		!V_strcmp( a.m_szStripped, b.m_szStripped ) &&
+		!V_strcmp( a.m_szComposed, b.m_szComposed );
+}
+
+CON_COMMAND( strtools_fuzz, "Checks the SSE2 string functions against the byte at a time versions on random strings. Usage: strtools_fuzz [iterations] [seed]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args.Arg( 1 ) ), 1 ) : 100000;
+	int nSeed = ( args.ArgC() > 2 ) ? atoi( args.Arg( 2 ) ) : 1;
+
+	CUniformRandomStream random;
+	random.SetSeed( nSeed );
+
+	// Each string is copied to end right at a page boundary, where the kernels
+	// have to stop loading 16 bytes at a time
+	char *pPages = (char *)MemAlloc_AllocAligned( STRTOOLS_BENCHMARK_PAGE_SIZE * 3, STRTOOLS_BENCHMARK_PAGE_SIZE );
+
+	int nMismatches = 0;
+	bool bWasEnabled = V_SetStringSIMDEnabled( false );
+	for ( int iTest = 0; iTest < nIterations; ++iTest )
+	{
+		char szA[STRTOOLS_FUZZ_MAX_LENGTH], szB[STRTOOLS_FUZZ_MAX_LENGTH], szSearch[8];
+
+		int nLengthA = random.RandomInt( 0, STRTOOLS_FUZZ_MAX_LENGTH - 1 );
+		for ( int i = 0; i < nLengthA; ++i )
+		{
+			szA[i] = RandomStrToolsFuzzChar( random );
+		}
+		szA[nLengthA] = 0;
+
+		// Usually B starts out as A with some case flipped, so the compares get past the first few bytes
+		int nLengthB = random.RandomInt( 0, STRTOOLS_FUZZ_MAX_LENGTH - 1 );
+		int nShared = random.RandomInt( 0, 3 ) ? MIN( nLengthA, nLengthB ) : 0;
+		FlipStrToolsBenchmarkCase( szA, szB, nShared + 1 );
+		for ( int i = nShared; i < nLengthB; ++i )
+		{
+			szB[i] = RandomStrToolsFuzzChar( random );
+		}
+		szB[nLengthB] = 0;
+		if ( nShared && random.RandomInt( 0, 1 ) )
+		{
+			szB[ random.RandomInt( 0, nShared - 1 ) ] = RandomStrToolsFuzzChar( random );
+		}
+
+		// Search for a piece of A, or something random
+		int nSearchLength = random.RandomInt( 1, sizeof( szSearch ) - 1 );
+		int iSearchStart = nLengthA ? random.RandomInt( 0, nLengthA - 1 ) : 0;
+		for ( int i = 0; i < nSearchLength; ++i )
+		{
+			bool bFromA = iSearchStart + i < nLengthA && random.RandomInt( 0, 3 );
+			szSearch[i] = bFromA ? szA[ iSearchStart + i ] : RandomStrToolsFuzzChar( random );
+		}
+		szSearch[nSearchLength] = 0;
+
+		int nCompare = random.RandomInt( 0, STRTOOLS_FUZZ_MAX_LENGTH );
+		char separator = ( iTest & 1 ) ? '/' : '\\';
+
+		StrToolsFuzzResult_t bytes, simd;
+		V_SetStringSIMDEnabled( false );
+		RunStrToolsFuzz( pPages, szA, szB, szSearch, nCompare, separator, bytes );
+		V_SetStringSIMDEnabled( true );
+		RunStrToolsFuzz( pPages, szA, szB, szSearch, nCompare, separator, simd );
+
+		if ( !StrToolsFuzzResultsMatch( bytes, simd ) )
+		{
+			if ( nMismatches < 10 )
+			{
+				Warning( "  mismatch: \"%s\" \"%s\" search \"%s\" n %d\n", szA, szB, szSearch, nCompare );
+			}
+			++nMismatches;
+		}
+	}
+	V_SetStringSIMDEnabled( bWasEnabled );
+
+	MemAlloc_FreeAligned( pPages );
+
+	Msg( "strtools_fuzz: %d cases, seed %d, %d mismatches%s\n", nIterations, nSeed, nMismatches, bWasEnabled ? "" : " (SSE2 not available, nothing to compare)" );
+}
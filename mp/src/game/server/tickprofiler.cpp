@@ -0,0 +1,494 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Sampling server tick profiler. See tickprofiler.h.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tickprofiler.h"
+#include "igamesystem.h"
+#include "utlmap.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar sv_tickprofile( "sv_tickprofile", "1", 0, "Sample server tick cost by entity class, game system and entity I/O event. See tickprofile_report." );
+static ConVar sv_tickprofile_interval( "sv_tickprofile_interval", "8", 0, "Time one server tick out of this many for sv_tickprofile.", true, 1, false, 0 );
+
+// Number of sampled ticks kept for the rolling percentiles
+#define TICKPROFILE_HISTORY		128
+
+static const char *s_pszCategoryNames[ TICKPROFILE_NUM_CATEGORIES ] =
+{
+	"think",
+	"gamesystem",
+	"events",
+};
+
+struct TickProfileKey_t
+{
+	int			category;
+	const char	*name;
+	const char	*context;
+};
+
+struct TickProfileEntry_t
+{
+	TickProfileKey_t	key;
+	CCycleCount			current;
+	int					nCurrentCalls;
+	int					nTotalCalls;
+	int					nFirstSample;
+	float				history[ TICKPROFILE_HISTORY ];	// ms per sampled tick
+};
+
+struct TickProfileStats_t
+{
+	float	mean;
+	float	p50;
+	float	p95;
+	float	p99;
+	float	max;
+};
+
+// A report line; entries whose keys are different pointers to the same strings are merged
+struct TickProfileLine_t
+{
+	int					category;
+	const char			*name;
+	const char			*context;
+	float				callsPerTick;
+	TickProfileStats_t	stats;
+};
+
+static bool TickProfileKeyLessFunc( const TickProfileKey_t &lhs, const TickProfileKey_t &rhs )
+{
+	if ( lhs.category != rhs.category )
+		return lhs.category < rhs.category;
+
+	if ( lhs.name != rhs.name )
+		return (uintp)lhs.name < (uintp)rhs.name;
+
+	return (uintp)lhs.context < (uintp)rhs.context;
+}
+
+static int __cdecl FloatSortFunc( const float *lhs, const float *rhs )
+{
+	if ( *lhs < *rhs )
+		return -1;
+	return ( *lhs > *rhs ) ? 1 : 0;
+}
+
+static int __cdecl TickProfileLineSortFunc( const TickProfileLine_t *lhs, const TickProfileLine_t *rhs )
+{
+	if ( lhs->stats.mean > rhs->stats.mean )
+		return -1;
+	return ( lhs->stats.mean < rhs->stats.mean ) ? 1 : 0;
+}
+
+static const char *TickProfileString( const char *psz )
+{
+	return psz ? psz : "";
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sorts entries so the ones for the same strings are adjacent
+//-----------------------------------------------------------------------------
+static int __cdecl TickProfileEntryNameSortFunc( TickProfileEntry_t * const *lhs, TickProfileEntry_t * const *rhs )
+{
+	const TickProfileKey_t &l = (*lhs)->key;
+	const TickProfileKey_t &r = (*rhs)->key;
+
+	if ( l.category != r.category )
+		return l.category - r.category;
+
+	int cmp = Q_stricmp( TickProfileString( l.name ), TickProfileString( r.name ) );
+	if ( cmp )
+		return cmp;
+
+	return Q_stricmp( TickProfileString( l.context ), TickProfileString( r.context ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The profiler. Keys are string pointers, which are only stable for
+//			a level, so everything is thrown away at level shutdown.
+//-----------------------------------------------------------------------------
+class CTickProfiler : public ITickProfiler, public CAutoGameSystem
+{
+public:
+	CTickProfiler();
+
+	// ITickProfiler
+	virtual void BeginTick( bool simulating );
+	virtual void EndTick();
+	virtual void AddSample( TickProfileCategory_t category, const char *pszName, const char *pszContext, const CCycleCount &duration );
+
+	// IGameSystem
+	virtual void LevelShutdownPostEntity() { Reset(); }
+
+	void Reset();
+	void Report( int nCategory, int nCount );
+	bool Dump( const char *pszFilename );
+
+private:
+	int NumHistorySamples() const { return MIN( m_nSamples, TICKPROFILE_HISTORY ); }
+	void ComputeStats( const float *pHistory, TickProfileStats_t &stats ) const;
+	void BuildReport( CUtlVector< TickProfileLine_t > &lines );
+
+	CUtlMap< TickProfileKey_t, int >	m_KeyMap;
+	CUtlVector< TickProfileEntry_t >	m_Entries;
+
+	int				m_nSamples;
+	CFastTimer		m_FrameTimer;
+	CCycleCount		m_Overhead;
+
+	float			m_FrameHistory[ TICKPROFILE_HISTORY ];
+	float			m_CategoryHistory[ TICKPROFILE_NUM_CATEGORIES ][ TICKPROFILE_HISTORY ];
+	float			m_OverheadHistory[ TICKPROFILE_HISTORY ];
+};
+
+static CTickProfiler g_TickProfiler;
+ITickProfiler *g_pTickProfiler = &g_TickProfiler;
+
+CTickProfiler::CTickProfiler() :
+	CAutoGameSystem( "CTickProfiler" ),
+	m_KeyMap( 0, 0, TickProfileKeyLessFunc )
+{
+	Reset();
+}
+
+void CTickProfiler::Reset()
+{
+	m_bSampling = false;
+	m_KeyMap.RemoveAll();
+	m_Entries.Purge();
+	m_nSamples = 0;
+
+	memset( m_FrameHistory, 0, sizeof( m_FrameHistory ) );
+	memset( m_CategoryHistory, 0, sizeof( m_CategoryHistory ) );
+	memset( m_OverheadHistory, 0, sizeof( m_OverheadHistory ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decides whether this tick gets timed
+//-----------------------------------------------------------------------------
+void CTickProfiler::BeginTick( bool simulating )
+{
+	m_bSampling = false;
+
+	if ( !simulating || !sv_tickprofile.GetBool() )
+		return;
+
+	if ( ( gpGlobals->tickcount % sv_tickprofile_interval.GetInt() ) != 0 )
+		return;
+
+	m_bSampling = true;
+	m_Overhead.Init();
+	m_FrameTimer.Start();
+}
+
+void CTickProfiler::AddSample( TickProfileCategory_t category, const char *pszName, const char *pszContext, const CCycleCount &duration )
+{
+	CFastTimer timer;
+	timer.Start();
+
+	TickProfileKey_t key;
+	key.category = category;
+	key.name = pszName;
+	key.context = pszContext;
+
+	int iEntry;
+	unsigned short i = m_KeyMap.Find( key );
+	if ( i != m_KeyMap.InvalidIndex() )
+	{
+		iEntry = m_KeyMap[ i ];
+	}
+	else
+	{
+		iEntry = m_Entries.AddToTail();
+		TickProfileEntry_t &entry = m_Entries[ iEntry ];
+		memset( &entry, 0, sizeof( entry ) );
+		entry.key = key;
+		entry.nFirstSample = m_nSamples;
+		m_KeyMap.Insert( key, iEntry );
+	}
+
+	TickProfileEntry_t &entry = m_Entries[ iEntry ];
+	entry.current += duration;
+	++entry.nCurrentCalls;
+
+	timer.End();
+	m_Overhead += timer.GetDuration();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rolls this tick's totals into the history
+//-----------------------------------------------------------------------------
+void CTickProfiler::EndTick()
+{
+	if ( !m_bSampling )
+		return;
+
+	m_FrameTimer.End();
+	m_bSampling = false;
+
+	CFastTimer timer;
+	timer.Start();
+
+	int slot = m_nSamples % TICKPROFILE_HISTORY;
+	++m_nSamples;
+
+	float flCategory[ TICKPROFILE_NUM_CATEGORIES ] = { 0.0f };
+
+	int c = m_Entries.Count();
+	for ( int i = 0; i < c; ++i )
+	{
+		TickProfileEntry_t &entry = m_Entries[ i ];
+
+		float ms = (float)entry.current.GetMillisecondsF();
+		entry.history[ slot ] = ms;
+		entry.nTotalCalls += entry.nCurrentCalls;
+		flCategory[ entry.key.category ] += ms;
+
+		entry.current.Init();
+		entry.nCurrentCalls = 0;
+	}
+
+	for ( int i = 0; i < TICKPROFILE_NUM_CATEGORIES; ++i )
+	{
+		m_CategoryHistory[ i ][ slot ] = flCategory[ i ];
+	}
+	m_FrameHistory[ slot ] = (float)m_FrameTimer.GetDuration().GetMillisecondsF();
+
+	timer.End();
+	m_Overhead += timer.GetDuration();
+	m_OverheadHistory[ slot ] = (float)m_Overhead.GetMillisecondsF();
+}
+
+void CTickProfiler::ComputeStats( const float *pHistory, TickProfileStats_t &stats ) const
+{
+	memset( &stats, 0, sizeof( stats ) );
+
+	int nSamples = NumHistorySamples();
+	if ( !nSamples )
+		return;
+
+	float sorted[ TICKPROFILE_HISTORY ];
+	float total = 0.0f;
+	for ( int i = 0; i < nSamples; ++i )
+	{
+		sorted[ i ] = pHistory[ i ];
+		total += pHistory[ i ];
+	}
+	qsort( sorted, nSamples, sizeof( float ), (int (__cdecl *)(const void *, const void *))FloatSortFunc );
+
+	stats.mean = total / nSamples;
+	stats.p50 = sorted[ ( nSamples - 1 ) * 50 / 100 ];
+	stats.p95 = sorted[ ( nSamples - 1 ) * 95 / 100 ];
+	stats.p99 = sorted[ ( nSamples - 1 ) * 99 / 100 ];
+	stats.max = sorted[ nSamples - 1 ];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Merges entries for the same strings and computes their stats,
+//			most expensive first
+//-----------------------------------------------------------------------------
+void CTickProfiler::BuildReport( CUtlVector< TickProfileLine_t > &lines )
+{
+	CUtlVector< TickProfileEntry_t * > sorted;
+	sorted.EnsureCapacity( m_Entries.Count() );
+	for ( int i = 0; i < m_Entries.Count(); ++i )
+	{
+		sorted.AddToTail( &m_Entries[ i ] );
+	}
+	sorted.Sort( TickProfileEntryNameSortFunc );
+
+	int i = 0;
+	while ( i < sorted.Count() )
+	{
+		float history[ TICKPROFILE_HISTORY ];
+		memset( history, 0, sizeof( history ) );
+
+		int nCalls = 0;
+		int nFirstSample = m_nSamples;
+
+		int j = i;
+		do
+		{
+			const TickProfileEntry_t *pEntry = sorted[ j ];
+			for ( int k = 0; k < TICKPROFILE_HISTORY; ++k )
+			{
+				history[ k ] += pEntry->history[ k ];
+			}
+			nCalls += pEntry->nTotalCalls;
+			nFirstSample = MIN( nFirstSample, pEntry->nFirstSample );
+			++j;
+		}
+		while ( j < sorted.Count() && !TickProfileEntryNameSortFunc( &sorted[ i ], &sorted[ j ] ) );
+
+		TickProfileLine_t &line = lines[ lines.AddToTail() ];
+		line.category = sorted[ i ]->key.category;
+		line.name = TickProfileString( sorted[ i ]->key.name );
+		line.context = TickProfileString( sorted[ i ]->key.context );
+		line.callsPerTick = ( m_nSamples > nFirstSample ) ? (float)nCalls / ( m_nSamples - nFirstSample ) : 0.0f;
+		ComputeStats( history, line.stats );
+
+		i = j;
+	}
+
+	lines.Sort( TickProfileLineSortFunc );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints the totals and the nCount most expensive lines
+//-----------------------------------------------------------------------------
+void CTickProfiler::Report( int nCategory, int nCount )
+{
+	if ( !m_nSamples )
+	{
+		Msg( "No ticks sampled yet%s.\n", sv_tickprofile.GetBool() ? "" : " (sv_tickprofile is 0)" );
+		return;
+	}
+
+	TickProfileStats_t frame, overhead;
+	ComputeStats( m_FrameHistory, frame );
+	ComputeStats( m_OverheadHistory, overhead );
+
+	Msg( "Tick profile over the last %d sampled ticks (1 in %d):\n", NumHistorySamples(), sv_tickprofile_interval.GetInt() );
+	Msg( "  %-40s mean %7.3fms  p50 %7.3fms  p95 %7.3fms  p99 %7.3fms  max %7.3fms\n",
+		"frame", frame.mean, frame.p50, frame.p95, frame.p99, frame.max );
+
+	for ( int i = 0; i < TICKPROFILE_NUM_CATEGORIES; ++i )
+	{
+		TickProfileStats_t stats;
+		ComputeStats( m_CategoryHistory[ i ], stats );
+		Msg( "  %-40s mean %7.3fms  p50 %7.3fms  p95 %7.3fms  p99 %7.3fms  max %7.3fms  %5.1f%%\n",
+			s_pszCategoryNames[ i ], stats.mean, stats.p50, stats.p95, stats.p99, stats.max,
+			frame.mean > 0.0f ? 100.0f * stats.mean / frame.mean : 0.0f );
+	}
+
+	Msg( "  %-40s mean %7.3fms  %5.2f%% of sampled ticks\n", "profiler overhead", overhead.mean,
+		frame.mean > 0.0f ? 100.0f * overhead.mean / frame.mean : 0.0f );
+
+	CUtlVector< TickProfileLine_t > lines;
+	BuildReport( lines );
+
+	Msg( "\n  %-11s %-40s %9s %9s %9s %9s %9s %7s\n", "category", "name", "calls", "mean", "p50", "p95", "p99", "max" );
+
+	int nPrinted = 0;
+	for ( int i = 0; i < lines.Count() && nPrinted < nCount; ++i )
+	{
+		const TickProfileLine_t &line = lines[ i ];
+		if ( nCategory >= 0 && line.category != nCategory )
+			continue;
+
+		char szName[ 256 ];
+		if ( line.context[0] )
+		{
+			Q_snprintf( szName, sizeof( szName ), "%s:%s", line.name, line.context );
+		}
+		else
+		{
+			Q_strncpy( szName, line.name, sizeof( szName ) );
+		}
+
+		Msg( "  %-11s %-40s %9.1f %9.3f %9.3f %9.3f %9.3f %7.3f\n", s_pszCategoryNames[ line.category ], szName,
+			line.callsPerTick, line.stats.mean, line.stats.p50, line.stats.p95, line.stats.p99, line.stats.max );
+		++nPrinted;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes every line as tab separated values, times in milliseconds
+//-----------------------------------------------------------------------------
+bool CTickProfiler::Dump( const char *pszFilename )
+{
+	FileHandle_t fh = filesystem->Open( pszFilename, "wt", "DEFAULT_WRITE_PATH" );
+	if ( !fh )
+		return false;
+
+	filesystem->FPrintf( fh, "map\t%s\n", STRING( gpGlobals->mapname ) );
+	filesystem->FPrintf( fh, "tickinterval\t%f\n", gpGlobals->interval_per_tick );
+	filesystem->FPrintf( fh, "sampleinterval\t%d\n", sv_tickprofile_interval.GetInt() );
+	filesystem->FPrintf( fh, "samples\t%d\n", NumHistorySamples() );
+	filesystem->FPrintf( fh, "\ncategory\tname\tcontext\tcalls_per_tick\tmean_ms\tp50_ms\tp95_ms\tp99_ms\tmax_ms\n" );
+
+	TickProfileStats_t stats;
+	ComputeStats( m_FrameHistory, stats );
+	filesystem->FPrintf( fh, "total\tframe\t\t1\t%f\t%f\t%f\t%f\t%f\n", stats.mean, stats.p50, stats.p95, stats.p99, stats.max );
+
+	ComputeStats( m_OverheadHistory, stats );
+	filesystem->FPrintf( fh, "total\tprofiler\t\t1\t%f\t%f\t%f\t%f\t%f\n", stats.mean, stats.p50, stats.p95, stats.p99, stats.max );
+
+	for ( int i = 0; i < TICKPROFILE_NUM_CATEGORIES; ++i )
+	{
+		ComputeStats( m_CategoryHistory[ i ], stats );
+		filesystem->FPrintf( fh, "total\t%s\t\t1\t%f\t%f\t%f\t%f\t%f\n", s_pszCategoryNames[ i ],
+			stats.mean, stats.p50, stats.p95, stats.p99, stats.max );
+	}
+
+	CUtlVector< TickProfileLine_t > lines;
+	BuildReport( lines );
+	for ( int i = 0; i < lines.Count(); ++i )
+	{
+		const TickProfileLine_t &line = lines[ i ];
+		filesystem->FPrintf( fh, "%s\t%s\t%s\t%f\t%f\t%f\t%f\t%f\t%f\n", s_pszCategoryNames[ line.category ], line.name, line.context,
+			line.callsPerTick, line.stats.mean, line.stats.p50, line.stats.p95, line.stats.p99, line.stats.max );
+	}
+
+	filesystem->Close( fh );
+	return true;
+}
+
+CON_COMMAND( tickprofile_report, "Reports sampled server tick cost. Usage: tickprofile_report [think|gamesystem|events] [count]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nCategory = -1;
+	int nCount = 20;
+	for ( int i = 1; i < args.ArgC(); ++i )
+	{
+		int j;
+		for ( j = 0; j < TICKPROFILE_NUM_CATEGORIES; ++j )
+		{
+			if ( !Q_stricmp( args.Arg( i ), s_pszCategoryNames[ j ] ) )
+			{
+				nCategory = j;
+				break;
+			}
+		}
+
+		if ( j == TICKPROFILE_NUM_CATEGORIES )
+		{
+			nCount = MAX( atoi( args.Arg( i ) ), 1 );
+		}
+	}
+
+	g_TickProfiler.Report( nCategory, nCount );
+}
+
+CON_COMMAND( tickprofile_dump, "Writes sampled server tick cost as tab separated values. Usage: tickprofile_dump [filename]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const char *pszFilename = ( args.ArgC() > 1 ) ? args.Arg( 1 ) : "tickprofile.txt";
+	if ( g_TickProfiler.Dump( pszFilename ) )
+	{
+		Msg( "Wrote tick profile to %s\n", pszFilename );
+	}
+	else
+	{
+		Warning( "Couldn't write tick profile to %s\n", pszFilename );
+	}
+}
+
+CON_COMMAND( tickprofile_reset, "Clears the sampled server tick cost history." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_TickProfiler.Reset();
+}
@@ -0,0 +1,86 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Sampling profiler that attributes server tick time to entity
+//			classes and think contexts, game system per-frame callbacks and
+//			entity I/O events. Unlike vprof it is cheap enough to leave on in
+//			production: only one tick in sv_tickprofile_interval is timed.
+//
+//=============================================================================//
+
+#ifndef TICKPROFILER_H
+#define TICKPROFILER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/fasttimer.h"
+
+enum TickProfileCategory_t
+{
+	TICKPROFILE_THINK = 0,			// Entity thinks, by classname and think context
+	TICKPROFILE_GAMESYSTEM,			// IGameSystemPerFrame callbacks, by system and method
+	TICKPROFILE_EVENTQUEUE,			// CEventQueue events, by input name
+
+	TICKPROFILE_NUM_CATEGORIES
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Interface used by the timing scopes and the server frame loop
+//-----------------------------------------------------------------------------
+class ITickProfiler
+{
+public:
+	// Is the current tick being timed? Checked inline by every scope.
+	bool IsSampling() const	{ return m_bSampling; }
+
+	virtual void BeginTick( bool simulating ) = 0;
+	virtual void EndTick() = 0;
+
+	// pszName and pszContext must stay valid until the level shuts down
+	// (pooled strings or literals); the pointers are the lookup key.
+	virtual void AddSample( TickProfileCategory_t category, const char *pszName, const char *pszContext, const CCycleCount &duration ) = 0;
+
+protected:
+	ITickProfiler() : m_bSampling( false ) {}
+
+	bool m_bSampling;
+};
+
+extern ITickProfiler *g_pTickProfiler;
+
+//-----------------------------------------------------------------------------
+// Purpose: Times a block when the current tick is being sampled
+//-----------------------------------------------------------------------------
+class CTickProfileScope
+{
+public:
+	CTickProfileScope( TickProfileCategory_t category, const char *pszName, const char *pszContext = NULL )
+	{
+		m_bActive = g_pTickProfiler->IsSampling();
+		if ( m_bActive )
+		{
+			m_Category = category;
+			m_pszName = pszName;
+			m_pszContext = pszContext;
+			m_Timer.Start();
+		}
+	}
+
+	~CTickProfileScope()
+	{
+		if ( m_bActive )
+		{
+			m_Timer.End();
+			g_pTickProfiler->AddSample( m_Category, m_pszName, m_pszContext, m_Timer.GetDuration() );
+		}
+	}
+
+private:
+	bool					m_bActive;
+	TickProfileCategory_t	m_Category;
+	const char				*m_pszName;
+	const char				*m_pszContext;
+	CFastTimer				m_Timer;
+};
+
+#endif // TICKPROFILER_H
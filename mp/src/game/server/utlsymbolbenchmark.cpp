@@ -0,0 +1,213 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Symbol table benchmark. Times the tree based CUtlSymbolTable
+//			against CUtlHashSymbolTable, and concurrent lookups through the
+//			lock free CUtlHashSymbolTableMT against the reader-writer locked
+//			CUtlSymbolTableMT.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/utlsymbol.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Symbol ids are 16 bits, so neither table can hold more than this, less
+// room for the case folding names
+#define UTLSYMBOL_BENCHMARK_MAX_SYMBOLS		( UTL_INVAL_SYMBOL - 16 )
+
+struct UtlSymbolBenchmarkNames_t
+{
+	CUtlVector< char > m_Data;
+	CUtlVector< int > m_Offsets;
+
+	int Count() const						{ return m_Offsets.Count(); }
+	const char *operator[]( int i ) const	{ return &m_Data[ m_Offsets[i] ]; }
+};
+
+static void BuildUtlSymbolBenchmarkNames( UtlSymbolBenchmarkNames_t &names, int nSymbols )
+{
+	static const char *s_pszPrefixes[] = { "models/props_c17/", "npc/combine_soldier/vo/", "scripted/", "SCHED_" };
+
+	for ( int i = 0; i < nSymbols; ++i )
+	{
+		char szName[64];
+		V_snprintf( szName, sizeof( szName ), "%s%05d_%x", s_pszPrefixes[ i % ARRAYSIZE( s_pszPrefixes ) ], i, i * 2654435761u );
+		names.m_Offsets.AddToTail( names.m_Data.AddMultipleToTail( V_strlen( szName ) + 1, szName ) );
+	}
+}
+
+template < class TABLE >
+static void TimeUtlSymbolTable( TABLE &table, const UtlSymbolBenchmarkNames_t &names, int nIterations, CCycleCount &timeAdd, CCycleCount &timeFind, int &nMissing )
+{
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < names.Count(); ++i )
+	{
+		table.AddString( names[i] );
+	}
+	timer.End();
+	timeAdd = timer.GetDuration();
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < names.Count(); ++i )
+		{
+			if ( !table.Find( names[i] ).IsValid() )
+			{
+				++nMissing;
+			}
+		}
+	}
+	timer.End();
+	timeFind = timer.GetDuration();
+}
+
+//-----------------------------------------------------------------------------
+// Concurrent lookups
+//-----------------------------------------------------------------------------
+struct UtlSymbolBenchmarkJob_t
+{
+	const UtlSymbolBenchmarkNames_t	*m_pNames;
+	const CUtlHashSymbolTableMT		*m_pLockFree;
+	const CUtlSymbolTableMT			*m_pLocked;
+	int								m_nIterations;
+	CInterlockedInt					m_nMissing;
+};
+
+static unsigned UtlSymbolBenchmarkThread( void *pParam )
+{
+	UtlSymbolBenchmarkJob_t *pJob = (UtlSymbolBenchmarkJob_t *)pParam;
+	const UtlSymbolBenchmarkNames_t &names = *pJob->m_pNames;
+
+	int nMissing = 0;
+	for ( int iPass = 0; iPass < pJob->m_nIterations; ++iPass )
+	{
+		for ( int i = 0; i < names.Count(); ++i )
+		{
+			CUtlSymbol sym = pJob->m_pLockFree ? pJob->m_pLockFree->Find( names[i] ) : pJob->m_pLocked->Find( names[i] );
+			if ( !sym.IsValid() )
+			{
+				++nMissing;
+			}
+		}
+	}
+
+	pJob->m_nMissing += nMissing;
+	return 0;
+}
+
+static CCycleCount TimeUtlSymbolThreads( UtlSymbolBenchmarkJob_t &job, int nThreads )
+{
+	CFastTimer timer;
+	timer.Start();
+
+	CUtlVector< ThreadHandle_t > threads;
+	for ( int i = 1; i < nThreads; ++i )
+	{
+		ThreadHandle_t hThread = CreateSimpleThread( UtlSymbolBenchmarkThread, &job );
+		if ( hThread )
+		{
+			threads.AddToTail( hThread );
+		}
+	}
+
+	UtlSymbolBenchmarkThread( &job );
+
+	for ( int i = 0; i < threads.Count(); ++i )
+	{
+		ThreadJoin( threads[i] );
+		ReleaseThreadHandle( threads[i] );
+	}
+
+	timer.End();
+	return timer.GetDuration();
+}
+
+CON_COMMAND( utlsymbol_benchmark, "Times the tree and hash symbol tables, single threaded and with concurrent lookups. Usage: utlsymbol_benchmark [symbols] [iterations] [threads]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nSymbols = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, UTLSYMBOL_BENCHMARK_MAX_SYMBOLS ) : UTLSYMBOL_BENCHMARK_MAX_SYMBOLS;
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args.Arg( 2 ) ), 1 ) : 10;
+	int nThreads = ( args.ArgC() > 3 ) ? clamp( atoi( args.Arg( 3 ) ), 1, 32 ) : 4;
+
+	UtlSymbolBenchmarkNames_t names;
+	BuildUtlSymbolBenchmarkNames( names, nSymbols );
+
+	int nMissing = 0;
+	CCycleCount timeTreeAdd, timeTreeFind, timeHashAdd, timeHashFind;
+	{
+		CUtlSymbolTable tree( 0, 32, true );
+		TimeUtlSymbolTable( tree, names, nIterations, timeTreeAdd, timeTreeFind, nMissing );
+	}
+	{
+		CUtlHashSymbolTable hash( 0, 32, true );
+		TimeUtlSymbolTable( hash, names, nIterations, timeHashAdd, timeHashFind, nMissing );
+	}
+
+	CUtlHashSymbolTableMT lockFree( 0, 32, true );
+	CUtlSymbolTableMT locked( 0, 32, true );
+	for ( int i = 0; i < names.Count(); ++i )
+	{
+		lockFree.AddString( names[i] );
+		locked.AddString( names[i] );
+	}
+
+	// Both fold case through V_stricmp, so they must agree on what matches,
+	// including names the CRT has to fold
+	static const char *s_pszFoldedNames[] = { "caf\xe9", "CAF\xc9", "\xc0\xc9\xce", "\xe0\xe9\xee", "na\xefve" };
+	int nDisagree = 0;
+	for ( int i = 0; i < ARRAYSIZE( s_pszFoldedNames ); ++i )
+	{
+		if ( i % 2 == 0 )
+		{
+			lockFree.AddString( s_pszFoldedNames[i] );
+			locked.AddString( s_pszFoldedNames[i] );
+		}
+	}
+	for ( int i = 0; i < names.Count() + ARRAYSIZE( s_pszFoldedNames ); ++i )
+	{
+		char szUpper[64];
+		V_strncpy( szUpper, ( i < names.Count() ) ? names[i] : s_pszFoldedNames[ i - names.Count() ], sizeof( szUpper ) );
+		V_strupr( szUpper );
+		if ( lockFree.Find( szUpper ).IsValid() != locked.Find( szUpper ).IsValid() )
+		{
+			++nDisagree;
+		}
+	}
+
+	UtlSymbolBenchmarkJob_t job;
+	job.m_pNames = &names;
+	job.m_nIterations = nIterations;
+
+	job.m_pLockFree = NULL;
+	job.m_pLocked = &locked;
+	CCycleCount timeLocked = TimeUtlSymbolThreads( job, nThreads );
+
+	job.m_pLockFree = &lockFree;
+	job.m_pLocked = NULL;
+	CCycleCount timeLockFree = TimeUtlSymbolThreads( job, nThreads );
+
+	nMissing += job.m_nMissing;
+
+	double flAdds = (double)nSymbols;
+	double flFinds = (double)nSymbols * nIterations;
+	Msg( "utlsymbol_benchmark: %d symbols, %d passes, %d threads\n", nSymbols, nIterations, nThreads );
+	Msg( "  tree: %.0f adds/s, %.0f finds/s\n", flAdds / timeTreeAdd.GetSeconds(), flFinds / timeTreeFind.GetSeconds() );
+	Msg( "  hash: %.0f adds/s, %.0f finds/s\n", flAdds / timeHashAdd.GetSeconds(), flFinds / timeHashFind.GetSeconds() );
+	Msg( "  concurrent finds: locked tree %.0f/s, lock free hash %.0f/s\n", flFinds * nThreads / timeLocked.GetSeconds(), flFinds * nThreads / timeLockFree.GetSeconds() );
+
+	if ( nMissing )
+	{
+		Warning( "  %d lookups failed\n", nMissing );
+	}
+	if ( nDisagree )
+	{
+		Warning( "  %d case folded lookups differ between the hash and the tree\n", nDisagree );
+	}
+}
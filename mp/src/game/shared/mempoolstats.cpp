@@ -0,0 +1,26 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Reports the thread safe memory pools in this module and how well
+//			their per thread caches are keeping threads off the pool locks.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/mempool.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#if defined( CLIENT_DLL )
+CON_COMMAND_F( cl_mempool_stats, "Display the thread safe memory pools and their thread caches (client only)", FCVAR_CHEAT )
+#else
+CON_COMMAND( sv_mempool_stats, "Display the thread safe memory pools and their thread caches (server only)" )
+#endif
+{
+#ifndef CLIENT_DLL
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+#endif
+
+	CMemoryPoolMT::ReportStats( Msg );
+}
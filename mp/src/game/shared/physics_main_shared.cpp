@@ -23,6 +23,10 @@
 	#include "portal_util_shared.h"
 #endif
 
+#ifndef CLIENT_DLL
+	#include "tickprofiler.h"
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -2114,7 +2118,15 @@ bool CBaseEntity::PhysicsRunSpecificThink( int nContextIndex, BASEPTR thinkFunc
 
 	SetNextThink( nContextIndex, TICK_NEVER_THINK );
 
+#if !defined( CLIENT_DLL )
+	{
+		CTickProfileScope tickProfile( TICKPROFILE_THINK, GetClassname(),
+			( nContextIndex != NO_THINK_CONTEXT ) ? STRING( m_aThinkFunctions[ nContextIndex ].m_iszContext ) : NULL );
+		PhysicsDispatchThink( thinkFunc );
+	}
+#else
 	PhysicsDispatchThink( thinkFunc );
+#endif
 
 	SetLastThink( nContextIndex, gpGlobals->curtime );
 
@@ -20,6 +20,7 @@
 #include "datamanager.h"
 #include "convar.h"
 #include "tier0/tslist.h"
+#include "tier0/fasttimer.h"
 #include "vphysics_interface.h"
 #ifdef CLIENT_DLL
 	#include "posedebugger.h"
@@ -212,34 +213,164 @@ short *CBoneCache::CachedToStudio()
 	return (short *)( (char *)(this+1) + m_cachedToStudioOffset );
 }
 
-// Construct a singleton
-static CDataManager<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex> g_StudioBoneCache( 128 * 1024L );
+// Construct a singleton. Each shard has its own lock, so threaded bone setup
+// only contends on lookups that land in the same shard.
+#define BONECACHE_SHARDS	4
+static CDataManagerSharded<CBoneCache, bonecacheparams_t, CBoneCache *, BONECACHE_SHARDS> g_StudioBoneCache( 128 * 1024L );
 
 CBoneCache *Studio_GetBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 }
 
 memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.CreateResource( params );
 }
 
 void Studio_DestroyBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	g_StudioBoneCache.DestroyResource( cacheHandle );
 }
 
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
-	CBoneCache *pCache = g_StudioBoneCache.GetResource_NoLock( cacheHandle );
+	// The shard only holds its lock for the lookup, so pin the cache while
+	// writing to it or another thread's create could evict it in between
+	CBoneCache *pCache = g_StudioBoneCache.LockResource( cacheHandle );
 	if ( pCache )
 	{
 		pCache->m_timeValid = -1.0f;
+		g_StudioBoneCache.UnlockResource( cacheHandle );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Contention benchmark for the bone cache. N threads look up random
+//			handles in a single mutex CDataManager and in the sharded one.
+//-----------------------------------------------------------------------------
+class CBoneCacheBenchmarkItem
+{
+public:
+	static unsigned int EstimatedSize( const unsigned int &nSize )	{ return nSize; }
+	static CBoneCacheBenchmarkItem *CreateResource( const unsigned int &nSize )
+	{
+		CBoneCacheBenchmarkItem *pItem = new CBoneCacheBenchmarkItem;
+		pItem->m_nSize = nSize;
+		return pItem;
+	}
+
+	void DestroyResource()				{ delete this; }
+	CBoneCacheBenchmarkItem *GetData()	{ return this; }
+	unsigned int Size() const			{ return m_nSize; }
+
+private:
+	unsigned int m_nSize;
+};
+
+typedef CDataManager<CBoneCacheBenchmarkItem, unsigned int, CBoneCacheBenchmarkItem *, CThreadFastMutex> BoneCacheBenchmarkSingle_t;
+typedef CDataManagerSharded<CBoneCacheBenchmarkItem, unsigned int, CBoneCacheBenchmarkItem *, BONECACHE_SHARDS> BoneCacheBenchmarkSharded_t;
+
+template< class MANAGER >
+struct BoneCacheBenchmarkJob_t
+{
+	MANAGER				*m_pManager;
+	const memhandle_t	*m_pHandles;
+	int					m_nHandles;
+	int					m_nLookups;
+	unsigned int		m_nSeed;
+	int					m_nMisses;
+};
+
+template< class MANAGER >
+static unsigned BoneCacheBenchmarkThread( void *pParam )
+{
+	BoneCacheBenchmarkJob_t< MANAGER > *pJob = (BoneCacheBenchmarkJob_t< MANAGER > *)pParam;
+	unsigned int nRand = pJob->m_nSeed;
+	int nMisses = 0;
+	for ( int i = 0; i < pJob->m_nLookups; ++i )
+	{
+		nRand = nRand * 1103515245 + 12345;
+		if ( !pJob->m_pManager->GetResource_NoLock( pJob->m_pHandles[ ( nRand >> 8 ) % pJob->m_nHandles ] ) )
+		{
+			++nMisses;
+		}
+	}
+	pJob->m_nMisses = nMisses;
+	return 0;
+}
+
+template< class MANAGER >
+static float RunBoneCacheBenchmark( MANAGER &manager, int nThreads, int nLookups, int &nMisses )
+{
+	const int nHandles = 1024;
+	const unsigned int nItemSize = 2048;
+	manager.SetTargetSize( nHandles * nItemSize * 2 );
+
+	CUtlVector< memhandle_t > handles;
+	handles.SetCount( nHandles );
+	for ( int i = 0; i < nHandles; ++i )
+	{
+		handles[i] = manager.CreateResource( nItemSize );
+	}
+
+	CUtlVector< BoneCacheBenchmarkJob_t< MANAGER > > jobs;
+	CUtlVector< ThreadHandle_t > threads;
+	jobs.SetCount( nThreads );
+	threads.SetCount( nThreads );
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		BoneCacheBenchmarkJob_t< MANAGER > &job = jobs[i];
+		job.m_pManager = &manager;
+		job.m_pHandles = handles.Base();
+		job.m_nHandles = nHandles;
+		job.m_nLookups = nLookups;
+		job.m_nSeed = i * 7919 + 1;
+		job.m_nMisses = 0;
+		threads[i] = CreateSimpleThread( BoneCacheBenchmarkThread< MANAGER >, &job );
+	}
+
+	nMisses = 0;
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		ThreadJoin( threads[i] );
+		ReleaseThreadHandle( threads[i] );
+		nMisses += jobs[i].m_nMisses;
+	}
+	timer.End();
+
+	manager.FlushAll();
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+#if defined( CLIENT_DLL )
+CON_COMMAND_F( cl_studio_bonecache_benchmark, "Times bone cache lookups from several threads, single lock against sharded. Usage: cl_studio_bonecache_benchmark [threads] [lookups per thread]", FCVAR_CHEAT )
+#else
+CON_COMMAND_F( sv_studio_bonecache_benchmark, "Times bone cache lookups from several threads, single lock against sharded. Usage: sv_studio_bonecache_benchmark [threads] [lookups per thread]", FCVAR_CHEAT )
+#endif
+{
+	int nThreads = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, 32 ) : 4;
+	int nLookups = ( args.ArgC() > 2 ) ? MAX( atoi( args.Arg( 2 ) ), 1 ) : 1000000;
+
+	BoneCacheBenchmarkSingle_t *pSingle = new BoneCacheBenchmarkSingle_t;
+	BoneCacheBenchmarkSharded_t *pSharded = new BoneCacheBenchmarkSharded_t;
+
+	int nSingleMisses, nShardedMisses;
+	float flSingle = RunBoneCacheBenchmark( *pSingle, nThreads, nLookups, nSingleMisses );
+	float flSharded = RunBoneCacheBenchmark( *pSharded, nThreads, nLookups, nShardedMisses );
+
+	delete pSingle;
+	delete pSharded;
+
+	Msg( "bonecache benchmark: %d threads, %d lookups each\n", nThreads, nLookups );
+	Msg( "  single lock: %.2f ms\n", flSingle );
+	Msg( "  %d shards:    %.2f ms\n", BONECACHE_SHARDS, flSharded );
+	if ( nSingleMisses || nShardedMisses )
+	{
+		Warning( "  lookups failed (single %d, sharded %d)\n", nSingleMisses, nShardedMisses );
 	}
 }
 
@@ -261,10 +392,27 @@ void BuildBoneChain(
 }
 
 
+static ConVar anim_seekindex( "anim_seekindex", "1", FCVAR_REPLICATED, "Use seek indices to find frames in long animations instead of walking the run list." );
+
+//-----------------------------------------------------------------------------
+// Purpose: jump to the checkpoint at or before frame k, if the stream is indexed
+//-----------------------------------------------------------------------------
+static inline mstudioanimvalue_t *SeekAnimValue( int &k, mstudioanimvalue_t *panimvalue, const mstudioanimseekpoint_t *pSeekPoints, int nSeekPoints )
+{
+	if ( pSeekPoints && k >= ANIMSEEK_FRAMES )
+	{
+		const mstudioanimseekpoint_t &point = pSeekPoints[ MIN( k / ANIMSEEK_FRAMES, nSeekPoints - 1 ) ];
+		k -= point.frame;
+		panimvalue += point.offset;
+	}
+	return panimvalue;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: return a sub frame rotation for a single bone
 //-----------------------------------------------------------------------------
-void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, float &v1, float &v2 )
+void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, float &v1, float &v2,
+					  const mstudioanimseekpoint_t *pSeekPoints = NULL, int nSeekPoints = 0 )
 {
 	if ( !panimvalue )
 	{
@@ -281,6 +429,7 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, f
 	}
 
 	int k = frame;
+	panimvalue = SeekAnimValue( k, panimvalue, pSeekPoints, nSeekPoints );
 
 	// find the data list that has the frame
 	while (panimvalue->num.total <= k)
@@ -336,7 +485,8 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, f
 }
 
 
-void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, float &v1 )
+void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, float &v1,
+					  const mstudioanimseekpoint_t *pSeekPoints = NULL, int nSeekPoints = 0 )
 {
 	if ( !panimvalue )
 	{
@@ -345,6 +495,7 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, f
 	}
 
 	int k = frame;
+	panimvalue = SeekAnimValue( k, panimvalue, pSeekPoints, nSeekPoints );
 
 	while (panimvalue->num.total <= k)
 	{
@@ -374,7 +525,8 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, f
 void CalcBoneQuaternion( int frame, float s, 
 						const Quaternion &baseQuat, const RadianEuler &baseRot, const Vector &baseRotScale, 
 						int iBaseFlags, const Quaternion &baseAlignment, 
-						const mstudioanim_t *panim, Quaternion &q )
+						const mstudioanim_t *panim, Quaternion &q,
+						const CStudioAnimSeekSection *pSeek = NULL, int iAnimBone = 0 )
 {
 	if ( panim->flags & STUDIO_ANIM_RAWROT )
 	{
@@ -405,14 +557,24 @@ void CalcBoneQuaternion( int frame, float s,
 
 	mstudioanim_valueptr_t *pValuesPtr = panim->pRotV();
 
+	const mstudioanimseekpoint_t *pSeekX = NULL, *pSeekY = NULL, *pSeekZ = NULL;
+	int nSeekPoints = 0;
+	if ( pSeek )
+	{
+		pSeekX = pSeek->pSeekPoints( iAnimBone, 0 );
+		pSeekY = pSeek->pSeekPoints( iAnimBone, 1 );
+		pSeekZ = pSeek->pSeekPoints( iAnimBone, 2 );
+		nSeekPoints = pSeek->NumSeekPoints();
+	}
+
 	if (s > 0.001f)
 	{
 		QuaternionAligned	q1, q2;
 		RadianEuler			angle1, angle2;
 
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x, pSeekX, nSeekPoints );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y, pSeekY, nSeekPoints );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z, pSeekZ, nSeekPoints );
 
 		if (!(panim->flags & STUDIO_ANIM_DELTA))
 		{
@@ -449,9 +611,9 @@ void CalcBoneQuaternion( int frame, float s,
 	{
 		RadianEuler			angle;
 
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x, pSeekX, nSeekPoints );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y, pSeekY, nSeekPoints );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z, pSeekZ, nSeekPoints );
 
 		if (!(panim->flags & STUDIO_ANIM_DELTA))
 		{
@@ -476,15 +638,16 @@ void CalcBoneQuaternion( int frame, float s,
 inline void CalcBoneQuaternion( int frame, float s, 
 						const mstudiobone_t *pBone,
 						const mstudiolinearbone_t *pLinearBones,
-						const mstudioanim_t *panim, Quaternion &q )
+						const mstudioanim_t *panim, Quaternion &q,
+						const CStudioAnimSeekSection *pSeek = NULL, int iAnimBone = 0 )
 {
 	if (pLinearBones)
 	{
-		CalcBoneQuaternion( frame, s, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q );
+		CalcBoneQuaternion( frame, s, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q, pSeek, iAnimBone );
 	}
 	else
 	{
-		CalcBoneQuaternion( frame, s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q );
+		CalcBoneQuaternion( frame, s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q, pSeek, iAnimBone );
 	}
 }
 
@@ -497,7 +660,8 @@ inline void CalcBoneQuaternion( int frame, float s,
 //-----------------------------------------------------------------------------
 void CalcBonePosition(	int frame, float s,
 						const Vector &basePos, const Vector &baseBoneScale, 
-						const mstudioanim_t *panim, Vector &pos	)
+						const mstudioanim_t *panim, Vector &pos,
+						const CStudioAnimSeekSection *pSeek = NULL, int iAnimBone = 0 )
 {
 	if (panim->flags & STUDIO_ANIM_RAWPOS)
 	{
@@ -522,12 +686,14 @@ void CalcBonePosition(	int frame, float s,
 	mstudioanim_valueptr_t *pPosV = panim->pPosV();
 	int					j;
 
+	int nSeekPoints = pSeek ? pSeek->NumSeekPoints() : 0;
+
 	if (s > 0.001f)
 	{
 		float v1, v2;
 		for (j = 0; j < 3; j++)
 		{
-			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], v1, v2 );
+			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], v1, v2, pSeek ? pSeek->pSeekPoints( iAnimBone, 3 + j ) : NULL, nSeekPoints );
 			pos[j] = v1 * (1.0 - s) + v2 * s;
 		}
 	}
@@ -535,7 +701,7 @@ void CalcBonePosition(	int frame, float s,
 	{
 		for (j = 0; j < 3; j++)
 		{
-			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], pos[j] );
+			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], pos[j], pSeek ? pSeek->pSeekPoints( iAnimBone, 3 + j ) : NULL, nSeekPoints );
 		}
 	}
 
@@ -553,15 +719,16 @@ void CalcBonePosition(	int frame, float s,
 inline void CalcBonePosition( int frame, float s, 
 						const mstudiobone_t *pBone,
 						const mstudiolinearbone_t *pLinearBones,
-						const mstudioanim_t *panim, Vector &pos )
+						const mstudioanim_t *panim, Vector &pos,
+						const CStudioAnimSeekSection *pSeek = NULL, int iAnimBone = 0 )
 {
 	if (pLinearBones)
 	{
-		CalcBonePosition( frame, s, pLinearBones->pos(panim->bone), pLinearBones->posscale(panim->bone), panim, pos );
+		CalcBonePosition( frame, s, pLinearBones->pos(panim->bone), pLinearBones->posscale(panim->bone), panim, pos, pSeek, iAnimBone );
 	}
 	else
 	{
-		CalcBonePosition( frame, s, pBone->pos, pBone->posscale, panim, pos );
+		CalcBonePosition( frame, s, pBone->pos, pBone->posscale, panim, pos, pSeek, iAnimBone );
 	}
 }
 
@@ -924,7 +1091,14 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 	int iLocalFrame = iFrame;
 	float flStall;
-	panim = animdesc.pAnim( &iLocalFrame, flStall );
+	int iSection;
+	panim = animdesc.pAnim( &iLocalFrame, flStall, &iSection );
+
+	const CStudioAnimSeekSection *pSeek = NULL;
+	if ( anim_seekindex.GetBool() )
+	{
+		pSeek = pStudioHdr->GetAnimSeekSection( baseanimation, iSection, animdesc, panim );
+	}
 
 	float *pweight = seqdesc.pBoneweight( 0 );
 	pbone = pStudioHdr->pBone( 0 );
@@ -966,6 +1140,7 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 	}
 
 	// FIXME: change encoding so that bone -1 is never the case
+	int iAnimBone = 0;
 	while (panim && panim->bone < 255)
 	{
 		j = pAnimGroup->masterBone[panim->bone];
@@ -975,14 +1150,15 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 			if (k >= 0 && pweight[k] > 0.0f)
 			{
-				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
-				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
+				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j], pSeek, iAnimBone );
+				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j], pSeek, iAnimBone );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 #endif
 			}
 		}
 		panim = panim->pNext();
+		iAnimBone++;
 	}
 
 	// cross fade in previous zeroframe data
@@ -1065,7 +1241,15 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 
 	int iLocalFrame = iFrame;
 	float flStall;
-	mstudioanim_t *panim = animdesc.pAnim( &iLocalFrame, flStall );
+	int iSection;
+	mstudioanim_t *panim = animdesc.pAnim( &iLocalFrame, flStall, &iSection );
+
+	const CStudioAnimSeekSection *pSeek = NULL;
+	if ( anim_seekindex.GetBool() )
+	{
+		pSeek = pStudioHdr->GetAnimSeekSection( animation, iSection, animdesc, panim );
+	}
+	int iAnimBone = 0;
 
 	float *pweight = seqdesc.pBoneweight( 0 );
 
@@ -1103,14 +1287,15 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		{
 			if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 			{
-				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
-				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
+				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i], pSeek, iAnimBone );
+				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i], pSeek, iAnimBone );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 				pStudioHdr->m_nPerfUsedBones++;
 #endif
 			}
 			panim = panim->pNext();
+			iAnimBone++;
 		}
 		else if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 		{
@@ -1372,6 +1557,105 @@ void WorldSpaceSlerp(
 
 
 
+static ConVar anim_simdbones( "anim_simdbones", "1", FCVAR_REPLICATED, "Blend bones and build bone matrices four at a time with SIMD." );
+
+//-----------------------------------------------------------------------------
+// Purpose: list the bones with a positive weight for the four-wide loops.
+//			The list is padded to a multiple of four by repeating the last
+//			bone; the padding lanes compute and store the same result.
+//			Returns the padded count.
+//-----------------------------------------------------------------------------
+static int CollectWeightedBones( const float *pWeights, int nBoneCount, int *pBones )
+{
+	int nBones = 0;
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( pWeights[i] > 0.0f )
+		{
+			pBones[nBones++] = i;
+		}
+	}
+
+	if ( nBones > 0 )
+	{
+		while ( nBones & 3 )
+		{
+			pBones[nBones] = pBones[nBones - 1];
+			++nBones;
+		}
+	}
+	return nBones;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: per lane weights and BONE_FIXED_ALIGNMENT mask for four bones
+//-----------------------------------------------------------------------------
+static FORCEINLINE fltx4 LoadBoneWeights( const float *pWeights, const int *pBones )
+{
+	ALIGN16 float flWeights[4] ALIGN16_POST = { pWeights[pBones[0]], pWeights[pBones[1]], pWeights[pBones[2]], pWeights[pBones[3]] };
+	return LoadAlignedSIMD( flWeights );
+}
+
+static FORCEINLINE fltx4 LoadFixedAlignmentMask( const CStudioHdr *pStudioHdr, const int *pBones )
+{
+	ALIGN16 int32 nMask[4] ALIGN16_POST;
+	for ( int k = 0; k < 4; k++ )
+	{
+		nMask[k] = ( pStudioHdr->boneFlags( pBones[k] ) & BONE_FIXED_ALIGNMENT ) ? ~0 : 0;
+	}
+	return LoadAlignedSIMD( nMask );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: SlerpBones for non-delta sequences, four bones at a time.
+//			pS2 is the per bone weight of q2,pos2.
+//-----------------------------------------------------------------------------
+static void SlerpBonesSIMD( 
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	const QuaternionAligned q2[MAXSTUDIOBONES], 
+	const Vector pos2[MAXSTUDIOBONES], 
+	const float *pS2,
+	int nBoneCount )
+{
+	int *pBones = (int*)stackalloc( ( nBoneCount + 3 ) * sizeof(int) );
+	int nBones = CollectWeightedBones( pS2, nBoneCount, pBones );
+
+	for ( int n = 0; n < nBones; n += 4 )
+	{
+		const int *b = &pBones[n];
+
+		FourQuaternions q2simd, q1simd;
+		q2simd.LoadAndSwizzle( q2[b[0]], q2[b[1]], q2[b[2]], q2[b[3]] );
+		q1simd.LoadAndSwizzle( q1[b[0]], q1[b[1]], q1[b[2]], q1[b[3]] );
+
+		FourQuaternions q1aligned = QuaternionAlignSIMD( q2simd, q1simd );
+		fltx4 fixedAlignment = LoadFixedAlignmentMask( pStudioHdr, b );
+		q1simd.x = MaskedAssign( fixedAlignment, q1simd.x, q1aligned.x );
+		q1simd.y = MaskedAssign( fixedAlignment, q1simd.y, q1aligned.y );
+		q1simd.z = MaskedAssign( fixedAlignment, q1simd.z, q1aligned.z );
+		q1simd.w = MaskedAssign( fixedAlignment, q1simd.w, q1aligned.w );
+
+		fltx4 s1 = SubSIMD( Four_Ones, LoadBoneWeights( pS2, b ) );
+		FourQuaternions result = QuaternionSlerpNoAlignSIMD( q2simd, q1simd, s1 );
+		result.SwizzleAndStore( q1[b[0]], q1[b[1]], q1[b[2]], q1[b[3]] );
+	}
+
+	// positions are a plain lerp, not worth the transpose
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		float s2 = pS2[i];
+		if ( s2 <= 0.0f )
+			continue;
+
+		float s1 = 1.0 - s2;
+		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
+		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
+		pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
@@ -1481,6 +1765,14 @@ void SlerpBones(
 		return;
 	}
 
+#ifndef _X360
+	if ( anim_simdbones.GetBool() )
+	{
+		SlerpBonesSIMD( pStudioHdr, q1, pos1, q2, pos2, pS2, nBoneCount );
+		return;
+	}
+#endif
+
 	QuaternionAligned q3;
 	for (i = 0; i < nBoneCount; i++)
 	{
@@ -1529,6 +1821,76 @@ void SlerpBones(
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: weight of each bone that seqdesc animates, 0 for the rest
+//-----------------------------------------------------------------------------
+static void CalcSequenceBoneWeights( const CStudioHdr *pStudioHdr, mstudioseqdesc_t &seqdesc, const virtualgroup_t *pSeqGroup, float s, int boneMask, float *pWeights )
+{
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		pWeights[i] = 0.0f;
+
+		// skip unused bones
+		if ( !( pStudioHdr->boneFlags( i ) & boneMask ) )
+			continue;
+
+		int j = pSeqGroup ? pSeqGroup->boneMap[i] : i;
+		if ( j >= 0 && seqdesc.weight( j ) > 0.0 )
+		{
+			pWeights[i] = s;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: BlendBones four bones at a time. pS2 is the per bone weight of 
+//			q2,pos2, either s or 0.
+//-----------------------------------------------------------------------------
+static void BlendBonesSIMD( 
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	const Quaternion q2[MAXSTUDIOBONES], 
+	const Vector pos2[MAXSTUDIOBONES], 
+	const float *pS2 )
+{
+	int nBoneCount = pStudioHdr->numbones();
+	int *pBones = (int*)stackalloc( ( nBoneCount + 3 ) * sizeof(int) );
+	int nBones = CollectWeightedBones( pS2, nBoneCount, pBones );
+
+	for ( int n = 0; n < nBones; n += 4 )
+	{
+		const int *b = &pBones[n];
+
+		FourQuaternions q2simd, q1simd;
+		q2simd.LoadAndSwizzle( q2[b[0]], q2[b[1]], q2[b[2]], q2[b[3]] );
+		q1simd.LoadAndSwizzle( q1[b[0]], q1[b[1]], q1[b[2]], q1[b[3]] );
+
+		FourQuaternions q1aligned = QuaternionAlignSIMD( q2simd, q1simd );
+		fltx4 fixedAlignment = LoadFixedAlignmentMask( pStudioHdr, b );
+		q1simd.x = MaskedAssign( fixedAlignment, q1simd.x, q1aligned.x );
+		q1simd.y = MaskedAssign( fixedAlignment, q1simd.y, q1aligned.y );
+		q1simd.z = MaskedAssign( fixedAlignment, q1simd.z, q1aligned.z );
+		q1simd.w = MaskedAssign( fixedAlignment, q1simd.w, q1aligned.w );
+
+		fltx4 s1 = SubSIMD( Four_Ones, LoadBoneWeights( pS2, b ) );
+		FourQuaternions result = QuaternionBlendNoAlignSIMD( q2simd, q1simd, s1 );
+		result.SwizzleAndStore( q1[b[0]], q1[b[1]], q1[b[2]], q1[b[3]] );
+	}
+
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		float s2 = pS2[i];
+		if ( s2 <= 0.0f )
+			continue;
+
+		float s1 = 1.0 - s2;
+		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
+		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
+		pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Inter-animation blend.  Assumes both types are identical.
 //			blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
@@ -1589,6 +1951,16 @@ void BlendBones(
 		return;
 	}
 
+#ifndef _X360
+	if ( anim_simdbones.GetBool() )
+	{
+		float *pS2 = (float*)stackalloc( pStudioHdr->numbones() * sizeof(float) );
+		CalcSequenceBoneWeights( pStudioHdr, seqdesc, pSeqGroup, s, boneMask, pS2 );
+		BlendBonesSIMD( pStudioHdr, q1, pos1, q2, pos2, pS2 );
+		return;
+	}
+#endif
+
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
@@ -1658,6 +2030,37 @@ void ScaleBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
+#ifndef _X360
+	if ( anim_simdbones.GetBool() )
+	{
+		int nBoneCount = pStudioHdr->numbones();
+		float *pWeights = (float*)stackalloc( nBoneCount * sizeof(float) );
+		CalcSequenceBoneWeights( pStudioHdr, seqdesc, pSeqGroup, 1.0f, boneMask, pWeights );
+
+		int *pBones = (int*)stackalloc( ( nBoneCount + 3 ) * sizeof(int) );
+		int nBones = CollectWeightedBones( pWeights, nBoneCount, pBones );
+		fltx4 s1simd = ReplicateX4( s1 );
+		for ( int n = 0; n < nBones; n += 4 )
+		{
+			const int *b = &pBones[n];
+
+			FourQuaternions q1simd;
+			q1simd.LoadAndSwizzle( q1[b[0]], q1[b[1]], q1[b[2]], q1[b[3]] );
+			FourQuaternions result = QuaternionIdentityBlendSIMD( q1simd, s1simd );
+			result.SwizzleAndStore( q1[b[0]], q1[b[1]], q1[b[2]], q1[b[3]] );
+		}
+
+		for ( i = 0; i < nBoneCount; i++ )
+		{
+			if ( pWeights[i] > 0.0f )
+			{
+				VectorScale( pos1[i], s2, pos1[i] );
+			}
+		}
+		return;
+	}
+#endif
+
 	for (i = 0; i < pStudioHdr->numbones(); i++)
 	{
 		// skip unused bones
@@ -1800,14 +2203,28 @@ void InitPose(
 	}
 	else
 	{
+		// the linear bone arrays are laid out like pos[] and q[], so copy
+		// each run of bones in the mask in one go
 		mstudiolinearbone_t *pLinearBones = pStudioHdr->pLinearBones();
-		for (int i = 0; i < pStudioHdr->numbones(); i++)
+		const Vector *pBonePos = (const Vector *)( (byte *)pLinearBones + pLinearBones->posindex );
+		const Quaternion *pBoneQuat = (const Quaternion *)( (byte *)pLinearBones + pLinearBones->quatindex );
+		int nBoneCount = pStudioHdr->numbones();
+		int i = 0;
+		while ( i < nBoneCount )
 		{
-			if (pStudioHdr->boneFlags(  i ) & boneMask ) 
+			if ( !( pStudioHdr->boneFlags( i ) & boneMask ) )
+			{
+				++i;
+				continue;
+			}
+
+			int nRunStart = i;
+			while ( i < nBoneCount && ( pStudioHdr->boneFlags( i ) & boneMask ) )
 			{
-				pos[i] = pLinearBones->pos(i);
-				q[i] = pLinearBones->quat(i);
+				++i;
 			}
+			memcpy( &pos[nRunStart], &pBonePos[nRunStart], ( i - nRunStart ) * sizeof(Vector) );
+			memcpy( &q[nRunStart], &pBoneQuat[nRunStart], ( i - nRunStart ) * sizeof(Quaternion) );
 		}
 	}
 }
@@ -4496,6 +4913,90 @@ void CBoneSetup::CalcAutoplaySequences(
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Studio_BuildLocalMatrices, four bones at a time
+//-----------------------------------------------------------------------------
+static void BuildLocalMatricesSIMD(
+	const CStudioHdr *pStudioHdr,
+	const Vector pos[],
+	const Quaternion q[],
+	matrix3x4_t *pLocal,
+	int boneMask
+	)
+{
+	int nBoneCount = pStudioHdr->numbones();
+
+	int *pBones = (int*)stackalloc( ( nBoneCount + 3 ) * sizeof(int) );
+	int nBones = 0;
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( pStudioHdr->boneFlags( i ) & boneMask )
+		{
+			pBones[nBones++] = i;
+		}
+	}
+	if ( nBones == 0 )
+		return;
+
+	while ( nBones & 3 )
+	{
+		pBones[nBones] = pBones[nBones - 1];
+		++nBones;
+	}
+
+	for ( int n = 0; n < nBones; n += 4 )
+	{
+		const int *b = &pBones[n];
+
+		FourQuaternions qsimd;
+		qsimd.LoadAndSwizzle( q[b[0]], q[b[1]], q[b[2]], q[b[3]] );
+
+		// Vector is 12 bytes, so fill the lanes directly rather than risk
+		// reading past the end of pos[]
+		FourVectors possimd;
+		for ( int k = 0; k < 4; k++ )
+		{
+			possimd.X( k ) = pos[b[k]].x;
+			possimd.Y( k ) = pos[b[k]].y;
+			possimd.Z( k ) = pos[b[k]].z;
+		}
+
+		QuaternionMatrixSIMD( qsimd, possimd, pLocal[b[0]], pLocal[b[1]], pLocal[b[2]], pLocal[b[3]] );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: convert the local pose of every bone in boneMask to a matrix.
+//			Bones outside the mask are left untouched.
+//-----------------------------------------------------------------------------
+void Studio_BuildLocalMatrices(
+	const CStudioHdr *pStudioHdr,
+	const Vector pos[],
+	const Quaternion q[],
+	matrix3x4_t *pLocal,
+	int boneMask
+	)
+{
+#ifndef _X360
+	if ( anim_simdbones.GetBool() )
+	{
+		BuildLocalMatricesSIMD( pStudioHdr, pos, q, pLocal, boneMask );
+		return;
+	}
+#endif
+
+	int nBoneCount = pStudioHdr->numbones();
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( pStudioHdr->boneFlags( i ) & boneMask )
+		{
+			QuaternionMatrix( q[i], pos[i], pLocal[i] );
+		}
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -4560,20 +5061,33 @@ void Studio_BuildMatrices(
 		VectorScale( rotationmatrix[2], flScale, rotationmatrix[2] );
 	}
 
+	// with every bone in play, build the local matrices in one vectorized
+	// pass and leave only the parent chain walk serial
+	matrix3x4_t *pLocal = NULL;
+	if ( iBone == -1 )
+	{
+		pLocal = (matrix3x4_t*)stackalloc( pStudioHdr->numbones() * sizeof(matrix3x4_t) );
+		Studio_BuildLocalMatrices( pStudioHdr, pos, q, pLocal, boneMask );
+	}
+
 	for (j = chainlength - 1; j >= 0; j--)
 	{
 		i = chain[j];
 		if (pStudioHdr->boneFlags(i) & boneMask)
 		{
-			QuaternionMatrix( q[i], pos[i], bonematrix );
+			if ( !pLocal )
+			{
+				QuaternionMatrix( q[i], pos[i], bonematrix );
+			}
+			const matrix3x4_t &localmatrix = pLocal ? pLocal[i] : bonematrix;
 
 			if (pStudioHdr->boneParent(i) == -1) 
 			{
-				ConcatTransforms (rotationmatrix, bonematrix, bonetoworld[i]);
+				ConcatTransforms (rotationmatrix, localmatrix, bonetoworld[i]);
 			} 
 			else 
 			{
-				ConcatTransforms (bonetoworld[pStudioHdr->boneParent(i)], bonematrix, bonetoworld[i]);
+				ConcatTransforms (bonetoworld[pStudioHdr->boneParent(i)], localmatrix, bonetoworld[i]);
 			}
 		}
 	}
@@ -319,6 +319,15 @@ bool CalcProceduralBone(
 	CBoneAccessor &bonetoworld
 	);
 
+// Converts the local pose of every bone in boneMask to a matrix, four bones at a time
+void Studio_BuildLocalMatrices(
+	const CStudioHdr *pStudioHdr,
+	const Vector pos[],
+	const Quaternion q[],
+	matrix3x4_t *pLocal,
+	int boneMask
+	);
+
 void Studio_BuildMatrices(
 	const CStudioHdr *pStudioHdr,
 	const QAngle& angles, 
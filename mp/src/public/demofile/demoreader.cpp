@@ -0,0 +1,391 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Headless .dem reader for offline analysis
+//
+//=============================================================================
+
+#include "demofile/demoreader.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+
+#ifdef _WIN32
+#include "winlite.h"
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Largest payload a single command can carry; anything bigger is corruption
+#define DEMOREADER_MAX_PAYLOAD	( 64 * 1024 * 1024 )
+
+CDemoFileReader::CDemoFileReader()
+{
+	m_pBase = NULL;
+	m_nSize = 0;
+	m_nPos = 0;
+	m_bMapped = false;
+	m_bStopped = false;
+	m_bCorrupt = false;
+	V_memset( &m_Header, 0, sizeof( m_Header ) );
+}
+
+CDemoFileReader::~CDemoFileReader()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps the whole file read only. The OS pages it in as the commands
+//			are walked, so nothing is copied up front.
+//-----------------------------------------------------------------------------
+bool CDemoFileReader::Open( const char *pszFilename )
+{
+	Close();
+
+	void *pView = NULL;
+	int64 nFileSize = 0;
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFile( pszFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if ( GetFileSizeEx( hFile, &size ) )
+	{
+		nFileSize = size.QuadPart;
+	}
+
+	if ( nFileSize > 0 && nFileSize <= INT_MAX )
+	{
+		HANDLE hMapping = CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+		if ( hMapping )
+		{
+			pView = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( hMapping );
+		}
+	}
+	CloseHandle( hFile );
+#else
+	int fd = open( pszFilename, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat( fd, &st ) == 0 )
+	{
+		nFileSize = st.st_size;
+	}
+
+	if ( nFileSize > 0 && nFileSize <= INT_MAX )
+	{
+		pView = mmap( NULL, (size_t)nFileSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( pView == MAP_FAILED )
+		{
+			pView = NULL;
+		}
+		else
+		{
+			madvise( pView, (size_t)nFileSize, MADV_SEQUENTIAL );
+		}
+	}
+	close( fd );
+#endif
+
+	if ( !pView )
+		return false;
+
+	m_pBase = (const byte *)pView;
+	m_nSize = (int)nFileSize;
+	m_bMapped = true;
+
+	if ( !ParseHeader() )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool CDemoFileReader::Attach( const void *pData, int nSize )
+{
+	Close();
+
+	if ( !pData || nSize <= 0 )
+		return false;
+
+	m_pBase = (const byte *)pData;
+	m_nSize = nSize;
+	m_bMapped = false;
+
+	if ( !ParseHeader() )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CDemoFileReader::Close()
+{
+	if ( m_pBase && m_bMapped )
+	{
+#ifdef _WIN32
+		UnmapViewOfFile( m_pBase );
+#else
+		munmap( (void *)m_pBase, m_nSize );
+#endif
+	}
+
+	m_pBase = NULL;
+	m_nSize = 0;
+	m_nPos = 0;
+	m_bMapped = false;
+	m_bStopped = false;
+	m_bCorrupt = false;
+}
+
+bool CDemoFileReader::ParseHeader()
+{
+	m_nPos = 0;
+	if ( !Read( &m_Header, sizeof( m_Header ) ) )
+		return false;
+
+	ByteSwap_demoheader_t( m_Header );
+
+	if ( V_strncmp( m_Header.demofilestamp, DEMO_HEADER_ID, sizeof( m_Header.demofilestamp ) ) )
+		return false;
+
+	if ( m_Header.demoprotocol != DEMO_PROTOCOL )
+		return false;
+
+	m_bStopped = false;
+	m_bCorrupt = false;
+	return true;
+}
+
+void CDemoFileReader::Rewind()
+{
+	if ( IsOpen() )
+	{
+		m_nPos = sizeof( demoheader_t );
+		m_bStopped = false;
+		m_bCorrupt = false;
+	}
+}
+
+bool CDemoFileReader::Read( void *pOut, int nBytes )
+{
+	if ( nBytes < 0 || nBytes > m_nSize - m_nPos )
+		return false;
+
+	V_memcpy( pOut, m_pBase + m_nPos, nBytes );
+	m_nPos += nBytes;
+	return true;
+}
+
+bool CDemoFileReader::ReadInt( int &nValue )
+{
+	if ( !Read( &nValue, sizeof( nValue ) ) )
+		return false;
+
+	nValue = LittleDWord( nValue );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Points the command at its length prefixed payload without copying
+//-----------------------------------------------------------------------------
+bool CDemoFileReader::ReadPayload( DemoCommand_t &cmd )
+{
+	int nLength;
+	if ( !ReadInt( nLength ) )
+		return false;
+
+	if ( nLength < 0 || nLength > DEMOREADER_MAX_PAYLOAD || nLength > m_nSize - m_nPos )
+		return false;
+
+	cmd.m_pData = m_pBase + m_nPos;
+	cmd.m_nDataLength = nLength;
+	m_nPos += nLength;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the next command the same way the engine's demo player
+//			does, but leaves the payload in place
+//-----------------------------------------------------------------------------
+bool CDemoFileReader::NextCommand( DemoCommand_t &cmd )
+{
+	if ( !IsOpen() || m_bStopped || m_bCorrupt )
+		return false;
+
+	// A clean end of file without dem_stop just ends the demo
+	if ( m_nPos >= m_nSize )
+	{
+		m_bStopped = true;
+		return false;
+	}
+
+	cmd.m_nFileOffset = m_nPos;
+	cmd.m_nTick = 0;
+	cmd.m_nSequenceIn = 0;
+	cmd.m_nSequenceOut = 0;
+	cmd.m_nUserCmdSequence = 0;
+	cmd.m_pData = NULL;
+	cmd.m_nDataLength = 0;
+
+	byte nCommand;
+	if ( !Read( &nCommand, 1 ) )
+	{
+		m_bCorrupt = true;
+		return false;
+	}
+
+	cmd.m_nCommand = ( nCommand == 0 ) ? dem_stop : nCommand;
+	if ( cmd.m_nCommand == dem_stop )
+	{
+		// The engine doesn't always get to write the tick
+		ReadInt( cmd.m_nTick );
+		m_bStopped = true;
+		return true;
+	}
+
+	bool bOk = ReadInt( cmd.m_nTick );
+	if ( bOk )
+	{
+		switch ( cmd.m_nCommand )
+		{
+		case dem_signon:
+		case dem_packet:
+			bOk = Read( &cmd.m_Info, sizeof( cmd.m_Info ) ) &&
+				ReadInt( cmd.m_nSequenceIn ) &&
+				ReadInt( cmd.m_nSequenceOut ) &&
+				ReadPayload( cmd );
+			break;
+
+		case dem_synctick:
+			break;
+
+		case dem_usercmd:
+			bOk = ReadInt( cmd.m_nUserCmdSequence ) && ReadPayload( cmd );
+			break;
+
+		case dem_consolecmd:
+		case dem_datatables:
+		case dem_stringtables:
+			bOk = ReadPayload( cmd );
+			break;
+
+		default:
+			bOk = false;
+			break;
+		}
+	}
+
+	if ( !bOk )
+	{
+		m_bCorrupt = true;
+		return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Parallel driver
+//-----------------------------------------------------------------------------
+struct DemoFileJob_t
+{
+	const char * const	*m_ppszFilenames;
+	int					m_nFiles;
+	IDemoFileVisitor	*m_pVisitor;
+	CInterlockedInt		m_nNextFile;
+	CInterlockedInt		m_nComplete;
+};
+
+static void ProcessDemoFile( DemoFileJob_t *pJob, CDemoFileReader &reader, int iDemo )
+{
+	const char *pszFilename = pJob->m_ppszFilenames[iDemo];
+	if ( !reader.Open( pszFilename ) )
+	{
+		pJob->m_pVisitor->OnDemoEnd( iDemo, false );
+		return;
+	}
+
+	bool bComplete = pJob->m_pVisitor->OnDemoStart( iDemo, pszFilename, reader.GetHeader() );
+	if ( bComplete )
+	{
+		DemoCommand_t cmd;
+		while ( reader.NextCommand( cmd ) )
+		{
+			if ( !pJob->m_pVisitor->OnCommand( iDemo, cmd ) )
+			{
+				bComplete = false;
+				break;
+			}
+		}
+
+		bComplete = bComplete && !reader.IsCorrupt();
+	}
+
+	reader.Close();
+	pJob->m_pVisitor->OnDemoEnd( iDemo, bComplete );
+	if ( bComplete )
+	{
+		++pJob->m_nComplete;
+	}
+}
+
+static unsigned DemoFileWorkerThread( void *pParam )
+{
+	DemoFileJob_t *pJob = (DemoFileJob_t *)pParam;
+	CDemoFileReader reader;
+	for ( ;; )
+	{
+		int iDemo = ++pJob->m_nNextFile - 1;
+		if ( iDemo >= pJob->m_nFiles )
+			break;
+
+		ProcessDemoFile( pJob, reader, iDemo );
+	}
+	return 0;
+}
+
+int DemoFile_ProcessParallel( const char * const *ppszFilenames, int nFiles, IDemoFileVisitor *pVisitor, int nThreads )
+{
+	if ( nFiles <= 0 || !pVisitor )
+		return 0;
+
+	DemoFileJob_t job;
+	job.m_ppszFilenames = ppszFilenames;
+	job.m_nFiles = nFiles;
+	job.m_pVisitor = pVisitor;
+
+	nThreads = clamp( nThreads, 1, nFiles );
+
+	// The calling thread is one of the workers
+	CUtlVector< ThreadHandle_t > threads;
+	for ( int i = 1; i < nThreads; ++i )
+	{
+		ThreadHandle_t hThread = CreateSimpleThread( DemoFileWorkerThread, &job );
+		if ( hThread )
+		{
+			threads.AddToTail( hThread );
+		}
+	}
+
+	DemoFileWorkerThread( &job );
+
+	for ( int i = 0; i < threads.Count(); ++i )
+	{
+		ThreadJoin( threads[i] );
+		ReleaseThreadHandle( threads[i] );
+	}
+
+	return job.m_nComplete;
+}
@@ -12,6 +12,7 @@
 #include "mathlib/vector.h"
 #include "tier0/dbg.h"
 #include "dt_utlvector_common.h"
+#include "tier1/utlmap.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -878,4 +879,305 @@ void SendTable::Construct( SendProp *pProps, int nProps, const char *pNetTableNa
 	m_bHasPropsEncodedAgainstCurrentTickCount = false;
 }
 
+
+// ---------------------------------------------------------------------- //
+// CSendTableEncodePlan
+// ---------------------------------------------------------------------- //
+
+// Runs separated by no more than this much padding are compared as one.
+#define ENCODEPLAN_MAX_RUN_GAP	8
+
+// Returns how many bytes a standard var proxy reads, or 0 if the proxy
+// isn't one whose output depends only on those bytes.
+static int GetPlainProxySize( SendVarProxyFn fn )
+{
+	if ( fn == SendProxy_Int8ToInt32 || fn == SendProxy_UInt8ToInt32 )
+		return 1;
+
+	if ( fn == SendProxy_Int16ToInt32 || fn == SendProxy_UInt16ToInt32 )
+		return 2;
+
+	if ( fn == SendProxy_Int32ToInt32 || fn == SendProxy_UInt32ToInt32 ||
+		 fn == SendProxy_FloatToFloat || fn == SendProxy_AngleToFloat )
+		return 4;
+
+#ifdef SUPPORTS_INT64
+	if ( fn == SendProxy_Int64ToInt64 || fn == SendProxy_UInt64ToInt64 )
+		return 8;
+#endif
+
+	if ( fn == SendProxy_VectorXYToVectorXY )
+		return 2 * sizeof( float );
+
+	if ( fn == SendProxy_VectorToVector || fn == SendProxy_QAngles )
+		return 3 * sizeof( float );
+
+	return 0;
+}
+
+// Datatable proxies that hand back the struct they were given (or NULL to
+// hide it from some clients), so the child table's props live in the entity.
+static bool IsPassThroughTableProxy( SendTableProxyFn fn )
+{
+	if ( fn == SendProxy_DataTableToDataTable || fn == SendProxy_SendLocalDataTable )
+		return true;
+
+	for ( CNonModifiedPointerProxy *pCur = s_pNonModifiedPointerProxyHead; pCur; pCur = pCur->m_pNext )
+	{
+		if ( pCur->m_Fn == fn )
+			return true;
+	}
+
+	return false;
+}
+
+CSendTableEncodePlan::CSendTableEncodePlan( SendTable *pTable )
+{
+	m_bValid = true;
+	m_nShadowSize = 0;
+
+	AddExcludes_R( pTable );
+	AddProps_R( pTable, 0 );
+	m_Excludes.Purge();
+
+	if ( !m_bValid )
+	{
+		m_Props.Purge();
+		m_VolatileOffsets.Purge();
+		return;
+	}
+
+	BuildRuns();
+}
+
+void CSendTableEncodePlan::AddExcludes_R( SendTable *pTable )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		const SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() )
+		{
+			m_Excludes.AddToTail( pProp );
+		}
+		else if ( pProp->GetType() == DPT_DataTable && pProp->GetDataTable() )
+		{
+			AddExcludes_R( pProp->GetDataTable() );
+		}
+	}
+}
+
+bool CSendTableEncodePlan::IsExcluded( SendTable *pTable, const SendProp *pProp ) const
+{
+	for ( int i = 0; i < m_Excludes.Count(); i++ )
+	{
+		const SendProp *pExclude = m_Excludes[i];
+		if ( !Q_stricmp( pExclude->GetExcludeDTName(), pTable->GetName() ) &&
+			 !Q_stricmp( pExclude->GetName(), pProp->GetName() ) )
+			return true;
+	}
+
+	return false;
+}
+
+void CSendTableEncodePlan::AddProps_R( SendTable *pTable, int nBaseOffset )
+{
+	for ( int i = 0; i < pTable->GetNumProps() && m_bValid; i++ )
+	{
+		const SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() || IsExcluded( pTable, pProp ) )
+			continue;
+
+		// SENDINFO_VECTORELEM offsets stay negative until the engine sets the table up
+		bool bVectorElem = ( pProp->GetOffset() < 0 ) || ( pProp->GetFlags() & SPROP_IS_A_VECTOR_ELEM );
+		int nOffset = nBaseOffset + abs( pProp->GetOffset() );
+
+		if ( pProp->GetType() == DPT_DataTable )
+		{
+			if ( !pProp->GetDataTable() )
+				continue;
+
+			if ( !IsPassThroughTableProxy( pProp->GetDataTableProxyFn() ) )
+			{
+				m_bValid = false;
+				return;
+			}
+
+			AddProps_R( pProp->GetDataTable(), nOffset );
+			continue;
+		}
+
+		// Old style arrays are encoded through a length proxy
+		if ( pProp->GetType() == DPT_Array || pProp->IsInsideArray() )
+		{
+			m_bValid = false;
+			return;
+		}
+
+		// The engine tracks changes with 16 bit offsets
+		if ( nOffset > 0xFFFF )
+		{
+			m_bValid = false;
+			return;
+		}
+
+		// A vector element's changes are reported against the whole network
+		// vector, so it always counts as changed, under both its own offset
+		// and the vector's
+		if ( bVectorElem )
+		{
+			const char *pszIndex = V_strrchr( pProp->GetName(), '[' );
+			int nVectorOffset = pszIndex ? nOffset - atoi( pszIndex + 1 ) * (int)sizeof( float ) : nOffset;
+			AddVolatileOffset( nOffset );
+			AddVolatileOffset( MAX( nVectorOffset, 0 ) );
+			continue;
+		}
+
+		int nSize = GetPlainProxySize( pProp->GetProxyFn() );
+		if ( nSize )
+		{
+			PlanProp_t &prop = m_Props[ m_Props.AddToTail() ];
+			prop.m_nOffset = (unsigned short)nOffset;
+			prop.m_nSize = (unsigned short)nSize;
+		}
+		else
+		{
+			AddVolatileOffset( nOffset );
+		}
+	}
+}
+
+void CSendTableEncodePlan::AddVolatileOffset( int nOffset )
+{
+	if ( m_VolatileOffsets.Find( (unsigned short)nOffset ) == m_VolatileOffsets.InvalidIndex() )
+	{
+		m_VolatileOffsets.AddToTail( (unsigned short)nOffset );
+	}
+}
+
+int __cdecl CSendTableEncodePlan::SortPropsByOffset( const PlanProp_t *a, const PlanProp_t *b )
+{
+	if ( a->m_nOffset != b->m_nOffset )
+		return (int)a->m_nOffset - (int)b->m_nOffset;
+
+	return (int)a->m_nSize - (int)b->m_nSize;
+}
+
+void CSendTableEncodePlan::BuildRuns()
+{
+	m_Props.Sort( SortPropsByOffset );
+
+	for ( int i = 0; i < m_Props.Count(); i++ )
+	{
+		const PlanProp_t &prop = m_Props[i];
+		int nEnd = prop.m_nOffset + prop.m_nSize;
+
+		if ( m_Runs.Count() )
+		{
+			PlanRun_t &run = m_Runs.Tail();
+			int nRunEnd = run.m_nOffset + run.m_nSize;
+			if ( prop.m_nOffset <= nRunEnd + ENCODEPLAN_MAX_RUN_GAP )
+			{
+				if ( nEnd > nRunEnd )
+				{
+					m_nShadowSize += nEnd - nRunEnd;
+					run.m_nSize = nEnd - run.m_nOffset;
+				}
+				run.m_nProps++;
+				continue;
+			}
+		}
+
+		PlanRun_t &run = m_Runs[ m_Runs.AddToTail() ];
+		run.m_nOffset = prop.m_nOffset;
+		run.m_nShadowOffset = m_nShadowSize;
+		run.m_nSize = prop.m_nSize;
+		run.m_iFirstProp = i;
+		run.m_nProps = 1;
+		m_nShadowSize += prop.m_nSize;
+	}
+}
+
+void CSendTableEncodePlan::CopyToShadow( const void *pStruct, void *pShadow ) const
+{
+	for ( int i = 0; i < m_Runs.Count(); i++ )
+	{
+		const PlanRun_t &run = m_Runs[i];
+		memcpy( (char*)pShadow + run.m_nShadowOffset, (const char*)pStruct + run.m_nOffset, run.m_nSize );
+	}
+}
+
+int CSendTableEncodePlan::FindChangedOffsets( const void *pStruct, const void *pShadow, unsigned short *pOffsets, int nMaxOffsets ) const
+{
+	if ( m_VolatileOffsets.Count() > nMaxOffsets )
+		return -1;
+
+	int nOffsets = m_VolatileOffsets.Count();
+	memcpy( pOffsets, m_VolatileOffsets.Base(), nOffsets * sizeof( unsigned short ) );
+
+	for ( int i = 0; i < m_Runs.Count(); i++ )
+	{
+		const PlanRun_t &run = m_Runs[i];
+		const char *pCur = (const char*)pStruct + run.m_nOffset;
+		const char *pOld = (const char*)pShadow + run.m_nShadowOffset;
+
+		// Nearly every run is unchanged, so only look at the props of the ones that aren't
+		if ( !memcmp( pCur, pOld, run.m_nSize ) )
+			continue;
+
+		int nLastOffset = -1;
+		for ( int j = run.m_iFirstProp; j < run.m_iFirstProp + run.m_nProps; j++ )
+		{
+			const PlanProp_t &prop = m_Props[j];
+			int nDelta = prop.m_nOffset - run.m_nOffset;
+			if ( prop.m_nOffset == nLastOffset || !memcmp( pCur + nDelta, pOld + nDelta, prop.m_nSize ) )
+				continue;
+
+			if ( nOffsets >= nMaxOffsets )
+				return -1;
+
+			pOffsets[nOffsets++] = prop.m_nOffset;
+			nLastOffset = prop.m_nOffset;
+		}
+	}
+
+	return nOffsets;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Plans are built once per table and live as long as the tables do
+//-----------------------------------------------------------------------------
+class CSendTableEncodePlanCache
+{
+public:
+	CSendTableEncodePlanCache() : m_Plans( DefLessFunc( SendTable * ) ) {}
+	~CSendTableEncodePlanCache()
+	{
+		FOR_EACH_MAP_FAST( m_Plans, i )
+		{
+			delete m_Plans[i];
+		}
+	}
+
+	CSendTableEncodePlan *GetPlan( SendTable *pTable )
+	{
+		int i = m_Plans.Find( pTable );
+		if ( i == m_Plans.InvalidIndex() )
+		{
+			i = m_Plans.Insert( pTable, new CSendTableEncodePlan( pTable ) );
+		}
+
+		return m_Plans[i]->IsValid() ? m_Plans[i] : NULL;
+	}
+
+private:
+	CUtlMap< SendTable *, CSendTableEncodePlan * > m_Plans;
+};
+
+static CSendTableEncodePlanCache g_SendTableEncodePlans;
+
+CSendTableEncodePlan* SendTable_GetEncodePlan( SendTable *pTable )
+{
+	return g_SendTableEncodePlans.GetPlan( pTable );
+}
+
 #endif
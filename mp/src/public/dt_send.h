@@ -17,6 +17,7 @@
 #include "tier0/dbg.h"
 #include "const.h"
 #include "bitvec.h"
+#include "tier1/utlvector.h"
 
 
 // ------------------------------------------------------------------------ //
@@ -805,4 +806,73 @@ SendProp SendPropExclude(
 	);
 
 
+// ------------------------------------------------------------------------ //
+// Encode plans.
+//
+// A plan flattens a SendTable the way the engine does and sorts its props
+// by what they need to find out whether they changed. Props read straight
+// from the entity by one of the standard proxies are merged into runs of
+// adjacent memory that can be compared against a shadow copy of the last
+// sent state in bulk. Props with any other proxy, and SENDINFO_VECTORELEM
+// props, can't be checked that way and always count as changed.
+// ------------------------------------------------------------------------ //
+class CSendTableEncodePlan
+{
+public:
+	CSendTableEncodePlan( SendTable *pTable );
+
+	// Tables behind a pointer, a custom datatable proxy or a variable length
+	// array have no plan.
+	bool		IsValid() const			{ return m_bValid; }
+
+	// Bytes of shadow state needed per entity.
+	int			GetShadowSize() const	{ return m_nShadowSize; }
+
+	// Number of props that are always reported as changed.
+	int			GetNumVolatileProps() const	{ return m_VolatileOffsets.Count(); }
+
+	void		CopyToShadow( const void *pStruct, void *pShadow ) const;
+
+	// Writes the offsets of the props that differ from the shadow, volatile
+	// props included, into pOffsets. Returns how many there were, or -1 if
+	// there were more than nMaxOffsets.
+	int			FindChangedOffsets( const void *pStruct, const void *pShadow, unsigned short *pOffsets, int nMaxOffsets ) const;
+
+private:
+	struct PlanProp_t
+	{
+		unsigned short	m_nOffset;		// from the start of the entity
+		unsigned short	m_nSize;
+	};
+
+	struct PlanRun_t
+	{
+		int		m_nOffset;
+		int		m_nShadowOffset;
+		int		m_nSize;
+		int		m_iFirstProp;
+		int		m_nProps;
+	};
+
+	void		AddExcludes_R( SendTable *pTable );
+	bool		IsExcluded( SendTable *pTable, const SendProp *pProp ) const;
+	void		AddProps_R( SendTable *pTable, int nBaseOffset );
+	void		AddVolatileOffset( int nOffset );
+	void		BuildRuns();
+
+	static int __cdecl SortPropsByOffset( const PlanProp_t *a, const PlanProp_t *b );
+
+	bool					m_bValid;
+	int						m_nShadowSize;
+	CUtlVector< const SendProp* >	m_Excludes;
+	CUtlVector< PlanProp_t >		m_Props;
+	CUtlVector< PlanRun_t >			m_Runs;
+	CUtlVector< unsigned short >	m_VolatileOffsets;
+};
+
+// Returns the plan for a table, building it on first use, or NULL if the
+// table can't have one.
+CSendTableEncodePlan* SendTable_GetEncodePlan( SendTable *pTable );
+
+
 #endif // DATATABLE_SEND_H
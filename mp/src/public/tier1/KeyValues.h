@@ -24,6 +24,7 @@
 
 #include "utlvector.h"
 #include "Color.h"
+#include "checksum_crc.h"
 
 #define FOR_EACH_SUBKEY( kvRoot, kvSubKey ) \
 	for ( KeyValues * kvSubKey = kvRoot->GetFirstSubKey(); kvSubKey != NULL; kvSubKey = kvSubKey->GetNextKey() )
@@ -39,6 +40,7 @@ class CUtlBuffer;
 class Color;
 typedef void * FileHandle_t;
 class CKeyValuesGrowableStringTable;
+struct KeyValuesChildIndex_t;
 
 //-----------------------------------------------------------------------------
 // Purpose: Simple recursive data access class
@@ -216,6 +218,13 @@ public:
 	bool WriteAsBinary( CUtlBuffer &buffer );
 	bool ReadAsBinary( CUtlBuffer &buffer, int nStackDepth = 0 );
 
+	// Compact binary form kept next to text files when -keyvalues_compiled is
+	// on (see LoadFromFile). Key names are stored once per file. ReadAsCompiled
+	// fails unless the text it came from had this size and CRC, and the same
+	// [$WIN32] style conditionals held where it was written.
+	bool WriteAsCompiled( CUtlBuffer &buffer, int nTextSize, CRC32_t textCRC );
+	bool ReadAsCompiled( CUtlBuffer &buffer, int nTextSize, CRC32_t textCRC );
+
 	// Allocate & create a new copy of the keys
 	KeyValues *MakeCopy( void ) const;
 
@@ -290,6 +299,20 @@ private:
 	void WriteConvertedString( IBaseFileSystem *filesystem, FileHandle_t f, CUtlBuffer *pBuf, const char *pszString );
 	
 	void RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &buf );
+	static KeyValues *ReadCompiledPeers( CUtlBuffer &buffer, const CUtlVector< int > &symbols, int nFlags, int nStackDepth );
+
+	// Hashed child lookup for nodes with many children. The index lives in a
+	// side table so the class layout stays compatible with the engine's.
+	KeyValuesChildIndex_t *GetChildIndex( KeyValues *pExpectedLast ) const;
+	bool ChildIndexMatchesList( KeyValuesChildIndex_t *pIndex ) const;
+	bool FindKeyInChildIndex( int keySymbol, KeyValues *&pFound ) const;
+	void BuildChildIndex() const;
+	void DestroyChildIndex( KeyValuesChildIndex_t *pExpected = NULL, bool bShared = false ) const;
+	void ReleaseChildIndex( KeyValuesChildIndex_t *pIndex ) const;
+	void InvalidateParentChildIndex() const;
+	void LinkSubKey( KeyValues *pSubkey, KeyValues *pLastChild );
+	void LinkSubKeyToList( KeyValues *pSubkey, KeyValues *pLastChild );
+	void UnlinkSubKey( KeyValues *pSubkey, KeyValues *pPrevChild );
 
 	// For handling #include "filename"
 	void AppendIncludedKeys( CUtlVector< KeyValues * >& includedKeys );
@@ -328,7 +351,7 @@ private:
 	char	   m_iDataType;
 	char	   m_bHasEscapeSequences; // true, if while parsing this KeyValue, Escape Sequences are used (default false)
 	char	   m_bEvaluateConditionals; // true, if while parsing this KeyValue, conditionals blocks are evaluated (default true)
-	char	   unused[1];
+	mutable char m_nChildIndexFlags; // KEYVALUES_INDEX_* bits, this used to be unused padding
 
 	KeyValues *m_pPeer;	// pointer to next key in list
 	KeyValues *m_pSub;	// pointer to Start of a new sub key list
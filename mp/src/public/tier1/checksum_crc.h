@@ -17,6 +17,9 @@ void CRC32_ProcessBuffer( CRC32_t *pulCRC, const void *p, int len );
 void CRC32_Final( CRC32_t *pulCRC );
 CRC32_t	CRC32_GetTableEntry( unsigned int slot );
 
+// Which CRC32_ProcessBuffer is using on this CPU, for benchmarks and logging
+const char *CRC32_GetImplementationName();
+
 inline CRC32_t CRC32_ProcessSingleBuffer( const void *p, int len )
 {
 	CRC32_t crc;
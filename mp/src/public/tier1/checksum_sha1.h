@@ -108,6 +108,10 @@ private:
 
 #define GenerateHash( hash, pubData, cubData ) { CSHA1 sha1; sha1.Update( (byte *)pubData, cubData ); sha1.Final(); sha1.GetHash( hash ); } 
 
+// Hashes each of nBuffers separate buffers, several at a time where the CPU
+// has the SIMD for it. pDigests[i] is the hash of ppBuffers[i].
+void SHA1_ProcessMultipleBuffers( const void * const *ppBuffers, const unsigned int *pnLengths, int nBuffers, SHADigest_t *pDigests );
+
 #if !defined(_MINIMUM_BUILD_)
 // hash comparison function, for use with CUtlMap/CUtlRBTree
 bool HashLessFunc( SHADigest_t const &lhs, SHADigest_t const &rhs );
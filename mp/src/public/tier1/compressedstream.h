@@ -0,0 +1,180 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Framed block compression over CUtlBuffers and file handles.
+//
+// A stream is a header naming the codec and the block size, then one frame
+// per block: the block's raw size and the size of what follows, then the
+// block compressed on its own. Blocks that don't shrink are stored as they
+// are. A frame with a raw size of zero ends the stream.
+//
+// Blocks don't reference each other, so the writer and reader never hold
+// more than a block however long the stream runs, and a stream that's all
+// in memory can be compressed or decompressed across the thread pool. When
+// the destination or source is a CUtlBuffer, frames are encoded straight
+// into it and decoded straight out of it, with no staging copy.
+//
+//===========================================================================//
+
+#ifndef COMPRESSEDSTREAM_H
+#define COMPRESSEDSTREAM_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlmemory.h"
+
+class CUtlBuffer;
+class IBaseFileSystem;
+typedef void * FileHandle_t;
+
+enum CompressedStreamCodec_t
+{
+	COMPRESSEDSTREAM_CODEC_STORE = 0,
+	COMPRESSEDSTREAM_CODEC_LZSS,
+	COMPRESSEDSTREAM_CODEC_SNAPPY,
+
+	COMPRESSEDSTREAM_CODEC_COUNT,
+};
+
+#define COMPRESSEDSTREAM_ID						uint32( BigLong( ('C'<<24)|('S'<<16)|('T'<<8)|('M') ) )
+#define COMPRESSEDSTREAM_VERSION				1
+#define COMPRESSEDSTREAM_DEFAULT_BLOCK_SIZE		( 64 * 1024 )
+#define COMPRESSEDSTREAM_MAX_BLOCK_SIZE			( 16 * 1024 * 1024 )
+
+// All fields are little endian
+struct CompressedStreamHeader_t
+{
+	uint32	m_nId;
+	uint8	m_nVersion;
+	uint8	m_nCodec;
+	uint16	m_nReserved;
+	uint32	m_nBlockSize;
+};
+
+#define COMPRESSEDSTREAM_FRAME_STORED			0x80000000	// in m_nPayloadSize: the block follows uncompressed
+
+struct CompressedStreamFrame_t
+{
+	uint32	m_nSize;			// raw bytes in the block, 0 ends the stream
+	uint32	m_nPayloadSize;		// bytes following the frame header
+};
+
+const char *CompressedStreamCodecName( CompressedStreamCodec_t codec );
+
+// Largest frame, header included, a block of nSize bytes can take
+int CompressedStreamMaxFrameSize( CompressedStreamCodec_t codec, int nSize );
+
+
+//-----------------------------------------------------------------------------
+// Writes a stream a piece at a time. Data is staged until a block fills,
+// except whole blocks written while nothing is staged, which are compressed
+// from the caller's memory. Nothing is complete until Finish()
+//-----------------------------------------------------------------------------
+class CCompressedStreamWriter
+{
+public:
+	// Appends to the buffer's put position
+	CCompressedStreamWriter( CUtlBuffer &out, CompressedStreamCodec_t codec = COMPRESSEDSTREAM_CODEC_SNAPPY, int nBlockSize = COMPRESSEDSTREAM_DEFAULT_BLOCK_SIZE );
+
+	// Writes at the file's position
+	CCompressedStreamWriter( IBaseFileSystem *pFileSystem, FileHandle_t hFile, CompressedStreamCodec_t codec = COMPRESSEDSTREAM_CODEC_SNAPPY, int nBlockSize = COMPRESSEDSTREAM_DEFAULT_BLOCK_SIZE );
+
+	~CCompressedStreamWriter();
+
+	bool Write( const void *pData, int nBytes );
+
+	// Flushes the last block and ends the stream
+	bool Finish();
+
+	bool IsValid() const		{ return !m_bError; }
+	int64 GetBytesIn() const	{ return m_nBytesIn; }
+	int64 GetBytesOut() const	{ return m_nBytesOut; }
+
+	// Staging memory held, which doesn't grow with the stream
+	int GetMemoryUsed() const;
+
+private:
+	void Init( CompressedStreamCodec_t codec, int nBlockSize );
+	bool Emit( const void *pData, int nBytes );
+	bool WriteBlock( const byte *pData, int nBytes );
+
+	CUtlBuffer *m_pBuffer;
+	IBaseFileSystem *m_pFileSystem;
+	FileHandle_t m_hFile;
+
+	CompressedStreamCodec_t m_Codec;
+	int m_nBlockSize;
+	CUtlMemory< byte > m_Block;			// partial block
+	int m_nBlockUsed;
+	CUtlMemory< byte > m_Frame;			// encoded frame, file output only
+
+	int64 m_nBytesIn;
+	int64 m_nBytesOut;
+	bool m_bFinished;
+	bool m_bError;
+};
+
+
+//-----------------------------------------------------------------------------
+// Reads a stream a block at a time. Blocks stored uncompressed in a
+// CUtlBuffer are handed back in place
+//-----------------------------------------------------------------------------
+class CCompressedStreamReader
+{
+public:
+	// Reads from the buffer's get position, which follows the frames consumed
+	CCompressedStreamReader( CUtlBuffer &in );
+
+	// Reads from the file's position
+	CCompressedStreamReader( IBaseFileSystem *pFileSystem, FileHandle_t hFile );
+
+	// The next block of raw data, good until the next call. NULL at the end
+	// of the stream or on a bad frame; IsValid() tells which
+	const void *NextBlock( int *pnBytes );
+
+	// Copies out up to nBytes, returning how many were read
+	int Read( void *pDest, int nBytes );
+
+	// Decodes the rest of the stream onto the buffer's put position
+	bool ReadAll( CUtlBuffer &out );
+
+	bool IsValid() const		{ return !m_bError; }
+	bool IsEnd() const			{ return m_bEnd; }
+	CompressedStreamCodec_t GetCodec() const	{ return m_Codec; }
+	int GetBlockSize() const	{ return m_nBlockSize; }
+
+	int GetMemoryUsed() const;
+
+private:
+	void Init();
+	bool ReadHeader();
+	bool ReadFrame( CompressedStreamFrame_t &frame, const byte **ppPayload );
+
+	CUtlBuffer *m_pBuffer;
+	IBaseFileSystem *m_pFileSystem;
+	FileHandle_t m_hFile;
+
+	CompressedStreamCodec_t m_Codec;
+	int m_nBlockSize;
+	CUtlMemory< byte > m_Block;			// decoded block
+	CUtlMemory< byte > m_Frame;			// payload read from a file
+
+	const byte *m_pCurrent;				// what Read() is working through
+	int m_nCurrentSize;
+	int m_nCurrentPos;
+
+	bool m_bEnd;
+	bool m_bError;
+};
+
+
+//-----------------------------------------------------------------------------
+// Whole buffers, with the blocks spread across the thread pool. Output goes
+// onto out's put position and matches what the streaming classes produce
+//-----------------------------------------------------------------------------
+bool CompressStreamParallel( CUtlBuffer &in, CUtlBuffer &out, CompressedStreamCodec_t codec = COMPRESSEDSTREAM_CODEC_SNAPPY, int nBlockSize = COMPRESSEDSTREAM_DEFAULT_BLOCK_SIZE );
+bool DecompressStreamParallel( CUtlBuffer &in, CUtlBuffer &out );
+
+
+#endif // COMPRESSEDSTREAM_H
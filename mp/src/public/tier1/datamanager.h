@@ -247,6 +247,242 @@ private:
 	MUTEX_TYPE m_mutex;
 };
 
+//-----------------------------------------------------------------------------
+// A CDataManager split into NUM_SHARDS independently locked managers, each
+// with its own LRU and an equal share of the target size. New resources are
+// spread across the shards round robin and the handle records which shard
+// owns it, so lookups from different threads only contend when they hit the
+// same shard. Handles are still serial checked: a stale handle fails the
+// lookup instead of returning a recycled resource.
+//
+// Eviction is per shard, so the LRU order is only approximate across the
+// whole set. Each shard can hold at most MAX_SHARD_HANDLES resources.
+//-----------------------------------------------------------------------------
+template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, int NUM_SHARDS = 8 >
+class CDataManagerSharded
+{
+public:
+	typedef CDataManager< STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, CThreadFastMutex > Shard_t;
+
+	enum
+	{
+		MAX_SHARD_HANDLES = 0xFFFE / NUM_SHARDS,
+	};
+
+	CDataManagerSharded( unsigned int size = (unsigned)-1 )
+	{
+		COMPILE_TIME_ASSERT( NUM_SHARDS > 1 && NUM_SHARDS <= 256 );
+		SetTargetSize( size );
+	}
+
+	memhandle_t CreateResource( const CREATE_PARAMS &createParams, bool bCreateLocked = false )
+	{
+		int iShard = (unsigned)( ++m_nNextShard ) % NUM_SHARDS;
+		Shard_t &shard = m_Shards[iShard];
+
+		// Hold the shard across the whole create so the new index can be checked
+		AUTO_LOCK( shard.AccessMutex() );
+		memhandle_t hShard = shard.CreateResource( createParams, bCreateLocked );
+		unsigned int nIndex = ( (unsigned int)hShard & 0xFFFF ) - 1;
+		if ( nIndex >= MAX_SHARD_HANDLES )
+		{
+			AssertMsg( 0, "CDataManagerSharded: shard is full\n" );
+			if ( bCreateLocked )
+			{
+				shard.BreakLock( hShard );
+			}
+			shard.DestroyResource( hShard );
+			return INVALID_MEMHANDLE;
+		}
+
+		unsigned int nSerial = (unsigned int)hShard & 0xFFFF0000;
+		return (memhandle_t)( nSerial | ( nIndex * NUM_SHARDS + iShard + 1 ) );
+	}
+
+	LOCK_TYPE LockResource( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		return ( iShard < 0 ) ? NULL : m_Shards[iShard].LockResource( hShard );
+	}
+
+	LOCK_TYPE GetResource_NoLock( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		return ( iShard < 0 ) ? NULL : m_Shards[iShard].GetResource_NoLock( hShard );
+	}
+
+	LOCK_TYPE GetResource_NoLockNoLRUTouch( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		return ( iShard < 0 ) ? NULL : m_Shards[iShard].GetResource_NoLockNoLRUTouch( hShard );
+	}
+
+	void DestroyResource( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		if ( iShard >= 0 )
+		{
+			m_Shards[iShard].DestroyResource( hShard );
+		}
+	}
+
+	int UnlockResource( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		return ( iShard < 0 ) ? 0 : m_Shards[iShard].UnlockResource( hShard );
+	}
+
+	void TouchResource( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		if ( iShard >= 0 )
+		{
+			m_Shards[iShard].TouchResource( hShard );
+		}
+	}
+
+	void MarkAsStale( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		if ( iShard >= 0 )
+		{
+			m_Shards[iShard].MarkAsStale( hShard );
+		}
+	}
+
+	int LockCount( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		return ( iShard < 0 ) ? 0 : m_Shards[iShard].LockCount( hShard );
+	}
+
+	int BreakLock( memhandle_t hMem )
+	{
+		int iShard;
+		memhandle_t hShard = ToShardHandle( hMem, iShard );
+		return ( iShard < 0 ) ? 0 : m_Shards[iShard].BreakLock( hShard );
+	}
+
+	int BreakAllLocks()
+	{
+		int nBroken = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nBroken += m_Shards[i].BreakAllLocks();
+		}
+		return nBroken;
+	}
+
+	unsigned int TargetSize()
+	{
+		unsigned int nSize = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nSize += m_Shards[i].TargetSize();
+		}
+		return nSize;
+	}
+
+	unsigned int AvailableSize()
+	{
+		unsigned int nSize = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nSize += m_Shards[i].AvailableSize();
+		}
+		return nSize;
+	}
+
+	unsigned int UsedSize()
+	{
+		unsigned int nSize = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nSize += m_Shards[i].UsedSize();
+		}
+		return nSize;
+	}
+
+	void SetTargetSize( unsigned int targetSize )
+	{
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			m_Shards[i].SetTargetSize( targetSize / NUM_SHARDS );
+		}
+	}
+
+	unsigned int FlushAllUnlocked()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nFlushed += m_Shards[i].FlushAllUnlocked();
+		}
+		return nFlushed;
+	}
+
+	unsigned int FlushToTargetSize()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nFlushed += m_Shards[i].FlushToTargetSize();
+		}
+		return nFlushed;
+	}
+
+	unsigned int FlushAll()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nFlushed += m_Shards[i].FlushAll();
+		}
+		return nFlushed;
+	}
+
+	unsigned int Purge( unsigned int nBytesToPurge )
+	{
+		unsigned int nPurged = 0;
+		for ( int i = 0; i < NUM_SHARDS; ++i )
+		{
+			nPurged += m_Shards[i].Purge( nBytesToPurge / NUM_SHARDS );
+		}
+		return nPurged;
+	}
+
+	// Iteration and debugging go through the shards. Lock the shard first.
+	int GetNumShards() const		{ return NUM_SHARDS; }
+	Shard_t &AccessShard( int i )	{ return m_Shards[i]; }
+
+private:
+	// Returns the shard's own handle and sets iShard, or sets iShard to -1
+	static memhandle_t ToShardHandle( memhandle_t hMem, int &iShard )
+	{
+		unsigned int fullWord = (unsigned int)hMem;
+		unsigned int nSlot = ( fullWord & 0xFFFF ) - 1;
+		if ( hMem == INVALID_MEMHANDLE || nSlot >= MAX_SHARD_HANDLES * NUM_SHARDS )
+		{
+			iShard = -1;
+			return INVALID_MEMHANDLE;
+		}
+
+		iShard = nSlot % NUM_SHARDS;
+		return (memhandle_t)( ( fullWord & 0xFFFF0000 ) | ( nSlot / NUM_SHARDS + 1 ) );
+	}
+
+	Shard_t			m_Shards[NUM_SHARDS];
+	CInterlockedInt	m_nNextShard;
+};
+
 //-----------------------------------------------------------------------------
 
 inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
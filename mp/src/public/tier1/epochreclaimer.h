@@ -0,0 +1,128 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Epoch based reclamation for lock-free readers.
+//
+// Readers bracket their accesses with EnterRead()/LeaveRead() (or a
+// CEpochReadGuard). Writers unlink an object so that new readers can't reach
+// it, then Retire() it. A retired object is freed once every reader that
+// might still hold a pointer to it has left.
+//
+// Reader counts are kept per epoch parity and striped by thread id over
+// separate cache lines, so entering and leaving never touch a line shared
+// by every reader. Retired objects wait on the parity they were retired in;
+// the epoch only advances once the readers of the previous one are gone, so
+// reclamation never blocks a reader or a writer.
+//
+//===========================================================================//
+
+#ifndef EPOCHRECLAIMER_H
+#define EPOCHRECLAIMER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+
+
+class CEpochReclaimer
+{
+public:
+	typedef void (*RetireFunc_t)( void *pObject, void *pContext );
+
+	CEpochReclaimer();
+	~CEpochReclaimer();
+
+	// Reads. Returns a token to hand back to LeaveRead()
+	int EnterRead() const;
+	void LeaveRead( int nToken ) const;
+
+	// Queues pObject to be freed with pfnFree once no reader can see it.
+	// The object must already be unreachable for readers entering from now on
+	void Retire( void *pObject, RetireFunc_t pfnFree, void *pContext = NULL );
+
+	// Frees what the readers have let go of and moves the epoch on if it can.
+	// Never waits; returns true if the epoch advanced
+	bool TryReclaim();
+
+	// Waits for every reader to leave and frees everything that's retired.
+	// Don't call this from inside a read
+	void ReclaimAll();
+
+	int NumRetired() const;
+
+private:
+	enum
+	{
+		READER_STRIPE_BITS = 4,
+		NUM_READER_STRIPES = ( 1 << READER_STRIPE_BITS ),
+		RECLAIM_THRESHOLD = 64,
+	};
+
+	struct ReaderCount_t
+	{
+		volatile int m_nCount;
+		byte m_Pad[ 128 - sizeof( int ) ];
+	};
+
+	struct Retired_t
+	{
+		void *m_pObject;
+		RetireFunc_t m_pfnFree;
+		void *m_pContext;
+	};
+
+	int CountReaders( int nParity ) const;
+	void FreeRetired( int nParity );
+
+	mutable ReaderCount_t m_Readers[ 2 * NUM_READER_STRIPES ];
+	volatile uint32 m_nEpoch;
+	mutable CThreadFastMutex m_Mutex;
+	CUtlVector< Retired_t > m_Retired[ 2 ];
+};
+
+
+//-----------------------------------------------------------------------------
+// Readers count themselves on a stripe picked by thread id, in the parity of
+// the epoch they saw. If the epoch moved on while they were doing so they
+// back out and retry, so a reader is only counted against an epoch that was
+// current after it had been counted
+//-----------------------------------------------------------------------------
+inline int CEpochReclaimer::EnterRead() const
+{
+	int nStripe = (int)( ( ThreadGetCurrentId() * 2654435761u ) >> ( 32 - READER_STRIPE_BITS ) );
+	for ( ;; )
+	{
+		uint32 nEpoch = m_nEpoch;
+		int nToken = ( nEpoch & 1 ) * NUM_READER_STRIPES + nStripe;
+		ThreadInterlockedIncrement( &m_Readers[ nToken ].m_nCount );
+		if ( m_nEpoch == nEpoch )
+			return nToken;
+
+		ThreadInterlockedDecrement( &m_Readers[ nToken ].m_nCount );
+	}
+}
+
+inline void CEpochReclaimer::LeaveRead( int nToken ) const
+{
+	ThreadInterlockedDecrement( &m_Readers[ nToken ].m_nCount );
+}
+
+
+//-----------------------------------------------------------------------------
+// Scoped read
+//-----------------------------------------------------------------------------
+class CEpochReadGuard
+{
+public:
+	CEpochReadGuard( const CEpochReclaimer &reclaimer ) : m_Reclaimer( reclaimer ), m_nToken( reclaimer.EnterRead() ) {}
+	~CEpochReadGuard() { m_Reclaimer.LeaveRead( m_nToken ); }
+
+private:
+	const CEpochReclaimer &m_Reclaimer;
+	int m_nToken;
+};
+
+
+#endif // EPOCHRECLAIMER_H
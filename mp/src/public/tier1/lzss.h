@@ -31,6 +31,7 @@ public:
 	unsigned int	Uncompress( const unsigned char *pInput, unsigned char *pOutput );
 	//unsigned int	Uncompress( unsigned char *pInput, CUtlBuffer &buf );
 	unsigned int	SafeUncompress( const unsigned char *pInput, unsigned char *pOutput, unsigned int unBufSize );
+	unsigned int	SafeUncompress( const unsigned char *pInput, unsigned int unInputSize, unsigned char *pOutput, unsigned int unBufSize );
 
 	static bool			IsCompressed( const unsigned char *pInput );
 	static unsigned int	GetActualSize( const unsigned char *pInput );
@@ -0,0 +1,1183 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: An ordered map with the same interface as CUtlMap, stored as a
+//			B+ tree of wide nodes instead of a red-black tree.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef UTLBTREEMAP_H
+#define UTLBTREEMAP_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/dbg.h"
+#include "tier1/utlmap.h"
+#include "tier1/utlvector.h"
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#include <emmintrin.h>
+#define UTLBTREEMAP_SIMD
+#endif
+
+//-----------------------------------------------------------------------------
+// Key types whose nodes can be searched with SSE2 when the map uses the
+// default less func
+//-----------------------------------------------------------------------------
+template < typename K >
+struct UtlBTreeMapKeyTraits_t
+{
+	enum { SIMD_SEARCH = 0, SIMD_UNSIGNED = 0 };
+	static bool (*DefaultLessFunc())( const K &, const K & ) { return NULL; }
+};
+
+template <>
+struct UtlBTreeMapKeyTraits_t< int >
+{
+	enum { SIMD_SEARCH = 1, SIMD_UNSIGNED = 0 };
+	static bool (*DefaultLessFunc())( const int &, const int & ) { return DefLessFunc( int ); }
+};
+
+template <>
+struct UtlBTreeMapKeyTraits_t< unsigned int >
+{
+	enum { SIMD_SEARCH = 1, SIMD_UNSIGNED = 1 };
+	static bool (*DefaultLessFunc())( const unsigned int &, const unsigned int & ) { return DefLessFunc( unsigned int ); }
+};
+
+//-----------------------------------------------------------------------------
+//
+// Purpose:	A drop-in for CUtlMap, FOR_EACH_MAP and FOR_EACH_MAP_FAST included.
+//			Handles are stable like CUtlMap's. Keys are copied into wide
+//			nodes (about two cache lines of keys per node) with the leaves
+//			linked for in-order iteration, so lookups and iteration touch a
+//			handful of nodes instead of one node per element. Duplicate keys
+//			are allowed, as in CUtlMap.
+//
+//			Keys are copied around inside the nodes, so this is for small,
+//			cheaply copied keys. Leaves and interior nodes are merged with a
+//			neighbour under the same parent when they get sparse.
+//
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I = unsigned short >
+class CUtlBTreeMap : public base_utlmap_t
+{
+public:
+	typedef K KeyType_t;
+	typedef T ElemType_t;
+	typedef I IndexType_t;
+
+	// Less func typedef
+	// Returns true if the first parameter is "less" than the second
+	typedef bool (*LessFunc_t)( const KeyType_t &, const KeyType_t & );
+
+	// int and unsigned int keys may leave the less func NULL to get the
+	// default ordering; every other key type needs one
+	CUtlBTreeMap( int growSize = 0, int initSize = 0, LessFunc_t lessfunc = 0 );
+	CUtlBTreeMap( LessFunc_t lessfunc );
+	~CUtlBTreeMap();
+
+	void EnsureCapacity( int num );
+
+	// gets particular elements
+	ElemType_t &		Element( IndexType_t i )			{ Assert( IsValidIndex( i ) ); return m_Elements[i].elem; }
+	const ElemType_t &	Element( IndexType_t i ) const		{ Assert( IsValidIndex( i ) ); return m_Elements[i].elem; }
+	ElemType_t &		operator[]( IndexType_t i )			{ return Element( i ); }
+	const ElemType_t &	operator[]( IndexType_t i ) const	{ return Element( i ); }
+	KeyType_t &			Key( IndexType_t i )				{ Assert( IsValidIndex( i ) ); return m_Elements[i].key; }
+	const KeyType_t &	Key( IndexType_t i ) const			{ Assert( IsValidIndex( i ) ); return m_Elements[i].key; }
+
+	// Num elements
+	unsigned int Count() const								{ return m_nCount; }
+
+	// Max "size" of the vector
+	IndexType_t  MaxElement() const							{ return (IndexType_t)m_nMaxElement; }
+
+	// Checks if a node is valid and in the map
+	bool  IsValidIndex( IndexType_t i ) const				{ return (int)i >= 0 && (int)i < m_nMaxElement && m_Links[i].m_iLeaf >= 0; }
+
+	// Checks if the map as a whole is valid
+	bool  IsValid() const;
+
+	// Invalid index
+	static IndexType_t InvalidIndex()						{ return (IndexType_t)~0; }
+
+	// Sets the less func
+	void SetLessFunc( LessFunc_t func );
+
+	// Insert method (inserts in order)
+	IndexType_t  Insert( const KeyType_t &key, const ElemType_t &insert );
+	IndexType_t  Insert( const KeyType_t &key );
+
+	// Find method
+	IndexType_t  Find( const KeyType_t &key ) const;
+
+	// Remove methods
+	void     RemoveAt( IndexType_t i );
+	bool     Remove( const KeyType_t &key );
+
+	void     RemoveAll();
+	void     Purge();
+
+	// Purges the list and calls delete on each element in it.
+	void PurgeAndDeleteElements();
+
+	// Iteration
+	IndexType_t  FirstInorder() const;
+	IndexType_t  NextInorder( IndexType_t i ) const;
+	IndexType_t  PrevInorder( IndexType_t i ) const;
+	IndexType_t  LastInorder() const;
+
+	// If you change the search key, this can be used to reinsert the
+	// element into the map.
+	void	Reinsert( const KeyType_t &key, IndexType_t i );
+
+	IndexType_t InsertOrReplace( const KeyType_t &key, const ElemType_t &insert );
+
+	// Replaces the contents with nCount elements whose keys are already in
+	// order. The nodes are built directly, without a search per element,
+	// and the handles come out in key order. pElems may be NULL.
+	void	BulkLoad( const KeyType_t *pKeys, const ElemType_t *pElems, int nCount );
+
+	void Swap( CUtlBTreeMap< K, T, I > &that );
+
+	struct Node_t
+	{
+		KeyType_t	key;
+		ElemType_t	elem;
+	};
+
+private:
+	// Keys per node: about two cache lines worth, between 8 and 32
+	enum
+	{
+		NODE_KEYS_RAW = 128 / sizeof( KeyType_t ),
+		NODE_KEYS = NODE_KEYS_RAW < 8 ? 8 : ( NODE_KEYS_RAW > 32 ? 32 : NODE_KEYS_RAW ),
+	};
+
+	struct Leaf_t
+	{
+		KeyType_t	m_Keys[NODE_KEYS];
+		IndexType_t	m_Handles[NODE_KEYS];
+		int			m_nCount;
+		int			m_iParent;
+		int			m_iPrev;
+		int			m_iNext;
+	};
+
+	// m_Keys[i] separates m_Children[i] from m_Children[i + 1]. Every key in
+	// a child is >= the separator on its left and <= the one on its right.
+	struct Inner_t
+	{
+		KeyType_t	m_Keys[NODE_KEYS];
+		int			m_Children[NODE_KEYS + 1];
+		int			m_nCount;		// keys, one less than the children
+		int			m_iParent;
+		int			m_nLevel;		// 1 when the children are leaves
+	};
+
+	// Where each handle lives in the leaves. Free handles have m_iLeaf -1
+	// and m_iSlot is the next free handle.
+	struct Link_t
+	{
+		int	m_iLeaf;
+		int	m_iSlot;
+	};
+
+	CUtlBTreeMap( const CUtlBTreeMap & );
+	CUtlBTreeMap &operator=( const CUtlBTreeMap & );
+
+	bool Less( const KeyType_t &lhs, const KeyType_t &rhs ) const { return m_LessFunc( lhs, rhs ); }
+	int Search( const KeyType_t *pKeys, int nCount, const KeyType_t &key, bool bUpper ) const;
+
+	IndexType_t AllocHandle();
+	void FreeHandle( IndexType_t i );
+	int NewLeaf();
+	int NewInner();
+
+	void InsertHandle( IndexType_t i );
+	void InsertIntoParent( int iLeft, const KeyType_t &separator, int iRight, int nLevel );
+	void UnlinkHandle( IndexType_t i );
+	void RemoveChild( int iInner, int iChild );
+	void MergeLeaves( int iLeft, int iRight );
+	void MergeInners( int iLeft, int iRight, const KeyType_t &separator );
+
+	int &Parent( int iNode, int nLevel ) { return nLevel ? m_Inners[iNode].m_iParent : m_Leaves[iNode].m_iParent; }
+	void SetLink( int iLeaf, int iSlot ) { Link_t &link = m_Links[ m_Leaves[iLeaf].m_Handles[iSlot] ]; link.m_iLeaf = iLeaf; link.m_iSlot = iSlot; }
+
+	CUtlMemory< Node_t, I >		m_Elements;
+	CUtlMemory< Link_t, I >		m_Links;
+	int							m_nCount;
+	int							m_nMaxElement;
+	int							m_iFirstFree;
+
+	CUtlVector< Leaf_t >		m_Leaves;
+	CUtlVector< Inner_t >		m_Inners;
+	CUtlVector< int >			m_FreeLeaves;
+	CUtlVector< int >			m_FreeInners;
+	int							m_iRoot;		// -1 when empty
+	int							m_nDepth;		// levels of inner nodes, 0 when the root is a leaf
+	int							m_iFirstLeaf;
+	int							m_iLastLeaf;
+
+	LessFunc_t					m_LessFunc;
+	bool						m_bSimdSearch;
+};
+
+//-----------------------------------------------------------------------------
+// constructor, destructor
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+CUtlBTreeMap<K, T, I>::CUtlBTreeMap( int growSize, int initSize, LessFunc_t lessfunc ) :
+	m_Elements( growSize, initSize ), m_Links( growSize, initSize )
+{
+	m_nCount = 0;
+	m_nMaxElement = 0;
+	m_iFirstFree = -1;
+	m_iRoot = -1;
+	m_nDepth = 0;
+	m_iFirstLeaf = -1;
+	m_iLastLeaf = -1;
+	SetLessFunc( lessfunc );
+}
+
+template < typename K, typename T, typename I >
+CUtlBTreeMap<K, T, I>::CUtlBTreeMap( LessFunc_t lessfunc )
+{
+	m_nCount = 0;
+	m_nMaxElement = 0;
+	m_iFirstFree = -1;
+	m_iRoot = -1;
+	m_nDepth = 0;
+	m_iFirstLeaf = -1;
+	m_iLastLeaf = -1;
+	SetLessFunc( lessfunc );
+}
+
+template < typename K, typename T, typename I >
+CUtlBTreeMap<K, T, I>::~CUtlBTreeMap()
+{
+	Purge();
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::SetLessFunc( LessFunc_t func )
+{
+	typedef UtlBTreeMapKeyTraits_t< KeyType_t > Traits_t;
+	if ( !func )
+	{
+		func = Traits_t::DefaultLessFunc();
+	}
+
+	m_LessFunc = func;
+	m_bSimdSearch = Traits_t::SIMD_SEARCH && func && func == Traits_t::DefaultLessFunc();
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::EnsureCapacity( int num )
+{
+	m_Elements.EnsureCapacity( num );
+	m_Links.EnsureCapacity( num );
+}
+
+//-----------------------------------------------------------------------------
+// Returns how many of the sorted pKeys are less than key, or less than or
+// equal to it when bUpper is set
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+inline int CUtlBTreeMap<K, T, I>::Search( const KeyType_t *pKeys, int nCount, const KeyType_t &key, bool bUpper ) const
+{
+#ifdef UTLBTREEMAP_SIMD
+	if ( m_bSimdSearch )
+	{
+		// The keys are sorted, so the matching lanes are always a prefix and
+		// the first group with a miss ends the search
+		const int *pIntKeys = reinterpret_cast< const int * >( pKeys );
+		const int nBias = UtlBTreeMapKeyTraits_t< KeyType_t >::SIMD_UNSIGNED ? (int)0x80000000 : 0;
+		const __m128i bias = _mm_set1_epi32( nBias );
+		const __m128i value = _mm_set1_epi32( *reinterpret_cast< const int * >( &key ) ^ nBias );
+
+		int i = 0;
+		for ( ; i + 4 <= nCount; i += 4 )
+		{
+			__m128i keys = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pIntKeys + i ) ), bias );
+			__m128i before = bUpper ? _mm_andnot_si128( _mm_cmpgt_epi32( keys, value ), _mm_set1_epi32( -1 ) ) : _mm_cmplt_epi32( keys, value );
+			int nMask = _mm_movemask_ps( _mm_castsi128_ps( before ) );
+			if ( nMask != 0xF )
+			{
+				// 0, 1, 3 or 7
+				return i + ( nMask & 1 ) + ( ( nMask >> 1 ) & 1 ) + ( nMask >> 2 );
+			}
+		}
+
+		const int nValue = *reinterpret_cast< const int * >( &key ) ^ nBias;
+		for ( ; i < nCount; ++i )
+		{
+			int nKey = pIntKeys[i] ^ nBias;
+			if ( bUpper ? nKey > nValue : nKey >= nValue )
+				break;
+		}
+		return i;
+	}
+#endif
+
+	int nLow = 0;
+	int nHigh = nCount;
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) >> 1;
+		if ( bUpper ? !Less( key, pKeys[nMid] ) : Less( pKeys[nMid], key ) )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+	return nLow;
+}
+
+//-----------------------------------------------------------------------------
+// Handles and nodes
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::AllocHandle()
+{
+	int i;
+	if ( m_iFirstFree >= 0 )
+	{
+		i = m_iFirstFree;
+		m_iFirstFree = m_Links[i].m_iSlot;
+	}
+	else
+	{
+		i = m_nMaxElement;
+		if ( (IndexType_t)i == InvalidIndex() || (int)(IndexType_t)i != i )
+		{
+			Error( "CUtlBTreeMap overflow!\n" );
+		}
+
+		if ( i >= m_Elements.NumAllocated() )
+		{
+			m_Elements.Grow( i + 1 - m_Elements.NumAllocated() );
+		}
+		if ( i >= m_Links.NumAllocated() )
+		{
+			m_Links.Grow( i + 1 - m_Links.NumAllocated() );
+		}
+		++m_nMaxElement;
+	}
+
+	Construct( &m_Elements[i] );
+	m_Links[i].m_iLeaf = -1;
+	return (IndexType_t)i;
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::FreeHandle( IndexType_t i )
+{
+	Destruct( &m_Elements[i] );
+	m_Links[i].m_iLeaf = -1;
+	m_Links[i].m_iSlot = m_iFirstFree;
+	m_iFirstFree = i;
+}
+
+template < typename K, typename T, typename I >
+int CUtlBTreeMap<K, T, I>::NewLeaf()
+{
+	int iLeaf = m_FreeLeaves.Count() ? m_FreeLeaves.Tail() : m_Leaves.AddToTail();
+	if ( m_FreeLeaves.Count() )
+	{
+		m_FreeLeaves.RemoveMultipleFromTail( 1 );
+	}
+
+	Leaf_t &leaf = m_Leaves[iLeaf];
+	leaf.m_nCount = 0;
+	leaf.m_iParent = -1;
+	leaf.m_iPrev = -1;
+	leaf.m_iNext = -1;
+	return iLeaf;
+}
+
+template < typename K, typename T, typename I >
+int CUtlBTreeMap<K, T, I>::NewInner()
+{
+	int iInner = m_FreeInners.Count() ? m_FreeInners.Tail() : m_Inners.AddToTail();
+	if ( m_FreeInners.Count() )
+	{
+		m_FreeInners.RemoveMultipleFromTail( 1 );
+	}
+
+	Inner_t &inner = m_Inners[iInner];
+	inner.m_nCount = 0;
+	inner.m_iParent = -1;
+	inner.m_nLevel = 1;
+	return iInner;
+}
+
+//-----------------------------------------------------------------------------
+// Insertion
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::Insert( const KeyType_t &key, const ElemType_t &insert )
+{
+	IndexType_t i = AllocHandle();
+	m_Elements[i].key = key;
+	m_Elements[i].elem = insert;
+	InsertHandle( i );
+	return i;
+}
+
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::Insert( const KeyType_t &key )
+{
+	IndexType_t i = AllocHandle();
+	m_Elements[i].key = key;
+	InsertHandle( i );
+	return i;
+}
+
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::InsertOrReplace( const KeyType_t &key, const ElemType_t &insert )
+{
+	IndexType_t i = Find( key );
+	if ( i != InvalidIndex() )
+	{
+		Element( i ) = insert;
+		return i;
+	}
+
+	return Insert( key, insert );
+}
+
+//-----------------------------------------------------------------------------
+// Puts an allocated handle into the leaves after any equal keys
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::InsertHandle( IndexType_t i )
+{
+	const KeyType_t &key = m_Elements[i].key;
+	++m_nCount;
+
+	if ( m_iRoot < 0 )
+	{
+		int iLeaf = NewLeaf();
+		Leaf_t &leaf = m_Leaves[iLeaf];
+		leaf.m_Keys[0] = key;
+		leaf.m_Handles[0] = i;
+		leaf.m_nCount = 1;
+		SetLink( iLeaf, 0 );
+		m_iRoot = m_iFirstLeaf = m_iLastLeaf = iLeaf;
+		m_nDepth = 0;
+		return;
+	}
+
+	int iNode = m_iRoot;
+	for ( int nLevel = m_nDepth; nLevel > 0; --nLevel )
+	{
+		const Inner_t &inner = m_Inners[iNode];
+		iNode = inner.m_Children[ Search( inner.m_Keys, inner.m_nCount, key, true ) ];
+	}
+
+	int iLeaf = iNode;
+	int iSlot = Search( m_Leaves[iLeaf].m_Keys, m_Leaves[iLeaf].m_nCount, key, true );
+
+	if ( m_Leaves[iLeaf].m_nCount < NODE_KEYS )
+	{
+		Leaf_t &leaf = m_Leaves[iLeaf];
+		for ( int j = leaf.m_nCount; j > iSlot; --j )
+		{
+			leaf.m_Keys[j] = leaf.m_Keys[j - 1];
+			leaf.m_Handles[j] = leaf.m_Handles[j - 1];
+			SetLink( iLeaf, j );
+		}
+		leaf.m_Keys[iSlot] = key;
+		leaf.m_Handles[iSlot] = i;
+		++leaf.m_nCount;
+		SetLink( iLeaf, iSlot );
+		return;
+	}
+
+	// Split the full leaf, the new one goes on the right
+	KeyType_t keys[NODE_KEYS + 1];
+	IndexType_t handles[NODE_KEYS + 1];
+	{
+		const Leaf_t &leaf = m_Leaves[iLeaf];
+		for ( int j = 0, k = 0; j <= NODE_KEYS; ++j )
+		{
+			if ( j == iSlot )
+			{
+				keys[j] = key;
+				handles[j] = i;
+			}
+			else
+			{
+				keys[j] = leaf.m_Keys[k];
+				handles[j] = leaf.m_Handles[k];
+				++k;
+			}
+		}
+	}
+
+	int iRight = NewLeaf();
+	Leaf_t &left = m_Leaves[iLeaf];
+	Leaf_t &right = m_Leaves[iRight];
+
+	int nLeft = ( NODE_KEYS + 1 ) / 2;
+	left.m_nCount = nLeft;
+	right.m_nCount = NODE_KEYS + 1 - nLeft;
+	for ( int j = 0; j < nLeft; ++j )
+	{
+		left.m_Keys[j] = keys[j];
+		left.m_Handles[j] = handles[j];
+		SetLink( iLeaf, j );
+	}
+	for ( int j = 0; j < right.m_nCount; ++j )
+	{
+		right.m_Keys[j] = keys[nLeft + j];
+		right.m_Handles[j] = handles[nLeft + j];
+		SetLink( iRight, j );
+	}
+
+	right.m_iPrev = iLeaf;
+	right.m_iNext = left.m_iNext;
+	if ( left.m_iNext >= 0 )
+	{
+		m_Leaves[left.m_iNext].m_iPrev = iRight;
+	}
+	else
+	{
+		m_iLastLeaf = iRight;
+	}
+	left.m_iNext = iRight;
+
+	InsertIntoParent( iLeaf, keys[nLeft], iRight, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Adds iRight after its new sibling iLeft, both at nLevel, splitting
+// parents as needed
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::InsertIntoParent( int iLeft, const KeyType_t &separator, int iRight, int nLevel )
+{
+	int iParent = Parent( iLeft, nLevel );
+	if ( iParent < 0 )
+	{
+		int iRoot = NewInner();
+		Inner_t &root = m_Inners[iRoot];
+		root.m_Keys[0] = separator;
+		root.m_Children[0] = iLeft;
+		root.m_Children[1] = iRight;
+		root.m_nCount = 1;
+		root.m_nLevel = nLevel + 1;
+		Parent( iLeft, nLevel ) = iRoot;
+		Parent( iRight, nLevel ) = iRoot;
+		m_iRoot = iRoot;
+		m_nDepth = nLevel + 1;
+		return;
+	}
+
+	int iChild = 0;
+	while ( m_Inners[iParent].m_Children[iChild] != iLeft )
+	{
+		++iChild;
+	}
+
+	if ( m_Inners[iParent].m_nCount < NODE_KEYS )
+	{
+		Inner_t &parent = m_Inners[iParent];
+		for ( int j = parent.m_nCount; j > iChild; --j )
+		{
+			parent.m_Keys[j] = parent.m_Keys[j - 1];
+			parent.m_Children[j + 1] = parent.m_Children[j];
+		}
+		parent.m_Keys[iChild] = separator;
+		parent.m_Children[iChild + 1] = iRight;
+		++parent.m_nCount;
+		Parent( iRight, nLevel ) = iParent;
+		return;
+	}
+
+	// Split the full parent around its middle key, which moves up
+	KeyType_t keys[NODE_KEYS + 1];
+	int children[NODE_KEYS + 2];
+	{
+		const Inner_t &parent = m_Inners[iParent];
+		for ( int j = 0, k = 0; j <= NODE_KEYS; ++j )
+		{
+			keys[j] = ( j == iChild ) ? separator : parent.m_Keys[k++];
+		}
+		for ( int j = 0, k = 0; j <= NODE_KEYS + 1; ++j )
+		{
+			children[j] = ( j == iChild + 1 ) ? iRight : parent.m_Children[k++];
+		}
+	}
+
+	int iNewInner = NewInner();
+	Inner_t &left = m_Inners[iParent];
+	Inner_t &right = m_Inners[iNewInner];
+
+	int nMiddle = ( NODE_KEYS + 1 ) / 2;
+	left.m_nCount = nMiddle;
+	right.m_nCount = NODE_KEYS - nMiddle;
+	right.m_nLevel = left.m_nLevel;
+	for ( int j = 0; j < nMiddle; ++j )
+	{
+		left.m_Keys[j] = keys[j];
+	}
+	for ( int j = 0; j <= nMiddle; ++j )
+	{
+		left.m_Children[j] = children[j];
+		Parent( children[j], nLevel ) = iParent;
+	}
+	for ( int j = 0; j < right.m_nCount; ++j )
+	{
+		right.m_Keys[j] = keys[nMiddle + 1 + j];
+	}
+	for ( int j = 0; j <= right.m_nCount; ++j )
+	{
+		right.m_Children[j] = children[nMiddle + 1 + j];
+		Parent( children[nMiddle + 1 + j], nLevel ) = iNewInner;
+	}
+
+	KeyType_t middle = keys[nMiddle];
+	InsertIntoParent( iParent, middle, iNewInner, nLevel + 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Find: the first element not less than key is in the leaf the search
+// ends in, or first in the next one
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::Find( const KeyType_t &key ) const
+{
+	if ( m_iRoot < 0 )
+		return InvalidIndex();
+
+	int iNode = m_iRoot;
+	for ( int nLevel = m_nDepth; nLevel > 0; --nLevel )
+	{
+		const Inner_t &inner = m_Inners[iNode];
+		iNode = inner.m_Children[ Search( inner.m_Keys, inner.m_nCount, key, false ) ];
+	}
+
+	const Leaf_t *pLeaf = &m_Leaves[iNode];
+	int iSlot = Search( pLeaf->m_Keys, pLeaf->m_nCount, key, false );
+	if ( iSlot == pLeaf->m_nCount )
+	{
+		if ( pLeaf->m_iNext < 0 )
+			return InvalidIndex();
+
+		pLeaf = &m_Leaves[pLeaf->m_iNext];
+		iSlot = 0;
+	}
+
+	return Less( key, pLeaf->m_Keys[iSlot] ) ? InvalidIndex() : pLeaf->m_Handles[iSlot];
+}
+
+//-----------------------------------------------------------------------------
+// Removal
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::RemoveAt( IndexType_t i )
+{
+	Assert( IsValidIndex( i ) );
+	UnlinkHandle( i );
+	FreeHandle( i );
+}
+
+template < typename K, typename T, typename I >
+bool CUtlBTreeMap<K, T, I>::Remove( const KeyType_t &key )
+{
+	IndexType_t i = Find( key );
+	if ( i == InvalidIndex() )
+		return false;
+
+	RemoveAt( i );
+	return true;
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::Reinsert( const KeyType_t &key, IndexType_t i )
+{
+	Assert( IsValidIndex( i ) );
+	UnlinkHandle( i );
+	m_Elements[i].key = key;
+	InsertHandle( i );
+}
+
+//-----------------------------------------------------------------------------
+// Takes a handle out of the leaves, leaving the element alone
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::UnlinkHandle( IndexType_t i )
+{
+	int iLeaf = m_Links[i].m_iLeaf;
+	int iSlot = m_Links[i].m_iSlot;
+	--m_nCount;
+
+	Leaf_t &leaf = m_Leaves[iLeaf];
+	Assert( leaf.m_Handles[iSlot] == i );
+	--leaf.m_nCount;
+	for ( int j = iSlot; j < leaf.m_nCount; ++j )
+	{
+		leaf.m_Keys[j] = leaf.m_Keys[j + 1];
+		leaf.m_Handles[j] = leaf.m_Handles[j + 1];
+		SetLink( iLeaf, j );
+	}
+
+	if ( leaf.m_nCount == 0 )
+	{
+		if ( leaf.m_iPrev >= 0 )
+		{
+			m_Leaves[leaf.m_iPrev].m_iNext = leaf.m_iNext;
+		}
+		else
+		{
+			m_iFirstLeaf = leaf.m_iNext;
+		}
+
+		if ( leaf.m_iNext >= 0 )
+		{
+			m_Leaves[leaf.m_iNext].m_iPrev = leaf.m_iPrev;
+		}
+		else
+		{
+			m_iLastLeaf = leaf.m_iPrev;
+		}
+
+		if ( leaf.m_iParent >= 0 )
+		{
+			RemoveChild( leaf.m_iParent, iLeaf );
+		}
+		else
+		{
+			m_iRoot = -1;
+			m_nDepth = 0;
+		}
+		m_FreeLeaves.AddToTail( iLeaf );
+		return;
+	}
+
+	// Fold a sparse leaf into a neighbour under the same parent
+	if ( leaf.m_nCount < NODE_KEYS / 4 && leaf.m_iParent >= 0 )
+	{
+		int iPrev = leaf.m_iPrev;
+		int iNext = leaf.m_iNext;
+		if ( iNext >= 0 && m_Leaves[iNext].m_iParent == leaf.m_iParent && leaf.m_nCount + m_Leaves[iNext].m_nCount <= NODE_KEYS / 2 )
+		{
+			MergeLeaves( iLeaf, iNext );
+		}
+		else if ( iPrev >= 0 && m_Leaves[iPrev].m_iParent == leaf.m_iParent && leaf.m_nCount + m_Leaves[iPrev].m_nCount <= NODE_KEYS / 2 )
+		{
+			MergeLeaves( iPrev, iLeaf );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Moves everything in iRight to the end of iLeft, its left sibling, and
+// drops iRight. The separator between them goes with it, so iLeft now
+// covers both ranges.
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::MergeLeaves( int iLeft, int iRight )
+{
+	Leaf_t &left = m_Leaves[iLeft];
+	Leaf_t &right = m_Leaves[iRight];
+	for ( int j = 0; j < right.m_nCount; ++j )
+	{
+		left.m_Keys[left.m_nCount] = right.m_Keys[j];
+		left.m_Handles[left.m_nCount] = right.m_Handles[j];
+		SetLink( iLeft, left.m_nCount );
+		++left.m_nCount;
+	}
+
+	left.m_iNext = right.m_iNext;
+	if ( right.m_iNext >= 0 )
+	{
+		m_Leaves[right.m_iNext].m_iPrev = iLeft;
+	}
+	else
+	{
+		m_iLastLeaf = iLeft;
+	}
+
+	RemoveChild( right.m_iParent, iRight );
+	m_FreeLeaves.AddToTail( iRight );
+}
+
+//-----------------------------------------------------------------------------
+// Drops a child and the separator on its left (or right, for the first
+// child). Sparse inner nodes are folded into a neighbour under the same
+// parent, empty ones are removed, and a root with a single child hands the
+// root over to it.
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::RemoveChild( int iInner, int iChild )
+{
+	Inner_t &inner = m_Inners[iInner];
+	int nChildren = inner.m_nCount + 1;
+	int iSlot = 0;
+	while ( inner.m_Children[iSlot] != iChild )
+	{
+		++iSlot;
+	}
+
+	if ( nChildren == 1 )
+	{
+		// Nothing left under this node
+		int iParent = inner.m_iParent;
+		if ( iParent >= 0 )
+		{
+			RemoveChild( iParent, iInner );
+		}
+		else
+		{
+			m_iRoot = -1;
+			m_nDepth = 0;
+		}
+		m_FreeInners.AddToTail( iInner );
+		return;
+	}
+
+	int iKey = ( iSlot > 0 ) ? iSlot - 1 : 0;
+	for ( int j = iKey; j < inner.m_nCount - 1; ++j )
+	{
+		inner.m_Keys[j] = inner.m_Keys[j + 1];
+	}
+	for ( int j = iSlot; j < nChildren - 1; ++j )
+	{
+		inner.m_Children[j] = inner.m_Children[j + 1];
+	}
+	--inner.m_nCount;
+
+	if ( inner.m_nCount < NODE_KEYS / 4 && inner.m_iParent >= 0 )
+	{
+		const Inner_t &parent = m_Inners[inner.m_iParent];
+		int iParentSlot = 0;
+		while ( parent.m_Children[iParentSlot] != iInner )
+		{
+			++iParentSlot;
+		}
+
+		// The merged node takes the separator between the two as well
+		int iNext = ( iParentSlot < parent.m_nCount ) ? parent.m_Children[iParentSlot + 1] : -1;
+		int iPrev = ( iParentSlot > 0 ) ? parent.m_Children[iParentSlot - 1] : -1;
+		if ( iNext >= 0 && inner.m_nCount + m_Inners[iNext].m_nCount + 1 <= NODE_KEYS / 2 )
+		{
+			MergeInners( iInner, iNext, parent.m_Keys[iParentSlot] );
+		}
+		else if ( iPrev >= 0 && inner.m_nCount + m_Inners[iPrev].m_nCount + 1 <= NODE_KEYS / 2 )
+		{
+			MergeInners( iPrev, iInner, parent.m_Keys[iParentSlot - 1] );
+		}
+	}
+
+	while ( m_nDepth > 0 && m_Inners[m_iRoot].m_nCount == 0 )
+	{
+		int iOldRoot = m_iRoot;
+		m_iRoot = m_Inners[iOldRoot].m_Children[0];
+		--m_nDepth;
+		Parent( m_iRoot, m_nDepth ) = -1;
+		m_FreeInners.AddToTail( iOldRoot );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Moves the separator and everything in iRight to the end of iLeft, its left
+// sibling, and drops iRight
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::MergeInners( int iLeft, int iRight, const KeyType_t &separator )
+{
+	Inner_t &left = m_Inners[iLeft];
+	Inner_t &right = m_Inners[iRight];
+	int nChildLevel = left.m_nLevel - 1;
+
+	left.m_Keys[left.m_nCount] = separator;
+	for ( int j = 0; j < right.m_nCount; ++j )
+	{
+		left.m_Keys[left.m_nCount + 1 + j] = right.m_Keys[j];
+	}
+	for ( int j = 0; j <= right.m_nCount; ++j )
+	{
+		left.m_Children[left.m_nCount + 1 + j] = right.m_Children[j];
+		Parent( right.m_Children[j], nChildLevel ) = iLeft;
+	}
+	left.m_nCount += right.m_nCount + 1;
+
+	RemoveChild( right.m_iParent, iRight );
+	m_FreeInners.AddToTail( iRight );
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::RemoveAll()
+{
+	for ( int i = 0; i < m_nMaxElement; ++i )
+	{
+		if ( m_Links[i].m_iLeaf >= 0 )
+		{
+			Destruct( &m_Elements[i] );
+		}
+	}
+
+	m_nCount = 0;
+	m_nMaxElement = 0;
+	m_iFirstFree = -1;
+	m_Leaves.RemoveAll();
+	m_Inners.RemoveAll();
+	m_FreeLeaves.RemoveAll();
+	m_FreeInners.RemoveAll();
+	m_iRoot = -1;
+	m_nDepth = 0;
+	m_iFirstLeaf = -1;
+	m_iLastLeaf = -1;
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::Purge()
+{
+	RemoveAll();
+	m_Elements.Purge();
+	m_Links.Purge();
+	m_Leaves.Purge();
+	m_Inners.Purge();
+	m_FreeLeaves.Purge();
+	m_FreeInners.Purge();
+}
+
+// Purges the list and calls delete on each element in it.
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::PurgeAndDeleteElements()
+{
+	for ( int i = 0; i < m_nMaxElement; ++i )
+	{
+		if ( !IsValidIndex( (IndexType_t)i ) )
+			continue;
+
+		delete Element( (IndexType_t)i );
+	}
+
+	Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Iteration
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::FirstInorder() const
+{
+	return ( m_iFirstLeaf >= 0 ) ? m_Leaves[m_iFirstLeaf].m_Handles[0] : InvalidIndex();
+}
+
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::LastInorder() const
+{
+	if ( m_iLastLeaf < 0 )
+		return InvalidIndex();
+
+	const Leaf_t &leaf = m_Leaves[m_iLastLeaf];
+	return leaf.m_Handles[leaf.m_nCount - 1];
+}
+
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::NextInorder( IndexType_t i ) const
+{
+	Assert( IsValidIndex( i ) );
+	const Link_t &link = m_Links[i];
+	const Leaf_t &leaf = m_Leaves[link.m_iLeaf];
+	if ( link.m_iSlot + 1 < leaf.m_nCount )
+		return leaf.m_Handles[link.m_iSlot + 1];
+
+	return ( leaf.m_iNext >= 0 ) ? m_Leaves[leaf.m_iNext].m_Handles[0] : InvalidIndex();
+}
+
+template < typename K, typename T, typename I >
+I CUtlBTreeMap<K, T, I>::PrevInorder( IndexType_t i ) const
+{
+	Assert( IsValidIndex( i ) );
+	const Link_t &link = m_Links[i];
+	const Leaf_t &leaf = m_Leaves[link.m_iLeaf];
+	if ( link.m_iSlot > 0 )
+		return leaf.m_Handles[link.m_iSlot - 1];
+
+	if ( leaf.m_iPrev < 0 )
+		return InvalidIndex();
+
+	const Leaf_t &prev = m_Leaves[leaf.m_iPrev];
+	return prev.m_Handles[prev.m_nCount - 1];
+}
+
+//-----------------------------------------------------------------------------
+// Bulk load: fills the leaves left to right, then builds each level of
+// inner nodes over the one below it
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::BulkLoad( const KeyType_t *pKeys, const ElemType_t *pElems, int nCount )
+{
+	RemoveAll();
+	if ( nCount <= 0 )
+		return;
+
+	EnsureCapacity( nCount );
+
+	// Spread the elements evenly over the fewest leaves that hold them
+	int nNodes = ( nCount + NODE_KEYS - 1 ) / NODE_KEYS;
+	CUtlVector< int > level;
+	CUtlVector< KeyType_t > lowest;
+	level.EnsureCapacity( nNodes );
+	lowest.EnsureCapacity( nNodes );
+
+	int iElement = 0;
+	for ( int n = 0; n < nNodes; ++n )
+	{
+		int iLeaf = NewLeaf();
+		Leaf_t &leaf = m_Leaves[iLeaf];
+		leaf.m_nCount = ( nCount * ( n + 1 ) ) / nNodes - ( nCount * n ) / nNodes;
+		for ( int j = 0; j < leaf.m_nCount; ++j, ++iElement )
+		{
+			Assert( iElement == 0 || !Less( pKeys[iElement], pKeys[iElement - 1] ) );
+			IndexType_t i = AllocHandle();
+			m_Elements[i].key = pKeys[iElement];
+			if ( pElems )
+			{
+				m_Elements[i].elem = pElems[iElement];
+			}
+			leaf.m_Keys[j] = pKeys[iElement];
+			leaf.m_Handles[j] = i;
+			SetLink( iLeaf, j );
+		}
+
+		leaf.m_iPrev = ( n > 0 ) ? level.Tail() : -1;
+		if ( n > 0 )
+		{
+			m_Leaves[level.Tail()].m_iNext = iLeaf;
+		}
+		level.AddToTail( iLeaf );
+		lowest.AddToTail( leaf.m_Keys[0] );
+	}
+
+	m_nCount = nCount;
+	m_iFirstLeaf = level[0];
+	m_iLastLeaf = level.Tail();
+	m_nDepth = 0;
+
+	CUtlVector< int > parents;
+	CUtlVector< KeyType_t > parentLowest;
+	while ( level.Count() > 1 )
+	{
+		int nChildren = level.Count();
+		nNodes = ( nChildren + NODE_KEYS ) / ( NODE_KEYS + 1 );
+		parents.RemoveAll();
+		parentLowest.RemoveAll();
+
+		int iChild = 0;
+		for ( int n = 0; n < nNodes; ++n )
+		{
+			int iInner = NewInner();
+			Inner_t &inner = m_Inners[iInner];
+			int nNodeChildren = ( nChildren * ( n + 1 ) ) / nNodes - ( nChildren * n ) / nNodes;
+			inner.m_nCount = nNodeChildren - 1;
+			inner.m_nLevel = m_nDepth + 1;
+			for ( int j = 0; j < nNodeChildren; ++j, ++iChild )
+			{
+				inner.m_Children[j] = level[iChild];
+				Parent( level[iChild], m_nDepth ) = iInner;
+				if ( j > 0 )
+				{
+					inner.m_Keys[j - 1] = lowest[iChild];
+				}
+			}
+			parents.AddToTail( iInner );
+			parentLowest.AddToTail( lowest[iChild - nNodeChildren] );
+		}
+
+		level.Swap( parents );
+		lowest.Swap( parentLowest );
+		++m_nDepth;
+	}
+
+	m_iRoot = level[0];
+}
+
+//-----------------------------------------------------------------------------
+// Checks the ordering, the separators and every handle's link
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename I >
+bool CUtlBTreeMap<K, T, I>::IsValid() const
+{
+	if ( m_iRoot < 0 )
+		return m_nCount == 0 && m_iFirstLeaf < 0 && m_iLastLeaf < 0;
+
+	int nCount = 0;
+	const KeyType_t *pPrevKey = NULL;
+	for ( int iLeaf = m_iFirstLeaf; iLeaf >= 0; iLeaf = m_Leaves[iLeaf].m_iNext )
+	{
+		const Leaf_t &leaf = m_Leaves[iLeaf];
+		if ( leaf.m_nCount <= 0 || leaf.m_nCount > NODE_KEYS )
+			return false;
+
+		for ( int j = 0; j < leaf.m_nCount; ++j )
+		{
+			const Link_t &link = m_Links[ leaf.m_Handles[j] ];
+			if ( link.m_iLeaf != iLeaf || link.m_iSlot != j )
+				return false;
+			if ( pPrevKey && Less( leaf.m_Keys[j], *pPrevKey ) )
+				return false;
+			if ( Less( leaf.m_Keys[j], m_Elements[ leaf.m_Handles[j] ].key ) || Less( m_Elements[ leaf.m_Handles[j] ].key, leaf.m_Keys[j] ) )
+				return false;
+			pPrevKey = &leaf.m_Keys[j];
+			++nCount;
+		}
+
+		// Every separator above a leaf must bound it
+		int iChild = iLeaf;
+		for ( int nLevel = 0, iParent = leaf.m_iParent; iParent >= 0; iChild = iParent, iParent = m_Inners[iParent].m_iParent, ++nLevel )
+		{
+			const Inner_t &inner = m_Inners[iParent];
+			if ( inner.m_nLevel != nLevel + 1 )
+				return false;
+
+			int iSlot = 0;
+			while ( iSlot <= inner.m_nCount && inner.m_Children[iSlot] != iChild )
+			{
+				++iSlot;
+			}
+			if ( iSlot > inner.m_nCount )
+				return false;
+			if ( iSlot > 0 && Less( leaf.m_Keys[0], inner.m_Keys[iSlot - 1] ) )
+				return false;
+			if ( iSlot < inner.m_nCount && Less( inner.m_Keys[iSlot], leaf.m_Keys[leaf.m_nCount - 1] ) )
+				return false;
+		}
+	}
+
+	return nCount == m_nCount;
+}
+
+template < typename K, typename T, typename I >
+void CUtlBTreeMap<K, T, I>::Swap( CUtlBTreeMap< K, T, I > &that )
+{
+	m_Elements.Swap( that.m_Elements );
+	m_Links.Swap( that.m_Links );
+	V_swap( m_nCount, that.m_nCount );
+	V_swap( m_nMaxElement, that.m_nMaxElement );
+	V_swap( m_iFirstFree, that.m_iFirstFree );
+	m_Leaves.Swap( that.m_Leaves );
+	m_Inners.Swap( that.m_Inners );
+	m_FreeLeaves.Swap( that.m_FreeLeaves );
+	m_FreeInners.Swap( that.m_FreeInners );
+	V_swap( m_iRoot, that.m_iRoot );
+	V_swap( m_nDepth, that.m_nDepth );
+	V_swap( m_iFirstLeaf, that.m_iFirstLeaf );
+	V_swap( m_iLastLeaf, that.m_iLastLeaf );
+	V_swap( m_LessFunc, that.m_LessFunc );
+	V_swap( m_bSimdSearch, that.m_bSimdSearch );
+}
+
+#endif // UTLBTREEMAP_H
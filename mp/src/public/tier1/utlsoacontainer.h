@@ -122,6 +122,16 @@ enum EAttributeDataType
 
 #define MAX_SOA_FIELDS 32
 
+// Columns are padded to a multiple of this, and every row starts on a
+// boundary of this many floats, so 8 wide SIMD never needs a remainder loop
+#define SOA_BLOCK_WIDTH 8
+
+class CSOAContainer;
+
+// Called on a block of rows by CSOAContainer::ParallelForRowBlocks. Rows are
+// numbered through every slice, so row nRows is the first row of slice 1.
+typedef void (*SOARowBlockFunc_t)( CSOAContainer const *pContainer, void *pContext, int nStartRow, int nEndRow );
+
 class CSOAContainer
 {
 
@@ -130,7 +140,7 @@ protected:
 	int m_nRows;
 	int m_nSlices;
 
-	int m_nPaddedColumns;									// # of columns rounded up for sse
+	int m_nPaddedColumns;									// # of columns rounded up to SOA_BLOCK_WIDTH
 	int m_nNumQuadsPerRow;									// # of groups of 4 elements per row
 
 	uint8 *m_pDataMemory;									// the actual data memory
@@ -288,10 +298,24 @@ public:
 	void CopyAttrToAttr( int nSrcAttributeIndex, int nDestAttributeIndex);
 
 	// move all the data from one csoacontainer to another, leaving the source empty.
-	// this is just a pointer copy.
-	FORCEINLINE void MoveDataFrom( CSOAContainer other )
+	// this is just a pointer copy. whatever this one held is freed first.
+	FORCEINLINE void MoveDataFrom( CSOAContainer &other )
 	{
-		(*this) = other;
+		if ( &other == this )
+			return;
+		Purge();
+		m_nColumns = other.m_nColumns;
+		m_nRows = other.m_nRows;
+		m_nSlices = other.m_nSlices;
+		m_nPaddedColumns = other.m_nPaddedColumns;
+		m_nNumQuadsPerRow = other.m_nNumQuadsPerRow;
+		m_pDataMemory = other.m_pDataMemory;
+		m_nFieldPresentMask = other.m_nFieldPresentMask;
+		memcpy( m_pAttributePtrs, other.m_pAttributePtrs, sizeof( m_pAttributePtrs ) );
+		memcpy( m_nDataType, other.m_nDataType, sizeof( m_nDataType ) );
+		memcpy( m_nStrideInBytes, other.m_nStrideInBytes, sizeof( m_nStrideInBytes ) );
+		memcpy( m_nRowStrideInBytes, other.m_nRowStrideInBytes, sizeof( m_nRowStrideInBytes ) );
+		memcpy( m_nSliceStrideInBytes, other.m_nSliceStrideInBytes, sizeof( m_nSliceStrideInBytes ) );
 		other.Init();
 	}
 
@@ -309,8 +333,183 @@ public:
 	void FillAttrWithInterpolatedValues( int nAttr, Vector flValue00, Vector flValue10,
 										 Vector const &flValue01, Vector const &flValue11 ) const;
 
+	// fused element-wise operations on float attributes. Each one is a single pass over the
+	// padded rows of every slice, so the source attributes are read once and dest written once.
+	// dest may be the same attribute as any source.
+	void MulAdd( int nDestAttr, int nAttrA, int nAttrB, int nAttrC ) const;		// dest = a * b + c
+	void ScaleBias( int nDestAttr, int nSrcAttr, float flScale, float flBias ) const;	// dest = src * scale + bias
+	void Clamp( int nDestAttr, int nSrcAttr, float flMin, float flMax ) const;
+	void Lerp( int nDestAttr, int nAttrA, int nAttrB, int nAttrT ) const;		// dest = a + ( b - a ) * t
+	void Lerp( int nDestAttr, int nAttrA, int nAttrB, float flT ) const;
+
+	// dest[i] = src's nSrcAttr at element index[i], where nIndexAttr is an ATTRDATATYPE_INT
+	// attribute of this container holding element numbers in src
+	void Gather( int nDestAttr, CSOAContainer const &src, int nSrcAttr, int nIndexAttr ) const;
+
+	// runs an arbitrary element-wise expression over up to three float attributes and writes
+	// the result to a fourth, 8 columns at a time. OP is anything with
+	//    fltx4 operator()( fltx4 const &a, fltx4 const &b, fltx4 const &c ) const
+	// Pass -1 for unused sources; they read as zero. Rows are numbered as for
+	// ParallelForRowBlocks, and nEndRow of -1 means all of them.
+	template<class OP> void Transform( int nDestAttr, int nAttrA, int nAttrB, int nAttrC, OP const &op,
+									   int nStartRow = 0, int nEndRow = -1 ) const;
+
+	// the same, with the rows split into blocks across the vstdlib thread pool
+	template<class OP> void ParallelTransform( int nDestAttr, int nAttrA, int nAttrB, int nAttrC, OP const &op,
+											   int nRowsPerBlock = 0 ) const;
+
+	// calls pfnProcess on blocks of rows in parallel using ParallelProcess. nRowsPerBlock of 0
+	// picks a size that gives each thread a few blocks.
+	void ParallelForRowBlocks( SOARowBlockFunc_t pfnProcess, void *pContext, int nRowsPerBlock = 0 ) const;
+
+	// total rows counting every slice
+	FORCEINLINE int NumRowsAllSlices( void ) const
+	{
+		return m_nRows * m_nSlices;
+	}
+
+private:
+	// the data memory belongs to one container; use MoveDataFrom to hand it over
+	CSOAContainer( const CSOAContainer &other );
+	CSOAContainer &operator=( const CSOAContainer &other );
+};
+
+//-----------------------------------------------------------------------------
+// Operators for CSOAContainer::Transform
+//-----------------------------------------------------------------------------
+struct SOAMulAddOp_t
+{
+	FORCEINLINE fltx4 operator()( fltx4 const &a, fltx4 const &b, fltx4 const &c ) const
+	{
+		return MaddSIMD( a, b, c );
+	}
 };
 
+struct SOAScaleBiasOp_t
+{
+	fltx4 m_Scale;
+	fltx4 m_Bias;
+
+	SOAScaleBiasOp_t( float flScale, float flBias ) : m_Scale( ReplicateX4( flScale ) ), m_Bias( ReplicateX4( flBias ) ) {}
+
+	FORCEINLINE fltx4 operator()( fltx4 const &a, fltx4 const &b, fltx4 const &c ) const
+	{
+		return MaddSIMD( a, m_Scale, m_Bias );
+	}
+};
+
+struct SOAClampOp_t
+{
+	fltx4 m_Min;
+	fltx4 m_Max;
+
+	SOAClampOp_t( float flMin, float flMax ) : m_Min( ReplicateX4( flMin ) ), m_Max( ReplicateX4( flMax ) ) {}
+
+	FORCEINLINE fltx4 operator()( fltx4 const &a, fltx4 const &b, fltx4 const &c ) const
+	{
+		return MinSIMD( m_Max, MaxSIMD( m_Min, a ) );
+	}
+};
+
+struct SOALerpOp_t
+{
+	FORCEINLINE fltx4 operator()( fltx4 const &a, fltx4 const &b, fltx4 const &t ) const
+	{
+		return MaddSIMD( SubSIMD( b, a ), t, a );
+	}
+};
+
+struct SOALerpConstantOp_t
+{
+	fltx4 m_T;
+
+	SOALerpConstantOp_t( float flT ) : m_T( ReplicateX4( flT ) ) {}
+
+	FORCEINLINE fltx4 operator()( fltx4 const &a, fltx4 const &b, fltx4 const &c ) const
+	{
+		return MaddSIMD( SubSIMD( b, a ), m_T, a );
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Rows are contiguous within an attribute through every slice, so a range of
+// rows is one run of whole 8 wide blocks
+//-----------------------------------------------------------------------------
+template<class OP> void CSOAContainer::Transform( int nDestAttr, int nAttrA, int nAttrB, int nAttrC, OP const &op,
+												  int nStartRow, int nEndRow ) const
+{
+	if ( nEndRow < 0 )
+		nEndRow = NumRowsAllSlices();
+	if ( nStartRow >= nEndRow )
+		return;
+
+	Assert( m_nDataType[nDestAttr] == ATTRDATATYPE_FLOAT );
+	COMPILE_TIME_ASSERT( SOA_BLOCK_WIDTH == 8 );
+
+	static ALIGN16 const float s_Zeros[SOA_BLOCK_WIDTH] ALIGN16_POST = { 0 };
+	int nSourceAttrs[3] = { nAttrA, nAttrB, nAttrC };
+	fltx4 const *pSources[3];
+	int nSourceStep[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		if ( nSourceAttrs[i] < 0 )
+		{
+			pSources[i] = reinterpret_cast<fltx4 const *>( s_Zeros );
+			nSourceStep[i] = 0;
+		}
+		else
+		{
+			Assert( m_nDataType[ nSourceAttrs[i] ] == ATTRDATATYPE_FLOAT );
+			pSources[i] = reinterpret_cast<fltx4 const *>( m_pAttributePtrs[ nSourceAttrs[i] ] + nStartRow * m_nRowStrideInBytes[ nSourceAttrs[i] ] );
+			nSourceStep[i] = 2;
+		}
+	}
+
+	fltx4 *pDest = reinterpret_cast<fltx4 *>( m_pAttributePtrs[nDestAttr] + nStartRow * m_nRowStrideInBytes[nDestAttr] );
+	int nBlocks = ( nEndRow - nStartRow ) * ( m_nPaddedColumns / SOA_BLOCK_WIDTH );
+	fltx4 const *pA = pSources[0];
+	fltx4 const *pB = pSources[1];
+	fltx4 const *pC = pSources[2];
+	for ( int i = 0; i < nBlocks; i++ )
+	{
+		fltx4 flLow = op( pA[0], pB[0], pC[0] );
+		fltx4 flHigh = op( pA[1], pB[1], pC[1] );
+		pDest[0] = flLow;
+		pDest[1] = flHigh;
+		pDest += 2;
+		pA += nSourceStep[0];
+		pB += nSourceStep[1];
+		pC += nSourceStep[2];
+	}
+}
+
+template<class OP> struct SOATransformJob_t
+{
+	int m_nDestAttr;
+	int m_nAttrA;
+	int m_nAttrB;
+	int m_nAttrC;
+	OP const *m_pOp;
+
+	static void ProcessRows( CSOAContainer const *pContainer, void *pContext, int nStartRow, int nEndRow )
+	{
+		SOATransformJob_t<OP> const *pJob = reinterpret_cast<SOATransformJob_t<OP> const *>( pContext );
+		pContainer->Transform( pJob->m_nDestAttr, pJob->m_nAttrA, pJob->m_nAttrB, pJob->m_nAttrC, *pJob->m_pOp, nStartRow, nEndRow );
+	}
+};
+
+template<class OP> void CSOAContainer::ParallelTransform( int nDestAttr, int nAttrA, int nAttrB, int nAttrC, OP const &op,
+														  int nRowsPerBlock ) const
+{
+	SOATransformJob_t<OP> job;
+	job.m_nDestAttr = nDestAttr;
+	job.m_nAttrA = nAttrA;
+	job.m_nAttrB = nAttrB;
+	job.m_nAttrC = nAttrC;
+	job.m_pOp = &op;
+	ParallelForRowBlocks( &SOATransformJob_t<OP>::ProcessRows, &job, nRowsPerBlock );
+}
+
 class CFltX4AttributeIterator : public CStridedConstPtr<fltx4>
 {
 	FORCEINLINE CFltX4AttributeIterator( CSOAContainer const *pContainer, int nAttribute, int nRowNumber = 0 )
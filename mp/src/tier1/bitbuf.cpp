@@ -548,7 +548,16 @@ bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 }
 
 
-void bf_write::WriteBitAngle( float fAngle, int numbits )
+//-----------------------------------------------------------------------------
+// Field encoders shared by the single value writers and the array writers.
+// Each packs its fields LSB first, in the order they go on the wire, and
+// returns how many bits to write.
+//-----------------------------------------------------------------------------
+#define BITCOORD_MAX_BITS	( 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS )
+#define BITCOORDMP_MAX_BITS	( 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS )
+#define BITNORMAL_BITS		( 1 + NORMAL_FRACTIONAL_BITS )
+
+static FORCEINLINE unsigned int EncodeBitAngle( float fAngle, int numbits )
 {
 	int d;
 	unsigned int mask;
@@ -560,14 +569,11 @@ void bf_write::WriteBitAngle( float fAngle, int numbits )
 	d = (int)( (fAngle / 360.0) * shift );
 	d &= mask;
 
-	WriteUBitLong((unsigned int)d, numbits);
+	return (unsigned int)d;
 }
 
-void bf_write::WriteBitCoordMP( const float f, bool bIntegral, bool bLowPrecision )
+static FORCEINLINE int EncodeBitCoordMP( const float f, bool bIntegral, bool bLowPrecision, unsigned int &bits )
 {
-#if defined( BB_PROFILING )
-	VPROF( "bf_write::WriteBitCoordMP" );
-#endif
 	int		signbit = (f <= -( bLowPrecision ? COORD_RESOLUTION_LOWPRECISION : COORD_RESOLUTION ));
 	int		intval = (int)abs(f);
 	int		fractval = bLowPrecision ? 
@@ -576,7 +582,7 @@ void bf_write::WriteBitCoordMP( const float f, bool bIntegral, bool bLowPrecisio
 
 	bool    bInBounds = intval < (1 << COORD_INTEGER_BITS_MP );
 
-	unsigned int bits, numbits;
+	unsigned int numbits;
 
 	if ( bIntegral )
 	{
@@ -613,65 +619,43 @@ void bf_write::WriteBitCoordMP( const float f, bool bIntegral, bool bLowPrecisio
 		}
 	}
 
-	WriteUBitLong( bits, numbits );
+	return numbits;
 }
 
-void bf_write::WriteBitCoord (const float f)
+static FORCEINLINE int EncodeBitCoord( const float f, unsigned int &bits )
 {
-#if defined( BB_PROFILING )
-	VPROF( "bf_write::WriteBitCoord" );
-#endif
 	int		signbit = (f <= -COORD_RESOLUTION);
 	int		intval = (int)abs(f);
 	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
 
+	// The bit flags that indicate whether we have an integer part and/or a fraction part.
+	bits = ( intval ? 1 : 0 ) | ( fractval ? 2 : 0 );
+	if ( !bits )
+		return 2;
 
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
+	// The sign bit
+	bits |= signbit << 2;
+	int numbits = 3;
 
-	if ( intval || fractval )
+	// The integer if we have one, adjusted from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1].
+	// Masked the way WriteUBitLong would have masked it on its own.
+	if ( intval )
 	{
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
+		bits |= ( (unsigned int)( intval - 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) << numbits;
+		numbits += COORD_INTEGER_BITS;
 	}
-}
-
-void bf_write::WriteBitVec3Coord( const Vector& fa )
-{
-	int		xflag, yflag, zflag;
 
-	xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
-	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
-	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
-
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
-	WriteOneBit( zflag );
+	// The fraction if we have one
+	if ( fractval )
+	{
+		bits |= (unsigned int)fractval << numbits;
+		numbits += COORD_FRACTIONAL_BITS;
+	}
 
-	if ( xflag )
-		WriteBitCoord( fa[0] );
-	if ( yflag )
-		WriteBitCoord( fa[1] );
-	if ( zflag )
-		WriteBitCoord( fa[2] );
+	return numbits;
 }
 
-void bf_write::WriteBitNormal( float f )
+static FORCEINLINE unsigned int EncodeBitNormal( float f )
 {
 	int	signbit = (f <= -NORMAL_RESOLUTION);
 
@@ -682,31 +666,110 @@ void bf_write::WriteBitNormal( float f )
 	if (fractval > NORMAL_DENOMINATOR)
 		fractval = NORMAL_DENOMINATOR;
 
-	// Send the sign bit
-	WriteOneBit( signbit );
+	// Sign bit, then the fractional component
+	return signbit | ( fractval << 1 );
+}
 
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+template < class WRITER >
+static FORCEINLINE void WriteBitCoordTo( WRITER &out, const float f )
+{
+	unsigned int bits;
+	int numbits = EncodeBitCoord( f, bits );
+	out.WriteUBitLong( bits, numbits );
 }
 
-void bf_write::WriteBitVec3Normal( const Vector& fa )
+template < class WRITER >
+static FORCEINLINE void WriteBitVec3CoordTo( WRITER &out, const Vector& fa )
+{
+	int		xflag, yflag, zflag;
+
+	xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
+	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
+	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
+
+	out.WriteUBitLong( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
+
+	if ( xflag )
+		WriteBitCoordTo( out, fa[0] );
+	if ( yflag )
+		WriteBitCoordTo( out, fa[1] );
+	if ( zflag )
+		WriteBitCoordTo( out, fa[2] );
+}
+
+template < class WRITER >
+static FORCEINLINE void WriteBitVec3NormalTo( WRITER &out, const Vector& fa )
 {
 	int		xflag, yflag;
 
 	xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
 	yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
+	out.WriteUBitLong( xflag | ( yflag << 1 ), 2 );
 
 	if ( xflag )
-		WriteBitNormal( fa[0] );
+		out.WriteUBitLong( EncodeBitNormal( fa[0] ), BITNORMAL_BITS );
 	if ( yflag )
-		WriteBitNormal( fa[1] );
+		out.WriteUBitLong( EncodeBitNormal( fa[1] ), BITNORMAL_BITS );
 	
 	// Write z sign bit
 	int	signbit = (fa[2] <= -NORMAL_RESOLUTION);
-	WriteOneBit( signbit );
+	out.WriteUBitLong( signbit, 1 );
+}
+
+void bf_write::WriteBitAngle( float fAngle, int numbits )
+{
+	WriteUBitLong( EncodeBitAngle( fAngle, numbits ), numbits );
+}
+
+void bf_write::WriteBitCoordMP( const float f, bool bIntegral, bool bLowPrecision )
+{
+#if defined( BB_PROFILING )
+	VPROF( "bf_write::WriteBitCoordMP" );
+#endif
+	unsigned int bits;
+	int numbits = EncodeBitCoordMP( f, bIntegral, bLowPrecision, bits );
+	WriteUBitLong( bits, numbits );
+}
+
+void bf_write::WriteBitCoord (const float f)
+{
+#if defined( BB_PROFILING )
+	VPROF( "bf_write::WriteBitCoord" );
+#endif
+	WriteBitCoordTo( *this, f );
+}
+
+void bf_write::WriteBitVec3Coord( const Vector& fa )
+{
+	if ( GetNumBitsLeft() < 3 + 3 * BITCOORD_MAX_BITS )
+	{
+		// Might not fit, let WriteUBitLong sort out the overflow
+		WriteBitVec3CoordTo( *this, fa );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	WriteBitVec3CoordTo( out, fa );
+	out.Flush();
+}
+
+void bf_write::WriteBitNormal( float f )
+{
+	WriteUBitLong( EncodeBitNormal( f ), BITNORMAL_BITS );
+}
+
+void bf_write::WriteBitVec3Normal( const Vector& fa )
+{
+	if ( GetNumBitsLeft() < 3 + 2 * BITNORMAL_BITS )
+	{
+		WriteBitVec3NormalTo( *this, fa );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	WriteBitVec3NormalTo( out, fa );
+	out.Flush();
 }
 
 void bf_write::WriteBitAngles( const QAngle& fa )
@@ -716,6 +779,84 @@ void bf_write::WriteBitAngles( const QAngle& fa )
 	WriteBitVec3Coord( tmp );
 }
 
+void bf_write::WriteBitAngleArray( const float *pValues, int nCount, int numbits )
+{
+	if ( GetNumBitsLeft() < nCount * numbits )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			WriteBitAngle( pValues[i], numbits );
+		}
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		out.WriteUBitLong( EncodeBitAngle( pValues[i], numbits ), numbits );
+	}
+	out.Flush();
+}
+
+void bf_write::WriteBitCoordArray( const float *pValues, int nCount )
+{
+	if ( GetNumBitsLeft() < nCount * BITCOORD_MAX_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			WriteBitCoord( pValues[i] );
+		}
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		WriteBitCoordTo( out, pValues[i] );
+	}
+	out.Flush();
+}
+
+void bf_write::WriteBitCoordMPArray( const float *pValues, int nCount, bool bIntegral, bool bLowPrecision )
+{
+	if ( GetNumBitsLeft() < nCount * BITCOORDMP_MAX_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			WriteBitCoordMP( pValues[i], bIntegral, bLowPrecision );
+		}
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		unsigned int bits;
+		int numbits = EncodeBitCoordMP( pValues[i], bIntegral, bLowPrecision, bits );
+		out.WriteUBitLong( bits, numbits );
+	}
+	out.Flush();
+}
+
+void bf_write::WriteBitNormalArray( const float *pValues, int nCount )
+{
+	if ( GetNumBitsLeft() < nCount * BITNORMAL_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			WriteBitNormal( pValues[i] );
+		}
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		out.WriteUBitLong( EncodeBitNormal( pValues[i] ), BITNORMAL_BITS );
+	}
+	out.Flush();
+}
+
 void bf_write::WriteChar(int val)
 {
 	WriteSBitLong(val, sizeof(char) << 3);
@@ -945,7 +1086,7 @@ int bf_read::ReadBitsClamped_ptr(void *pOutData, size_t outSizeBytes, size_t nBi
 	return (int)readSizeBits;
 }
 
-float bf_read::ReadBitAngle( int numbits )
+static FORCEINLINE float DecodeBitAngle( unsigned int bits, int numbits )
 {
 	float fReturn;
 	int i;
@@ -953,12 +1094,17 @@ float bf_read::ReadBitAngle( int numbits )
 
 	shift = (float)( BitForBitnum(numbits) );
 
-	i = ReadUBitLong( numbits );
+	i = bits;
 	fReturn = (float)i * (360.0 / shift);
 
 	return fReturn;
 }
 
+float bf_read::ReadBitAngle( int numbits )
+{
+	return DecodeBitAngle( ReadUBitLong( numbits ), numbits );
+}
+
 unsigned int bf_read::PeekUBitLong( int numbits )
 {
 	unsigned int r;
@@ -1080,36 +1226,37 @@ unsigned int bf_read::ReadBitLong(int numbits, bool bSigned)
 
 
 // Basic Coordinate Routines (these contain bit-field size AND fixed point scaling constants)
-float bf_read::ReadBitCoord (void)
+//-----------------------------------------------------------------------------
+// Field decoders shared by the single value readers and the array readers
+//-----------------------------------------------------------------------------
+template < class READER >
+static FORCEINLINE float ReadBitCoordFrom( READER &in )
 {
-#if defined( BB_PROFILING )
-	VPROF( "bf_read::ReadBitCoord" );
-#endif
 	int		intval=0,fractval=0,signbit=0;
 	float	value = 0.0;
 
-
 	// Read the required integer and fraction flags
-	intval = ReadOneBit();
-	fractval = ReadOneBit();
+	unsigned int flags = in.ReadUBitLong( 2 );
+	intval = flags & 1;
+	fractval = flags & 2;
 
 	// If we got either parse them, otherwise it's a zero.
 	if ( intval || fractval )
 	{
 		// Read the sign bit
-		signbit = ReadOneBit();
+		signbit = in.ReadOneBit();
 
 		// If there's an integer, read it in
 		if ( intval )
 		{
 			// Adjust the integers from [0..MAX_COORD_VALUE-1] to [1..MAX_COORD_VALUE]
-			intval = ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+			intval = in.ReadUBitLong( COORD_INTEGER_BITS ) + 1;
 		}
 
 		// If there's a fraction, read it in
 		if ( fractval )
 		{
-			fractval = ReadUBitLong( COORD_FRACTIONAL_BITS );
+			fractval = in.ReadUBitLong( COORD_FRACTIONAL_BITS );
 		}
 
 		// Calculate the correct floating point value
@@ -1123,17 +1270,15 @@ float bf_read::ReadBitCoord (void)
 	return value;
 }
 
-float bf_read::ReadBitCoordMP( bool bIntegral, bool bLowPrecision )
+template < class READER >
+static FORCEINLINE float ReadBitCoordMPFrom( READER &in, bool bIntegral, bool bLowPrecision )
 {
-#if defined( BB_PROFILING )
-	VPROF( "bf_read::ReadBitCoordMP" );
-#endif
 	// BitCoordMP float encoding: inbounds bit, integer bit, sign bit, optional int bits, float bits
 	// BitCoordMP integer encoding: inbounds bit, integer bit, optional sign bit, optional int bits.
 	// int bits are always encoded as (value - 1) since zero is handled by the integer bit
 
 	// With integer-only encoding, the presence of the third bit depends on the second
-	int flags = ReadUBitLong(3 - bIntegral);
+	int flags = in.ReadUBitLong(3 - bIntegral);
 	enum { INBOUNDS=1, INTVAL=2, SIGN=4 };
 
 	if ( bIntegral )
@@ -1141,7 +1286,7 @@ float bf_read::ReadBitCoordMP( bool bIntegral, bool bLowPrecision )
 		if ( flags & INTVAL )
 		{
 			// Read the third bit and the integer portion together at once
-			unsigned int bits = ReadUBitLong( (flags & INBOUNDS) ? COORD_INTEGER_BITS_MP+1 : COORD_INTEGER_BITS+1 );
+			unsigned int bits = in.ReadUBitLong( (flags & INBOUNDS) ? COORD_INTEGER_BITS_MP+1 : COORD_INTEGER_BITS+1 );
 			// Remap from [0,N] to [1,N+1]
 			int intval = (bits >> 1) + 1;
 			return (bits & 1) ? -intval : intval;
@@ -1170,7 +1315,7 @@ float bf_read::ReadBitCoordMP( bool bIntegral, bool bLowPrecision )
 		COORD_FRACTIONAL_BITS_MP_LOWPRECISION + COORD_INTEGER_BITS,
 		COORD_FRACTIONAL_BITS_MP_LOWPRECISION + COORD_INTEGER_BITS_MP
 	};
-	unsigned int bits = ReadUBitLong( numbits_table[ (flags & (INBOUNDS|INTVAL)) + bLowPrecision*4 ] );
+	unsigned int bits = in.ReadUBitLong( numbits_table[ (flags & (INBOUNDS|INTVAL)) + bLowPrecision*4 ] );
 
 	if ( flags & INTVAL )
 	{
@@ -1209,6 +1354,85 @@ float bf_read::ReadBitCoordMP( bool bIntegral, bool bLowPrecision )
 	return (int)bits * multiply;
 }
 
+template < class READER >
+static FORCEINLINE float ReadBitNormalFrom( READER &in )
+{
+	// Sign bit, then the fractional part
+	unsigned int bits = in.ReadUBitLong( BITNORMAL_BITS );
+	int	signbit = bits & 1;
+	unsigned int fractval = bits >> 1;
+
+	// Calculate the correct floating point value
+	float value = (float)fractval * NORMAL_RESOLUTION;
+
+	// Fixup the sign if negative.
+	if ( signbit )
+		value = -value;
+
+	return value;
+}
+
+template < class READER >
+static FORCEINLINE void ReadBitVec3CoordFrom( READER &in, Vector& fa )
+{
+	// This vector must be initialized! Otherwise, If any of the flags aren't set,
+	// the corresponding component will not be read and will be stack garbage.
+	fa.Init( 0, 0, 0 );
+
+	unsigned int flags = in.ReadUBitLong( 3 );
+
+	if ( flags & 1 )
+		fa[0] = ReadBitCoordFrom( in );
+	if ( flags & 2 )
+		fa[1] = ReadBitCoordFrom( in );
+	if ( flags & 4 )
+		fa[2] = ReadBitCoordFrom( in );
+}
+
+template < class READER >
+static FORCEINLINE void ReadBitVec3NormalFrom( READER &in, Vector& fa )
+{
+	unsigned int flags = in.ReadUBitLong( 2 );
+
+	if ( flags & 1 )
+		fa[0] = ReadBitNormalFrom( in );
+	else
+		fa[0] = 0.0f;
+
+	if ( flags & 2 )
+		fa[1] = ReadBitNormalFrom( in );
+	else
+		fa[1] = 0.0f;
+
+	// The first two imply the third (but not its sign)
+	int znegative = in.ReadOneBit();
+
+	float fafafbfb = fa[0] * fa[0] + fa[1] * fa[1];
+	if (fafafbfb < 1.0f)
+		fa[2] = sqrt( 1.0f - fafafbfb );
+	else
+		fa[2] = 0.0f;
+
+	if (znegative)
+		fa[2] = -fa[2];
+}
+
+float bf_read::ReadBitCoord (void)
+{
+#if defined( BB_PROFILING )
+	VPROF( "bf_read::ReadBitCoord" );
+#endif
+	return ReadBitCoordFrom( *this );
+}
+
+float bf_read::ReadBitCoordMP( bool bIntegral, bool bLowPrecision )
+{
+#if defined( BB_PROFILING )
+	VPROF( "bf_read::ReadBitCoordMP" );
+#endif
+	return ReadBitCoordMPFrom( *this, bIntegral, bLowPrecision );
+}
+
 unsigned int bf_read::ReadBitCoordBits (void)
 {
 #if defined( BB_PROFILING )
@@ -1270,75 +1494,119 @@ unsigned int bf_read::ReadBitCoordMPBits( bool bIntegral, bool bLowPrecision )
 
 void bf_read::ReadBitVec3Coord( Vector& fa )
 {
-	int		xflag, yflag, zflag;
-
-	// This vector must be initialized! Otherwise, If any of the flags aren't set, 
-	// the corresponding component will not be read and will be stack garbage.
-	fa.Init( 0, 0, 0 );
-
-	xflag = ReadOneBit();
-	yflag = ReadOneBit(); 
-	zflag = ReadOneBit();
+	if ( GetNumBitsLeft() < 3 + 3 * BITCOORD_MAX_BITS )
+	{
+		// Might run out, let ReadUBitLong sort out the overflow
+		ReadBitVec3CoordFrom( *this, fa );
+		return;
+	}
 
-	if ( xflag )
-		fa[0] = ReadBitCoord();
-	if ( yflag )
-		fa[1] = ReadBitCoord();
-	if ( zflag )
-		fa[2] = ReadBitCoord();
+	CBitReadAccumulator in( this );
+	ReadBitVec3CoordFrom( in, fa );
+	in.Finish();
 }
 
 float bf_read::ReadBitNormal (void)
 {
-	// Read the sign bit
-	int	signbit = ReadOneBit();
-
-	// Read the fractional part
-	unsigned int fractval = ReadUBitLong( NORMAL_FRACTIONAL_BITS );
+	return ReadBitNormalFrom( *this );
+}
 
-	// Calculate the correct floating point value
-	float value = (float)fractval * NORMAL_RESOLUTION;
+void bf_read::ReadBitVec3Normal( Vector& fa )
+{
+	if ( GetNumBitsLeft() < 3 + 2 * BITNORMAL_BITS )
+	{
+		ReadBitVec3NormalFrom( *this, fa );
+		return;
+	}
 
-	// Fixup the sign if negative.
-	if ( signbit )
-		value = -value;
+	CBitReadAccumulator in( this );
+	ReadBitVec3NormalFrom( in, fa );
+	in.Finish();
+}
 
-	return value;
+void bf_read::ReadBitAngles( QAngle& fa )
+{
+	Vector tmp;
+	ReadBitVec3Coord( tmp );
+	fa.Init( tmp.x, tmp.y, tmp.z );
 }
 
-void bf_read::ReadBitVec3Normal( Vector& fa )
+void bf_read::ReadBitAngleArray( float *pOut, int nCount, int numbits )
 {
-	int xflag = ReadOneBit();
-	int yflag = ReadOneBit(); 
+	if ( GetNumBitsLeft() < nCount * numbits )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			pOut[i] = ReadBitAngle( numbits );
+		}
+		return;
+	}
 
-	if (xflag)
-		fa[0] = ReadBitNormal();
-	else
-		fa[0] = 0.0f;
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = DecodeBitAngle( in.ReadUBitLong( numbits ), numbits );
+	}
+	in.Finish();
+}
 
-	if (yflag)
-		fa[1] = ReadBitNormal();
-	else
-		fa[1] = 0.0f;
+void bf_read::ReadBitCoordArray( float *pOut, int nCount )
+{
+	// Coords are variable length, so a run near the end of the buffer may be
+	// valid without leaving room for the longest encoding; read those singly
+	if ( GetNumBitsLeft() < nCount * BITCOORD_MAX_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			pOut[i] = ReadBitCoord();
+		}
+		return;
+	}
 
-	// The first two imply the third (but not its sign)
-	int znegative = ReadOneBit();
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = ReadBitCoordFrom( in );
+	}
+	in.Finish();
+}
 
-	float fafafbfb = fa[0] * fa[0] + fa[1] * fa[1];
-	if (fafafbfb < 1.0f)
-		fa[2] = sqrt( 1.0f - fafafbfb );
-	else
-		fa[2] = 0.0f;
+void bf_read::ReadBitCoordMPArray( float *pOut, int nCount, bool bIntegral, bool bLowPrecision )
+{
+	if ( GetNumBitsLeft() < nCount * BITCOORDMP_MAX_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			pOut[i] = ReadBitCoordMP( bIntegral, bLowPrecision );
+		}
+		return;
+	}
 
-	if (znegative)
-		fa[2] = -fa[2];
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = ReadBitCoordMPFrom( in, bIntegral, bLowPrecision );
+	}
+	in.Finish();
 }
 
-void bf_read::ReadBitAngles( QAngle& fa )
+void bf_read::ReadBitNormalArray( float *pOut, int nCount )
 {
-	Vector tmp;
-	ReadBitVec3Coord( tmp );
-	fa.Init( tmp.x, tmp.y, tmp.z );
+	if ( GetNumBitsLeft() < nCount * BITNORMAL_BITS )
+	{
+		for ( int i = 0; i < nCount; i++ )
+		{
+			pOut[i] = ReadBitNormal();
+		}
+		return;
+	}
+
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = ReadBitNormalFrom( in );
+	}
+	in.Finish();
 }
 
 int64 bf_read::ReadLongLong()
@@ -0,0 +1,436 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: MD5 and SHA1 over several independent buffers at once. Each SSE2
+//			lane runs its own hash, so four buffers cost about as much as one.
+//			Lanes pick up the next buffer as soon as theirs is done, so the
+//			buffers don't need to be the same size.
+//
+//=============================================================================//
+
+#include "basetypes.h"
+#include "checksum_md5.h"
+#include "checksum_sha1.h"
+#include "processor_detect.h"
+#include "tier0/dbg.h"
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#include <emmintrin.h>
+#define CHECKSUM_MULTIBUFFER_SIMD
+#endif
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#ifdef CHECKSUM_MULTIBUFFER_SIMD
+
+#define MULTIBUFFER_LANES		4
+#define MULTIBUFFER_BLOCK_SIZE	64
+
+#define ROTL4( v, s )	_mm_or_si128( _mm_slli_epi32( v, s ), _mm_srli_epi32( v, 32 - ( s ) ) )
+#define ADD4( a, b )	_mm_add_epi32( a, b )
+#define CONST4( k )		_mm_set1_epi32( (int)( k ) )
+
+//-----------------------------------------------------------------------------
+// Loads one 64 byte block per lane as 16 words, word i of every lane in W[i]
+//-----------------------------------------------------------------------------
+static inline void LoadTransposedBlocks( __m128i W[16], const unsigned char * const pBlocks[MULTIBUFFER_LANES] )
+{
+	for ( int j = 0; j < 16; j += 4 )
+	{
+		__m128i r0 = _mm_loadu_si128( (const __m128i *)( pBlocks[0] + j * 4 ) );
+		__m128i r1 = _mm_loadu_si128( (const __m128i *)( pBlocks[1] + j * 4 ) );
+		__m128i r2 = _mm_loadu_si128( (const __m128i *)( pBlocks[2] + j * 4 ) );
+		__m128i r3 = _mm_loadu_si128( (const __m128i *)( pBlocks[3] + j * 4 ) );
+
+		__m128i t0 = _mm_unpacklo_epi32( r0, r1 );
+		__m128i t1 = _mm_unpacklo_epi32( r2, r3 );
+		__m128i t2 = _mm_unpackhi_epi32( r0, r1 );
+		__m128i t3 = _mm_unpackhi_epi32( r2, r3 );
+
+		W[j + 0] = _mm_unpacklo_epi64( t0, t1 );
+		W[j + 1] = _mm_unpackhi_epi64( t0, t1 );
+		W[j + 2] = _mm_unpacklo_epi64( t2, t3 );
+		W[j + 3] = _mm_unpackhi_epi64( t2, t3 );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// MD5, the same steps as MD5Transform
+//-----------------------------------------------------------------------------
+#define MD5_F1_4( x, y, z )	_mm_xor_si128( z, _mm_and_si128( x, _mm_xor_si128( y, z ) ) )
+#define MD5_F2_4( x, y, z )	MD5_F1_4( z, x, y )
+#define MD5_F3_4( x, y, z )	_mm_xor_si128( _mm_xor_si128( x, y ), z )
+#define MD5_F4_4( x, y, z )	_mm_xor_si128( y, _mm_or_si128( x, _mm_xor_si128( z, allOnes ) ) )
+
+#define MD5STEP4( f, w, x, y, z, data, k, s ) \
+	( w = ADD4( w, ADD4( f( x, y, z ), ADD4( data, CONST4( k ) ) ) ), w = ADD4( ROTL4( w, s ), x ) )
+
+struct MD5MultiBuffer_t
+{
+	enum
+	{
+		STATE_WORDS = 4,
+		BIG_ENDIAN_LENGTH = 0,
+	};
+
+	typedef MD5Value_t Result_t;
+
+	static const unsigned int s_InitialState[STATE_WORDS];
+
+	static void Transform( __m128i state[STATE_WORDS], const unsigned char * const pBlocks[MULTIBUFFER_LANES] )
+	{
+		__m128i W[16];
+		LoadTransposedBlocks( W, pBlocks );
+
+		const __m128i allOnes = _mm_set1_epi32( -1 );
+		__m128i a = state[0];
+		__m128i b = state[1];
+		__m128i c = state[2];
+		__m128i d = state[3];
+
+	MD5STEP4( MD5_F1_4, a, b, c, d, W[0], 0xd76aa478, 7 );
+	MD5STEP4( MD5_F1_4, d, a, b, c, W[1], 0xe8c7b756, 12 );
+	MD5STEP4( MD5_F1_4, c, d, a, b, W[2], 0x242070db, 17 );
+	MD5STEP4( MD5_F1_4, b, c, d, a, W[3], 0xc1bdceee, 22 );
+	MD5STEP4( MD5_F1_4, a, b, c, d, W[4], 0xf57c0faf, 7 );
+	MD5STEP4( MD5_F1_4, d, a, b, c, W[5], 0x4787c62a, 12 );
+	MD5STEP4( MD5_F1_4, c, d, a, b, W[6], 0xa8304613, 17 );
+	MD5STEP4( MD5_F1_4, b, c, d, a, W[7], 0xfd469501, 22 );
+	MD5STEP4( MD5_F1_4, a, b, c, d, W[8], 0x698098d8, 7 );
+	MD5STEP4( MD5_F1_4, d, a, b, c, W[9], 0x8b44f7af, 12 );
+	MD5STEP4( MD5_F1_4, c, d, a, b, W[10], 0xffff5bb1, 17 );
+	MD5STEP4( MD5_F1_4, b, c, d, a, W[11], 0x895cd7be, 22 );
+	MD5STEP4( MD5_F1_4, a, b, c, d, W[12], 0x6b901122, 7 );
+	MD5STEP4( MD5_F1_4, d, a, b, c, W[13], 0xfd987193, 12 );
+	MD5STEP4( MD5_F1_4, c, d, a, b, W[14], 0xa679438e, 17 );
+	MD5STEP4( MD5_F1_4, b, c, d, a, W[15], 0x49b40821, 22 );
+
+	MD5STEP4( MD5_F2_4, a, b, c, d, W[1], 0xf61e2562, 5 );
+	MD5STEP4( MD5_F2_4, d, a, b, c, W[6], 0xc040b340, 9 );
+	MD5STEP4( MD5_F2_4, c, d, a, b, W[11], 0x265e5a51, 14 );
+	MD5STEP4( MD5_F2_4, b, c, d, a, W[0], 0xe9b6c7aa, 20 );
+	MD5STEP4( MD5_F2_4, a, b, c, d, W[5], 0xd62f105d, 5 );
+	MD5STEP4( MD5_F2_4, d, a, b, c, W[10], 0x02441453, 9 );
+	MD5STEP4( MD5_F2_4, c, d, a, b, W[15], 0xd8a1e681, 14 );
+	MD5STEP4( MD5_F2_4, b, c, d, a, W[4], 0xe7d3fbc8, 20 );
+	MD5STEP4( MD5_F2_4, a, b, c, d, W[9], 0x21e1cde6, 5 );
+	MD5STEP4( MD5_F2_4, d, a, b, c, W[14], 0xc33707d6, 9 );
+	MD5STEP4( MD5_F2_4, c, d, a, b, W[3], 0xf4d50d87, 14 );
+	MD5STEP4( MD5_F2_4, b, c, d, a, W[8], 0x455a14ed, 20 );
+	MD5STEP4( MD5_F2_4, a, b, c, d, W[13], 0xa9e3e905, 5 );
+	MD5STEP4( MD5_F2_4, d, a, b, c, W[2], 0xfcefa3f8, 9 );
+	MD5STEP4( MD5_F2_4, c, d, a, b, W[7], 0x676f02d9, 14 );
+	MD5STEP4( MD5_F2_4, b, c, d, a, W[12], 0x8d2a4c8a, 20 );
+
+	MD5STEP4( MD5_F3_4, a, b, c, d, W[5], 0xfffa3942, 4 );
+	MD5STEP4( MD5_F3_4, d, a, b, c, W[8], 0x8771f681, 11 );
+	MD5STEP4( MD5_F3_4, c, d, a, b, W[11], 0x6d9d6122, 16 );
+	MD5STEP4( MD5_F3_4, b, c, d, a, W[14], 0xfde5380c, 23 );
+	MD5STEP4( MD5_F3_4, a, b, c, d, W[1], 0xa4beea44, 4 );
+	MD5STEP4( MD5_F3_4, d, a, b, c, W[4], 0x4bdecfa9, 11 );
+	MD5STEP4( MD5_F3_4, c, d, a, b, W[7], 0xf6bb4b60, 16 );
+	MD5STEP4( MD5_F3_4, b, c, d, a, W[10], 0xbebfbc70, 23 );
+	MD5STEP4( MD5_F3_4, a, b, c, d, W[13], 0x289b7ec6, 4 );
+	MD5STEP4( MD5_F3_4, d, a, b, c, W[0], 0xeaa127fa, 11 );
+	MD5STEP4( MD5_F3_4, c, d, a, b, W[3], 0xd4ef3085, 16 );
+	MD5STEP4( MD5_F3_4, b, c, d, a, W[6], 0x04881d05, 23 );
+	MD5STEP4( MD5_F3_4, a, b, c, d, W[9], 0xd9d4d039, 4 );
+	MD5STEP4( MD5_F3_4, d, a, b, c, W[12], 0xe6db99e5, 11 );
+	MD5STEP4( MD5_F3_4, c, d, a, b, W[15], 0x1fa27cf8, 16 );
+	MD5STEP4( MD5_F3_4, b, c, d, a, W[2], 0xc4ac5665, 23 );
+
+	MD5STEP4( MD5_F4_4, a, b, c, d, W[0], 0xf4292244, 6 );
+	MD5STEP4( MD5_F4_4, d, a, b, c, W[7], 0x432aff97, 10 );
+	MD5STEP4( MD5_F4_4, c, d, a, b, W[14], 0xab9423a7, 15 );
+	MD5STEP4( MD5_F4_4, b, c, d, a, W[5], 0xfc93a039, 21 );
+	MD5STEP4( MD5_F4_4, a, b, c, d, W[12], 0x655b59c3, 6 );
+	MD5STEP4( MD5_F4_4, d, a, b, c, W[3], 0x8f0ccc92, 10 );
+	MD5STEP4( MD5_F4_4, c, d, a, b, W[10], 0xffeff47d, 15 );
+	MD5STEP4( MD5_F4_4, b, c, d, a, W[1], 0x85845dd1, 21 );
+	MD5STEP4( MD5_F4_4, a, b, c, d, W[8], 0x6fa87e4f, 6 );
+	MD5STEP4( MD5_F4_4, d, a, b, c, W[15], 0xfe2ce6e0, 10 );
+	MD5STEP4( MD5_F4_4, c, d, a, b, W[6], 0xa3014314, 15 );
+	MD5STEP4( MD5_F4_4, b, c, d, a, W[13], 0x4e0811a1, 21 );
+	MD5STEP4( MD5_F4_4, a, b, c, d, W[4], 0xf7537e82, 6 );
+	MD5STEP4( MD5_F4_4, d, a, b, c, W[11], 0xbd3af235, 10 );
+	MD5STEP4( MD5_F4_4, c, d, a, b, W[2], 0x2ad7d2bb, 15 );
+	MD5STEP4( MD5_F4_4, b, c, d, a, W[9], 0xeb86d391, 21 );
+
+		state[0] = ADD4( state[0], a );
+		state[1] = ADD4( state[1], b );
+		state[2] = ADD4( state[2], c );
+		state[3] = ADD4( state[3], d );
+	}
+
+	static void StoreResult( const unsigned int state[STATE_WORDS], Result_t &result )
+	{
+		for ( int i = 0; i < MD5_DIGEST_LENGTH; i++ )
+		{
+			result.bits[i] = (unsigned char)( state[i >> 2] >> ( ( i & 3 ) * 8 ) );
+		}
+	}
+};
+
+const unsigned int MD5MultiBuffer_t::s_InitialState[MD5MultiBuffer_t::STATE_WORDS] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+//-----------------------------------------------------------------------------
+// SHA1, the same rounds as CSHA1::Transform
+//-----------------------------------------------------------------------------
+static inline __m128i ByteSwap4( __m128i v )
+{
+	v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+	return _mm_or_si128( _mm_slli_epi32( v, 16 ), _mm_srli_epi32( v, 16 ) );
+}
+
+struct SHA1MultiBuffer_t
+{
+	enum
+	{
+		STATE_WORDS = 5,
+		BIG_ENDIAN_LENGTH = 1,
+	};
+
+	typedef SHADigest_t Result_t;
+
+	static const unsigned int s_InitialState[STATE_WORDS];
+
+	static void Transform( __m128i state[STATE_WORDS], const unsigned char * const pBlocks[MULTIBUFFER_LANES] )
+	{
+		__m128i W[16];
+		LoadTransposedBlocks( W, pBlocks );
+		for ( int i = 0; i < 16; i++ )
+		{
+			W[i] = ByteSwap4( W[i] );
+		}
+
+		__m128i a = state[0];
+		__m128i b = state[1];
+		__m128i c = state[2];
+		__m128i d = state[3];
+		__m128i e = state[4];
+
+		int i = 0;
+		for ( ; i < 20; i++ )
+		{
+			__m128i f = _mm_xor_si128( _mm_and_si128( b, _mm_xor_si128( c, d ) ), d );
+			SHA1Step( a, b, c, d, e, f, CONST4( 0x5A827999 ), W, i );
+		}
+		for ( ; i < 40; i++ )
+		{
+			__m128i f = _mm_xor_si128( _mm_xor_si128( b, c ), d );
+			SHA1Step( a, b, c, d, e, f, CONST4( 0x6ED9EBA1 ), W, i );
+		}
+		for ( ; i < 60; i++ )
+		{
+			__m128i f = _mm_or_si128( _mm_and_si128( _mm_or_si128( b, c ), d ), _mm_and_si128( b, c ) );
+			SHA1Step( a, b, c, d, e, f, CONST4( 0x8F1BBCDC ), W, i );
+		}
+		for ( ; i < 80; i++ )
+		{
+			__m128i f = _mm_xor_si128( _mm_xor_si128( b, c ), d );
+			SHA1Step( a, b, c, d, e, f, CONST4( 0xCA62C1D6 ), W, i );
+		}
+
+		state[0] = ADD4( state[0], a );
+		state[1] = ADD4( state[1], b );
+		state[2] = ADD4( state[2], c );
+		state[3] = ADD4( state[3], d );
+		state[4] = ADD4( state[4], e );
+	}
+
+	static inline void SHA1Step( __m128i &a, __m128i &b, __m128i &c, __m128i &d, __m128i &e, __m128i f, __m128i k, __m128i W[16], int i )
+	{
+		if ( i >= 16 )
+		{
+			W[i & 15] = ROTL4( _mm_xor_si128( _mm_xor_si128( W[( i + 13 ) & 15], W[( i + 8 ) & 15] ), _mm_xor_si128( W[( i + 2 ) & 15], W[i & 15] ) ), 1 );
+		}
+
+		__m128i temp = ADD4( ADD4( ROTL4( a, 5 ), f ), ADD4( ADD4( e, k ), W[i & 15] ) );
+		e = d;
+		d = c;
+		c = ROTL4( b, 30 );
+		b = a;
+		a = temp;
+	}
+
+	static void StoreResult( const unsigned int state[STATE_WORDS], Result_t &result )
+	{
+		for ( int i = 0; i < (int)k_cubHash; i++ )
+		{
+			result[i] = (unsigned char)( state[i >> 2] >> ( ( 3 - ( i & 3 ) ) * 8 ) );
+		}
+	}
+};
+
+const unsigned int SHA1MultiBuffer_t::s_InitialState[SHA1MultiBuffer_t::STATE_WORDS] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+//-----------------------------------------------------------------------------
+// Purpose: Feeds the buffers through the lanes. A lane's blocks are the whole
+//			blocks of its buffer, read in place, then one or two blocks
+//			holding the remainder, the padding and the length.
+//-----------------------------------------------------------------------------
+template < class HASH >
+static void ProcessMultipleBuffersSIMD( const void * const *ppBuffers, const unsigned int *pnLengths, int nBuffers, typename HASH::Result_t *pResults )
+{
+	struct Lane_t
+	{
+		int					m_iBuffer;		// -1 when idle
+		const unsigned char	*m_pData;
+		unsigned int		m_nDataBlocks;
+		unsigned int		m_nBlocks;		// including the tail
+		unsigned int		m_iBlock;
+		unsigned char		m_Tail[MULTIBUFFER_BLOCK_SIZE * 2];
+	};
+
+	static const unsigned char s_IdleBlock[MULTIBUFFER_BLOCK_SIZE] = { 0 };
+
+	Lane_t lanes[MULTIBUFFER_LANES];
+	__m128i state[HASH::STATE_WORDS];
+	for ( int i = 0; i < HASH::STATE_WORDS; i++ )
+	{
+		state[i] = _mm_setzero_si128();
+	}
+
+	for ( int iLane = 0; iLane < MULTIBUFFER_LANES; iLane++ )
+	{
+		lanes[iLane].m_iBuffer = -1;
+	}
+
+	int iNextBuffer = 0;
+	for ( ;; )
+	{
+		// Start idle lanes on the next buffers
+		int nActive = 0;
+		for ( int iLane = 0; iLane < MULTIBUFFER_LANES; iLane++ )
+		{
+			Lane_t &lane = lanes[iLane];
+			if ( lane.m_iBuffer < 0 && iNextBuffer < nBuffers )
+			{
+				lane.m_iBuffer = iNextBuffer++;
+				lane.m_pData = (const unsigned char *)ppBuffers[lane.m_iBuffer];
+				lane.m_iBlock = 0;
+
+				unsigned int nLength = pnLengths[lane.m_iBuffer];
+				unsigned int nRemainder = nLength % MULTIBUFFER_BLOCK_SIZE;
+				lane.m_nDataBlocks = nLength / MULTIBUFFER_BLOCK_SIZE;
+				lane.m_nBlocks = lane.m_nDataBlocks + ( ( nRemainder < MULTIBUFFER_BLOCK_SIZE - 8 ) ? 1 : 2 );
+
+				unsigned int nTailSize = ( lane.m_nBlocks - lane.m_nDataBlocks ) * MULTIBUFFER_BLOCK_SIZE;
+				memset( lane.m_Tail, 0, sizeof( lane.m_Tail ) );
+				memcpy( lane.m_Tail, lane.m_pData + nLength - nRemainder, nRemainder );
+				lane.m_Tail[nRemainder] = 0x80;
+
+				uint64 nBits = (uint64)nLength * 8;
+				for ( int i = 0; i < 8; i++ )
+				{
+					int iByte = HASH::BIG_ENDIAN_LENGTH ? nTailSize - 1 - i : nTailSize - 8 + i;
+					lane.m_Tail[iByte] = (unsigned char)( nBits >> ( i * 8 ) );
+				}
+
+				unsigned int laneState[MULTIBUFFER_LANES];
+				for ( int i = 0; i < HASH::STATE_WORDS; i++ )
+				{
+					_mm_storeu_si128( (__m128i *)laneState, state[i] );
+					laneState[iLane] = HASH::s_InitialState[i];
+					state[i] = _mm_loadu_si128( (const __m128i *)laneState );
+				}
+			}
+
+			if ( lane.m_iBuffer >= 0 )
+			{
+				nActive++;
+			}
+		}
+
+		if ( !nActive )
+			break;
+
+		const unsigned char *pBlocks[MULTIBUFFER_LANES];
+		for ( int iLane = 0; iLane < MULTIBUFFER_LANES; iLane++ )
+		{
+			const Lane_t &lane = lanes[iLane];
+			if ( lane.m_iBuffer < 0 )
+			{
+				pBlocks[iLane] = s_IdleBlock;
+			}
+			else if ( lane.m_iBlock < lane.m_nDataBlocks )
+			{
+				pBlocks[iLane] = lane.m_pData + lane.m_iBlock * MULTIBUFFER_BLOCK_SIZE;
+			}
+			else
+			{
+				pBlocks[iLane] = lane.m_Tail + ( lane.m_iBlock - lane.m_nDataBlocks ) * MULTIBUFFER_BLOCK_SIZE;
+			}
+		}
+
+		HASH::Transform( state, pBlocks );
+
+		// Hand out the results of lanes that just finished
+		for ( int iLane = 0; iLane < MULTIBUFFER_LANES; iLane++ )
+		{
+			Lane_t &lane = lanes[iLane];
+			if ( lane.m_iBuffer < 0 || ++lane.m_iBlock < lane.m_nBlocks )
+				continue;
+
+			unsigned int laneState[HASH::STATE_WORDS];
+			for ( int i = 0; i < HASH::STATE_WORDS; i++ )
+			{
+				unsigned int stateWords[MULTIBUFFER_LANES];
+				_mm_storeu_si128( (__m128i *)stateWords, state[i] );
+				laneState[i] = stateWords[iLane];
+			}
+
+			HASH::StoreResult( laneState, pResults[lane.m_iBuffer] );
+			lane.m_iBuffer = -1;
+		}
+	}
+}
+
+#endif // CHECKSUM_MULTIBUFFER_SIMD
+
+static bool MultiBufferSIMDAvailable()
+{
+#ifdef CHECKSUM_MULTIBUFFER_SIMD
+	static int s_nAvailable = -1;
+	if ( s_nAvailable < 0 )
+	{
+		s_nAvailable = CheckSSE2Technology() ? 1 : 0;
+	}
+	return s_nAvailable != 0;
+#else
+	return false;
+#endif
+}
+
+void MD5_ProcessMultipleBuffers( const void * const *ppBuffers, const int *pnLengths, int nBuffers, MD5Value_t *pResults )
+{
+#ifdef CHECKSUM_MULTIBUFFER_SIMD
+	if ( nBuffers > 1 && MultiBufferSIMDAvailable() )
+	{
+		COMPILE_TIME_ASSERT( sizeof( int ) == sizeof( unsigned int ) );
+		ProcessMultipleBuffersSIMD< MD5MultiBuffer_t >( ppBuffers, (const unsigned int *)pnLengths, nBuffers, pResults );
+		return;
+	}
+#endif
+
+	for ( int i = 0; i < nBuffers; i++ )
+	{
+		MD5_ProcessSingleBuffer( ppBuffers[i], pnLengths[i], pResults[i] );
+	}
+}
+
+void SHA1_ProcessMultipleBuffers( const void * const *ppBuffers, const unsigned int *pnLengths, int nBuffers, SHADigest_t *pDigests )
+{
+#ifdef CHECKSUM_MULTIBUFFER_SIMD
+	if ( nBuffers > 1 && MultiBufferSIMDAvailable() )
+	{
+		ProcessMultipleBuffersSIMD< SHA1MultiBuffer_t >( ppBuffers, pnLengths, nBuffers, pDigests );
+		return;
+	}
+#endif
+
+	for ( int i = 0; i < nBuffers; i++ )
+	{
+		GenerateHash( pDigests[i], ppBuffers[i], pnLengths[i] );
+	}
+}
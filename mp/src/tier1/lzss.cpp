@@ -0,0 +1,336 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+//	LZSS Codec. Designed for fast cheap gametime encoding/decoding. Compression results
+//	are	not aggresive as other alogrithms, but gets 2:1 on most arbitrary uncompressed data.
+//
+//	The stream is a run of groups of eight items. Each group starts with a command
+//	byte, read from the low bit up; a clear bit is a literal byte, a set bit is a
+//	two byte back reference of a 12 bit distance and a 4 bit length. A reference
+//	of length one ends the stream.
+//
+//=====================================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier1/lzss.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define LZSS_LOOKSHIFT		4
+#define LZSS_LOOKAHEAD		( 1 << LZSS_LOOKSHIFT )
+#define LZSS_MAX_DISTANCE	4096	// what 12 bits of distance can reach
+#define LZSS_MIN_MATCH		3
+#define LZSS_HASH_BITS		12
+#define LZSS_HASH_SIZE		( 1 << LZSS_HASH_BITS )
+#define LZSS_MAX_CHAIN		256		// candidates tried per position
+
+// A match needs three bytes, so positions are hashed on their first three
+static inline int LZSSHash( const unsigned char *pData )
+{
+	return ( ( pData[0] << 8 ) ^ ( pData[1] << 4 ) ^ pData[2] ) & ( LZSS_HASH_SIZE - 1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Links a position into its hash chain. The target slots are indexed
+//			by address, so a position's slot is the one last used a window ago,
+//			and whatever is in it has just slid out of reach
+//-----------------------------------------------------------------------------
+void CLZSS::BuildHash( const unsigned char *pData )
+{
+	lzss_node_t *pTarget = &m_pHashTarget[ (uintp)pData & ( m_nWindowSize - 1 ) ];
+	if ( pTarget->pData )
+	{
+		lzss_list_t *pOldList = &m_pHashTable[ LZSSHash( pTarget->pData ) ];
+		if ( pTarget->pPrev )
+		{
+			pTarget->pPrev->pNext = pTarget->pNext;
+		}
+		else
+		{
+			pOldList->pStart = pTarget->pNext;
+		}
+
+		if ( pTarget->pNext )
+		{
+			pTarget->pNext->pPrev = pTarget->pPrev;
+		}
+		else
+		{
+			pOldList->pEnd = pTarget->pPrev;
+		}
+	}
+
+	// Newest first, so the nearest matches are tried first
+	lzss_list_t *pList = &m_pHashTable[ LZSSHash( pData ) ];
+	pTarget->pData = pData;
+	pTarget->pPrev = NULL;
+	pTarget->pNext = pList->pStart;
+	if ( pList->pStart )
+	{
+		pList->pStart->pPrev = pTarget;
+	}
+	else
+	{
+		pList->pEnd = pTarget;
+	}
+	pList->pStart = pTarget;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Compresses into a caller supplied buffer of at least inputLength
+//			bytes. Returns NULL, and leaves the buffer's contents undefined, if
+//			the result wouldn't be smaller than the input
+//-----------------------------------------------------------------------------
+unsigned char *CLZSS::CompressNoAlloc( const unsigned char *pInput, int inputLength, unsigned char *pOutputBuf, unsigned int *pOutputSize )
+{
+	if ( inputLength <= (int)sizeof( lzss_header_t ) + 8 )
+		return NULL;
+
+	// Distances are stored in 12 bits
+	Assert( ( m_nWindowSize & ( m_nWindowSize - 1 ) ) == 0 );
+	if ( m_nWindowSize > LZSS_MAX_DISTANCE )
+	{
+		m_nWindowSize = LZSS_MAX_DISTANCE;
+	}
+
+	// The output needn't be aligned
+	lzss_header_t header;
+	header.id = LZSS_ID;
+	header.actualSize = LittleLong( inputLength );
+	memcpy( pOutputBuf, &header, sizeof( header ) );
+
+	m_pHashTable = new lzss_list_t[ LZSS_HASH_SIZE ];
+	memset( m_pHashTable, 0, LZSS_HASH_SIZE * sizeof( lzss_list_t ) );
+	m_pHashTarget = new lzss_node_t[ m_nWindowSize ];
+	memset( m_pHashTarget, 0, m_nWindowSize * sizeof( lzss_node_t ) );
+
+	const unsigned char *pEnd = pInput + inputLength;
+	unsigned char *pOutput = pOutputBuf + sizeof( lzss_header_t );
+	unsigned char *pCmdByte = NULL;
+	int nCmdShift = 8;
+	bool bGain = true;
+
+	while ( pInput < pEnd )
+	{
+		// A command byte and a reference, plus room for the terminator, must
+		// still come in under the input size
+		if ( ( pOutput - pOutputBuf ) + 6 > inputLength )
+		{
+			bGain = false;
+			break;
+		}
+
+		if ( nCmdShift == 8 )
+		{
+			pCmdByte = pOutput++;
+			*pCmdByte = 0;
+			nCmdShift = 0;
+		}
+
+		int nMaxLength = MIN( LZSS_LOOKAHEAD, pEnd - pInput );
+		int nBestLength = 0;
+		const unsigned char *pBest = NULL;
+		if ( nMaxLength >= LZSS_MIN_MATCH )
+		{
+			int nChain = 0;
+			for ( lzss_node_t *pNode = m_pHashTable[ LZSSHash( pInput ) ].pStart; pNode && nChain < LZSS_MAX_CHAIN; pNode = pNode->pNext, ++nChain )
+			{
+				const unsigned char *pCandidate = pNode->pData;
+				int nLength = 0;
+				while ( nLength < nMaxLength && pCandidate[ nLength ] == pInput[ nLength ] )
+				{
+					++nLength;
+				}
+
+				if ( nLength > nBestLength )
+				{
+					nBestLength = nLength;
+					pBest = pCandidate;
+					if ( nLength == nMaxLength )
+						break;
+				}
+			}
+		}
+
+		int nConsumed;
+		if ( nBestLength >= LZSS_MIN_MATCH )
+		{
+			int nPosition = ( pInput - pBest ) - 1;
+			*pCmdByte |= ( 1 << nCmdShift );
+			*pOutput++ = (unsigned char)( nPosition >> LZSS_LOOKSHIFT );
+			*pOutput++ = (unsigned char)( ( ( nPosition & ( LZSS_LOOKAHEAD - 1 ) ) << LZSS_LOOKSHIFT ) | ( nBestLength - 1 ) );
+			nConsumed = nBestLength;
+		}
+		else
+		{
+			*pOutput++ = *pInput;
+			nConsumed = 1;
+		}
+		++nCmdShift;
+
+		for ( ; nConsumed > 0; --nConsumed, ++pInput )
+		{
+			if ( pEnd - pInput >= LZSS_MIN_MATCH )
+			{
+				BuildHash( pInput );
+			}
+		}
+	}
+
+	delete [] m_pHashTable;
+	delete [] m_pHashTarget;
+	m_pHashTable = NULL;
+	m_pHashTarget = NULL;
+
+	if ( !bGain )
+		return NULL;
+
+	// Terminator: a reference of length one
+	if ( nCmdShift == 8 )
+	{
+		pCmdByte = pOutput++;
+		*pCmdByte = 0;
+		nCmdShift = 0;
+	}
+	*pCmdByte |= ( 1 << nCmdShift );
+	*pOutput++ = 0;
+	*pOutput++ = 0;
+
+	unsigned int nOutputSize = pOutput - pOutputBuf;
+	if ( nOutputSize >= (unsigned int)inputLength )
+		return NULL;
+
+	*pOutputSize = nOutputSize;
+	return pOutputBuf;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns a new[]'d buffer, or NULL if the data didn't compress
+//-----------------------------------------------------------------------------
+unsigned char *CLZSS::Compress( const unsigned char *pInput, int inputLength, unsigned int *pOutputSize )
+{
+	if ( inputLength <= 0 )
+		return NULL;
+
+	unsigned char *pOutputBuf = new unsigned char[ inputLength ];
+	if ( !CompressNoAlloc( pInput, inputLength, pOutputBuf, pOutputSize ) )
+	{
+		delete [] pOutputBuf;
+		return NULL;
+	}
+	return pOutputBuf;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes unInputSize bytes of stream, header included, into
+//			pOutput, which must hold GetActualSize() bytes. Returns the number
+//			of bytes written, 0 on a bad or truncated stream
+//-----------------------------------------------------------------------------
+unsigned int CLZSS::SafeUncompress( const unsigned char *pInput, unsigned int unInputSize, unsigned char *pOutput, unsigned int unBufSize )
+{
+	if ( unInputSize < sizeof( lzss_header_t ) )
+		return 0;
+
+	unsigned int actualSize = GetActualSize( pInput );
+	if ( !actualSize || actualSize > unBufSize )
+		return 0;
+
+	const unsigned char *pInputEnd = pInput + unInputSize;
+	pInput += sizeof( lzss_header_t );
+
+	unsigned int totalBytes = 0;
+	int cmdByte = 0;
+	int getCmdByte = 0;
+	for ( ;; )
+	{
+		if ( !getCmdByte )
+		{
+			if ( pInput >= pInputEnd )
+				return 0;
+			cmdByte = *pInput++;
+		}
+		getCmdByte = ( getCmdByte + 1 ) & 0x07;
+
+		if ( cmdByte & 0x01 )
+		{
+			if ( pInputEnd - pInput < 2 )
+				return 0;
+
+			unsigned int position = *pInput++ << LZSS_LOOKSHIFT;
+			position |= ( *pInput >> LZSS_LOOKSHIFT );
+			unsigned int count = ( *pInput++ & 0x0F ) + 1;
+			if ( count == 1 )
+				break;
+
+			if ( position >= totalBytes || totalBytes + count > actualSize )
+				return 0;
+
+			// Byte at a time; the source may run into what's being written
+			const unsigned char *pSource = pOutput - position - 1;
+			for ( unsigned int i = 0; i < count; i++ )
+			{
+				*pOutput++ = *pSource++;
+			}
+			totalBytes += count;
+		}
+		else
+		{
+			if ( totalBytes >= actualSize || pInput >= pInputEnd )
+				return 0;
+
+			*pOutput++ = *pInput++;
+			totalBytes++;
+		}
+		cmdByte = cmdByte >> 1;
+	}
+
+	if ( totalBytes != actualSize )
+		return 0;
+
+	return totalBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: For callers that don't know the stream's size. A stream can be no
+//			longer than every byte a literal, plus the command bytes and the
+//			terminator, so the read stops there.
+//-----------------------------------------------------------------------------
+unsigned int CLZSS::SafeUncompress( const unsigned char *pInput, unsigned char *pOutput, unsigned int unBufSize )
+{
+	unsigned int actualSize = GetActualSize( pInput );
+	if ( !actualSize || actualSize > unBufSize )
+		return 0;
+
+	unsigned int maxInputSize = sizeof( lzss_header_t ) + actualSize + actualSize / 8 + 4;
+	return SafeUncompress( pInput, maxInputSize, pOutput, unBufSize );
+}
+
+unsigned int CLZSS::Uncompress( const unsigned char *pInput, unsigned char *pOutput )
+{
+	return SafeUncompress( pInput, pOutput, GetActualSize( pInput ) );
+}
+
+bool CLZSS::IsCompressed( const unsigned char *pInput )
+{
+	if ( !pInput )
+		return false;
+
+	lzss_header_t header;
+	memcpy( &header, pInput, sizeof( header ) );
+	return ( header.id == LZSS_ID );
+}
+
+unsigned int CLZSS::GetActualSize( const unsigned char *pInput )
+{
+	if ( !IsCompressed( pInput ) )
+		return 0;
+
+	lzss_header_t header;
+	memcpy( &header, pInput, sizeof( header ) );
+	return LittleLong( header.actualSize );
+}
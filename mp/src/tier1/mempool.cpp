@@ -12,6 +12,12 @@
 #include <ctype.h>
 #include "tier1/strtools.h"
 
+#if defined( _WIN32 ) && !defined( _X360 )
+#include "winlite.h"
+#elif defined( POSIX )
+#include <pthread.h>
+#endif
+
 // Should be last include
 #include "tier0/memdbgon.h"
  
@@ -310,3 +316,487 @@ void CUtlMemoryPool::Free( void *memBlock )
 }
 
 
+
+
+//-----------------------------------------------------------------------------
+// CMemoryPoolMT per thread magazines
+//-----------------------------------------------------------------------------
+
+// Thread safe pools tracked per module. Pools past this always take the lock
+// and don't show up in the stats.
+#define MEMPOOLMT_MAX_POOLS		64
+
+// About how many bytes a magazine moves to or from its pool at a time
+#define MEMPOOLMT_BATCH_BYTES	4096
+
+struct MemoryPoolMagazine_t
+{
+	void	*m_pHead;		// free blocks, linked through their first word
+	int		m_nCount;
+	int		m_nAllocs;		// not yet added to the pool's stats
+	int		m_nFrees;
+};
+
+struct MemoryPoolThreadCache_t
+{
+	MemoryPoolMagazine_t	m_Magazines[MEMPOOLMT_MAX_POOLS];
+	MemoryPoolThreadCache_t	*m_pNext;
+	bool					m_bInUse;
+};
+
+// Pools may be constructed by static initializers in other files, so all of
+// this is either plain data or safe to use zero filled
+static CThreadFastMutex			s_PoolMTMutex;
+static CMemoryPoolMT			*s_pPoolsMT[MEMPOOLMT_MAX_POOLS];
+static MemoryPoolThreadCache_t	*s_pThreadCaches;
+
+enum ThreadCacheOp_t
+{
+	THREADCACHE_FIND,
+	THREADCACHE_CREATE,
+	THREADCACHE_RELEASE,
+};
+
+#if defined( _WIN32 ) && !defined( _X360 )
+#define THREADCACHE_EXIT_CALLBACK	WINAPI
+#else
+#define THREADCACHE_EXIT_CALLBACK
+#endif
+
+//-----------------------------------------------------------------------------
+// Purpose: Flushes and releases a thread's cache when the thread exits, so
+//			threads that never call FlushThreadCache don't hold theirs
+//			forever. A key that calls back into the module is only safe while
+//			the module is loaded, so it's deleted with it. Safe to use zero
+//			filled, and only touched under s_PoolMTMutex.
+//-----------------------------------------------------------------------------
+class CThreadCacheExitHook
+{
+public:
+	~CThreadCacheExitHook()
+	{
+		AUTO_LOCK( s_PoolMTMutex );
+		if ( !m_bCreated )
+			return;
+
+		m_bCreated = false;
+#if defined( _WIN32 ) && !defined( _X360 )
+		FlsFree( m_iSlot );
+#elif defined( POSIX )
+		pthread_key_delete( m_Key );
+#endif
+	}
+
+	// The calling thread's cache, or NULL once it has been released
+	void Set( MemoryPoolThreadCache_t *pCache )
+	{
+		if ( !m_bCreated )
+		{
+			if ( !pCache )
+				return;
+
+#if defined( _WIN32 ) && !defined( _X360 )
+			m_iSlot = FlsAlloc( &OnThreadExit );
+			m_bCreated = ( m_iSlot != FLS_OUT_OF_INDEXES );
+#elif defined( POSIX )
+			m_bCreated = ( pthread_key_create( &m_Key, &OnThreadExit ) == 0 );
+#endif
+			if ( !m_bCreated )
+				return;
+		}
+
+#if defined( _WIN32 ) && !defined( _X360 )
+		FlsSetValue( m_iSlot, pCache );
+#elif defined( POSIX )
+		pthread_setspecific( m_Key, pCache );
+#endif
+	}
+
+private:
+	static void THREADCACHE_EXIT_CALLBACK OnThreadExit( void *pCache )
+	{
+		// Windows also calls this, with no value, for threads that never
+		// took a cache
+		if ( pCache )
+		{
+			CMemoryPoolMT::FlushThreadCache();
+		}
+	}
+
+	bool		m_bCreated;
+#if defined( _WIN32 ) && !defined( _X360 )
+	DWORD		m_iSlot;
+#elif defined( POSIX )
+	pthread_key_t	m_Key;
+#endif
+};
+
+static CThreadCacheExitHook		s_ThreadCacheExitHook;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds, creates or releases the calling thread's cache. Released
+//			caches are handed to the next thread that needs one.
+//-----------------------------------------------------------------------------
+static MemoryPoolThreadCache_t *AccessThreadCache( ThreadCacheOp_t op )
+{
+	static CTHREADLOCALPTR( MemoryPoolThreadCache_t ) s_pThreadCache;
+
+	MemoryPoolThreadCache_t *pCache = GETLOCAL( s_pThreadCache );
+	if ( op == THREADCACHE_RELEASE )
+	{
+		if ( pCache )
+		{
+			AUTO_LOCK( s_PoolMTMutex );
+			pCache->m_bInUse = false;
+			s_pThreadCache = NULL;
+			s_ThreadCacheExitHook.Set( NULL );
+		}
+		return NULL;
+	}
+
+	if ( !pCache && op == THREADCACHE_CREATE )
+	{
+		AUTO_LOCK( s_PoolMTMutex );
+		for ( pCache = s_pThreadCaches; pCache && pCache->m_bInUse; pCache = pCache->m_pNext )
+		{
+		}
+
+		if ( !pCache )
+		{
+			MEM_ALLOC_CREDIT_( "CMemoryPoolMT thread cache" );
+			pCache = new MemoryPoolThreadCache_t;
+			V_memset( pCache, 0, sizeof( *pCache ) );
+			pCache->m_pNext = s_pThreadCaches;
+			s_pThreadCaches = pCache;
+		}
+
+		pCache->m_bInUse = true;
+		s_pThreadCache = pCache;
+		s_ThreadCacheExitHook.Set( pCache );
+	}
+	return pCache;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::CMemoryPoolMT( int blockSize, int numElements, int growMode, const char *pszAllocOwner, int nAlignment ) :
+	CUtlMemoryPool( blockSize, numElements, growMode, pszAllocOwner, nAlignment )
+{
+	V_memset( &m_Stats, 0, sizeof( m_Stats ) );
+	m_iMagazine = -1;
+	m_nBatch = ( growMode != UTLMEMORYPOOL_GROW_NONE ) ? clamp( MEMPOOLMT_BATCH_BYTES / m_BlockSize, 4, 64 ) : 0;
+
+	AUTO_LOCK( s_PoolMTMutex );
+
+	// Sets up the thread local while we're still single threaded
+	AccessThreadCache( THREADCACHE_FIND );
+
+	for ( int i = 0; i < MEMPOOLMT_MAX_POOLS; ++i )
+	{
+		if ( !s_pPoolsMT[i] )
+		{
+			s_pPoolsMT[i] = this;
+			m_iMagazine = i;
+			break;
+		}
+	}
+}
+
+CMemoryPoolMT::~CMemoryPoolMT()
+{
+	if ( m_iMagazine >= 0 )
+	{
+		AUTO_LOCK( s_PoolMTMutex );
+		ReclaimMagazines( true );
+		s_pPoolsMT[m_iMagazine] = NULL;
+	}
+}
+
+void CMemoryPoolMT::Lock()
+{
+	if ( !m_mutex.TryLock() )
+	{
+		m_mutex.Lock();
+		++m_Stats.m_nContended;
+	}
+}
+
+MemoryPoolMagazine_t *CMemoryPoolMT::GetMagazine()
+{
+	if ( !m_nBatch || m_iMagazine < 0 )
+		return NULL;
+
+	return &AccessThreadCache( THREADCACHE_CREATE )->m_Magazines[m_iMagazine];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves a batch of blocks from the pool into an empty magazine
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Refill( MemoryPoolMagazine_t *pMagazine )
+{
+	Lock();
+
+	m_Stats.m_nAllocs += pMagazine->m_nAllocs;
+	m_Stats.m_nFrees += pMagazine->m_nFrees;
+	pMagazine->m_nAllocs = pMagazine->m_nFrees = 0;
+	++m_Stats.m_nRefills;
+
+	for ( int i = 0; i < m_nBatch; ++i )
+	{
+		void *pMem = CUtlMemoryPool::Alloc();
+		if ( !pMem )
+			break;
+
+		*(void **)pMem = pMagazine->m_pHead;
+		pMagazine->m_pHead = pMem;
+		++pMagazine->m_nCount;
+	}
+
+	Unlock();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gives up to nBlocks blocks from a magazine back to the pool
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Flush( MemoryPoolMagazine_t *pMagazine, int nBlocks )
+{
+	Lock();
+
+	m_Stats.m_nAllocs += pMagazine->m_nAllocs;
+	m_Stats.m_nFrees += pMagazine->m_nFrees;
+	pMagazine->m_nAllocs = pMagazine->m_nFrees = 0;
+	++m_Stats.m_nFlushes;
+
+	for ( ; nBlocks > 0 && pMagazine->m_pHead; --nBlocks )
+	{
+		void *pMem = pMagazine->m_pHead;
+		pMagazine->m_pHead = *(void **)pMem;
+		--pMagazine->m_nCount;
+		CUtlMemoryPool::Free( pMem );
+	}
+
+	Unlock();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Empties this pool's magazine in every thread's cache, giving the
+//			blocks back if bFree is set. Only safe while no other thread is
+//			using the pool; the caller holds s_PoolMTMutex.
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::ReclaimMagazines( bool bFree )
+{
+	Lock();
+
+	for ( MemoryPoolThreadCache_t *pCache = s_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		MemoryPoolMagazine_t &magazine = pCache->m_Magazines[m_iMagazine];
+		m_Stats.m_nAllocs += magazine.m_nAllocs;
+		m_Stats.m_nFrees += magazine.m_nFrees;
+
+		while ( bFree && magazine.m_pHead )
+		{
+			void *pMem = magazine.m_pHead;
+			magazine.m_pHead = *(void **)pMem;
+			CUtlMemoryPool::Free( pMem );
+		}
+
+		V_memset( &magazine, 0, sizeof( magazine ) );
+	}
+
+	Unlock();
+}
+
+void *CMemoryPoolMT::Alloc()
+{
+	return Alloc( m_BlockSize );
+}
+
+void *CMemoryPoolMT::AllocZero()
+{
+	return AllocZero( m_BlockSize );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Allocs a block from the calling thread's magazine, refilling it
+//			from the pool when it's empty
+//-----------------------------------------------------------------------------
+void *CMemoryPoolMT::Alloc( size_t amount )
+{
+	if ( amount > (unsigned int)m_BlockSize )
+		return NULL;
+
+	MemoryPoolMagazine_t *pMagazine = GetMagazine();
+	if ( !pMagazine )
+	{
+		Lock();
+		void *pMem = CUtlMemoryPool::Alloc( amount );
+		if ( pMem )
+		{
+			++m_Stats.m_nAllocs;
+		}
+		Unlock();
+		return pMem;
+	}
+
+	if ( !pMagazine->m_pHead )
+	{
+		Refill( pMagazine );
+		if ( !pMagazine->m_pHead )
+			return NULL;
+	}
+
+	void *pMem = pMagazine->m_pHead;
+	pMagazine->m_pHead = *(void **)pMem;
+	--pMagazine->m_nCount;
+	++pMagazine->m_nAllocs;
+	return pMem;
+}
+
+void *CMemoryPoolMT::AllocZero( size_t amount )
+{
+	void *mem = Alloc( amount );
+	if ( mem )
+	{
+		V_memset( mem, 0x00, amount );
+	}
+	return mem;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts a block in the calling thread's magazine. A full magazine
+//			gives half of its blocks back to the pool.
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Free( void *pMem )
+{
+	if ( !pMem )
+		return;
+
+	MemoryPoolMagazine_t *pMagazine = GetMagazine();
+	if ( !pMagazine )
+	{
+		Lock();
+		CUtlMemoryPool::Free( pMem );
+		++m_Stats.m_nFrees;
+		Unlock();
+		return;
+	}
+
+#ifdef _DEBUG
+	// invalidate the memory
+	memset( pMem, 0xDD, m_BlockSize );
+#endif
+
+	*(void **)pMem = pMagazine->m_pHead;
+	pMagazine->m_pHead = pMem;
+	++pMagazine->m_nCount;
+	++pMagazine->m_nFrees;
+
+	if ( pMagazine->m_nCount >= 2 * m_nBatch )
+	{
+		Flush( pMagazine, m_nBatch );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees everything
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Clear()
+{
+	AUTO_LOCK( s_PoolMTMutex );
+	if ( m_iMagazine >= 0 )
+	{
+		// The blobs are about to go, so the blocks are just dropped
+		ReclaimMagazines( false );
+	}
+
+	Lock();
+	CUtlMemoryPool::Clear();
+	Unlock();
+}
+
+void CMemoryPoolMT::GetStats( MemoryPoolMTStats_t &stats )
+{
+	AUTO_LOCK( s_PoolMTMutex );
+	Lock();
+
+	stats = m_Stats;
+	if ( m_iMagazine >= 0 )
+	{
+		// The owning threads update these without a lock, so this is only a
+		// snapshot
+		for ( MemoryPoolThreadCache_t *pCache = s_pThreadCaches; pCache; pCache = pCache->m_pNext )
+		{
+			const MemoryPoolMagazine_t &magazine = pCache->m_Magazines[m_iMagazine];
+			stats.m_nAllocs += magazine.m_nAllocs;
+			stats.m_nFrees += magazine.m_nFrees;
+			stats.m_nCached += magazine.m_nCount;
+		}
+	}
+
+	Unlock();
+}
+
+void CMemoryPoolMT::FlushThreadCache()
+{
+	AUTO_LOCK( s_PoolMTMutex );
+
+	MemoryPoolThreadCache_t *pCache = AccessThreadCache( THREADCACHE_FIND );
+	if ( !pCache )
+		return;
+
+	for ( int i = 0; i < MEMPOOLMT_MAX_POOLS; ++i )
+	{
+		MemoryPoolMagazine_t &magazine = pCache->m_Magazines[i];
+		if ( s_pPoolsMT[i] && ( magazine.m_nCount || magazine.m_nAllocs || magazine.m_nFrees ) )
+		{
+			s_pPoolsMT[i]->Flush( &magazine, magazine.m_nCount );
+		}
+	}
+
+	AccessThreadCache( THREADCACHE_RELEASE );
+}
+
+int CMemoryPoolMT::GetThreadCacheCount( int *pnInUse )
+{
+	AUTO_LOCK( s_PoolMTMutex );
+
+	int nCaches = 0;
+	int nInUse = 0;
+	for ( MemoryPoolThreadCache_t *pCache = s_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		++nCaches;
+		if ( pCache->m_bInUse )
+		{
+			++nInUse;
+		}
+	}
+
+	if ( pnInUse )
+	{
+		*pnInUse = nInUse;
+	}
+	return nCaches;
+}
+
+void CMemoryPoolMT::ReportStats( MemoryPoolReportFunc_t func )
+{
+	AUTO_LOCK( s_PoolMTMutex );
+
+	int nInUse;
+	int nCaches = GetThreadCacheCount( &nInUse );
+	func( "%d thread caches, %d held by running threads\n", nCaches, nInUse );
+
+	for ( int i = 0; i < MEMPOOLMT_MAX_POOLS; ++i )
+	{
+		CMemoryPoolMT *pPool = s_pPoolsMT[i];
+		if ( !pPool )
+			continue;
+
+		MemoryPoolMTStats_t stats;
+		pPool->GetStats( stats );
+		func( "%s: %d byte blocks, %d in use, %d cached, %d peak, %d allocs, %d refills, %d flushes, %d contended\n",
+			pPool->m_pszAllocOwner, pPool->m_BlockSize, stats.m_nAllocs - stats.m_nFrees, stats.m_nCached, pPool->m_PeakAlloc,
+			stats.m_nAllocs, stats.m_nRefills, stats.m_nFlushes, stats.m_nContended );
+	}
+}
@@ -12,6 +12,7 @@ bool CheckMMXTechnology(void) { return false; }
 bool CheckSSETechnology(void) { return false; }
 bool CheckSSE2Technology(void) { return false; }
 bool Check3DNowTechnology(void) { return false; }
+bool CheckPCLMULQDQTechnology(void) { return false; }
 
 #elif defined( _WIN32 ) && !defined( _X360 )
 
@@ -269,6 +270,32 @@ bool Check3DNowTechnology(void)
     return retval;
 }
 
+bool CheckPCLMULQDQTechnology(void)
+{
+	// The carry-less multiply works on SSE registers, so the OS has to save them
+	if ( !CheckSSE2Technology() )
+		return false;
+
+    unsigned int RegECX = 0;
+
+#ifdef CPUID
+	_asm pushad;
+#endif
+
+	_asm
+	{
+        mov eax, 1				// set up CPUID to return processor version and features
+        CPUID					// code bytes = 0fh,  0a2h
+        mov RegECX, ecx			// more features returned in ecx
+	}
+
+#ifdef CPUID
+	_asm popad;
+#endif
+
+	return ( RegECX & 0x2 ) != 0;	// bit 1 is set for PCLMULQDQ
+}
+
 #pragma optimize( "", on )
 
 #endif // _WIN32
@@ -72,9 +72,19 @@
 #include <time.h>
 #include "tier0/basetypes.h"
 #include "tier1/utldict.h"
+#include "tier1/processor_detect.h"
 #if defined( _X360 )
 #include "xbox/xbox_win32stubs.h"
 #endif
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#define STRTOOLS_SIMD
+#endif
+
 #include "tier0/memdbgon.h"
 
 static int FastToLower( char c )
@@ -92,6 +102,190 @@ static int FastToLower( char c )
 	return i;
 }
 
+//-----------------------------------------------------------------------------
+// SSE2 kernels. Each works through 16 bytes at a time for as long as a load
+// can't run into the next page, and stops at anything it can't handle, so
+// the byte at a time loops after it see the same input they always did.
+//-----------------------------------------------------------------------------
+#ifdef STRTOOLS_SIMD
+
+#define STRTOOLS_PAGE_SIZE	4096
+
+// Static initializers that run before this see false and use the byte loops
+static bool s_bStrToolsSIMD = CheckSSE2Technology();
+
+// Can 16 bytes be read at p without touching the next page?
+static FORCEINLINE bool CanLoad16( const void *p )
+{
+	return ( (uintp)p & ( STRTOOLS_PAGE_SIZE - 1 ) ) <= STRTOOLS_PAGE_SIZE - 16;
+}
+
+static FORCEINLINE int StrToolsLowestBit( int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+
+static FORCEINLINE int StrToolsHighestBit( int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanReverse( &nBit, nMask );
+	return (int)nBit;
+#else
+	return 31 - __builtin_clz( nMask );
+#endif
+}
+
+// 'A'-'Z' become 'a'-'z', everything else is left alone
+static FORCEINLINE __m128i ToLowerASCII16( __m128i v )
+{
+	__m128i upper = _mm_cmplt_epi8( _mm_sub_epi8( v, _mm_set1_epi8( (char)( 'A' + 0x80 ) ) ), _mm_set1_epi8( (char)( 0x80 + 26 ) ) );
+	return _mm_or_si128( v, _mm_and_si128( upper, _mm_set1_epi8( 0x20 ) ) );
+}
+
+static FORCEINLINE int ZeroMask16( __m128i v )
+{
+	return _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_setzero_si128() ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns how many leading bytes of s1 and s2, up to nMax, are equal
+//			ignoring ASCII case and aren't the terminator
+//-----------------------------------------------------------------------------
+static int CaseFoldedPrefixSIMD( const char *s1, const char *s2, int nMax )
+{
+	int n = 0;
+	while ( nMax - n >= 16 && CanLoad16( s1 + n ) && CanLoad16( s2 + n ) )
+	{
+		__m128i a = _mm_loadu_si128( (const __m128i *)( s1 + n ) );
+		__m128i b = _mm_loadu_si128( (const __m128i *)( s2 + n ) );
+		int nEqual = _mm_movemask_epi8( _mm_cmpeq_epi8( ToLowerASCII16( a ), ToLowerASCII16( b ) ) );
+		int nStop = ( ~nEqual & 0xFFFF ) | ZeroMask16( a );
+		if ( nStop )
+			return n + StrToolsLowestBit( nStop );
+		n += 16;
+	}
+	return n;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lowercases ASCII up to the terminator or the first non-ASCII byte,
+//			which it returns
+//-----------------------------------------------------------------------------
+static unsigned char *LowerASCIISIMD( unsigned char *str )
+{
+	while ( CanLoad16( str ) )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)str );
+		int nStop = ZeroMask16( v ) | _mm_movemask_epi8( v );
+		if ( nStop )
+		{
+			for ( unsigned char *pStop = str + StrToolsLowestBit( nStop ); str < pStop; ++str )
+			{
+				if ( (unsigned char)( *str - 'A' ) <= ( 'Z' - 'A' ) )
+					*str += 'a' - 'A';
+			}
+			return str;
+		}
+
+		_mm_storeu_si128( (__m128i *)str, ToLowerASCII16( v ) );
+		str += 16;
+	}
+	return str;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Changes both kinds of slash to separator up to the terminator
+//-----------------------------------------------------------------------------
+static char *FixSlashesSIMD( char *pname, char separator )
+{
+	__m128i forward = _mm_set1_epi8( '/' );
+	__m128i backward = _mm_set1_epi8( '\\' );
+	__m128i replacement = _mm_set1_epi8( separator );
+	while ( CanLoad16( pname ) )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)pname );
+		int nZero = ZeroMask16( v );
+		if ( nZero )
+		{
+			for ( char *pEnd = pname + StrToolsLowestBit( nZero ); pname < pEnd; ++pname )
+			{
+				if ( *pname == '/' || *pname == '\\' )
+				{
+					*pname = separator;
+				}
+			}
+			return pname;
+		}
+
+		__m128i slashes = _mm_or_si128( _mm_cmpeq_epi8( v, forward ), _mm_cmpeq_epi8( v, backward ) );
+		if ( _mm_movemask_epi8( slashes ) )
+		{
+			v = _mm_or_si128( _mm_andnot_si128( slashes, v ), _mm_and_si128( slashes, replacement ) );
+			_mm_storeu_si128( (__m128i *)pname, v );
+		}
+		pname += 16;
+	}
+	return pname;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Skips to the first byte that lowercases to chLower, or the
+//			terminator. chLower must be lowercase ASCII.
+//-----------------------------------------------------------------------------
+static const char *FindLowerASCIISIMD( const char *p, char chLower )
+{
+	__m128i search = _mm_set1_epi8( chLower );
+	while ( CanLoad16( p ) )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)p );
+		int nStop = _mm_movemask_epi8( _mm_cmpeq_epi8( ToLowerASCII16( v ), search ) ) | ZeroMask16( v );
+		if ( nStop )
+			return p + StrToolsLowestBit( nStop );
+		p += 16;
+	}
+	return p;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the index of the last '.', '/' or '\' in str[1..nLast],
+//			scanning back 16 bytes at a time, or a lower index for the byte
+//			loop to finish from
+//-----------------------------------------------------------------------------
+static int FindLastDotOrSlashSIMD( const char *str, int nLast )
+{
+	while ( nLast >= 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)( str + nLast - 15 ) );
+		__m128i stop = _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( '.' ) ),
+			_mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( '/' ) ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '\\' ) ) ) );
+		int nStop = _mm_movemask_epi8( stop );
+		if ( nStop )
+			return nLast - 15 + StrToolsHighestBit( nStop );
+		nLast -= 16;
+	}
+	return nLast;
+}
+
+#endif // STRTOOLS_SIMD
+
+bool V_SetStringSIMDEnabled( bool bEnabled )
+{
+#ifdef STRTOOLS_SIMD
+	bool bWasEnabled = s_bStrToolsSIMD;
+	s_bStrToolsSIMD = bEnabled && CheckSSE2Technology();
+	return bWasEnabled;
+#else
+	return false;
+#endif
+}
+
 void _V_memset (const char* file, int line, void *dest, int fill, int count)
 {
 	Assert( count >= 0 );
@@ -226,6 +420,14 @@ char *V_strlower( char *start )
 	unsigned char *str = (unsigned char*)start;
 	while( *str )
 	{
+#ifdef STRTOOLS_SIMD
+		if ( s_bStrToolsSIMD )
+		{
+			str = LowerASCIISIMD( str );
+			if ( !*str )
+				break;
+		}
+#endif
 		if ( (unsigned char)(*str - 'A') <= ('Z' - 'A') )
 			*str += 'a' - 'A';
 		else if ( (unsigned char)*str >= 0x80 ) // non-ascii, fall back to CRT
@@ -271,6 +473,16 @@ int V_stricmp( const char *str1, const char *str2 )
 	const unsigned char *s2 = (const unsigned char*)str2;
 	for ( ; *s1; ++s1, ++s2 )
 	{
+#ifdef STRTOOLS_SIMD
+		if ( s_bStrToolsSIMD )
+		{
+			int nSkip = CaseFoldedPrefixSIMD( (const char*)s1, (const char*)s2, INT_MAX );
+			s1 += nSkip;
+			s2 += nSkip;
+			if ( !*s1 )
+				break;
+		}
+#endif
 		if ( *s1 != *s2 )
 		{
 			// in ascii char set, lowercase = uppercase | 0x20
@@ -296,6 +508,17 @@ int V_strnicmp( const char *str1, const char *str2, int n )
 	const unsigned char *s2 = (const unsigned char*)str2;
 	for ( ; n > 0 && *s1; --n, ++s1, ++s2 )
 	{
+#ifdef STRTOOLS_SIMD
+		if ( s_bStrToolsSIMD )
+		{
+			int nSkip = CaseFoldedPrefixSIMD( (const char*)s1, (const char*)s2, n );
+			s1 += nSkip;
+			s2 += nSkip;
+			n -= nSkip;
+			if ( n <= 0 || !*s1 )
+				break;
+		}
+#endif
 		if ( *s1 != *s2 )
 		{
 			// in ascii char set, lowercase = uppercase | 0x20
@@ -624,9 +847,24 @@ char const* V_stristr( char const* pStr, char const* pSearch )
 
 	char const* pLetter = pStr;
 
+#ifdef STRTOOLS_SIMD
+	// Only ASCII lowercases the same way in every locale
+	bool bSIMDSearch = s_bStrToolsSIMD && *pSearch && (unsigned char)*pSearch < 0x80;
+	char chSearchLower = (char)FastToLower( *pSearch );
+#endif
+
 	// Check the entire string
 	while (*pLetter != 0)
 	{
+#ifdef STRTOOLS_SIMD
+		if ( bSIMDSearch )
+		{
+			pLetter = FindLowerASCIISIMD( pLetter, chSearchLower );
+			if ( !*pLetter )
+				break;
+		}
+#endif
+
 		// Skip over non-matches
 		if (FastToLower((unsigned char)*pLetter) == FastToLower((unsigned char)*pSearch))
 		{
@@ -1747,6 +1985,12 @@ void V_StripExtension( const char *in, char *out, int outSize )
 
 	// scan backward for '.'
 	int end = V_strlen( in ) - 1;
+#ifdef STRTOOLS_SIMD
+	if ( s_bStrToolsSIMD )
+	{
+		end = FindLastDotOrSlashSIMD( in, end );
+	}
+#endif
 	while ( end > 0 && in[end] != '.' && !PATHSEPARATOR( in[end] ) )
 	{
 		--end;
@@ -1866,6 +2110,14 @@ void V_FixSlashes( char *pname, char separator /* = CORRECT_PATH_SEPARATOR */ )
 {
 	while ( *pname )
 	{
+#ifdef STRTOOLS_SIMD
+		if ( s_bStrToolsSIMD )
+		{
+			pname = FixSlashesSIMD( pname, separator );
+			if ( !*pname )
+				break;
+		}
+#endif
 		if ( *pname == INCORRECT_PATH_SEPARATOR || *pname == CORRECT_PATH_SEPARATOR )
 		{
 			*pname = separator;
@@ -1971,8 +2223,11 @@ void V_ComposeFileName( const char *path, const char *filename, char *dest, int
 	V_strncpy( dest, path, destSize );
 	V_FixSlashes( dest );
 	V_AppendSlash( dest, destSize );
+
+	// The path is already fixed, so only the filename needs it
+	int nPathLength = V_strlen( dest );
 	V_strncat( dest, filename, destSize, COPY_ALL_CHARACTERS );
-	V_FixSlashes( dest );
+	V_FixSlashes( dest + nPathLength );
 }
 
 
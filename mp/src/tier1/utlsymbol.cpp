@@ -11,6 +11,7 @@
 #include "utlsymbol.h"
 #include "KeyValues.h"
 #include "tier0/threadtools.h"
+#include <ctype.h>
 #include "tier0/memdbgon.h"
 #include "stringpool.h"
 #include "utlhashtable.h"
@@ -44,7 +45,7 @@
 // globals
 //-----------------------------------------------------------------------------
 
-CUtlSymbolTableMT* CUtlSymbol::s_pSymbolTable = 0; 
+CUtlHashSymbolTableMT* CUtlSymbol::s_pSymbolTable = 0; 
 bool CUtlSymbol::s_bAllowStaticSymbolTable = true;
 
 
@@ -63,7 +64,7 @@ void CUtlSymbol::Initialize()
 	static bool symbolsInitialized = false;
 	if (!symbolsInitialized)
 	{
-		s_pSymbolTable = new CUtlSymbolTableMT;
+		s_pSymbolTable = new CUtlHashSymbolTableMT;
 		symbolsInitialized = true;
 	}
 }
@@ -83,7 +84,7 @@ public:
 
 static CCleanupUtlSymbolTable g_CleanupSymbolTable;
 
-CUtlSymbolTableMT* CUtlSymbol::CurrTable()
+CUtlHashSymbolTableMT* CUtlSymbol::CurrTable()
 {
 	Initialize();
 	return s_pSymbolTable; 
@@ -288,6 +289,233 @@ void CUtlSymbolTable::RemoveAll()
 }
 
 
+//-----------------------------------------------------------------------------
+// Hashed symbol table
+//-----------------------------------------------------------------------------
+
+#define MIN_HASH_SYMBOL_SLOTS	32
+
+CUtlHashSymbolTable::CUtlHashSymbolTable( int growSize, int initSize, bool caseInsensitive ) :
+	m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
+{
+	// Keep the table at most half full
+	int nSlots = MIN_HASH_SYMBOL_SLOTS;
+	while ( nSlots < initSize * 2 )
+	{
+		nSlots <<= 1;
+	}
+
+	m_pTable = AllocTable( nSlots );
+	memset( (void *)m_pPages, 0, sizeof( m_pPages ) );
+	m_nStrings = 0;
+	m_pPoolSpace = NULL;
+	m_nPoolSpaceLeft = 0;
+}
+
+CUtlHashSymbolTable::~CUtlHashSymbolTable()
+{
+	RemoveAll();
+	free( m_pTable );
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a. Case insensitive tables fold the way V_stricmp compares: ASCII
+// letters by hand, and anything else through the CRT, which is what
+// V_stricmp falls back to when it meets a non-ASCII byte.
+//-----------------------------------------------------------------------------
+uint32 CUtlHashSymbolTable::HashString( const char *pString ) const
+{
+	uint32 nHash = 2166136261u;
+	const unsigned char *p = (const unsigned char *)pString;
+	if ( m_bInsensitive )
+	{
+		for ( ; *p; ++p )
+		{
+			unsigned char c = *p;
+			if ( c >= 'A' && c <= 'Z' )
+			{
+				c |= 0x20;
+			}
+			else if ( c >= 0x80 )
+			{
+				c = (unsigned char)tolower( c );
+			}
+			nHash = ( nHash ^ c ) * 16777619u;
+		}
+	}
+	else
+	{
+		for ( ; *p; ++p )
+		{
+			nHash = ( nHash ^ *p ) * 16777619u;
+		}
+	}
+	return nHash;
+}
+
+CUtlHashSymbolTable::Table_t *CUtlHashSymbolTable::AllocTable( int nSlots )
+{
+	Table_t *pTable = (Table_t *)malloc( sizeof( Table_t ) + ( nSlots - 1 ) * sizeof( uint32 ) );
+	pTable->m_nMask = nSlots - 1;
+	memset( pTable->m_Slots, 0, nSlots * sizeof( uint32 ) );
+	return pTable;
+}
+
+UtlSymId_t CUtlHashSymbolTable::FindInTable( const Table_t *pTable, const char *pString, uint32 nHash ) const
+{
+	uint32 nTag = nHash >> 16;
+	for ( uint32 i = nHash & pTable->m_nMask; ; i = ( i + 1 ) & pTable->m_nMask )
+	{
+		uint32 nSlot = *(volatile const uint32 *)&pTable->m_Slots[i];
+		if ( !nSlot )
+			return UTL_INVAL_SYMBOL;
+
+		if ( ( nSlot >> 16 ) == nTag )
+		{
+			UtlSymId_t id = (UtlSymId_t)( ( nSlot & 0xFFFF ) - 1 );
+			const char *pSymbol = m_pPages[id >> PAGE_BITS][id & ( PAGE_SIZE - 1 )];
+			if ( m_bInsensitive ? !V_stricmp( pSymbol, pString ) : !V_strcmp( pSymbol, pString ) )
+				return id;
+		}
+	}
+}
+
+void CUtlHashSymbolTable::InsertIntoTable( Table_t *pTable, uint32 nHash, UtlSymId_t id )
+{
+	uint32 i = nHash & pTable->m_nMask;
+	while ( pTable->m_Slots[i] )
+	{
+		i = ( i + 1 ) & pTable->m_nMask;
+	}
+
+	// A single aligned store, so readers see the whole slot or none of it
+	*(volatile uint32 *)&pTable->m_Slots[i] = ( nHash & 0xFFFF0000 ) | ( (uint32)id + 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Builds a table twice the size off to the side. Readers keep using the old
+// one until the new one is published.
+//-----------------------------------------------------------------------------
+CUtlHashSymbolTable::Table_t *CUtlHashSymbolTable::GrowTable( const Table_t *pTable ) const
+{
+	Table_t *pNewTable = AllocTable( ( pTable->m_nMask + 1 ) * 2 );
+	for ( int id = 0; id < m_nStrings; ++id )
+	{
+		const char *pSymbol = m_pPages[id >> PAGE_BITS][id & ( PAGE_SIZE - 1 )];
+		InsertIntoTable( pNewTable, HashString( pSymbol ), (UtlSymId_t)id );
+	}
+	return pNewTable;
+}
+
+const char *CUtlHashSymbolTable::CopyString( const char *pString )
+{
+	int len = V_strlen( pString ) + 1;
+	if ( len > m_nPoolSpaceLeft )
+	{
+		int newPoolSize = max( len, MIN_STRING_POOL_SIZE );
+		m_pPoolSpace = (char *)malloc( newPoolSize );
+		m_nPoolSpaceLeft = newPoolSize;
+		m_StringPools.AddToTail( m_pPoolSpace );
+	}
+
+	char *pCopy = m_pPoolSpace;
+	memcpy( pCopy, pString, len );
+	m_pPoolSpace += len;
+	m_nPoolSpaceLeft -= len;
+	return pCopy;
+}
+
+CUtlSymbol CUtlHashSymbolTable::Find( const char* pString ) const
+{
+	if ( !pString )
+		return CUtlSymbol();
+
+	return CUtlSymbol( FindInTable( m_pTable, pString, HashString( pString ) ) );
+}
+
+//-----------------------------------------------------------------------------
+// Finds and/or creates a symbol based on the string. Everything a reader
+// can reach through the new slot is written before the slot is.
+//-----------------------------------------------------------------------------
+CUtlSymbol CUtlHashSymbolTable::AddString( const char* pString )
+{
+	if ( !pString )
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	uint32 nHash = HashString( pString );
+	UtlSymId_t id = FindInTable( m_pTable, pString, nHash );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	if ( m_nStrings >= MAX_STRINGS )
+	{
+		AssertMsg( false, "CUtlHashSymbolTable is full" );
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+	}
+
+	id = (UtlSymId_t)m_nStrings;
+	const char **pPage = m_pPages[id >> PAGE_BITS];
+	if ( !pPage )
+	{
+		pPage = (const char **)malloc( PAGE_SIZE * sizeof( const char * ) );
+		ThreadMemoryBarrier();
+		m_pPages[id >> PAGE_BITS] = pPage;
+	}
+	pPage[id & ( PAGE_SIZE - 1 )] = CopyString( pString );
+	ThreadMemoryBarrier();
+
+	Table_t *pTable = m_pTable;
+	if ( (uint32)( m_nStrings + 1 ) * 2 > pTable->m_nMask + 1 )
+	{
+		Table_t *pNewTable = GrowTable( pTable );
+		InsertIntoTable( pNewTable, nHash, id );
+		ThreadMemoryBarrier();
+		m_pTable = pNewTable;
+		m_RetiredTables.AddToTail( pTable );
+	}
+	else
+	{
+		InsertIntoTable( pTable, nHash, id );
+	}
+
+	ThreadMemoryBarrier();
+	m_nStrings = m_nStrings + 1;
+	return CUtlSymbol( id );
+}
+
+const char* CUtlHashSymbolTable::String( CUtlSymbol id ) const
+{
+	if ( !id.IsValid() )
+		return "";
+
+	Assert( (UtlSymId_t)id < m_nStrings );
+	return m_pPages[(UtlSymId_t)id >> PAGE_BITS][(UtlSymId_t)id & ( PAGE_SIZE - 1 )];
+}
+
+void CUtlHashSymbolTable::RemoveAll()
+{
+	memset( m_pTable->m_Slots, 0, ( m_pTable->m_nMask + 1 ) * sizeof( uint32 ) );
+
+	for ( int i = 0; i < m_RetiredTables.Count(); i++ )
+		free( m_RetiredTables[i] );
+	m_RetiredTables.RemoveAll();
+
+	for ( int i = 0; i < MAX_PAGES; i++ )
+	{
+		free( (void *)m_pPages[i] );
+		m_pPages[i] = NULL;
+	}
+
+	for ( int i = 0; i < m_StringPools.Count(); i++ )
+		free( m_StringPools[i] );
+	m_StringPools.RemoveAll();
+
+	m_pPoolSpace = NULL;
+	m_nPoolSpaceLeft = 0;
+	m_nStrings = 0;
+}
+
+
 
 class CUtlFilenameSymbolTable::HashTable : public CUtlStableHashtable<CUtlConstString>
 {
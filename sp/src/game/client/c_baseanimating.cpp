@@ -1494,6 +1494,10 @@ void C_BaseAnimating::BuildTransformations( CStudioHdr *hdr, Vector *pos, Quater
 		}
 	}
 
+	// Convert the local pose to matrices up front, four bones at a time
+	matrix3x4_t *pLocalMatrices = (matrix3x4_t*)stackalloc( hdr->numbones() * sizeof(matrix3x4_t) );
+	Studio_BuildLocalMatrices( hdr, pos, q, pLocalMatrices, boneMask );
+
 	for (int i = 0; i < hdr->numbones(); i++) 
 	{
 		// Only update bones reference by the bone mask.
@@ -1518,7 +1522,7 @@ void C_BaseAnimating::BuildTransformations( CStudioHdr *hdr, Vector *pos, Quater
 		}
 		else
 		{
-			QuaternionMatrix( q[i], pos[i], bonematrix );
+			MatrixCopy( pLocalMatrices[i], bonematrix );
 
 			Assert( fabs( pos[i].x ) < 100000 );
 			Assert( fabs( pos[i].y ) < 100000 );
@@ -175,6 +175,8 @@ public:
 	virtual void SetDebug( bool bDebug ) = 0;
 };
 
+// Array entries are views onto a row of their history's value block (or onto
+// stack memory, for temporaries). They never own the values.
 template< typename Type, bool IS_ARRAY >
 struct CInterpolatedVarEntryBase
 {
@@ -184,90 +186,37 @@ struct CInterpolatedVarEntryBase
 		count = 0;
 		changetime = 0;
 	}
-	~CInterpolatedVarEntryBase()
-	{
-		delete[] value;
-		value = NULL;
-	}
-
-	// This will transfer the data from another varentry.  This is used to avoid allocation
-	// pointers can be transferred (only one varentry has a copy), but not trivially copied
-	void FastTransferFrom( CInterpolatedVarEntryBase &src )
-	{
-		Assert(!value);
-		value = src.value;
-		count = src.count;
-		changetime = src.changetime;
-		src.value = 0;
-		src.count = 0;
-	}
-
-	CInterpolatedVarEntryBase& operator=( const CInterpolatedVarEntryBase& src )
-	{
-		delete[] value;
-		value = NULL;
-		count = 0;
-		if ( src.value )
-		{
-			count = src.count;
-			value = new Type[count];
-			for ( int i = 0; i < count; i++ )
-			{
-				value[i] = src.value[i];
-			}
-		}
-		return *this;
-	}
 
 	Type *GetValue() { return value; }
 	const Type *GetValue() const { return value; }
 
-	void Init(int maxCount)
+	// Point the entry at room for maxCount values.
+	void Attach( Type *pStorage, int maxCount )
 	{
-		if ( !maxCount )
-		{
-			DeleteEntry();
-		}
-		else
-		{
-			// resize
-			if ( maxCount != count )
-			{
-				DeleteEntry();
-			}
-
-			if ( !value )
-			{
-				count = maxCount;
-				value = new Type[maxCount];
-			}
-		}
-		Assert(count==maxCount);
+		value = pStorage;
+		count = maxCount;
 	}
+
 	Type *NewEntry( const Type *pValue, int maxCount, float time )
 	{
+		Assert( value && count == maxCount );
 		changetime = time;
-		Init(maxCount);
-		if ( value && maxCount)
-		{
-			memcpy( value, pValue, maxCount*sizeof(Type) );
-		}
+		memcpy( value, pValue, maxCount*sizeof(Type) );
 		return value;
 	}
 
-	void DeleteEntry()
+	// Moving an entry to another slot swaps rows with it instead of copying values.
+	void FastTransferFrom( CInterpolatedVarEntryBase &src )
 	{
-		delete[] value;
-		value = NULL;
-		count = 0;
+		changetime = src.changetime;
+		V_swap( value, src.value );
 	}
 
+	void DeleteEntry() {}
+
 	float		changetime;
 	int			count;
 	Type *		value;
-
-private:
-	CInterpolatedVarEntryBase( const CInterpolatedVarEntryBase &src );
 };
 
 template<typename Type>
@@ -283,6 +232,10 @@ struct CInterpolatedVarEntryBase<Type, false>
 	{
 		Assert(maxCount==1);
 	}
+	void Attach( Type *pStorage, int maxCount )
+	{
+		Assert(maxCount==1);
+	}
 	Type *NewEntry( const Type *pValue, int maxCount, float time )
 	{
 		Assert(maxCount==1);
@@ -428,6 +381,179 @@ private:
 	unsigned short m_growSize;
 };
 
+//-----------------------------------------------------------------------------
+// History for interpolated arrays. Change times and row pointers live in one
+// ring and all the rows of values in one block, rather than an allocation
+// per entry.
+//-----------------------------------------------------------------------------
+template< typename Type >
+class CInterpolatedVarColumns
+{
+public:
+	typedef CInterpolatedVarEntryBase< Type, true > Entry_t;
+
+	enum
+	{
+		GROW_ROWS = 4,	// the history rarely holds more than a handful of samples
+	};
+
+	CInterpolatedVarColumns()
+	{
+		m_pEntries = NULL;
+		m_pValues = NULL;
+		m_nRowSize = 0;
+		m_maxElement = 0;
+		m_firstElement = 0;
+		m_count = 0;
+	}
+	~CInterpolatedVarColumns()
+	{
+		delete[] m_pEntries;
+		delete[] m_pValues;
+	}
+
+	// Throws the history away if the row size changes.
+	void SetRowSize( int nRowSize )
+	{
+		if ( nRowSize == m_nRowSize )
+			return;
+
+		delete[] m_pEntries;
+		delete[] m_pValues;
+		m_pEntries = NULL;
+		m_pValues = NULL;
+		m_nRowSize = nRowSize;
+		m_maxElement = 0;
+		m_firstElement = 0;
+		m_count = 0;
+	}
+
+	inline int Count() const { return m_count; }
+
+	int Head() const { return (m_count>0) ? 0 : InvalidIndex(); }
+
+	bool IsIdxValid( int i ) const { return (i >= 0 && i < m_count) ? true : false; }
+	bool IsValidIndex(int i) const { return IsIdxValid(i); }
+	static int InvalidIndex() { return -1; }
+
+	Entry_t& operator[]( int i )
+	{
+		Assert( IsIdxValid(i) );
+		return m_pEntries[ WrapRange( i + m_firstElement ) ];
+	}
+
+	const Entry_t& operator[]( int i ) const
+	{
+		Assert( IsIdxValid(i) );
+		return m_pEntries[ WrapRange( i + m_firstElement ) ];
+	}
+
+	void EnsureCapacity( int capSize )
+	{
+		if ( capSize <= m_maxElement )
+			return;
+
+		Assert( m_nRowSize > 0 );
+		int newMax = m_maxElement + ((capSize+GROW_ROWS-1)/GROW_ROWS) * GROW_ROWS;
+		Entry_t *pNewEntries = new Entry_t[newMax];
+		Type *pNewValues = new Type[newMax * m_nRowSize];
+		for ( int i = 0; i < newMax; i++ )
+		{
+			pNewEntries[i].Attach( pNewValues + i * m_nRowSize, m_nRowSize );
+		}
+
+		for ( int i = 0; i < m_count; i++ )
+		{
+			const Entry_t &src = (*this)[i];
+			pNewEntries[i].NewEntry( src.GetValue(), m_nRowSize, src.changetime );
+		}
+
+		delete[] m_pEntries;
+		delete[] m_pValues;
+		m_pEntries = pNewEntries;
+		m_pValues = pNewValues;
+		m_firstElement = 0;
+		m_maxElement = newMax;
+	}
+
+	int AddToHead()
+	{
+		EnsureCapacity( m_count + 1 );
+		int i = m_firstElement + m_maxElement - 1;
+		m_count++;
+		m_firstElement = WrapRange(i);
+		return 0;
+	}
+
+	int AddToTail()
+	{
+		EnsureCapacity( m_count + 1 );
+		m_count++;
+		return m_count - 1;
+	}
+
+	void RemoveAll()
+	{
+		m_count = 0;
+		m_firstElement = 0;
+	}
+
+	void RemoveAtHead()
+	{
+		if ( m_count > 0 )
+		{
+			m_firstElement = WrapRange(m_firstElement+1);
+			m_count--;
+		}
+	}
+
+	void Truncate( int newLength )
+	{
+		if ( newLength < m_count )
+		{
+			Assert(newLength>=0);
+			m_count = newLength;
+		}
+	}
+
+private:
+	inline int WrapRange( int i ) const
+	{
+		return ( i >= m_maxElement ) ? (i - m_maxElement) : i;
+	}
+
+	Entry_t *m_pEntries;
+	Type *m_pValues;
+	int m_nRowSize;
+	unsigned short m_maxElement;
+	unsigned short m_firstElement;
+	unsigned short m_count;
+};
+
+// Single values keep theirs inline in the ring; arrays use columns.
+template< typename Type, bool IS_ARRAY >
+struct CInterpolatedVarHistory
+{
+	typedef CSimpleRingBuffer< CInterpolatedVarEntryBase< Type, IS_ARRAY > > History_t;
+};
+
+template< typename Type >
+struct CInterpolatedVarHistory< Type, true >
+{
+	typedef CInterpolatedVarColumns< Type > History_t;
+};
+
+template< typename T >
+inline void SetInterpolatedVarRowSize( CSimpleRingBuffer< T > &history, int nRowSize )
+{
+}
+
+template< typename T >
+inline void SetInterpolatedVarRowSize( CInterpolatedVarColumns< T > &history, int nRowSize )
+{
+	history.SetRowSize( nRowSize );
+}
+
 // -------------------------------------------------------------------------------------------------------------- //
 // CInterpolatedVarArrayBase - the main implementation of IInterpolatedVar.
 // -------------------------------------------------------------------------------------------------------------- //
@@ -503,7 +629,7 @@ public:
 protected:
 
 	typedef CInterpolatedVarEntryBase<Type, IS_ARRAY> CInterpolatedVarEntry;
-	typedef CSimpleRingBuffer< CInterpolatedVarEntry > CVarHistory;
+	typedef typename CInterpolatedVarHistory< Type, IS_ARRAY >::History_t CVarHistory;
 	friend class CInterpolationInfo;
 
 	class CInterpolationInfo
@@ -572,6 +698,7 @@ protected:
 	float								m_InterpolationAmount;
 	const char *						m_pDebugName;
 	bool								m_bDebug : 1;
+	bool								m_bAnyLooping : 1;
 };
 
 
@@ -587,6 +714,7 @@ inline CInterpolatedVarArrayBase<Type, IS_ARRAY>::CInterpolatedVarArrayBase( con
 	m_LastNetworkedValue = NULL;
 	m_bLooping = NULL;
 	m_bDebug = false;
+	m_bAnyLooping = false;
 }
 
 template< typename Type, bool IS_ARRAY >
@@ -1180,6 +1308,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::Copy( IInterpolatedVar *p
 		m_LastNetworkedValue[i] = pSrc->m_LastNetworkedValue[i];
 		m_bLooping[i] = pSrc->m_bLooping[i];
 	}
+	m_bAnyLooping = pSrc->m_bAnyLooping;
 
 	m_LastNetworkedTime = pSrc->m_LastNetworkedTime;
 
@@ -1273,6 +1402,16 @@ inline void	CInterpolatedVarArrayBase<Type, IS_ARRAY>::SetLooping( bool looping,
 {
 	Assert( iArrayIndex >= 0 && iArrayIndex < m_nMaxCount );
 	m_bLooping[ iArrayIndex ] = looping;
+
+	m_bAnyLooping = false;
+	for ( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[i] )
+		{
+			m_bAnyLooping = true;
+			break;
+		}
+	}
 }
 
 template< typename Type, bool IS_ARRAY >
@@ -1293,7 +1432,9 @@ inline void	CInterpolatedVarArrayBase<Type, IS_ARRAY>::SetMaxCount( int newmax )
 		m_LastNetworkedValue = new Type[m_nMaxCount];
 		memset( m_bLooping, 0, sizeof(byte) * m_nMaxCount);
 		memset( m_LastNetworkedValue, 0, sizeof(Type) * m_nMaxCount);
+		m_bAnyLooping = false;
 
+		SetInterpolatedVarRowSize( m_VarHistory, m_nMaxCount );
 		Reset();
 	}
 }
@@ -1325,6 +1466,9 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate( Type *out,
 
 	Assert( frac >= 0.0f && frac <= 1.0f );
 
+	if ( IS_ARRAY && !m_bAnyLooping && Lerp_Row( m_nMaxCount, frac, start->GetValue(), end->GetValue(), out ) )
+		return;
+
 	// Note that QAngle has a specialization that will do quaternion interpolation here...
 	for ( int i = 0; i < m_nMaxCount; i++ )
 	{
@@ -1388,6 +1532,12 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::TimeFixup2_Hermite(
 		// Fixed interval into past
 		fixup.changetime = start->changetime - dt1;
 
+		if ( IS_ARRAY && !m_bAnyLooping && Lerp_Row( m_nMaxCount, 1-frac, prev->GetValue(), start->GetValue(), fixup.GetValue() ) )
+		{
+			prev = &fixup;
+			return;
+		}
+
 		for ( int i = 0; i < m_nMaxCount; i++ )
 		{
 			if ( m_bLooping[i] )
@@ -1434,9 +1584,12 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate_Hermite(
 	CDisableRangeChecks disableRangeChecks; 
 
 	CInterpolatedVarEntry fixup;
-	fixup.Init(m_nMaxCount);
+	fixup.Attach( (Type*)stackalloc( sizeof(Type) * m_nMaxCount ), m_nMaxCount );
 	TimeFixup_Hermite( fixup, prev, start, end );
 
+	if ( IS_ARRAY && !m_bAnyLooping && Lerp_Hermite_Row( m_nMaxCount, frac, prev->GetValue(), start->GetValue(), end->GetValue(), out ) )
+		return;
+
 	for( int i = 0; i < m_nMaxCount; i++ )
 	{
 		// Note that QAngle has a specialization that will do quaternion interpolation here...
@@ -1473,7 +1626,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Derivative_Hermite(
 	CDisableRangeChecks disableRangeChecks; 
 
 	CInterpolatedVarEntry fixup;
-	fixup.value = (Type*)_alloca( sizeof(Type) * m_nMaxCount );
+	fixup.Attach( (Type*)stackalloc( sizeof(Type) * m_nMaxCount ), m_nMaxCount );
 	TimeFixup_Hermite( fixup, prev, start, end );
 
 	float divisor = 1.0f / (end->changetime - start->changetime);
@@ -1496,7 +1649,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Derivative_Hermite_Smoot
 	CInterpolatedVarEntry *d )
 {
 	CInterpolatedVarEntry fixup;
-	fixup.Init(m_nMaxCount);
+	fixup.Attach( (Type*)stackalloc( sizeof(Type) * m_nMaxCount ), m_nMaxCount );
 	TimeFixup_Hermite( fixup, b, c, d );
 	for ( int i=0; i < m_nMaxCount; i++ )
 	{
@@ -59,6 +59,7 @@ public:
 		maxequals = false;
 		maxval = 0.0f;
 		minval = 0.0f;
+		tokenval = 0.0f;
 
 		token = UTL_INVAL_SYMBOL;
 		rawtoken = UTL_INVAL_SYMBOL;
@@ -110,6 +111,7 @@ public:
 
 	float	maxval;
 	float	minval;
+	float	tokenval;		// token as a number, so we don't atof it on every compare
 
 	bool	valid : 1;      //1
 	bool	isnumeric : 1;  //2
@@ -396,6 +398,7 @@ struct Criteria
 		value = NULL;
 		weight.SetFloat( 1.0f );
 		required = false;
+		nameid = -1;
 	}
 	Criteria& operator =(const Criteria& src )
 	{
@@ -406,6 +409,7 @@ struct Criteria
 		value = CopyString( src.value );
 		weight = src.weight;
 		required = src.required;
+		nameid = -1;
 
 		matcher = src.matcher;
 
@@ -423,6 +427,7 @@ struct Criteria
 		value = CopyString( src.value );
 		weight = src.weight;
 		required = src.required;
+		nameid = -1;
 
 		matcher = src.matcher;
 
@@ -448,6 +453,9 @@ struct Criteria
 	float16						weight;
 	bool						required;
 
+	// Index of name in the compiled criterion name list, -1 until the rules are compiled
+	int							nameid;
+
 	Matcher						matcher;
 
 	// Indices into sub criteria
@@ -677,12 +685,21 @@ public:
 	int			ParseOneCriterion( const char *criterionName );
 	
 	bool		Compare( const char *setValue, Criteria *c, bool verbose = false );
+	bool		Compare( const char *setValue, float setNumber, Criteria *c, bool verbose = false );
 	bool		CompareUsingMatcher( const char *setValue, Matcher& m, bool verbose = false );
+	bool		CompareUsingMatcher( const char *setValue, float setNumber, Matcher& m, bool verbose = false );
+	float		ComputeSetNumber( const char *setValue );
 	void		ComputeMatcher( Criteria *c, Matcher& matcher );
 	void		ResolveToken( Matcher& matcher, char *token, size_t bufsize, char const *rawtoken );
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
+	void		FindCandidateRules( const AI_CriteriaSet& set, CUtlVector< int >& candidates );
+
+	void		CompileRules();
+	void		InvalidateCompiledRules() { m_bRulesCompiled = false; }
+	bool		IsIndexableCriterion( Criteria *c );
+	bool		LookupQueryCriterion( const AI_CriteriaSet& set, Criteria *c, int& setIndex, float& setNumber );
 
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
@@ -710,6 +727,34 @@ public:
 	CUtlDict< Rule, short >	m_Rules;
 	CUtlDict< Enumeration, short > m_Enumerations;
 
+	// Compiled matching data. Every criterion name gets a dense id, and rules
+	// are bucketed by the value of one of their required criteria so a query
+	// only has to score the rules that could possibly match it.
+	struct RuleIndexKey_t
+	{
+		int						nameid;
+		const char				*name;
+		CUtlDict< int, int >	values;		// value -> m_RuleBuckets index
+	};
+
+	struct QueryCriterion_t
+	{
+		int			serial;
+		int			setindex;
+		float		number;
+	};
+
+	bool							m_bRulesCompiled;
+	CUtlDict< int, int >			m_CriterionNameIds;
+	CUtlVector< RuleIndexKey_t >	m_RuleIndex;
+	CUtlVector< CUtlVector< unsigned short > > m_RuleBuckets;
+	CUtlVector< unsigned short >	m_UnindexedRules;
+
+	// Per query lookups of set values, indexed by criterion name id
+	CUtlVector< QueryCriterion_t >	m_QueryCriteria;
+	const AI_CriteriaSet			*m_pQuerySet;
+	int								m_nQuerySerial;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -762,6 +807,9 @@ CResponseSystem::CResponseSystem()
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_bRulesCompiled = false;
+	m_pQuerySet = NULL;
+	m_nQuerySerial = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +865,13 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+
+	m_CriterionNameIds.RemoveAll();
+	m_RuleIndex.RemoveAll();
+	m_RuleBuckets.RemoveAll();
+	m_UnindexedRules.RemoveAll();
+	m_QueryCriteria.RemoveAll();
+	InvalidateCompiledRules();
 }
 
 //-----------------------------------------------------------------------------
@@ -988,21 +1043,34 @@ void CResponseSystem::ComputeMatcher( Criteria *c, Matcher& matcher )
 
 	matcher.SetToken( token );
 	matcher.SetRaw( rawtoken );
+	matcher.tokenval = (float)atof( token );
 	matcher.valid = true;
 }
 
-bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, bool verbose /*=false*/ )
+float CResponseSystem::ComputeSetNumber( const char *setValue )
 {
-	if ( !m.valid )
-		return false;
-
-	float v = (float)atof( setValue );
 	if ( setValue[0] == '[' )
 	{
 		bool found = false;
-		v = LookupEnumeration( setValue, found );
+		return LookupEnumeration( setValue, found );
 	}
-	
+
+	return (float)atof( setValue );
+}
+
+bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, bool verbose /*=false*/ )
+{
+	if ( !m.valid )
+		return false;
+
+	return CompareUsingMatcher( setValue, ComputeSetNumber( setValue ), m, verbose );
+}
+
+bool CResponseSystem::CompareUsingMatcher( const char *setValue, float v, Matcher& m, bool verbose /*=false*/ )
+{
+	if ( !m.valid )
+		return false;
+
 	int minmaxcount = 0;
 
 	if ( m.usemin )
@@ -1047,7 +1115,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	{
 		if ( m.isnumeric )
 		{
-			if ( v == (float)atof( m.GetToken() ) )
+			if ( v == m.tokenval )
 				return false;
 		}
 		else
@@ -1066,18 +1134,24 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 		if ( !setValue || !setValue[0] )
 			return false;
 
-		return v == (float)atof( m.GetToken() );
+		return v == m.tokenval;
 	}
 
 	return !Q_stricmp( setValue, m.GetToken() ) ? true : false;
 }
 
 bool CResponseSystem::Compare( const char *setValue, Criteria *c, bool verbose /*= false*/ )
+{
+	Assert( setValue );
+	return Compare( setValue, ComputeSetNumber( setValue ), c, verbose );
+}
+
+bool CResponseSystem::Compare( const char *setValue, float setNumber, Criteria *c, bool verbose /*= false*/ )
 {
 	Assert( c );
 	Assert( setValue );
 
-	bool bret = CompareUsingMatcher( setValue, c->matcher, verbose );
+	bool bret = CompareUsingMatcher( setValue, setNumber, c->matcher, verbose );
 
 	if ( verbose )
 	{
@@ -1164,7 +1238,18 @@ float CResponseSystem::ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& s
 
 	const char *actualValue = "";
 
-	int found = set.FindCriterionIndex( c->name );
+	int found;
+	float actualNumber;
+	if ( !LookupQueryCriterion( set, c, found, actualNumber ) )
+	{
+		found = set.FindCriterionIndex( c->name );
+		actualNumber = 0.0f;
+		if ( found != -1 && set.GetValue( found ) )
+		{
+			actualNumber = ComputeSetNumber( set.GetValue( found ) );
+		}
+	}
+
 	if ( found != -1 )
 	{
 		actualValue = set.GetValue( found );
@@ -1177,7 +1262,7 @@ float CResponseSystem::ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& s
 
 	Assert( actualValue );
 
-	if ( Compare( actualValue, c, verbose ) )
+	if ( Compare( actualValue, actualNumber, c, verbose ) )
 	{
 		float w = set.GetWeight( found );
 		score = w * c->weight.GetFloat();
@@ -1676,6 +1761,204 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule
 	return bret;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Can this criterion only match one exact string value?
+//-----------------------------------------------------------------------------
+bool CResponseSystem::IsIndexableCriterion( Criteria *c )
+{
+	if ( !c->required || c->IsSubCriteriaType() || !c->name )
+		return false;
+
+	// An empty token also matches a set that doesn't have the criterion at all
+	Matcher &m = c->matcher;
+	return m.valid && !m.isnumeric && !m.notequal && !m.usemin && !m.usemax && m.GetToken()[0];
+}
+
+static int RuleIndexLessFunc( const int *lhs, const int *rhs )
+{
+	return *lhs - *rhs;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the criterion name ids and the rule index. A rule with a
+//			required criterion that only matches one string (concept and
+//			classname, for instance) can't score unless the set has that
+//			value, so the rule is filed under it. Everything else is scored
+//			on every query.
+//-----------------------------------------------------------------------------
+void CResponseSystem::CompileRules()
+{
+	m_CriterionNameIds.RemoveAll();
+	m_RuleIndex.RemoveAll();
+	m_RuleBuckets.RemoveAll();
+	m_UnindexedRules.RemoveAll();
+	m_QueryCriteria.RemoveAll();
+
+	// Give every criterion name a dense id
+	for ( int i = m_Criteria.First(); i != m_Criteria.InvalidIndex(); i = m_Criteria.Next( i ) )
+	{
+		Criteria *c = &m_Criteria[ i ];
+		c->nameid = -1;
+		if ( c->IsSubCriteriaType() || !c->name )
+			continue;
+
+		int idx = m_CriterionNameIds.Find( c->name );
+		if ( idx == m_CriterionNameIds.InvalidIndex() )
+		{
+			idx = m_CriterionNameIds.Insert( c->name, m_CriterionNameIds.Count() );
+		}
+		c->nameid = m_CriterionNameIds[ idx ];
+	}
+
+	QueryCriterion_t empty;
+	empty.serial = 0;
+	empty.setindex = -1;
+	empty.number = 0.0f;
+	m_QueryCriteria.AddMultipleToTail( m_CriterionNameIds.Count() );
+	for ( int i = 0; i < m_QueryCriteria.Count(); i++ )
+	{
+		m_QueryCriteria[ i ] = empty;
+	}
+	m_nQuerySerial = 0;
+
+	// Prefer the names the most rules can be filed under so there are few keys to look up per query
+	CUtlVector< int > nameUseCount;
+	nameUseCount.AddMultipleToTail( m_CriterionNameIds.Count() );
+	for ( int i = 0; i < nameUseCount.Count(); i++ )
+	{
+		nameUseCount[ i ] = 0;
+	}
+
+	int nRules = m_Rules.Count();
+	for ( int irule = 0; irule < nRules; irule++ )
+	{
+		Rule *rule = &m_Rules[ irule ];
+		for ( int i = 0; i < rule->m_Criteria.Count(); i++ )
+		{
+			Criteria *c = &m_Criteria[ rule->m_Criteria[ i ] ];
+			if ( IsIndexableCriterion( c ) )
+			{
+				++nameUseCount[ c->nameid ];
+			}
+		}
+	}
+
+	for ( int irule = 0; irule < nRules; irule++ )
+	{
+		Rule *rule = &m_Rules[ irule ];
+
+		Criteria *pKey = NULL;
+		for ( int i = 0; i < rule->m_Criteria.Count(); i++ )
+		{
+			Criteria *c = &m_Criteria[ rule->m_Criteria[ i ] ];
+			if ( !IsIndexableCriterion( c ) )
+				continue;
+
+			if ( !pKey || nameUseCount[ c->nameid ] > nameUseCount[ pKey->nameid ] )
+			{
+				pKey = c;
+			}
+		}
+
+		if ( !pKey )
+		{
+			m_UnindexedRules.AddToTail( irule );
+			continue;
+		}
+
+		int key;
+		for ( key = 0; key < m_RuleIndex.Count(); key++ )
+		{
+			if ( m_RuleIndex[ key ].nameid == pKey->nameid )
+				break;
+		}
+		if ( key == m_RuleIndex.Count() )
+		{
+			key = m_RuleIndex.AddToTail();
+			m_RuleIndex[ key ].nameid = pKey->nameid;
+			m_RuleIndex[ key ].name = pKey->name;
+		}
+
+		CUtlDict< int, int > &values = m_RuleIndex[ key ].values;
+		const char *pszValue = pKey->matcher.GetToken();
+		int idx = values.Find( pszValue );
+		if ( idx == values.InvalidIndex() )
+		{
+			idx = values.Insert( pszValue, m_RuleBuckets.AddToTail() );
+		}
+		m_RuleBuckets[ values[ idx ] ].AddToTail( irule );
+	}
+
+	m_bRulesCompiled = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers, in rule order, every rule that could score against set
+//-----------------------------------------------------------------------------
+void CResponseSystem::FindCandidateRules( const AI_CriteriaSet& set, CUtlVector< int >& candidates )
+{
+	Assert( m_bRulesCompiled );
+
+	candidates.AddMultipleToTail( m_UnindexedRules.Count() );
+	for ( int i = 0; i < m_UnindexedRules.Count(); i++ )
+	{
+		candidates[ i ] = m_UnindexedRules[ i ];
+	}
+
+	for ( int key = 0; key < m_RuleIndex.Count(); key++ )
+	{
+		const RuleIndexKey_t &index = m_RuleIndex[ key ];
+
+		// A required criterion that isn't in the set can't match
+		int found = set.FindCriterionIndex( index.name );
+		if ( found == -1 )
+			continue;
+
+		const char *pszValue = set.GetValue( found );
+		if ( !pszValue )
+			continue;
+
+		int idx = index.values.Find( pszValue );
+		if ( idx == index.values.InvalidIndex() )
+			continue;
+
+		const CUtlVector< unsigned short > &rules = m_RuleBuckets[ index.values[ idx ] ];
+		for ( int i = 0; i < rules.Count(); i++ )
+		{
+			candidates.AddToTail( rules[ i ] );
+		}
+	}
+
+	// Each rule is filed under at most one key, so the lists don't overlap,
+	// but they do need to go back into rule order for tie breaking
+	candidates.Sort( RuleIndexLessFunc );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the set entry and numeric value for c, once per query
+//-----------------------------------------------------------------------------
+bool CResponseSystem::LookupQueryCriterion( const AI_CriteriaSet& set, Criteria *c, int& setIndex, float& setNumber )
+{
+	if ( m_pQuerySet != &set || c->nameid < 0 || !m_bRulesCompiled )
+		return false;
+
+	QueryCriterion_t &query = m_QueryCriteria[ c->nameid ];
+	if ( query.serial != m_nQuerySerial )
+	{
+		query.serial = m_nQuerySerial;
+		query.setindex = set.FindCriterionIndex( c->name );
+		query.number = 0.0f;
+		if ( query.setindex != -1 && set.GetValue( query.setindex ) )
+		{
+			query.number = ComputeSetNumber( set.GetValue( query.setindex ) );
+		}
+	}
+
+	setIndex = query.setindex;
+	setNumber = query.number;
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : set - 
@@ -1687,11 +1970,31 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	CUtlVector< int >	bestrules;
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
+	if ( !m_bRulesCompiled )
+	{
+		CompileRules();
+	}
+
+	// Only score the rules that could match, unless someone is watching
+	// the scoring, in which case they want to see every rule.
+	CUtlVector< int >	candidates;
+	const char *pszDebugRule = rr_debugrule.GetString();
+	bool bScoreAll = verbose || ( pszDebugRule && pszDebugRule[0] );
+	if ( !bScoreAll )
+	{
+		FindCandidateRules( set, candidates );
+	}
+
+	// Set up the per query criterion lookups
+	m_pQuerySet = &set;
+	++m_nQuerySerial;
+
+	int c = bScoreAll ? m_Rules.Count() : candidates.Count();
 	int i;
 	for ( i = 0; i < c; i++ )
 	{
-		float score = ScoreCriteriaAgainstRule( set, i, verbose );
+		int irule = bScoreAll ? i : candidates[ i ];
+		float score = ScoreCriteriaAgainstRule( set, irule, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
 		{
@@ -1703,10 +2006,12 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 			}
 
 			// Add to bucket
-			bestrules.AddToTail( i );
+			bestrules.AddToTail( irule );
 		}
 	}
 
+	m_pQuerySet = NULL;
+
 	int bestCount = bestrules.Count();
 	if ( bestCount <= 0 )
 		return -1;
@@ -2004,6 +2309,9 @@ void CResponseSystem::LoadRuleSet( const char *basescript )
 	UTIL_FreeFile( buffer );
 
 	Assert( m_ScriptStack.Count() == 0 );
+
+	// Build the rule index now rather than on the first query
+	CompileRules();
 }
 
 static ResponseType_t ComputeResponseType( const char *s )
@@ -2412,6 +2720,7 @@ int CResponseSystem::ParseOneCriterion( const char *criterionName )
 	}
 
 	int idx = m_Criteria.Insert( criterionName, newCriterion );
+	InvalidateCompiledRules();
 	return idx;
 }
 
@@ -2607,6 +2916,7 @@ void CResponseSystem::ParseRule( void )
 	if ( validRule )
 	{
 		m_Rules.Insert( ruleName, newRule );
+		InvalidateCompiledRules();
 	}
 	else
 	{
@@ -2699,6 +3009,7 @@ void CResponseSystem::CopyCriteriaFrom( Rule *pSrcRule, Rule *pDstRule, CRespons
 			}
 
 			int iInsertIndex = pCustomSystem->m_Criteria.Insert( m_Criteria.GetElementName( iSrcIndex ), dstCriteria );
+			pCustomSystem->InvalidateCompiledRules();
 			pDstRule->m_Criteria.AddToTail( iInsertIndex );
 		}
 	}
@@ -2804,6 +3115,7 @@ void CResponseSystem::CopyRuleFrom( Rule *pSrcRule, int iRule, CResponseSystem *
 
 	// Add rule.
 	pCustomSystem->m_Rules.Insert( m_Rules.GetElementName( iRule ), dstRule );
+	pCustomSystem->InvalidateCompiledRules();
 }
 
 //-----------------------------------------------------------------------------
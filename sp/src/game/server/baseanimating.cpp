@@ -27,6 +27,8 @@
 #include "datacache/idatacache.h"
 #include "smoke_trail.h"
 #include "props.h"
+#include "vstdlib/jobthread.h"
+#include "ilagcompensationmanager.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1839,6 +1841,7 @@ void CBaseAnimating::BuildMatricesWithBoneMerge(
 
 ConVar sv_pvsskipanimation( "sv_pvsskipanimation", "1", FCVAR_ARCHIVE, "Skips SetupBones when npc's are outside the PVS" );
 ConVar ai_setupbones_debug( "ai_setupbones_debug", "0", 0, "Shows that bones that are setup every think" );
+ConVar sv_parallel_setupbones( "sv_parallel_setupbones", "1", 0, "Set up batched player hitbox bones on the job pool; 0 sets them up one at a time on the main thread" );
 
 
 
@@ -2673,38 +2676,58 @@ void CBaseAnimating::UnlockStudioHdr()
 // Purpose: return the index to the shared bone cache
 // Output :
 //-----------------------------------------------------------------------------
-CBoneCache *CBaseAnimating::GetBoneCache( void )
+int CBaseAnimating::GetBoneCacheMask()
 {
-	CStudioHdr *pStudioHdr = GetModelPtr( );
-	Assert(pStudioHdr);
-
-	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
 	int boneMask = BONE_USED_BY_HITBOX | BONE_USED_BY_ATTACHMENT;
 
 	// TF queries these bones to position weapons when players are killed
 #if defined( TF_DLL )
 	boneMask |= BONE_USED_BY_BONE_MERGE;
 #endif
-	if ( pcache )
+	return boneMask;
+}
+
+bool CBaseAnimating::HasValidBoneCache( int boneMask )
+{
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+	return pcache && pcache->IsValid( gpGlobals->curtime ) && (pcache->m_boneMask & boneMask) == boneMask && pcache->m_timeValid <= gpGlobals->curtime;
+}
+
+CBoneCache *CBaseAnimating::GetBoneCache( void )
+{
+	int boneMask = GetBoneCacheMask();
+
+	if ( HasValidBoneCache( boneMask ) )
 	{
-		if ( pcache->IsValid( gpGlobals->curtime ) && (pcache->m_boneMask & boneMask) == boneMask && pcache->m_timeValid <= gpGlobals->curtime)
-		{
-			// Msg("%s:%s:%s (%x:%x:%8.4f) cache\n", GetClassname(), GetDebugName(), STRING(GetModelName()), boneMask, pcache->m_boneMask, pcache->m_timeValid );
-			// in memory and still valid, use it!
-			return pcache;
-		}
-		// in memory, but missing some of the bone masks
-		if ( (pcache->m_boneMask & boneMask) != boneMask )
-		{
-			Studio_DestroyBoneCache( m_boneCacheHandle );
-			m_boneCacheHandle = 0;
-			pcache = NULL;
-		}
+		// Msg("%s:%s:%s (%x:%x:%8.4f) cache\n", GetClassname(), GetDebugName(), STRING(GetModelName()), boneMask, pcache->m_boneMask, pcache->m_timeValid );
+		// in memory and still valid, use it!
+		return Studio_GetBoneCache( m_boneCacheHandle );
 	}
 
 	matrix3x4_t bonetoworld[MAXSTUDIOBONES];
 	SetupBones( bonetoworld, boneMask );
 
+	return UpdateBoneCache( bonetoworld, boneMask );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Stores freshly set up bones in the bone cache
+//-----------------------------------------------------------------------------
+CBoneCache *CBaseAnimating::UpdateBoneCache( matrix3x4_t *bonetoworld, int boneMask )
+{
+	CStudioHdr *pStudioHdr = GetModelPtr( );
+	Assert(pStudioHdr);
+
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+
+	// in memory, but missing some of the bone masks
+	if ( pcache && (pcache->m_boneMask & boneMask) != boneMask )
+	{
+		Studio_DestroyBoneCache( m_boneCacheHandle );
+		m_boneCacheHandle = 0;
+		pcache = NULL;
+	}
+
 	if ( pcache )
 	{
 		// still in memory but out of date, refresh the bones.
@@ -2731,6 +2754,90 @@ void CBaseAnimating::InvalidateBoneCache( void )
 	Studio_InvalidateBoneCache( m_boneCacheHandle );
 }
 
+struct BoneSetupBatchItem_t
+{
+	CBaseAnimating	*pAnimating;
+	int				iFirstBone;		// into s_BoneSetupBatchMatrices
+	int				boneMask;
+};
+
+static CUtlVector< matrix3x4_t > s_BoneSetupBatchMatrices;
+
+static void SetupBonesForBatchItem( BoneSetupBatchItem_t &item )
+{
+	// SetupBones is virtual; only the player classes' versions are known to
+	// be safe off the main thread
+	Assert( item.pAnimating->IsPlayer() );
+	item.pAnimating->SetupBones( &s_BoneSetupBatchMatrices[ item.iFirstBone ], item.boneMask );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sets up hitbox bones for many entities at once. Entities whose
+//			cache is already valid are skipped. Only players go to the job
+//			pool; anything else, and players that can't safely run off the
+//			main thread (server IK traces against the world, bone merge
+//			reads the parent's cache), are set up here in order first.
+//-----------------------------------------------------------------------------
+void CBaseAnimating::SetupBonesBatch( CBaseAnimating **ppAnimating, int nCount )
+{
+	VPROF_BUDGET( "CBaseAnimating::SetupBonesBatch", VPROF_BUDGETGROUP_SERVER_ANIM );
+
+	int boneMask = GetBoneCacheMask();
+
+	CUtlVector< BoneSetupBatchItem_t > items( 0, nCount );
+	int nBones = 0;
+
+	for ( int i = 0; i < nCount; i++ )
+	{
+		CBaseAnimating *pAnimating = ppAnimating[i];
+		if ( !pAnimating || pAnimating->HasValidBoneCache( boneMask ) )
+			continue;
+
+		CStudioHdr *pStudioHdr = pAnimating->GetModelPtr();
+		if ( !pStudioHdr || pAnimating->IsEFlagSet( EFL_SETTING_UP_BONES ) )
+			continue;
+
+		if ( !pAnimating->IsPlayer() || pAnimating->m_pIk || dynamic_cast< CBaseAnimating* >( pAnimating->GetMoveParent() ) || ai_setupbones_debug.GetBool() )
+		{
+			pAnimating->GetBoneCache();
+			continue;
+		}
+
+		// Bring the abs transform up to date here rather than on a worker
+		pAnimating->GetAbsOrigin();
+		pAnimating->GetAbsAngles();
+
+		BoneSetupBatchItem_t &item = items[ items.AddToTail() ];
+		item.pAnimating = pAnimating;
+		item.iFirstBone = nBones;
+		item.boneMask = boneMask;
+		nBones += pStudioHdr->numbones();
+	}
+
+	if ( !items.Count() )
+		return;
+
+	s_BoneSetupBatchMatrices.EnsureCount( nBones );
+
+	if ( sv_parallel_setupbones.GetBool() && items.Count() > 1 )
+	{
+		ParallelProcess( "CBaseAnimating::SetupBonesBatch", items.Base(), items.Count(), &SetupBonesForBatchItem );
+	}
+	else
+	{
+		for ( int i = 0; i < items.Count(); i++ )
+		{
+			SetupBonesForBatchItem( items[i] );
+		}
+	}
+
+	// Publishing touches the shared bone cache manager, so it stays on this thread
+	for ( int i = 0; i < items.Count(); i++ )
+	{
+		items[i].pAnimating->UpdateBoneCache( &s_BoneSetupBatchMatrices[ items[i].iFirstBone ], items[i].boneMask );
+	}
+}
+
 bool CBaseAnimating::TestCollision( const Ray_t &ray, unsigned int fContentsMask, trace_t& tr )
 {
 	// Return a special case for scaled physics objects
@@ -2772,6 +2879,10 @@ bool CBaseAnimating::TestHitboxes( const Ray_t &ray, unsigned int fContentsMask,
 	if ( !set || !set->numhitboxes )
 		return false;
 
+	// Players moved back in time get their bones set up together, and only
+	// once a trace reaches them. Outside lag compensation none are pending
+	lagcompensation->SetupBonesForRay( ray );
+
 	CBoneCache *pcache = GetBoneCache( );
 
 	matrix3x4_t *hitboxbones[MAXSTUDIOBONES];
@@ -3686,3 +3797,106 @@ CStudioHdr *CBaseAnimating::OnNewModel()
 
 	return hdr;
 }
+
+//-----------------------------------------------------------------------------
+// Purpose: Times pose setup across the longest sequences of a model, with and
+//			without the animation seek index
+//-----------------------------------------------------------------------------
+struct SeekBenchmarkSequence_t
+{
+	int		iSequence;
+	int		nFrames;
+};
+
+static int __cdecl SeekBenchmarkSequenceSortFunc( const SeekBenchmarkSequence_t *lhs, const SeekBenchmarkSequence_t *rhs )
+{
+	return rhs->nFrames - lhs->nFrames;
+}
+
+static float TimeSequencePoses( CStudioHdr *pStudioHdr, int iSequence, const float *poseParameter, int nIterations )
+{
+	Vector pos[MAXSTUDIOBONES];
+	Quaternion q[MAXSTUDIOBONES];
+
+	const int nCycles = 64;
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		for ( int j = 0; j < nCycles; j++ )
+		{
+			IBoneSetup boneSetup( pStudioHdr, BONE_USED_BY_ANYTHING, poseParameter );
+			boneSetup.InitPose( pos, q );
+			boneSetup.AccumulatePose( pos, q, iSequence, (float)j / ( nCycles - 1 ), 1.0f, gpGlobals->curtime, NULL );
+		}
+	}
+	timer.End();
+
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+CON_COMMAND( anim_seekindex_benchmark, "Times pose setup on a model's longest sequences with and without animation seek indices. Usage: anim_seekindex_benchmark <model> [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: anim_seekindex_benchmark <model> [iterations]\n" );
+		return;
+	}
+
+	int modelIndex = modelinfo->GetModelIndex( args[1] );
+	const model_t *pModel = ( modelIndex >= 0 ) ? modelinfo->GetModel( modelIndex ) : NULL;
+	if ( !pModel || modelinfo->GetModelType( pModel ) != mod_studio )
+	{
+		Warning( "anim_seekindex_benchmark: %s isn't a precached studio model\n", args[1] );
+		return;
+	}
+
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 10;
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	CStudioHdr studioHdr( modelinfo->GetStudiomodel( pModel ), mdlcache );
+	if ( !studioHdr.IsValid() || !studioHdr.SequencesAvailable() )
+		return;
+
+	float poseParameter[MAXSTUDIOPOSEPARAM];
+	for ( int i = 0; i < MAXSTUDIOPOSEPARAM; i++ )
+	{
+		poseParameter[i] = 0.5f;
+	}
+
+	CUtlVector< SeekBenchmarkSequence_t > sequences;
+	sequences.SetCount( studioHdr.GetNumSeq() );
+	for ( int i = 0; i < sequences.Count(); i++ )
+	{
+		sequences[i].iSequence = i;
+		sequences[i].nFrames = Studio_MaxFrame( &studioHdr, i, poseParameter );
+	}
+	sequences.Sort( SeekBenchmarkSequenceSortFunc );
+
+	ConVarRef anim_seekindex( "anim_seekindex" );
+	bool bOldSeekIndex = anim_seekindex.GetBool();
+
+	Msg( "%-32s %8s %12s %12s %8s\n", "sequence", "frames", "walk (ms)", "seek (ms)", "speedup" );
+	for ( int i = 0; i < MIN( sequences.Count(), 8 ); i++ )
+	{
+		int iSequence = sequences[i].iSequence;
+
+		anim_seekindex.SetValue( 0 );
+		float flWalk = TimeSequencePoses( &studioHdr, iSequence, poseParameter, nIterations );
+
+		// The first pass builds the index
+		anim_seekindex.SetValue( 1 );
+		TimeSequencePoses( &studioHdr, iSequence, poseParameter, 1 );
+		float flSeek = TimeSequencePoses( &studioHdr, iSequence, poseParameter, nIterations );
+
+		Msg( "%-32s %8d %12.3f %12.3f %7.2fx\n", studioHdr.pSeqdesc( iSequence ).pszLabel(), sequences[i].nFrames,
+			flWalk, flSeek, flSeek > 0.0f ? flWalk / flSeek : 0.0f );
+	}
+
+	anim_seekindex.SetValue( bOldSeekIndex );
+}
@@ -278,6 +278,11 @@ public:
 	virtual bool TestHitboxes( const Ray_t &ray, unsigned int fContentsMask, trace_t& tr );
 	class CBoneCache *GetBoneCache( void );
 	void InvalidateBoneCache();
+	// Sets up the hitbox bones of several entities at once and leaves them in
+	// each entity's bone cache, so GetBoneCache() this tick is free. Players
+	// are set up on the job pool, so a player class overriding SetupBones must
+	// keep it safe to run off the main thread.
+	static void SetupBonesBatch( CBaseAnimating **ppAnimating, int nCount );
 	void InvalidateBoneCacheIfOlderThan( float deltaTime );
 	virtual int DrawDebugTextOverlays( void );
 	
@@ -457,6 +462,10 @@ public:
 	COutputEvent m_OnIgnite;
 
 private:
+	static int GetBoneCacheMask();
+	bool HasValidBoneCache( int boneMask );
+	class CBoneCache *UpdateBoneCache( matrix3x4_t *pBoneToWorld, int boneMask );
+
 	CStudioHdr			*m_pStudioHdr;
 	CThreadFastMutex	m_StudioHdrInitLock;
 	CThreadFastMutex	m_BoneSetupMutex;
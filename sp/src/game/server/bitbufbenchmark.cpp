@@ -0,0 +1,270 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Throughput benchmark for the bf_write / bf_read coord, normal
+//			and angle encoders, single value calls against the array calls.
+//			Runs over entity state recorded with bitbuf_benchmark_record,
+//			or over the entities on the server right now.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/bitbuf.h"
+#include "coordsize.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlbuffer.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define BITBUF_BENCHMARK_VERSION	1
+#define BITBUF_BENCHMARK_ANGLEBITS	13
+
+//-----------------------------------------------------------------------------
+// Purpose: The float fields a snapshot carries for each entity
+//-----------------------------------------------------------------------------
+struct BitBufBenchmarkPayload_t
+{
+	CUtlVector< float >	m_Coords;		// origins and velocities
+	CUtlVector< float >	m_Normals;		// facing directions
+	CUtlVector< float >	m_Angles;		// euler angles
+};
+
+static void CaptureBitBufPayload( BitBufBenchmarkPayload_t &payload )
+{
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		if ( !pEntity->edict() )
+			continue;
+
+		const Vector &vecOrigin = pEntity->GetAbsOrigin();
+		const Vector &vecVelocity = pEntity->GetAbsVelocity();
+		const QAngle &angles = pEntity->GetAbsAngles();
+
+		Vector vecForward;
+		AngleVectors( angles, &vecForward );
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			payload.m_Coords.AddToTail( vecOrigin[i] );
+			payload.m_Coords.AddToTail( vecVelocity[i] );
+			payload.m_Normals.AddToTail( vecForward[i] );
+			payload.m_Angles.AddToTail( anglemod( angles[i] ) );
+		}
+	}
+}
+
+static void WriteFloats( CUtlBuffer &buf, const CUtlVector< float > &values )
+{
+	buf.PutInt( values.Count() );
+	for ( int i = 0; i < values.Count(); ++i )
+	{
+		buf.PutFloat( values[i] );
+	}
+}
+
+static bool ReadFloats( CUtlBuffer &buf, CUtlVector< float > &values )
+{
+	int nCount = buf.GetInt();
+	if ( !buf.IsValid() || nCount < 0 || nCount * (int)sizeof( float ) > buf.GetBytesRemaining() )
+		return false;
+
+	values.SetCount( nCount );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		values[i] = buf.GetFloat();
+	}
+	return buf.IsValid();
+}
+
+static bool LoadBitBufPayload( const char *pszFilename, BitBufBenchmarkPayload_t &payload )
+{
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( pszFilename, "MOD", buf ) )
+		return false;
+
+	if ( buf.GetInt() != BITBUF_BENCHMARK_VERSION )
+		return false;
+
+	return ReadFloats( buf, payload.m_Coords ) && ReadFloats( buf, payload.m_Normals ) && ReadFloats( buf, payload.m_Angles );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Encodes the payload one value at a time or in runs. Both must
+//			produce the same bits.
+//-----------------------------------------------------------------------------
+static void EncodeBitBufPayload( bf_write &buf, const BitBufBenchmarkPayload_t &payload, bool bArrays )
+{
+	if ( bArrays )
+	{
+		buf.WriteBitCoordArray( payload.m_Coords.Base(), payload.m_Coords.Count() );
+		buf.WriteBitCoordMPArray( payload.m_Coords.Base(), payload.m_Coords.Count(), false, false );
+		buf.WriteBitNormalArray( payload.m_Normals.Base(), payload.m_Normals.Count() );
+		buf.WriteBitAngleArray( payload.m_Angles.Base(), payload.m_Angles.Count(), BITBUF_BENCHMARK_ANGLEBITS );
+		return;
+	}
+
+	for ( int i = 0; i < payload.m_Coords.Count(); ++i )
+	{
+		buf.WriteBitCoord( payload.m_Coords[i] );
+	}
+	for ( int i = 0; i < payload.m_Coords.Count(); ++i )
+	{
+		buf.WriteBitCoordMP( payload.m_Coords[i], false, false );
+	}
+	for ( int i = 0; i < payload.m_Normals.Count(); ++i )
+	{
+		buf.WriteBitNormal( payload.m_Normals[i] );
+	}
+	for ( int i = 0; i < payload.m_Angles.Count(); ++i )
+	{
+		buf.WriteBitAngle( payload.m_Angles[i], BITBUF_BENCHMARK_ANGLEBITS );
+	}
+}
+
+static void DecodeBitBufPayload( bf_read &buf, const BitBufBenchmarkPayload_t &payload, float *pOut, bool bArrays )
+{
+	int nCoords = payload.m_Coords.Count();
+	int nNormals = payload.m_Normals.Count();
+	int nAngles = payload.m_Angles.Count();
+
+	if ( bArrays )
+	{
+		buf.ReadBitCoordArray( pOut, nCoords );
+		buf.ReadBitCoordMPArray( pOut + nCoords, nCoords, false, false );
+		buf.ReadBitNormalArray( pOut + nCoords * 2, nNormals );
+		buf.ReadBitAngleArray( pOut + nCoords * 2 + nNormals, nAngles, BITBUF_BENCHMARK_ANGLEBITS );
+		return;
+	}
+
+	for ( int i = 0; i < nCoords; ++i )
+	{
+		*pOut++ = buf.ReadBitCoord();
+	}
+	for ( int i = 0; i < nCoords; ++i )
+	{
+		*pOut++ = buf.ReadBitCoordMP( false, false );
+	}
+	for ( int i = 0; i < nNormals; ++i )
+	{
+		*pOut++ = buf.ReadBitNormal();
+	}
+	for ( int i = 0; i < nAngles; ++i )
+	{
+		*pOut++ = buf.ReadBitAngle( BITBUF_BENCHMARK_ANGLEBITS );
+	}
+}
+
+CON_COMMAND( bitbuf_benchmark_record, "Saves the coords, normals and angles of the current entities for bitbuf_benchmark. Usage: bitbuf_benchmark_record <filename>" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: bitbuf_benchmark_record <filename>\n" );
+		return;
+	}
+
+	BitBufBenchmarkPayload_t payload;
+	CaptureBitBufPayload( payload );
+
+	CUtlBuffer buf;
+	buf.PutInt( BITBUF_BENCHMARK_VERSION );
+	WriteFloats( buf, payload.m_Coords );
+	WriteFloats( buf, payload.m_Normals );
+	WriteFloats( buf, payload.m_Angles );
+
+	if ( filesystem->WriteFile( args.Arg( 1 ), "MOD", buf ) )
+	{
+		Msg( "Recorded %d entities to %s\n", payload.m_Angles.Count() / 3, args.Arg( 1 ) );
+	}
+	else
+	{
+		Warning( "Couldn't write %s\n", args.Arg( 1 ) );
+	}
+}
+
+CON_COMMAND( bitbuf_benchmark, "Times bitbuf coord, normal and angle encoding one value at a time against the array calls. Usage: bitbuf_benchmark [filename] [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	BitBufBenchmarkPayload_t payload;
+	if ( args.ArgC() > 1 && Q_strcmp( args.Arg( 1 ), "-" ) )
+	{
+		if ( !LoadBitBufPayload( args.Arg( 1 ), payload ) )
+		{
+			Warning( "Couldn't load bitbuf payload from %s\n", args.Arg( 1 ) );
+			return;
+		}
+	}
+	else
+	{
+		CaptureBitBufPayload( payload );
+	}
+
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args.Arg( 2 ) ), 1 ) : 100;
+	int nValues = payload.m_Coords.Count() * 2 + payload.m_Normals.Count() + payload.m_Angles.Count();
+	if ( !nValues )
+	{
+		Msg( "Nothing to encode\n" );
+		return;
+	}
+
+	// Worst case is a full length coord for every value, plus dword padding
+	int nMaxBits = nValues * ( 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS );
+	int nBufferBytes = ( ( nMaxBits + 7 ) / 8 + 4 ) & ~3;
+	CUtlVector< uint32 > singleData, arrayData;
+	singleData.SetCount( nBufferBytes / 4 );
+	arrayData.SetCount( nBufferBytes / 4 );
+	memset( singleData.Base(), 0, nBufferBytes );
+	memset( arrayData.Base(), 0, nBufferBytes );
+
+	CUtlVector< float > singleValues, arrayValues;
+	singleValues.SetCount( nValues );
+	arrayValues.SetCount( nValues );
+
+	CCycleCount timeWrite[2], timeRead[2];
+	int nBits = 0;
+
+	for ( int iPass = 0; iPass < 2; ++iPass )
+	{
+		bool bArrays = ( iPass == 1 );
+		uint32 *pData = bArrays ? arrayData.Base() : singleData.Base();
+		float *pValues = bArrays ? arrayValues.Base() : singleValues.Base();
+
+		CFastTimer timer;
+		timer.Start();
+		for ( int i = 0; i < nIterations; ++i )
+		{
+			bf_write buf( "bitbuf_benchmark", pData, nBufferBytes );
+			EncodeBitBufPayload( buf, payload, bArrays );
+			nBits = buf.GetNumBitsWritten();
+		}
+		timer.End();
+		timeWrite[iPass] = timer.GetDuration();
+
+		timer.Start();
+		for ( int i = 0; i < nIterations; ++i )
+		{
+			bf_read buf( "bitbuf_benchmark", pData, nBufferBytes, nBits );
+			DecodeBitBufPayload( buf, payload, pValues, bArrays );
+		}
+		timer.End();
+		timeRead[iPass] = timer.GetDuration();
+	}
+
+	bool bSameBits = !memcmp( singleData.Base(), arrayData.Base(), nBufferBytes );
+	bool bSameValues = !memcmp( singleValues.Base(), arrayValues.Base(), nValues * sizeof( float ) );
+
+	double flMegabits = (double)nBits * nIterations / 1000000.0;
+	Msg( "bitbuf_benchmark: %d values, %d bits per pass, %d passes\n", nValues, nBits, nIterations );
+	Msg( "  write: single %.1f Mbit/s, array %.1f Mbit/s\n", flMegabits / timeWrite[0].GetSeconds(), flMegabits / timeWrite[1].GetSeconds() );
+	Msg( "  read:  single %.1f Mbit/s, array %.1f Mbit/s\n", flMegabits / timeRead[0].GetSeconds(), flMegabits / timeRead[1].GetSeconds() );
+
+	if ( !bSameBits || !bSameValues )
+	{
+		Warning( "  array encoding doesn't match (bits %s, values %s)\n", bSameBits ? "match" : "differ", bSameValues ? "match" : "differ" );
+	}
+}
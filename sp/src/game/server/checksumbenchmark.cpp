@@ -0,0 +1,180 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checksum throughput benchmark. Times CRC32 against the byte at a
+//			time table loop it replaced, and MD5 and SHA1 one buffer at a time
+//			against the multi-buffer versions.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/checksum_crc.h"
+#include "tier1/checksum_md5.h"
+#include "tier1/checksum_sha1.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define CHECKSUM_BENCHMARK_MAX_BYTES	( 256 * 1024 * 1024 )
+
+//-----------------------------------------------------------------------------
+// Purpose: CRC32_ProcessBuffer as it was, one table lookup per byte
+//-----------------------------------------------------------------------------
+static CRC32_t CRC32ByteAtATime( const void *pBuffer, int nBuffer )
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+
+	const unsigned char *pb = (const unsigned char *)pBuffer;
+	for ( int i = 0; i < nBuffer; ++i )
+	{
+		crc = CRC32_GetTableEntry( ( crc ^ pb[i] ) & 0xff ) ^ ( crc >> 8 );
+	}
+
+	CRC32_Final( &crc );
+	return crc;
+}
+
+static double ChecksumBenchmarkMBPerSecond( int nBytes, const CCycleCount &time )
+{
+	return (double)nBytes / ( 1024.0 * 1024.0 ) / time.GetSeconds();
+}
+
+CON_COMMAND( checksum_benchmark, "Times CRC32, MD5 and SHA1 throughput, one buffer at a time and several at once. Usage: checksum_benchmark [buffer size] [buffers] [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nBufferSize = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, 16 * 1024 * 1024 ) : 4096;
+	int nBuffers = ( args.ArgC() > 2 ) ? clamp( atoi( args.Arg( 2 ) ), 1, 4096 ) : 256;
+	int nIterations = ( args.ArgC() > 3 ) ? MAX( atoi( args.Arg( 3 ) ), 1 ) : 10;
+	nBuffers = MIN( nBuffers, MAX( CHECKSUM_BENCHMARK_MAX_BYTES / nBufferSize, 1 ) );
+
+	CUtlVector< unsigned char > data;
+	data.SetCount( nBufferSize * nBuffers );
+	unsigned int nSeed = 0x9e3779b9;
+	for ( int i = 0; i < data.Count(); ++i )
+	{
+		nSeed = nSeed * 1664525u + 1013904223u;
+		data[i] = (unsigned char)( nSeed >> 24 );
+	}
+
+	CUtlVector< const void * > buffers;
+	CUtlVector< int > lengths;
+	CUtlVector< unsigned int > unsignedLengths;
+	for ( int i = 0; i < nBuffers; ++i )
+	{
+		buffers.AddToTail( &data[ i * nBufferSize ] );
+		lengths.AddToTail( nBufferSize );
+		unsignedLengths.AddToTail( nBufferSize );
+	}
+
+	int nMismatches = 0;
+	CFastTimer timer;
+
+	// CRC32
+	CRC32_t crcCurrent = 0, crcByte = 0;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < nBuffers; ++i )
+		{
+			crcCurrent ^= CRC32_ProcessSingleBuffer( buffers[i], nBufferSize );
+		}
+	}
+	timer.End();
+	CCycleCount timeCRC = timer.GetDuration();
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < nBuffers; ++i )
+		{
+			crcByte ^= CRC32ByteAtATime( buffers[i], nBufferSize );
+		}
+	}
+	timer.End();
+	CCycleCount timeCRCByte = timer.GetDuration();
+
+	if ( crcCurrent != crcByte )
+	{
+		++nMismatches;
+	}
+
+	// MD5
+	CUtlVector< MD5Value_t > md5Single, md5Multi;
+	md5Single.SetCount( nBuffers );
+	md5Multi.SetCount( nBuffers );
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < nBuffers; ++i )
+		{
+			MD5_ProcessSingleBuffer( buffers[i], nBufferSize, md5Single[i] );
+		}
+	}
+	timer.End();
+	CCycleCount timeMD5 = timer.GetDuration();
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		MD5_ProcessMultipleBuffers( buffers.Base(), lengths.Base(), nBuffers, md5Multi.Base() );
+	}
+	timer.End();
+	CCycleCount timeMD5Multi = timer.GetDuration();
+
+	for ( int i = 0; i < nBuffers; ++i )
+	{
+		if ( md5Single[i] != md5Multi[i] )
+		{
+			++nMismatches;
+		}
+	}
+
+	// SHA1
+	CUtlVector< CSHA > sha1Single, sha1Multi;
+	sha1Single.SetCount( nBuffers );
+	sha1Multi.SetCount( nBuffers );
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < nBuffers; ++i )
+		{
+			GenerateHash( sha1Single[i].SHADigest(), buffers[i], nBufferSize );
+		}
+	}
+	timer.End();
+	CCycleCount timeSHA1 = timer.GetDuration();
+
+	COMPILE_TIME_ASSERT( sizeof( CSHA ) == sizeof( SHADigest_t ) );
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		SHA1_ProcessMultipleBuffers( buffers.Base(), unsignedLengths.Base(), nBuffers, (SHADigest_t *)sha1Multi.Base() );
+	}
+	timer.End();
+	CCycleCount timeSHA1Multi = timer.GetDuration();
+
+	for ( int i = 0; i < nBuffers; ++i )
+	{
+		if ( sha1Single[i] != sha1Multi[i] )
+		{
+			++nMismatches;
+		}
+	}
+
+	int nTotalBytes = nBufferSize * nBuffers;
+	double flScale = (double)nIterations;
+	Msg( "checksum_benchmark: %d buffers of %d bytes, %d passes\n", nBuffers, nBufferSize, nIterations );
+	Msg( "  CRC32 %s: %.1f MB/s, byte at a time: %.1f MB/s\n", CRC32_GetImplementationName(), flScale * ChecksumBenchmarkMBPerSecond( nTotalBytes, timeCRC ), flScale * ChecksumBenchmarkMBPerSecond( nTotalBytes, timeCRCByte ) );
+	Msg( "  MD5 single: %.1f MB/s, multi-buffer: %.1f MB/s\n", flScale * ChecksumBenchmarkMBPerSecond( nTotalBytes, timeMD5 ), flScale * ChecksumBenchmarkMBPerSecond( nTotalBytes, timeMD5Multi ) );
+	Msg( "  SHA1 single: %.1f MB/s, multi-buffer: %.1f MB/s\n", flScale * ChecksumBenchmarkMBPerSecond( nTotalBytes, timeSHA1 ), flScale * ChecksumBenchmarkMBPerSecond( nTotalBytes, timeSHA1Multi ) );
+
+	if ( nMismatches )
+	{
+		Warning( "  %d results didn't match\n", nMismatches );
+	}
+}
@@ -360,5 +360,6 @@ void AimTarget_ForceRepopulateList();
 void SimThink_EntityChanged( CBaseEntity *pEntity );
 int SimThink_ListCount();
 int SimThink_ListCopy( CBaseEntity *pList[], int listMax );
+void SimThink_RecordTickStats( int thinkers, float flMilliseconds );
 
 #endif // ENTITYLIST_H
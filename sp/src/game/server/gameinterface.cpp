@@ -89,6 +89,8 @@
 #include "tier3/tier3.h"
 #include "serverbenchmark_base.h"
 #include "querycache.h"
+#include "tickprofiler.h"
+#include "sendtableshadow.h"
 
 
 #ifdef TF_DLL
@@ -1206,6 +1208,8 @@ void CServerGameDLL::GameFrame( bool simulating )
 
 	float oldframetime = gpGlobals->frametime;
 
+	g_pTickProfiler->BeginTick( simulating );
+
 #ifdef _DEBUG
 	// For profiling.. let them enable/disable the networkvar manual mode stuff.
 	g_bUseNetworkVars = s_UseNetworkVars.GetBool();
@@ -1277,6 +1281,8 @@ void CServerGameDLL::GameFrame( bool simulating )
 	// Any entities that detect network state changes on a timer do it here.
 	g_NetworkPropertyEventMgr.FireEvents();
 
+	g_pTickProfiler->EndTick();
+
 	gpGlobals->frametime = oldframetime;
 }
 
@@ -2392,6 +2398,237 @@ inline void CServerNetworkProperty::CheckTransmit( CCheckTransmitInfo *pInfo )
 	}
 } */
 
+//-----------------------------------------------------------------------------
+// Per-snapshot transmit data. The engine calls CheckTransmit once per client
+// with the same edict list, so everything that doesn't depend on the client
+// (state flags, PVS info, always-send hierarchies) is gathered once per frame,
+// in edict list order, and shared by every client in the snapshot.
+//-----------------------------------------------------------------------------
+enum TransmitEntryType_t
+{
+	TRANSMIT_ENTRY_ALWAYS = 0,
+	TRANSMIT_ENTRY_PVSCHECK,
+	TRANSMIT_ENTRY_FULLCHECK,
+};
+
+class CTransmitSnapshot
+{
+public:
+	CTransmitSnapshot() : m_nFrameCount( -1 ), m_nTickCount( -1 ), m_pEdictIndices( NULL ), m_nEdicts( 0 ) {}
+
+	// Rebuilds the snapshot data if this is a new frame or edict list
+	void Update( edict_t *pBaseEdict, const unsigned short *pEdictIndices, int nEdicts );
+
+	// Works out which PVS checked entities this client can see
+	void ComputeVisibility( const CCheckTransmitInfo *pInfo );
+
+	int Count() const { return m_EdictIndex.Count(); }
+
+	// One entry per entity that might be sent, DONTSEND entities are dropped
+	CUtlVector< unsigned short >	m_EdictIndex;
+	CUtlVector< unsigned char >		m_nType;
+	CUtlVector< short >				m_nAreaNum;
+	CUtlVector< short >				m_nAreaNum2;
+	CUtlVector< short >				m_nHeadNode;
+	CUtlVector< short >				m_nClusterCount;	// -1 if there are too many and we have to use the headnode
+	CUtlVector< int >				m_nFirstCluster;	// into m_Clusters, or m_AlwaysChain for FL_EDICT_ALWAYS entries
+
+	CUtlVector< unsigned short >	m_Clusters;
+	CUtlVector< unsigned short >	m_AlwaysChain;		// FL_EDICT_ALWAYS entity followed by its network parents
+	CUtlVector< unsigned short >	m_Areas;			// each area used by a PVS checked entity
+
+	// Per client results
+	CBitVec< MAX_MAP_AREAS >		m_AreaConnected;
+	CBitVec< MAX_EDICTS >			m_InPVS;
+
+private:
+	int								m_nFrameCount;
+	int								m_nTickCount;
+	const unsigned short			*m_pEdictIndices;
+	int								m_nEdicts;
+};
+
+static CTransmitSnapshot g_TransmitSnapshot;
+
+void CTransmitSnapshot::Update( edict_t *pBaseEdict, const unsigned short *pEdictIndices, int nEdicts )
+{
+	if ( m_nFrameCount == gpGlobals->framecount && m_nTickCount == gpGlobals->tickcount &&
+		 m_pEdictIndices == pEdictIndices && m_nEdicts == nEdicts )
+		return;
+
+	VPROF( "CTransmitSnapshot::Update" );
+
+	m_nFrameCount = gpGlobals->framecount;
+	m_nTickCount = gpGlobals->tickcount;
+	m_pEdictIndices = pEdictIndices;
+	m_nEdicts = nEdicts;
+
+	m_EdictIndex.RemoveAll();
+	m_nType.RemoveAll();
+	m_nAreaNum.RemoveAll();
+	m_nAreaNum2.RemoveAll();
+	m_nHeadNode.RemoveAll();
+	m_nClusterCount.RemoveAll();
+	m_nFirstCluster.RemoveAll();
+	m_Clusters.RemoveAll();
+	m_AlwaysChain.RemoveAll();
+	m_Areas.RemoveAll();
+
+	CBitVec< MAX_MAP_AREAS > areasUsed;
+	areasUsed.ClearAll();
+
+	for ( int i=0; i < nEdicts; i++ )
+	{
+		int iEdict = pEdictIndices[i];
+
+		edict_t *pEdict = &pBaseEdict[iEdict];
+		Assert( pEdict == engine->PEntityOfEntIndex( iEdict ) );
+		int nFlags = pEdict->m_fStateFlags & (FL_EDICT_DONTSEND|FL_EDICT_ALWAYS|FL_EDICT_PVSCHECK|FL_EDICT_FULLCHECK);
+
+		// entity needs no transmit
+		if ( nFlags & FL_EDICT_DONTSEND )
+			continue;
+
+		int nType;
+		if ( nFlags & FL_EDICT_ALWAYS )
+		{
+			nType = TRANSMIT_ENTRY_ALWAYS;
+		}
+		else if ( nFlags == FL_EDICT_FULLCHECK )
+		{
+			nType = TRANSMIT_ENTRY_FULLCHECK;
+		}
+		else if ( nFlags & FL_EDICT_PVSCHECK )
+		{
+			nType = TRANSMIT_ENTRY_PVSCHECK;
+		}
+		else
+		{
+			// don't send this entity
+			continue;
+		}
+
+		m_EdictIndex.AddToTail( iEdict );
+		m_nType.AddToTail( nType );
+
+		if ( nType == TRANSMIT_ENTRY_ALWAYS )
+		{
+			m_nFirstCluster.AddToTail( m_AlwaysChain.Count() );
+			while ( true )
+			{
+				m_AlwaysChain.AddToTail( iEdict );
+
+				CServerNetworkProperty *pEnt = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
+				if ( !pEnt )
+					break;
+
+				CServerNetworkProperty *pParent = pEnt->GetNetworkParent();
+				if ( !pParent )
+					break;
+
+				pEdict = pParent->edict();
+				iEdict = pParent->entindex();
+			}
+			m_nClusterCount.AddToTail( m_AlwaysChain.Count() - m_nFirstCluster.Tail() );
+			m_nAreaNum.AddToTail( 0 );
+			m_nAreaNum2.AddToTail( 0 );
+			m_nHeadNode.AddToTail( 0 );
+			continue;
+		}
+
+		// NOTE: call of AreaNum() ensures that PVS data is up to date for this entity
+		CServerNetworkProperty *netProp = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
+		netProp->AreaNum();
+		const PVSInfo_t *pPVSInfo = netProp->GetPVSInfo();
+
+		m_nAreaNum.AddToTail( pPVSInfo->m_nAreaNum );
+		m_nAreaNum2.AddToTail( pPVSInfo->m_nAreaNum2 );
+		m_nHeadNode.AddToTail( pPVSInfo->m_nHeadNode );
+		m_nClusterCount.AddToTail( pPVSInfo->m_nClusterCount );
+		m_nFirstCluster.AddToTail( m_Clusters.Count() );
+		if ( pPVSInfo->m_nClusterCount > 0 )
+		{
+			m_Clusters.AddMultipleToTail( pPVSInfo->m_nClusterCount, pPVSInfo->m_pClusters );
+		}
+
+		if ( !areasUsed.IsBitSet( pPVSInfo->m_nAreaNum ) )
+		{
+			areasUsed.Set( pPVSInfo->m_nAreaNum );
+			m_Areas.AddToTail( pPVSInfo->m_nAreaNum );
+		}
+		if ( pPVSInfo->m_nAreaNum2 && !areasUsed.IsBitSet( pPVSInfo->m_nAreaNum2 ) )
+		{
+			areasUsed.Set( pPVSInfo->m_nAreaNum2 );
+			m_Areas.AddToTail( pPVSInfo->m_nAreaNum2 );
+		}
+	}
+}
+
+void CTransmitSnapshot::ComputeVisibility( const CCheckTransmitInfo *pInfo )
+{
+	VPROF( "CTransmitSnapshot::ComputeVisibility" );
+
+	// Resolve area connectivity once per area instead of once per entity
+	m_AreaConnected.ClearAll();
+	for ( int i = 0; i < m_Areas.Count(); i++ )
+	{
+		int nArea = m_Areas[i];
+		for ( int j = 0; j < pInfo->m_AreasNetworked; j++ )
+		{
+			int clientArea = pInfo->m_Areas[j];
+			if ( clientArea == nArea || engine->CheckAreasConnected( clientArea, nArea ) )
+			{
+				m_AreaConnected.Set( nArea );
+				break;
+			}
+		}
+	}
+
+	const unsigned char *pPVS = pInfo->m_PVS;
+	const unsigned char *pType = m_nType.Base();
+	const short *pAreaNum = m_nAreaNum.Base();
+	const short *pAreaNum2 = m_nAreaNum2.Base();
+	const short *pClusterCount = m_nClusterCount.Base();
+	const int *pFirstCluster = m_nFirstCluster.Base();
+
+	m_InPVS.ClearAll();
+	int nCount = Count();
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( pType[i] == TRANSMIT_ENTRY_ALWAYS )
+			continue;
+
+		// doors can legally straddle two areas, so we may need to check another one
+		if ( !m_AreaConnected.IsBitSet( pAreaNum[i] ) &&
+			 !( pAreaNum2[i] && m_AreaConnected.IsBitSet( pAreaNum2[i] ) ) )
+			continue;
+
+		bool bVisible = false;
+		if ( pClusterCount[i] < 0 )   // too many clusters, use headnode
+		{
+			bVisible = ( engine->CheckHeadnodeVisible( m_nHeadNode[i], pPVS, pInfo->m_nPVSSize ) != 0 );
+		}
+		else
+		{
+			const unsigned short *pClusters = m_Clusters.Base() + pFirstCluster[i];
+			for ( int j = pClusterCount[i]; --j >= 0; )
+			{
+				int nCluster = pClusters[j];
+				if ( ((int)(pPVS[nCluster >> 3])) & BitVec_BitInByte( nCluster ) )
+				{
+					bVisible = true;
+					break;
+				}
+			}
+		}
+
+		if ( bVisible )
+		{
+			m_InPVS.Set( m_EdictIndex[i] );
+		}
+	}
+}
+
 void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts )
 {
 	// NOTE: for speed's sake, this assumes that all networkables are CBaseEntities and that the edict list
@@ -2411,68 +2648,66 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 	CBasePlayer *pRecipientPlayer = static_cast<CBasePlayer*>( pRecipientEntity );
 	const int skyBoxArea = pRecipientPlayer->m_Local.m_skybox3d.area;
 
+	bool bIsHLTV = false;
+	bool bIsReplay = false;
 #ifndef _X360
-	const bool bIsHLTV = pRecipientPlayer->IsHLTV();
-	const bool bIsReplay = pRecipientPlayer->IsReplay();
+	bIsHLTV = pRecipientPlayer->IsHLTV();
+	bIsReplay = pRecipientPlayer->IsReplay();
 
 	// m_pTransmitAlways must be set if HLTV client
 	Assert( bIsHLTV == ( pInfo->m_pTransmitAlways != NULL) ||
 		    bIsReplay == ( pInfo->m_pTransmitAlways != NULL) );
 #endif
 
-	for ( int i=0; i < nEdicts; i++ )
+	// Shared with every other client this frame
+	CTransmitSnapshot &snapshot = g_TransmitSnapshot;
+	snapshot.Update( pBaseEdict, pEdictIndices, nEdicts );
+
+	// for the HLTV/Replay we don't cull against PVS
+	if ( !bIsHLTV && !bIsReplay )
 	{
-		int iEdict = pEdictIndices[i];
+		snapshot.ComputeVisibility( pInfo );
+	}
 
-		edict_t *pEdict = &pBaseEdict[iEdict];
-		Assert( pEdict == engine->PEntityOfEntIndex( iEdict ) );
-		int nFlags = pEdict->m_fStateFlags & (FL_EDICT_DONTSEND|FL_EDICT_ALWAYS|FL_EDICT_PVSCHECK|FL_EDICT_FULLCHECK);
+	const bool bForceTransmit = sv_force_transmit_ents.GetBool();
+
+	int nCount = snapshot.Count();
+	for ( int i=0; i < nCount; i++ )
+	{
+		int iEdict = snapshot.m_EdictIndex[i];
 
-		// entity needs no transmit
-		if ( nFlags & FL_EDICT_DONTSEND )
-			continue;
-		
 		// entity is already marked for sending
 		if ( pInfo->m_pTransmitEdict->Get( iEdict ) )
 			continue;
 		
-		if ( nFlags & FL_EDICT_ALWAYS )
+		int nType = snapshot.m_nType[i];
+		if ( nType == TRANSMIT_ENTRY_ALWAYS )
 		{
 			// FIXME: Hey! Shouldn't this be using SetTransmit so as 
 			// to also force network down dependent entities?
-			while ( true )
+			const unsigned short *pChain = snapshot.m_AlwaysChain.Base() + snapshot.m_nFirstCluster[i];
+			for ( int j = 0; j < snapshot.m_nClusterCount[i]; j++ )
 			{
 				// mark entity for sending
-				pInfo->m_pTransmitEdict->Set( iEdict );
+				pInfo->m_pTransmitEdict->Set( pChain[j] );
 	
-#ifndef _X360
 				if ( bIsHLTV || bIsReplay )
 				{
-					pInfo->m_pTransmitAlways->Set( iEdict );
+					pInfo->m_pTransmitAlways->Set( pChain[j] );
 				}
-#endif	
-				CServerNetworkProperty *pEnt = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
-				if ( !pEnt )
-					break;
-
-				CServerNetworkProperty *pParent = pEnt->GetNetworkParent();
-				if ( !pParent )
-					break;
-
-				pEdict = pParent->edict();
-				iEdict = pParent->entindex();
 			}
 			continue;
 		}
 
 		// FIXME: Would like to remove all dependencies
+		edict_t *pEdict = &pBaseEdict[iEdict];
 		CBaseEntity *pEnt = ( CBaseEntity * )pEdict->GetUnknown();
 		Assert( dynamic_cast< CBaseEntity* >( pEdict->GetUnknown() ) == pEnt );
 
-		if ( nFlags == FL_EDICT_FULLCHECK )
+		if ( nType == TRANSMIT_ENTRY_FULLCHECK )
 		{
 			// do a full ShouldTransmit() check, may return FL_EDICT_CHECKPVS
-			nFlags = pEnt->ShouldTransmit( pInfo );
+			int nFlags = pEnt->ShouldTransmit( pInfo );
 
 			Assert( !(nFlags & FL_EDICT_FULLCHECK) );
 
@@ -2481,19 +2716,19 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 				pEnt->SetTransmit( pInfo, true );
 				continue;
 			}	
-		}
 
-		// don't send this entity
-		if ( !( nFlags & FL_EDICT_PVSCHECK ) )
-			continue;
+			// don't send this entity
+			if ( !( nFlags & FL_EDICT_PVSCHECK ) )
+				continue;
+		}
 
-		CServerNetworkProperty *netProp = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
+		int nAreaNum = snapshot.m_nAreaNum[i];
 
 #ifndef _X360
 		if ( bIsHLTV || bIsReplay )
 		{
 			// for the HLTV/Replay we don't cull against PVS
-			if ( netProp->AreaNum() == skyBoxArea )
+			if ( nAreaNum == skyBoxArea )
 			{
 				pEnt->SetTransmit( pInfo, true );
 			}
@@ -2506,16 +2741,15 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 #endif
 
 		// Always send entities in the player's 3d skybox.
-		// Sidenote: call of AreaNum() ensures that PVS data is up to date for this entity
-		bool bSameAreaAsSky = netProp->AreaNum() == skyBoxArea;
+		bool bSameAreaAsSky = nAreaNum == skyBoxArea;
 		if ( bSameAreaAsSky )
 		{
 			pEnt->SetTransmit( pInfo, true );
 			continue;
 		}
 
-		bool bInPVS = netProp->IsInPVS( pInfo );
-		if ( bInPVS || sv_force_transmit_ents.GetBool() )
+		bool bInPVS = snapshot.m_InPVS.IsBitSet( iEdict );
+		if ( bInPVS || bForceTransmit )
 		{
 			// only send if entity is in PVS
 			pEnt->SetTransmit( pInfo, false );
@@ -2525,6 +2759,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 		// If the entity is marked "check PVS" but it's in hierarchy, walk up the hierarchy looking for the
 		//  for any parent which is also in the PVS.  If none are found, then we don't need to worry about sending ourself
 		CBaseEntity *orig = pEnt;
+		CServerNetworkProperty *netProp = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
 		CServerNetworkProperty *check = netProp->GetNetworkParent();
 
 		// BUG BUG:  I think it might be better to build up a list of edict indices which "depend" on other answers and then
@@ -2555,7 +2790,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			{
 				// do a full ShouldTransmit() check, may return FL_EDICT_CHECKPVS
 				CBaseEntity *pCheckEntity = check->GetBaseEntity();
-				nFlags = pCheckEntity->ShouldTransmit( pInfo );
+				int nFlags = pCheckEntity->ShouldTransmit( pInfo );
 				Assert( !(nFlags & FL_EDICT_FULLCHECK) );
 				if ( nFlags & FL_EDICT_ALWAYS )
 				{
@@ -2582,6 +2817,8 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 		}
 	}
 
+	SendTableShadow_RecordTransmit( pInfo );
+
 //	Msg("A:%i, N:%i, F: %i, P: %i\n", always, dontSend, fullCheck, PVS );
 }
 
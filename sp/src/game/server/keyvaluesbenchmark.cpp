@@ -0,0 +1,311 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: KeyValues benchmarks. Times the text parser and the compiled
+//			binary form over the script, resource and material files the
+//			game ships with, and name lookups on nodes with many children.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "KeyValues.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/checksum_crc.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define KEYVALUES_BENCHMARK_MAX_FILES	4096
+
+struct KeyValuesBenchmarkFile_t
+{
+	CUtlString	m_Name;
+	CUtlBuffer	m_Text;
+	CUtlBuffer	m_Compiled;
+	bool		m_bEscapes;
+};
+
+static bool IsKeyValuesBenchmarkFile( const char *pszFilename )
+{
+	const char *pszExtension = V_GetFileExtension( pszFilename );
+	return pszExtension && ( !V_stricmp( pszExtension, "txt" ) || !V_stricmp( pszExtension, "res" ) || !V_stricmp( pszExtension, "vmt" ) );
+}
+
+static void FindKeyValuesBenchmarkFiles( const char *pszDirectory, CUtlVector< KeyValuesBenchmarkFile_t * > &files )
+{
+	char szWildcard[MAX_PATH];
+	V_snprintf( szWildcard, sizeof( szWildcard ), "%s/*", pszDirectory );
+
+	CUtlVector< CUtlString > subDirectories;
+	FileFindHandle_t hFind;
+	for ( const char *pszName = filesystem->FindFirstEx( szWildcard, "GAME", &hFind ); pszName; pszName = filesystem->FindNext( hFind ) )
+	{
+		if ( pszName[0] == '.' )
+			continue;
+
+		char szPath[MAX_PATH];
+		V_snprintf( szPath, sizeof( szPath ), "%s/%s", pszDirectory, pszName );
+
+		if ( filesystem->FindIsDirectory( hFind ) )
+		{
+			subDirectories.AddToTail( szPath );
+		}
+		else if ( IsKeyValuesBenchmarkFile( pszName ) && files.Count() < KEYVALUES_BENCHMARK_MAX_FILES )
+		{
+			KeyValuesBenchmarkFile_t *pFile = new KeyValuesBenchmarkFile_t;
+			pFile->m_Text.SetBufferType( true, false );
+			if ( filesystem->ReadFile( szPath, "GAME", pFile->m_Text ) && pFile->m_Text.TellPut() > 0 )
+			{
+				pFile->m_Text.PutChar( 0 );
+				pFile->m_Name = szPath;
+				pFile->m_bEscapes = !V_stricmp( V_GetFileExtension( pszName ), "res" );
+				files.AddToTail( pFile );
+			}
+			else
+			{
+				delete pFile;
+			}
+		}
+	}
+	filesystem->FindClose( hFind );
+
+	for ( int i = 0; i < subDirectories.Count(); ++i )
+	{
+		FindKeyValuesBenchmarkFiles( subDirectories[i], files );
+	}
+}
+
+static KeyValues *ParseKeyValuesBenchmarkFile( KeyValuesBenchmarkFile_t *pFile )
+{
+	KeyValues *pKV = new KeyValues( "benchmark" );
+	pKV->UsesEscapeSequences( pFile->m_bEscapes );
+	pKV->LoadFromBuffer( pFile->m_Name, (const char *)pFile->m_Text.Base() );
+	return pKV;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares two peer lists key by key, values and children included
+//-----------------------------------------------------------------------------
+static bool KeyValuesBenchmarkTreesMatch( KeyValues *pA, KeyValues *pB )
+{
+	for ( ; pA && pB; pA = pA->GetNextKey(), pB = pB->GetNextKey() )
+	{
+		if ( pA->GetNameSymbol() != pB->GetNameSymbol() || pA->GetDataType() != pB->GetDataType() )
+			return false;
+
+		switch ( pA->GetDataType() )
+		{
+		case KeyValues::TYPE_NONE:
+			if ( !KeyValuesBenchmarkTreesMatch( pA->GetFirstSubKey(), pB->GetFirstSubKey() ) )
+				return false;
+			break;
+
+		case KeyValues::TYPE_STRING:
+			if ( V_strcmp( pA->GetString(), pB->GetString() ) )
+				return false;
+			break;
+
+		case KeyValues::TYPE_INT:
+			if ( pA->GetInt() != pB->GetInt() )
+				return false;
+			break;
+
+		case KeyValues::TYPE_FLOAT:
+			if ( pA->GetFloat() != pB->GetFloat() )
+				return false;
+			break;
+
+		case KeyValues::TYPE_COLOR:
+			if ( pA->GetColor() != pB->GetColor() )
+				return false;
+			break;
+
+		case KeyValues::TYPE_UINT64:
+			if ( pA->GetUint64() != pB->GetUint64() )
+				return false;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return !pA && !pB;
+}
+
+CON_COMMAND( keyvalues_benchmark, "Times parsing the game's .txt, .res and .vmt files as text and in compiled form. Usage: keyvalues_benchmark [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args.Arg( 1 ) ), 1 ) : 10;
+
+	CUtlVector< KeyValuesBenchmarkFile_t * > files;
+	FindKeyValuesBenchmarkFiles( "scripts", files );
+	FindKeyValuesBenchmarkFiles( "resource", files );
+	FindKeyValuesBenchmarkFiles( "materials", files );
+
+	if ( !files.Count() )
+	{
+		Msg( "No KeyValues files found\n" );
+		return;
+	}
+
+	// Compile everything up front, checking each compiled tree reads back
+	// the same as the text; this also warms the key name symbols
+	int nTextBytes = 0;
+	int nCompiledBytes = 0;
+	int nMismatched = 0;
+	for ( int i = 0; i < files.Count(); ++i )
+	{
+		KeyValuesBenchmarkFile_t *pFile = files[i];
+		int nTextSize = pFile->m_Text.TellPut() - 1;
+		CRC32_t textCRC = CRC32_ProcessSingleBuffer( pFile->m_Text.Base(), nTextSize );
+
+		KeyValues *pKV = ParseKeyValuesBenchmarkFile( pFile );
+		pKV->WriteAsCompiled( pFile->m_Compiled, nTextSize, textCRC );
+
+		KeyValues *pCompiledKV = new KeyValues( "benchmark" );
+		pCompiledKV->UsesEscapeSequences( pFile->m_bEscapes );
+		if ( !pCompiledKV->ReadAsCompiled( pFile->m_Compiled, nTextSize, textCRC ) || !KeyValuesBenchmarkTreesMatch( pKV, pCompiledKV ) )
+		{
+			Warning( "  %s: compiled tree differs from the text\n", pFile->m_Name.Get() );
+			++nMismatched;
+		}
+		pCompiledKV->deleteThis();
+		pKV->deleteThis();
+
+		nTextBytes += nTextSize;
+		nCompiledBytes += pFile->m_Compiled.TellPut();
+	}
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < files.Count(); ++i )
+		{
+			ParseKeyValuesBenchmarkFile( files[i] )->deleteThis();
+		}
+	}
+	timer.End();
+	CCycleCount timeText = timer.GetDuration();
+
+	int nCompiledFailed = 0;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < files.Count(); ++i )
+		{
+			KeyValuesBenchmarkFile_t *pFile = files[i];
+			int nTextSize = pFile->m_Text.TellPut() - 1;
+			CRC32_t textCRC = CRC32_ProcessSingleBuffer( pFile->m_Text.Base(), nTextSize );
+
+			KeyValues *pKV = new KeyValues( "benchmark" );
+			pKV->UsesEscapeSequences( pFile->m_bEscapes );
+			pFile->m_Compiled.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+			if ( !pKV->ReadAsCompiled( pFile->m_Compiled, nTextSize, textCRC ) )
+			{
+				++nCompiledFailed;
+			}
+			pKV->deleteThis();
+		}
+	}
+	timer.End();
+	CCycleCount timeCompiled = timer.GetDuration();
+
+	double flMegabytes = (double)nTextBytes * nIterations / ( 1024.0 * 1024.0 );
+	double flFiles = (double)files.Count() * nIterations;
+	Msg( "keyvalues_benchmark: %d files, %d KB text, %d KB compiled, %d passes\n", files.Count(), nTextBytes / 1024, nCompiledBytes / 1024, nIterations );
+	Msg( "  text:     %.1f MB/s, %.0f files/s\n", flMegabytes / timeText.GetSeconds(), flFiles / timeText.GetSeconds() );
+	Msg( "  compiled: %.1f MB/s, %.0f files/s (including the CRC check)\n", flMegabytes / timeCompiled.GetSeconds(), flFiles / timeCompiled.GetSeconds() );
+
+	if ( nCompiledFailed )
+	{
+		Warning( "  %d compiled reads failed\n", nCompiledFailed / nIterations );
+	}
+
+	if ( nMismatched )
+	{
+		Warning( "  %d compiled trees didn't match the text\n", nMismatched );
+	}
+
+	files.PurgeAndDeleteElements();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks every child of a wide node up by name, through FindKey and
+//			by walking the sibling list the way FindKey used to
+//-----------------------------------------------------------------------------
+static KeyValues *FindKeyByWalking( KeyValues *pParent, int iKeySymbol )
+{
+	for ( KeyValues *pKey = pParent->GetFirstSubKey(); pKey; pKey = pKey->GetNextKey() )
+	{
+		if ( pKey->GetNameSymbol() == iKeySymbol )
+			return pKey;
+	}
+	return NULL;
+}
+
+CON_COMMAND( keyvalues_lookup_benchmark, "Times looking up every child of a wide KeyValues node by name. Usage: keyvalues_lookup_benchmark [children] [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nChildren = ( args.ArgC() > 1 ) ? MAX( atoi( args.Arg( 1 ) ), 1 ) : 10000;
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args.Arg( 2 ) ), 1 ) : 10;
+
+	KeyValues *pParent = new KeyValues( "keyvalues_lookup_benchmark" );
+	CUtlVector< int > symbols;
+	symbols.SetCount( nChildren );
+	for ( int i = 0; i < nChildren; ++i )
+	{
+		char szName[32];
+		V_snprintf( szName, sizeof( szName ), "key%d", i );
+		pParent->SetInt( szName, i );
+		symbols[i] = KeyValues::CallGetSymbolForString( szName );
+	}
+
+	int nMissing = 0;
+	CFastTimer timer;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < nChildren; ++i )
+		{
+			if ( pParent->FindKey( symbols[i] ) == NULL )
+			{
+				++nMissing;
+			}
+		}
+	}
+	timer.End();
+	CCycleCount timeIndexed = timer.GetDuration();
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < nChildren; ++i )
+		{
+			if ( FindKeyByWalking( pParent, symbols[i] ) == NULL )
+			{
+				++nMissing;
+			}
+		}
+	}
+	timer.End();
+	CCycleCount timeWalked = timer.GetDuration();
+
+	pParent->deleteThis();
+
+	double flLookups = (double)nChildren * nIterations;
+	Msg( "keyvalues_lookup_benchmark: %d children, %d passes\n", nChildren, nIterations );
+	Msg( "  FindKey: %.0f lookups/s\n", flLookups / timeIndexed.GetSeconds() );
+	Msg( "  walking: %.0f lookups/s\n", flLookups / timeWalked.GetSeconds() );
+
+	if ( nMissing )
+	{
+		Warning( "  %d lookups failed\n", nMissing );
+	}
+}
@@ -0,0 +1,156 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Thread safe memory pool benchmark. Runs rounds of short lived
+//			threads that allocate from one pool and exit without flushing,
+//			and checks that every thread's cache came back: no blocks left
+//			in magazines, and later rounds reusing the caches of earlier ones.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/mempool.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/random.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define MEMPOOL_BENCHMARK_BLOCK_SIZE	48
+#define MEMPOOL_BENCHMARK_MAX_LIVE		256		// blocks each thread holds at most
+
+struct MemPoolBenchmarkJob_t
+{
+	CMemoryPoolMT	*m_pPool;
+	int				m_nIterations;
+	CInterlockedInt	m_nSeed;
+	CInterlockedInt	m_nFailed;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Random allocs and frees, then gives everything back and exits,
+//			leaving the blocks in the thread's magazine
+//-----------------------------------------------------------------------------
+static unsigned MemPoolBenchmarkThread( void *pParam )
+{
+	MemPoolBenchmarkJob_t *pJob = (MemPoolBenchmarkJob_t *)pParam;
+
+	CUniformRandomStream random;
+	random.SetSeed( ++pJob->m_nSeed );
+
+	void *pLive[MEMPOOL_BENCHMARK_MAX_LIVE];
+	int nLive = 0;
+	for ( int i = 0; i < pJob->m_nIterations; ++i )
+	{
+		if ( nLive < MEMPOOL_BENCHMARK_MAX_LIVE && ( !nLive || random.RandomInt( 0, 2 ) ) )
+		{
+			void *pMem = pJob->m_pPool->Alloc();
+			if ( !pMem )
+			{
+				++pJob->m_nFailed;
+				break;
+			}
+			pLive[nLive++] = pMem;
+		}
+		else
+		{
+			int iFree = random.RandomInt( 0, nLive - 1 );
+			pJob->m_pPool->Free( pLive[iFree] );
+			pLive[iFree] = pLive[--nLive];
+		}
+	}
+
+	while ( nLive )
+	{
+		pJob->m_pPool->Free( pLive[--nLive] );
+	}
+	return 0;
+}
+
+CON_COMMAND( mempool_thread_benchmark, "Runs rounds of threads that allocate from a thread safe pool and exit, and checks their caches come back. Usage: mempool_thread_benchmark [threads] [rounds] [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nThreads = ( args.ArgC() > 1 ) ? clamp( atoi( args.Arg( 1 ) ), 1, 32 ) : 8;
+	int nRounds = ( args.ArgC() > 2 ) ? clamp( atoi( args.Arg( 2 ) ), 1, 1000 ) : 20;
+	int nIterations = ( args.ArgC() > 3 ) ? MAX( atoi( args.Arg( 3 ) ), 1 ) : 100000;
+
+	int nInUseBefore;
+	int nCachesBefore = CMemoryPoolMT::GetThreadCacheCount( &nInUseBefore );
+
+	CMemoryPoolMT pool( MEMPOOL_BENCHMARK_BLOCK_SIZE, 1024, CUtlMemoryPool::GROW_FAST, "mempool_thread_benchmark" );
+
+	MemPoolBenchmarkJob_t job;
+	job.m_pPool = &pool;
+	job.m_nIterations = nIterations;
+	job.m_nSeed = 0;
+	job.m_nFailed = 0;
+
+	int nFailures = 0;
+	CFastTimer timer;
+	timer.Start();
+
+	for ( int iRound = 0; iRound < nRounds; ++iRound )
+	{
+		CUtlVector< ThreadHandle_t > threads;
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			ThreadHandle_t hThread = CreateSimpleThread( MemPoolBenchmarkThread, &job );
+			if ( hThread )
+			{
+				threads.AddToTail( hThread );
+			}
+		}
+
+		for ( int i = 0; i < threads.Count(); ++i )
+		{
+			ThreadJoin( threads[i] );
+			ReleaseThreadHandle( threads[i] );
+		}
+
+		// Every block is free and none may still sit in an exited thread's
+		// magazine
+		MemoryPoolMTStats_t stats;
+		pool.GetStats( stats );
+		if ( stats.m_nCached || stats.m_nAllocs != stats.m_nFrees || pool.Count() )
+		{
+			Warning( "  round %d: %d blocks cached, %d in use after the threads exited\n", iRound, stats.m_nCached, pool.Count() );
+			++nFailures;
+		}
+	}
+
+	timer.End();
+
+	MemoryPoolMTStats_t stats;
+	pool.GetStats( stats );
+
+	int nInUse;
+	int nCaches = CMemoryPoolMT::GetThreadCacheCount( &nInUse );
+
+	Msg( "mempool_thread_benchmark: %d rounds of %d threads, %.1f ms a round\n", nRounds, nThreads, timer.GetDuration().GetMillisecondsF() / nRounds );
+	Msg( "  %d allocs, %d refills, %d flushes, %d contended\n", stats.m_nAllocs, stats.m_nRefills, stats.m_nFlushes, stats.m_nContended );
+	Msg( "  thread caches: %d before, %d after, %d held by running threads\n", nCachesBefore, nCaches, nInUse );
+
+	if ( job.m_nFailed )
+	{
+		Warning( "  %d threads failed to allocate\n", (int)job.m_nFailed );
+		++nFailures;
+	}
+
+	// Other threads may come and go meanwhile, but the exited ones must have
+	// handed their caches on to the next round
+	if ( nCaches > nCachesBefore + nThreads || nInUse > nInUseBefore )
+	{
+		Warning( "  exited threads kept their caches\n" );
+		++nFailures;
+	}
+
+	if ( nFailures )
+	{
+		Warning( "mempool_thread_benchmark: %d failures\n", nFailures );
+	}
+	else
+	{
+		Msg( "mempool_thread_benchmark: every exited thread gave its cache back\n" );
+	}
+}
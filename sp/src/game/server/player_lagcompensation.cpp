@@ -10,9 +10,9 @@
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
 #include "inetchannelinfo.h"
-#include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
+#include "collisionutils.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -114,6 +114,162 @@ public:
 	float					m_masterCycle;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Fixed capacity history of lag records for a single player.
+//			Records live in a ring of parallel arrays, newest at the head, so
+//			backtracking can binary search the simulation times without
+//			touching the rest of the record data.
+//-----------------------------------------------------------------------------
+class CLagRecordTrack
+{
+public:
+	CLagRecordTrack() : m_nMask( 0 ), m_nHead( 0 ), m_nCount( 0 ), m_nSequence( 0 ) {}
+
+	// nCapacity must be a power of two
+	void Init( int nCapacity )
+	{
+		Assert( IsPowerOfTwo( nCapacity ) );
+		Purge();
+
+		m_flSimulationTime.EnsureCapacity( nCapacity );
+		m_fFlags.EnsureCapacity( nCapacity );
+		m_nChainStart.EnsureCapacity( nCapacity );
+		m_vecOrigin.EnsureCapacity( nCapacity );
+		m_vecAngles.EnsureCapacity( nCapacity );
+		m_vecMinsPreScaled.EnsureCapacity( nCapacity );
+		m_vecMaxsPreScaled.EnsureCapacity( nCapacity );
+		m_masterSequence.EnsureCapacity( nCapacity );
+		m_masterCycle.EnsureCapacity( nCapacity );
+		m_layerRecords.EnsureCapacity( nCapacity * MAX_LAYER_RECORDS );
+		m_nMask = nCapacity - 1;
+	}
+
+	void Purge()
+	{
+		m_flSimulationTime.Purge();
+		m_fFlags.Purge();
+		m_nChainStart.Purge();
+		m_vecOrigin.Purge();
+		m_vecAngles.Purge();
+		m_vecMinsPreScaled.Purge();
+		m_vecMaxsPreScaled.Purge();
+		m_masterSequence.Purge();
+		m_masterCycle.Purge();
+		m_layerRecords.Purge();
+		m_nMask = 0;
+		RemoveAll();
+	}
+
+	void RemoveAll()
+	{
+		m_nHead = 0;
+		m_nCount = 0;
+	}
+
+	int Count() const		{ return m_nCount; }
+	int Capacity() const	{ return m_nMask ? m_nMask + 1 : 0; }
+
+	// Slot of the record nAge steps older than the newest one
+	int Slot( int nAge ) const
+	{
+		Assert( nAge >= 0 && nAge < m_nCount );
+		return ( m_nHead - nAge ) & m_nMask;
+	}
+
+	// Adds a new head record, overwriting the oldest one if the ring is full
+	int AddToHead()
+	{
+		Assert( Capacity() > 0 );
+		m_nHead = ( m_nHead + 1 ) & m_nMask;
+		m_nCount = MIN( m_nCount + 1, Capacity() );
+		++m_nSequence;
+		return m_nHead;
+	}
+
+	// Drops records from the tail that are older than flDeadTime
+	void RemoveOlderThan( float flDeadTime )
+	{
+		while ( m_nCount > 0 && m_flSimulationTime[ Slot( m_nCount - 1 ) ] < flDeadTime )
+		{
+			--m_nCount;
+		}
+	}
+
+	// Links the head record to the one before it. A record can only be
+	// backtracked to if it and every newer record are alive and no two
+	// neighbouring records are further apart than flTeleportDistanceSqr.
+	void UpdateChain( float flTeleportDistanceSqr )
+	{
+		int nHead = Slot( 0 );
+		if ( !( m_fFlags[nHead] & LC_ALIVE ) )
+		{
+			m_nChainStart[nHead] = m_nSequence + 1;
+			return;
+		}
+
+		m_nChainStart[nHead] = m_nSequence;
+		if ( m_nCount > 1 )
+		{
+			int nPrev = Slot( 1 );
+			Vector delta = m_vecOrigin[nHead] - m_vecOrigin[nPrev];
+			if ( m_nChainStart[nPrev] < m_nSequence && delta.Length2DSqr() <= flTeleportDistanceSqr )
+			{
+				m_nChainStart[nHead] = m_nChainStart[nPrev];
+			}
+		}
+	}
+
+	// Returns the age of the newest record at or before flTargetTime,
+	// or the age of the oldest record if they are all newer.
+	int FindAge( float flTargetTime ) const
+	{
+		Assert( m_nCount > 0 );
+
+		// simulation times strictly decrease with age
+		int nLow = 0;
+		int nHigh = m_nCount - 1;
+		while ( nLow < nHigh )
+		{
+			int nMid = ( nLow + nHigh ) >> 1;
+			if ( m_flSimulationTime[ Slot( nMid ) ] <= flTargetTime )
+			{
+				nHigh = nMid;
+			}
+			else
+			{
+				nLow = nMid + 1;
+			}
+		}
+		return nLow;
+	}
+
+	// Can we walk back from the head to the record nAge steps old without losing track?
+	bool IsChainValid( int nAge ) const
+	{
+		unsigned int nChainStart = m_nChainStart[ Slot( 0 ) ];
+		return ( nChainStart <= m_nSequence ) && ( m_nSequence - nChainStart >= (unsigned int)nAge );
+	}
+
+	LayerRecord *GetLayerRecords( int nSlot ) { return &m_layerRecords[ nSlot * MAX_LAYER_RECORDS ]; }
+
+	CUtlMemory< float >			m_flSimulationTime;
+	CUtlMemory< int >			m_fFlags;
+	CUtlMemory< unsigned int >	m_nChainStart;	// sequence number of the oldest record reachable from this one
+	CUtlMemory< Vector >		m_vecOrigin;
+	CUtlMemory< QAngle >		m_vecAngles;
+	CUtlMemory< Vector >		m_vecMinsPreScaled;
+	CUtlMemory< Vector >		m_vecMaxsPreScaled;
+	CUtlMemory< int >			m_masterSequence;
+	CUtlMemory< float >			m_masterCycle;
+	CUtlMemory< LayerRecord >	m_layerRecords;
+
+private:
+	int							m_nMask;
+	int							m_nHead;
+	int							m_nCount;
+	unsigned int				m_nSequence;	// sequence number of the head record
+};
+
 
 //
 // Try to take the player from his current origin to vWantedPos.
@@ -170,7 +326,7 @@ static void RestorePlayerTo( CBasePlayer *pPlayer, const Vector &vWantedPos )
 class CLagCompensationManager : public CAutoGameSystemPerFrame, public ILagCompensationManager
 {
 public:
-	CLagCompensationManager( char const *name ) : CAutoGameSystemPerFrame( name ), m_flTeleportDistanceSqr( 64 *64 )
+	CLagCompensationManager( char const *name ) : CAutoGameSystemPerFrame( name ), m_nTrackCapacity( 0 ), m_flTeleportDistanceSqr( 64 *64 )
 	{
 	}
 
@@ -194,21 +350,31 @@ public:
 	void			StartLagCompensation( CBasePlayer *player, CUserCmd *cmd );
 	void			FinishLagCompensation( CBasePlayer *player );
 
+	void			SetupBonesForRay( const Ray_t &ray ) OVERRIDE;
+
 private:
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
+	void			BacktrackPlayers( const CBitVec<MAX_PLAYERS> &players, float flTargetTime );
+	bool			FindBacktrackRecords( CBasePlayer *player, float flTargetTime, int &nRecordSlot, int &nPrevSlot );
+	void			ApplyBacktrack( CBasePlayer *player, float flTargetTime, int nRecordSlot, int nPrevSlot );
 
 	void ClearHistory()
 	{
 		for ( int i=0; i<MAX_PLAYERS; i++ )
 			m_PlayerTrack[i].Purge();
+		m_nTrackCapacity = 0;
 	}
 
-	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	// keep a ring of lag records for each player
+	CLagRecordTrack			m_PlayerTrack[ MAX_PLAYERS ];
+	int						m_nTrackCapacity;
 
 	// Scratchpad for determining what needs to be restored
 	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
 	bool					m_bNeedToRestore;
+
+	// Moved players whose bones no hitbox trace has needed yet
+	CBitVec<MAX_PLAYERS>	m_PendingBoneSetup;
 	
 	LagRecord				m_RestoreData[ MAX_PLAYERS ];	// player data before we moved him back
 	LagRecord				m_ChangeData[ MAX_PLAYERS ];	// player data where we moved him back
@@ -238,14 +404,25 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
 	// remove all records before that time:
-	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+	float flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+
+	// size the history to hold sv_maxunlag worth of ticks, players add at most one record per tick
+	int nCapacity = SmallestPowerOfTwoGreaterOrEqual( TIME_TO_TICKS( sv_maxunlag.GetFloat() ) + 2 );
+	if ( nCapacity != m_nTrackCapacity )
+	{
+		for ( int i=0; i<MAX_PLAYERS; i++ )
+		{
+			m_PlayerTrack[i].Init( nCapacity );
+		}
+		m_nTrackCapacity = nCapacity;
+	}
 
 	// Iterate all active players
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 
-		CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[i-1];
+		CLagRecordTrack *track = &m_PlayerTrack[i-1];
 
 		if ( !pPlayer )
 		{
@@ -257,62 +434,48 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 			continue;
 		}
 
-		Assert( track->Count() < 1000 ); // insanity check
-
 		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while ( track->IsValidIndex( tailIndex ) )
-		{
-			LagRecord &tail = track->Element( tailIndex );
-
-			// if tail is within limits, stop
-			if ( tail.m_flSimulationTime >= flDeadtime )
-				break;
-			
-			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
-		}
+		track->RemoveOlderThan( flDeadtime );
 
 		// check if head has same simulation time
 		if ( track->Count() > 0 )
 		{
-			LagRecord &head = track->Element( track->Head() );
-
 			// check if player changed simulation time since last time updated
-			if ( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
+			if ( track->m_flSimulationTime[ track->Slot( 0 ) ] >= pPlayer->GetSimulationTime() )
 				continue; // don't add new entry for same or older time
 		}
 
 		// add new record to player track
-		LagRecord &record = track->Element( track->AddToHead() );
+		int slot = track->AddToHead();
 
-		record.m_fFlags = 0;
+		track->m_fFlags[slot] = 0;
 		if ( pPlayer->IsAlive() )
 		{
-			record.m_fFlags |= LC_ALIVE;
+			track->m_fFlags[slot] |= LC_ALIVE;
 		}
 
-		record.m_flSimulationTime	= pPlayer->GetSimulationTime();
-		record.m_vecAngles			= pPlayer->GetLocalAngles();
-		record.m_vecOrigin			= pPlayer->GetLocalOrigin();
-		record.m_vecMinsPreScaled	= pPlayer->CollisionProp()->OBBMinsPreScaled();
-		record.m_vecMaxsPreScaled	= pPlayer->CollisionProp()->OBBMaxsPreScaled();
+		track->m_flSimulationTime[slot]	= pPlayer->GetSimulationTime();
+		track->m_vecAngles[slot]			= pPlayer->GetLocalAngles();
+		track->m_vecOrigin[slot]			= pPlayer->GetLocalOrigin();
+		track->m_vecMinsPreScaled[slot]	= pPlayer->CollisionProp()->OBBMinsPreScaled();
+		track->m_vecMaxsPreScaled[slot]	= pPlayer->CollisionProp()->OBBMaxsPreScaled();
+		track->UpdateChain( m_flTeleportDistanceSqr );
 
+		LayerRecord *pLayerRecords = track->GetLayerRecords( slot );
 		int layerCount = pPlayer->GetNumAnimOverlays();
 		for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
 		{
 			CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
 			if( currentLayer )
 			{
-				record.m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
-				record.m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
-				record.m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
-				record.m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
+				pLayerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
+				pLayerRecords[layerIndex].m_order = currentLayer->m_nOrder;
+				pLayerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
+				pLayerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
 			}
 		}
-		record.m_masterSequence = pPlayer->GetSequence();
-		record.m_masterCycle = pPlayer->GetCycle();
+		track->m_masterSequence[slot] = pPlayer->GetSequence();
+		track->m_masterCycle[slot] = pPlayer->GetCycle();
 	}
 
 	//Clear the current player.
@@ -333,6 +496,7 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 
 	// Assume no players need to be restored
 	m_RestorePlayer.ClearAll();
+	m_PendingBoneSetup.ClearAll();
 	m_bNeedToRestore = false;
 
 	m_pCurrentPlayer = player;
@@ -385,10 +549,19 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		targettick = gpGlobals->tickcount - TIME_TO_TICKS( correct );
 	}
 	
-	// Iterate all active players
+	// Iterate all active players and gather the ones to move back in time
+	CBitVec<MAX_PLAYERS> targets;
+	targets.ClearAll();
+
 	const CBitVec<MAX_EDICTS> *pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
+		// Nothing to move back to
+		if ( m_PlayerTrack[i-1].Count() <= 0 )
+		{
+			continue;
+		}
+
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 
 		if ( !pPlayer )
@@ -406,109 +579,178 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		if ( !player->WantsLagCompensationOnEntity( pPlayer, cmd, pEntityTransmitBits ) )
 			continue;
 
-		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		targets.Set( i-1 );
 	}
-}
 
-void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
-{
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
+	// Move other players back in time
+	BacktrackPlayers( targets, TICKS_TO_TIME( targettick ) );
 
-	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
-	int pl_index = pPlayer->entindex() - 1;
+	// Moving flushed their bone caches. Leave the rebuild to the hitbox
+	// traces, so players no trace reaches are never set up
+	if ( m_bNeedToRestore && sv_lagflushbonecache.GetBool() )
+	{
+		m_PendingBoneSetup = m_RestorePlayer;
+	}
+}
 
-	// get track history of this player
-	CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[ pl_index ];
+//-----------------------------------------------------------------------------
+// Purpose: Sets up, in one batch, every pending player whose bounds the ray
+//			crosses: the ones this trace is about to test hitboxes against.
+//			Later traces pick up whoever is left
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::SetupBonesForRay( const Ray_t &ray )
+{
+	CBaseAnimating *pReached[ MAX_PLAYERS ];
+	int nReached = 0;
 
-	// check if we have at leat one entry
-	if ( track->Count() <= 0 )
-		return;
+	for ( int i = m_PendingBoneSetup.FindNextSetBit( 0 ); i >= 0; i = m_PendingBoneSetup.FindNextSetBit( i + 1 ) )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i + 1 );
+		if ( !pPlayer )
+		{
+			m_PendingBoneSetup.Clear( i );
+			continue;
+		}
 
-	int curr = track->Head();
+		Vector vecMins, vecMaxs;
+		pPlayer->CollisionProp()->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+		if ( !IsBoxIntersectingRay( vecMins, vecMaxs, ray ) )
+			continue;
 
-	LagRecord *prevRecord = NULL;
-	LagRecord *record = NULL;
+		m_PendingBoneSetup.Clear( i );
+		pReached[ nReached++ ] = pPlayer;
+	}
 
-	Vector prevOrg = pPlayer->GetLocalOrigin();
-	
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex(curr) )
+	if ( nReached )
 	{
-		// remember last record
-		prevRecord = record;
+		CBaseAnimating::SetupBonesBatch( pReached, nReached );
+	}
+}
 
-		// get next record
-		record = &track->Element( curr );
+//-----------------------------------------------------------------------------
+// Purpose: Finds the history records for all the players first, then moves
+//			them back. Keeps the record searches together and out of the
+//			way of the entity updates.
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::BacktrackPlayers( const CBitVec<MAX_PLAYERS> &players, float flTargetTime )
+{
+	VPROF_BUDGET( "BacktrackPlayers", "CLagCompensationManager" );
 
-		if ( !(record->m_fFlags & LC_ALIVE) )
-		{
-			// player most be alive, lost track
-			return;
-		}
+	int nRecordSlot[ MAX_PLAYERS ];
+	int nPrevSlot[ MAX_PLAYERS ];
+	CBitVec<MAX_PLAYERS> found;
+	found.ClearAll();
 
-		Vector delta = record->m_vecOrigin - prevOrg;
-		if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+	for ( int i = players.FindNextSetBit( 0 ); i >= 0; i = players.FindNextSetBit( i + 1 ) )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i + 1 );
+		if ( pPlayer && FindBacktrackRecords( pPlayer, flTargetTime, nRecordSlot[i], nPrevSlot[i] ) )
 		{
-			// lost track, too much difference
-			return; 
+			found.Set( i );
 		}
+	}
 
-		// did we find a context smaller than target time ?
-		if ( record->m_flSimulationTime <= flTargetTime )
-			break; // hurra, stop
-
-		prevOrg = record->m_vecOrigin;
+	for ( int i = found.FindNextSetBit( 0 ); i >= 0; i = found.FindNextSetBit( i + 1 ) )
+	{
+		// sv_unlag_fixstuck may have already moved this player while moving someone else
+		if ( m_RestorePlayer.Get( i ) )
+			continue;
 
-		// go one step back
-		curr = track->Next( curr );
+		ApplyBacktrack( UTIL_PlayerByIndex( i + 1 ), flTargetTime, nRecordSlot[i], nPrevSlot[i] );
 	}
+}
 
-	Assert( record );
+void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
+{
+	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
 
-	if ( !record )
+	int nRecordSlot, nPrevSlot;
+	if ( FindBacktrackRecords( pPlayer, flTargetTime, nRecordSlot, nPrevSlot ) )
 	{
-		if ( sv_unlag_debug.GetBool() )
-		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
-		}
+		ApplyBacktrack( pPlayer, flTargetTime, nRecordSlot, nPrevSlot );
+	}
+}
 
-		return; // that should never happen
+//-----------------------------------------------------------------------------
+// Purpose: Finds the record at or just before flTargetTime and the newer one
+//			after it (-1 if there isn't one). Returns false if we lost track
+//			of the player somewhere between now and then.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::FindBacktrackRecords( CBasePlayer *pPlayer, float flTargetTime, int &nRecordSlot, int &nPrevSlot )
+{
+	int pl_index = pPlayer->entindex() - 1;
+
+	// get track history of this player
+	const CLagRecordTrack *track = &m_PlayerTrack[ pl_index ];
+
+	// check if we have at leat one entry
+	if ( track->Count() <= 0 )
+		return false;
+
+	// the newest record has to be close to where the player is now
+	int nHead = track->Slot( 0 );
+	Vector delta = track->m_vecOrigin[nHead] - pPlayer->GetLocalOrigin();
+	if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+	{
+		// lost track, too much difference
+		return false;
 	}
 
+	int nAge = track->FindAge( flTargetTime );
+
+	// player must be alive, and not have teleported, all the way back to the record
+	if ( !track->IsChainValid( nAge ) )
+		return false;
+
+	nRecordSlot = track->Slot( nAge );
+	nPrevSlot = ( nAge > 0 ) ? track->Slot( nAge - 1 ) : -1;
+	return true;
+}
+
+void CLagCompensationManager::ApplyBacktrack( CBasePlayer *pPlayer, float flTargetTime, int nRecordSlot, int nPrevSlot )
+{
+	Vector org;
+	Vector minsPreScaled;
+	Vector maxsPreScaled;
+	QAngle ang;
+
+	int pl_index = pPlayer->entindex() - 1;
+	CLagRecordTrack *track = &m_PlayerTrack[ pl_index ];
+
+	int record = nRecordSlot;
+	int prevRecord = nPrevSlot;
+	bool bHasPrevRecord = ( prevRecord >= 0 );
+
 	float frac = 0.0f;
-	if ( prevRecord && 
-		 (record->m_flSimulationTime < flTargetTime) &&
-		 (record->m_flSimulationTime < prevRecord->m_flSimulationTime) )
+	if ( bHasPrevRecord && 
+		 (track->m_flSimulationTime[record] < flTargetTime) &&
+		 (track->m_flSimulationTime[record] < track->m_flSimulationTime[prevRecord]) )
 	{
 		// we didn't find the exact time but have a valid previous record
 		// so interpolate between these two records;
 
-		Assert( prevRecord->m_flSimulationTime > record->m_flSimulationTime );
-		Assert( flTargetTime < prevRecord->m_flSimulationTime );
+		Assert( track->m_flSimulationTime[prevRecord] > track->m_flSimulationTime[record] );
+		Assert( flTargetTime < track->m_flSimulationTime[prevRecord] );
 
 		// calc fraction between both records
-		frac = ( flTargetTime - record->m_flSimulationTime ) / 
-			( prevRecord->m_flSimulationTime - record->m_flSimulationTime );
+		frac = ( flTargetTime - track->m_flSimulationTime[record] ) / 
+			( track->m_flSimulationTime[prevRecord] - track->m_flSimulationTime[record] );
 
 		Assert( frac > 0 && frac < 1 ); // should never extrapolate
 
-		ang				= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
-		org				= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
-		minsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
-		maxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
+		ang				= Lerp( frac, track->m_vecAngles[record], track->m_vecAngles[prevRecord] );
+		org				= Lerp( frac, track->m_vecOrigin[record], track->m_vecOrigin[prevRecord] );
+		minsPreScaled	= Lerp( frac, track->m_vecMinsPreScaled[record], track->m_vecMinsPreScaled[prevRecord] );
+		maxsPreScaled	= Lerp( frac, track->m_vecMaxsPreScaled[record], track->m_vecMaxsPreScaled[prevRecord] );
 	}
 	else
 	{
 		// we found the exact record or no other record to interpolate with
 		// just copy these values since they are the best we have
-		org				= record->m_vecOrigin;
-		ang				= record->m_vecAngles;
-		minsPreScaled	= record->m_vecMinsPreScaled;
-		maxsPreScaled	= record->m_vecMaxsPreScaled;
+		org				= track->m_vecOrigin[record];
+		ang				= track->m_vecAngles[record];
+		minsPreScaled	= track->m_vecMinsPreScaled[record];
+		maxsPreScaled	= track->m_vecMaxsPreScaled[record];
 	}
 
 	// See if this is still a valid position for us to teleport to
@@ -620,7 +862,7 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	restore->m_masterCycle = pPlayer->GetCycle();
 
 	bool interpolationAllowed = false;
-	if( prevRecord && (record->m_masterSequence == prevRecord->m_masterSequence) )
+	if( bHasPrevRecord && (track->m_masterSequence[record] == track->m_masterSequence[prevRecord]) )
 	{
 		// If the master state changes, all layers will be invalid too, so don't interp (ya know, interp barely ever happens anyway)
 		interpolationAllowed = true;
@@ -632,25 +874,25 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	if( frac > 0.0f && interpolationAllowed )
 	{
 		interpolatedMasters = true;
-		pPlayer->SetSequence( Lerp( frac, record->m_masterSequence, prevRecord->m_masterSequence ) );
-		pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
+		pPlayer->SetSequence( Lerp( frac, track->m_masterSequence[record], track->m_masterSequence[prevRecord] ) );
+		pPlayer->SetCycle( Lerp( frac, track->m_masterCycle[record], track->m_masterCycle[prevRecord] ) );
 
-		if( record->m_masterCycle > prevRecord->m_masterCycle )
+		if( track->m_masterCycle[record] > track->m_masterCycle[prevRecord] )
 		{
 			// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
 			// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
-			float newCycle = Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle + 1 );
+			float newCycle = Lerp( frac, track->m_masterCycle[record], track->m_masterCycle[prevRecord] + 1 );
 			pPlayer->SetCycle(newCycle < 1 ? newCycle : newCycle - 1 );// and make sure .9 to 1.2 does not end up 1.05
 		}
 		else
 		{
-			pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
+			pPlayer->SetCycle( Lerp( frac, track->m_masterCycle[record], track->m_masterCycle[prevRecord] ) );
 		}
 	}
 	if( !interpolatedMasters )
 	{
-		pPlayer->SetSequence(record->m_masterSequence);
-		pPlayer->SetCycle(record->m_masterCycle);
+		pPlayer->SetSequence(track->m_masterSequence[record]);
+		pPlayer->SetCycle(track->m_masterCycle[record]);
 	}
 
 	////////////////////////
@@ -669,8 +911,8 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			bool interpolated = false;
 			if( (frac > 0.0f)  &&  interpolationAllowed )
 			{
-				LayerRecord &recordsLayerRecord = record->m_layerRecords[layerIndex];
-				LayerRecord &prevRecordsLayerRecord = prevRecord->m_layerRecords[layerIndex];
+				LayerRecord &recordsLayerRecord = track->GetLayerRecords( record )[layerIndex];
+				LayerRecord &prevRecordsLayerRecord = track->GetLayerRecords( prevRecord )[layerIndex];
 				if( (recordsLayerRecord.m_order == prevRecordsLayerRecord.m_order)
 					&& (recordsLayerRecord.m_sequence == prevRecordsLayerRecord.m_sequence)
 					)
@@ -696,10 +938,10 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			if( !interpolated )
 			{
 				//Either no interp, or interp failed.  Just use record.
-				currentLayer->m_flCycle = record->m_layerRecords[layerIndex].m_cycle;
-				currentLayer->m_nOrder = record->m_layerRecords[layerIndex].m_order;
-				currentLayer->m_nSequence = record->m_layerRecords[layerIndex].m_sequence;
-				currentLayer->m_flWeight = record->m_layerRecords[layerIndex].m_weight;
+				currentLayer->m_flCycle = track->GetLayerRecords( record )[layerIndex].m_cycle;
+				currentLayer->m_nOrder = track->GetLayerRecords( record )[layerIndex].m_order;
+				currentLayer->m_nSequence = track->GetLayerRecords( record )[layerIndex].m_sequence;
+				currentLayer->m_flWeight = track->GetLayerRecords( record )[layerIndex].m_weight;
 			}
 		}
 	}
@@ -732,6 +974,7 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 	VPROF_BUDGET_FLAGS( "FinishLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING, BUDGETFLAG_CLIENT|BUDGETFLAG_SERVER );
 
 	m_pCurrentPlayer = NULL;
+	m_PendingBoneSetup.ClearAll();
 
 	if ( !m_bNeedToRestore )
 		return; // no player was changed at all
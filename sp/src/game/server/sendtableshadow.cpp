@@ -0,0 +1,154 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps a copy of each entity's networked state as it was last
+//			packed, so entities that flag a full state change can be narrowed
+//			down to the props that really differ before the engine encodes.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "sendtableshadow.h"
+#include "dt_send.h"
+#include "iservernetworkable.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static void SendTableShadowChanged( IConVar *var, const char *pOldValue, float flOldValue );
+
+ConVar sv_netstate_shadow( "sv_netstate_shadow", "0", 0, "Compare entities that flag a full network state change against what was last sent, and only report the props that differ.", SendTableShadowChanged );
+
+//-----------------------------------------------------------------------------
+// Purpose: Per edict copy of the props the encode plan can compare
+//-----------------------------------------------------------------------------
+class CSendTableShadowSystem : public CAutoGameSystemPerFrame
+{
+public:
+	CSendTableShadowSystem() : CAutoGameSystemPerFrame( "CSendTableShadowSystem" ) {}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		Purge();
+	}
+
+	virtual void PreClientUpdate();
+
+	void RecordTransmit( const CCheckTransmitInfo *pInfo );
+
+	void Purge()
+	{
+		for ( int i = 0; i < MAX_EDICTS; i++ )
+		{
+			m_Shadows[i].m_hEntity.Term();
+			m_Shadows[i].m_pPlan = NULL;
+			m_Shadows[i].m_nTick = -1;
+			m_Shadows[i].m_Data.Purge();
+		}
+	}
+
+private:
+	struct Shadow_t
+	{
+		Shadow_t() : m_pPlan( NULL ), m_nTick( -1 ) {}
+
+		CBaseHandle				m_hEntity;
+		CSendTableEncodePlan	*m_pPlan;
+		int						m_nTick;	// when the shadow was last recorded
+		CUtlVector< byte >		m_Data;
+	};
+
+	Shadow_t m_Shadows[ MAX_EDICTS ];
+};
+
+static CSendTableShadowSystem g_SendTableShadowSystem;
+
+static void SendTableShadowChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	// Shadows left over from before it was turned off no longer match what
+	// the clients have
+	g_SendTableShadowSystem.Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs after the frame's game code and before the engine packs
+//-----------------------------------------------------------------------------
+void CSendTableShadowSystem::PreClientUpdate()
+{
+	if ( !sv_netstate_shadow.GetBool() )
+		return;
+
+	unsigned short offsets[ MAX_CHANGE_OFFSETS ];
+
+	for ( int i = 0; i < gpGlobals->maxEntities; i++ )
+	{
+		Shadow_t &shadow = m_Shadows[i];
+		if ( !shadow.m_pPlan )
+			continue;
+
+		edict_t *pEdict = engine->PEntityOfEntIndex( i );
+		if ( !pEdict || pEdict->IsFree() || !( pEdict->m_fStateFlags & FL_FULL_EDICT_CHANGED ) )
+			continue;
+
+		CBaseEntity *pEnt = CBaseEntity::Instance( pEdict );
+		if ( !pEnt || pEnt->GetRefEHandle() != shadow.m_hEntity )
+			continue;
+
+		int nOffsets = shadow.m_pPlan->FindChangedOffsets( pEnt, shadow.m_Data.Base(), offsets, MAX_CHANGE_OFFSETS );
+		if ( nOffsets < 0 )
+			continue;
+
+		// Swap the full change for the props that differ. If none do, the
+		// engine can reuse what it packed last time.
+		pEdict->ClearStateChanged();
+
+		for ( int j = 0; j < nOffsets; j++ )
+		{
+			pEdict->StateChanged( offsets[j] );
+		}
+	}
+}
+
+void CSendTableShadowSystem::RecordTransmit( const CCheckTransmitInfo *pInfo )
+{
+	if ( !sv_netstate_shadow.GetBool() )
+		return;
+
+	// Every client's CheckTransmit runs before the engine packs, and whatever
+	// any of them sees gets packed, so one copy per tick covers them all
+	for ( int i = pInfo->m_pTransmitEdict->FindNextSetBit( 0 ); i >= 0; i = pInfo->m_pTransmitEdict->FindNextSetBit( i + 1 ) )
+	{
+		Shadow_t &shadow = m_Shadows[i];
+		if ( shadow.m_nTick == gpGlobals->tickcount )
+			continue;
+
+		shadow.m_nTick = gpGlobals->tickcount;
+
+		CBaseEntity *pEnt = CBaseEntity::Instance( i );
+		if ( !pEnt || !pEnt->GetServerClass() )
+		{
+			shadow.m_pPlan = NULL;
+			continue;
+		}
+
+		// Unchanged entities aren't packed again, so the shadow still holds
+		// what their clients have
+		if ( shadow.m_pPlan && shadow.m_hEntity == pEnt->GetRefEHandle() && !pEnt->edict()->HasStateChanged() )
+			continue;
+
+		shadow.m_pPlan = NULL;
+
+		CSendTableEncodePlan *pPlan = SendTable_GetEncodePlan( pEnt->GetServerClass()->m_pTable );
+		if ( !pPlan )
+			continue;
+
+		shadow.m_hEntity = pEnt->GetRefEHandle();
+		shadow.m_pPlan = pPlan;
+		shadow.m_Data.SetCount( pPlan->GetShadowSize() );
+		pPlan->CopyToShadow( pEnt, shadow.m_Data.Base() );
+	}
+}
+
+void SendTableShadow_RecordTransmit( const CCheckTransmitInfo *pInfo )
+{
+	g_SendTableShadowSystem.RecordTransmit( pInfo );
+}
@@ -0,0 +1,21 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps a copy of each entity's networked state as it was last
+//			packed, so entities that flag a full state change can be narrowed
+//			down to the props that really differ before the engine encodes.
+//
+//=============================================================================//
+
+#ifndef SENDTABLESHADOW_H
+#define SENDTABLESHADOW_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CCheckTransmitInfo;
+
+// Called at the end of CheckTransmit, once the edicts the engine is about
+// to pack for this client are known.
+void SendTableShadow_RecordTransmit( const CCheckTransmitInfo *pInfo );
+
+#endif // SENDTABLESHADOW_H
@@ -0,0 +1,157 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Ordered map benchmark. Times insert, find, in-order iteration
+//			and removal on CUtlMap against CUtlBTreeMap from 1k to 1M
+//			elements, checking the maps are still well formed afterwards.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/utlmap.h"
+#include "tier1/utlbtreemap.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+struct UtlMapBenchmarkResult_t
+{
+	CCycleCount	m_Insert;
+	CCycleCount	m_Find;
+	CCycleCount	m_Iterate;
+	CCycleCount	m_Remove;
+	CCycleCount	m_BulkLoad;
+	int			m_nMissing;
+};
+
+static int __cdecl UtlMapBenchmarkCompare( const int *pLeft, const int *pRight )
+{
+	return ( *pLeft < *pRight ) ? -1 : ( *pLeft > *pRight );
+}
+
+template < class MAP >
+static void TimeUtlMap( MAP &map, const CUtlVector< int > &keys, int nIterations, UtlMapBenchmarkResult_t &result )
+{
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		map.Insert( keys[i], i );
+	}
+	timer.End();
+	result.m_Insert = timer.GetDuration();
+
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		for ( int i = 0; i < keys.Count(); ++i )
+		{
+			if ( map.Find( keys[i] ) == map.InvalidIndex() )
+			{
+				++result.m_nMissing;
+			}
+		}
+	}
+	timer.End();
+	result.m_Find = timer.GetDuration();
+
+	int nSum = 0;
+	timer.Start();
+	for ( int iPass = 0; iPass < nIterations; ++iPass )
+	{
+		FOR_EACH_MAP( map, i )
+		{
+			nSum += map[i];
+		}
+	}
+	timer.End();
+	result.m_Iterate = timer.GetDuration();
+
+	// Keeps the iteration from being optimized away
+	if ( nSum == 1 )
+	{
+		++result.m_nMissing;
+	}
+
+	// Thin the map out to a tenth, which leaves the nodes sparse
+	timer.Start();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		if ( i % 10 && !map.Remove( keys[i] ) )
+		{
+			++result.m_nMissing;
+		}
+	}
+	timer.End();
+	result.m_Remove = timer.GetDuration();
+
+	if ( !map.IsValid() || (int)map.Count() != ( keys.Count() + 9 ) / 10 || map.IsValidIndex( map.InvalidIndex() ) )
+	{
+		++result.m_nMissing;
+	}
+}
+
+CON_COMMAND( utlbtreemap_benchmark, "Times insert, find, iteration and removal on CUtlMap and CUtlBTreeMap from 1k to 1M elements. Usage: utlbtreemap_benchmark [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args.Arg( 1 ) ), 1 ) : 5;
+
+	Msg( "utlbtreemap_benchmark: %d passes, millions of operations per second\n", nIterations );
+	Msg( "  %8s %20s %20s %20s %20s %10s\n", "elements", "insert (rb/btree)", "find (rb/btree)", "iterate (rb/btree)", "remove (rb/btree)", "bulk load" );
+
+	int nMissing = 0;
+	for ( int nElements = 1000; nElements <= 1000000; nElements *= 10 )
+	{
+		CUtlVector< int > keys;
+		keys.SetCount( nElements );
+		unsigned int nSeed = 1;
+		for ( int i = 0; i < nElements; ++i )
+		{
+			nSeed = nSeed * 1103515245u + 12345u;
+			keys[i] = (int)nSeed;
+		}
+
+		UtlMapBenchmarkResult_t rb, btree;
+		rb.m_nMissing = btree.m_nMissing = 0;
+		{
+			CUtlMap< int, int, int > map( DefLessFunc( int ) );
+			TimeUtlMap( map, keys, nIterations, rb );
+		}
+		{
+			CUtlBTreeMap< int, int, int > map;
+			TimeUtlMap( map, keys, nIterations, btree );
+		}
+
+		// Bulk loading from sorted keys, compared against the inserts above
+		CUtlVector< int > sorted;
+		sorted.CopyArray( keys.Base(), keys.Count() );
+		sorted.Sort( UtlMapBenchmarkCompare );
+		{
+			CUtlBTreeMap< int, int, int > map;
+			CFastTimer timer;
+			timer.Start();
+			map.BulkLoad( sorted.Base(), NULL, sorted.Count() );
+			timer.End();
+			btree.m_BulkLoad = timer.GetDuration();
+		}
+
+		double flOps = (double)nElements / 1000000.0;
+		double flPassOps = flOps * nIterations;
+		double flRemoveOps = flOps * 0.9;
+		Msg( "  %8d %9.1f / %-8.1f %9.1f / %-8.1f %9.1f / %-8.1f %9.1f / %-8.1f %10.1f\n", nElements,
+			flOps / rb.m_Insert.GetSeconds(), flOps / btree.m_Insert.GetSeconds(),
+			flPassOps / rb.m_Find.GetSeconds(), flPassOps / btree.m_Find.GetSeconds(),
+			flPassOps / rb.m_Iterate.GetSeconds(), flPassOps / btree.m_Iterate.GetSeconds(),
+			flRemoveOps / rb.m_Remove.GetSeconds(), flRemoveOps / btree.m_Remove.GetSeconds(),
+			flOps / btree.m_BulkLoad.GetSeconds() );
+
+		nMissing += rb.m_nMissing + btree.m_nMissing;
+	}
+
+	if ( nMissing )
+	{
+		Warning( "  %d lookups, removals or validity checks failed\n", nMissing );
+	}
+}
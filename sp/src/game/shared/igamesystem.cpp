@@ -11,6 +11,9 @@
 #include "datacache/imdlcache.h"
 #include "utlvector.h"
 #include "vprof.h"
+#ifndef CLIENT_DLL
+#include "tickprofiler.h"
+#endif
 #if defined( _X360 )
 #include "xbox/xbox_console.h"
 #endif
@@ -327,19 +330,19 @@ void IGameSystem::PostRenderAllSystems()
 
 void IGameSystem::FrameUpdatePreEntityThinkAllSystems()
 {
-	InvokePerFrameMethod( &IGameSystemPerFrame::FrameUpdatePreEntityThink );
+	InvokePerFrameMethod( &IGameSystemPerFrame::FrameUpdatePreEntityThink, "FrameUpdatePreEntityThink" );
 }
 
 void IGameSystem::FrameUpdatePostEntityThinkAllSystems()
 {
 	SafeRemoveIfDesiredAllSystems();
 
-	InvokePerFrameMethod( &IGameSystemPerFrame::FrameUpdatePostEntityThink );
+	InvokePerFrameMethod( &IGameSystemPerFrame::FrameUpdatePostEntityThink, "FrameUpdatePostEntityThink" );
 }
 
 void IGameSystem::PreClientUpdateAllSystems() 
 {
-	InvokePerFrameMethod( &IGameSystemPerFrame::PreClientUpdate );
+	InvokePerFrameMethod( &IGameSystemPerFrame::PreClientUpdate, "PreClientUpdate" );
 }
 
 #endif
@@ -369,13 +372,14 @@ void InvokeMethod( GameSystemFunc_t f, char const *timed /*=0*/ )
 //-----------------------------------------------------------------------------
 void InvokePerFrameMethod( PerFrameGameSystemFunc_t f, char const *timed /*=0*/ )
 {
-	NOTE_UNUSED( timed );
-
 	int i;
 	int c = s_GameSystemsPerFrame.Count();
 	for ( i = 0; i < c ; ++i )
 	{
 		IGameSystemPerFrame *sys  = s_GameSystemsPerFrame[i];
+#ifndef CLIENT_DLL
+		CTickProfileScope tickProfile( TICKPROFILE_GAMESYSTEM, sys->Name(), timed );
+#endif
 		MDLCACHE_CRITICAL_SECTION();
 		(sys->*f)();
 	}
@@ -21,6 +21,8 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "tier1/utlmap.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1373,6 +1375,368 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 	m_pWatchField = FindFieldByName( pwatchvar.GetString(), dmap );
 }
 
+static ConVar cl_pred_copyplans( "cl_pred_copyplans", "1", 0, "Copy and compare predicted fields using per-class compiled field runs." );
+
+enum PredictionRunType_t
+{
+	PREDRUN_BYTES = 0,		// memcpy / memcmp
+	PREDRUN_FLOATS,			// float, Vector and Quaternion components sharing one tolerance
+	PREDRUN_STRING,			// null terminated string
+};
+
+struct PredictionCopyRun_t
+{
+	int		destOffset;
+	int		srcOffset;
+	int		size;			// in bytes, unused for strings
+	int		type;
+	float	tolerance;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: The field walk CopyFields does for one root datamap, copy type
+//			and pair of data layouts, done once. Fields that end up next to
+//			each other on both sides are merged into a single run, so a plain
+//			copy is a few memcpys and a compare only looks at the bytes.
+//-----------------------------------------------------------------------------
+class CPredictionCopyPlan
+{
+public:
+	CPredictionCopyPlan( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex, bool bCompare );
+
+	// Maps with embedded pointers that must be followed, or with field types
+	// CopyFields asserts on, have no plan and take the per-field path.
+	bool IsValid() const { return m_bValid; }
+
+	void Copy( void *pDest, void const *pSrc ) const;
+
+	// True when CopyFields would find nothing differing beyond tolerance.
+	// False only means the per-field path has to make the call.
+	bool Matches( void const *pDest, void const *pSrc ) const;
+
+private:
+	bool AddFields_R( int chaincount, typedescription_t *pFields, int fieldCount, int destBase, int srcBase );
+	void AddRun( int type, int destOffset, int srcOffset, int size, float tolerance );
+	void MergeRuns();
+
+	int			m_nType;
+	int			m_nDestOffsetIndex;
+	int			m_nSrcOffsetIndex;
+	bool		m_bCompare;
+	bool		m_bValid;
+	CUtlVector< PredictionCopyRun_t > m_Runs;
+};
+
+CPredictionCopyPlan::CPredictionCopyPlan( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex, bool bCompare )
+{
+	m_nType				= type;
+	m_nDestOffsetIndex	= destOffsetIndex;
+	m_nSrcOffsetIndex	= srcOffsetIndex;
+	m_bCompare			= bCompare;
+	m_bValid			= true;
+
+	// Walk with a chain count of our own so overridden baseclass fields are
+	// skipped exactly as TransferData_R would skip them
+	int chaincount = ++g_nChainCount;
+	for ( datamap_t *pMap = dmap; pMap && m_bValid; pMap = pMap->baseMap )
+	{
+		m_bValid = AddFields_R( chaincount, pMap->dataDesc, pMap->dataNumFields, 0, 0 );
+	}
+
+	if ( m_bValid )
+	{
+		MergeRuns();
+	}
+	else
+	{
+		m_Runs.Purge();
+	}
+}
+
+bool CPredictionCopyPlan::AddFields_R( int chaincount, typedescription_t *pFields, int fieldCount, int destBase, int srcBase )
+{
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		if ( pField->override_field != NULL )
+		{
+			pField->override_field->override_count = chaincount;
+		}
+
+		if ( pField->override_count == chaincount )
+			continue;
+
+		if ( pField->fieldType != FIELD_EMBEDDED )
+		{
+			if ( flags & FTYPEDESC_PRIVATE )
+				continue;
+
+			if ( m_nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+
+			if ( m_nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+
+			// CanCheck() reports these as identical
+			if ( m_bCompare && ( flags & FTYPEDESC_NOERRORCHECK ) )
+				continue;
+		}
+
+		int destOffset = destBase + pField->fieldOffset[ m_nDestOffsetIndex ];
+		int srcOffset = srcBase + pField->fieldOffset[ m_nSrcOffsetIndex ];
+		int fieldSize = pField->fieldSize;
+		int floatType = m_bCompare ? PREDRUN_FLOATS : PREDRUN_BYTES;
+
+		switch ( pField->fieldType )
+		{
+		case FIELD_EMBEDDED:
+			// Where the pointer leads differs per instance
+			if ( ( flags & FTYPEDESC_PTR ) && ( m_nSrcOffsetIndex == TD_OFFSET_NORMAL || m_nDestOffsetIndex == TD_OFFSET_NORMAL ) )
+				return false;
+
+			if ( !AddFields_R( chaincount, pField->td->dataDesc, pField->td->dataNumFields, destOffset, srcOffset ) )
+				return false;
+			break;
+		case FIELD_FLOAT:
+			AddRun( floatType, destOffset, srcOffset, sizeof( float ) * fieldSize, pField->fieldTolerance );
+			break;
+		case FIELD_VECTOR:
+			AddRun( floatType, destOffset, srcOffset, sizeof( Vector ) * fieldSize, pField->fieldTolerance );
+			break;
+		case FIELD_QUATERNION:
+			AddRun( floatType, destOffset, srcOffset, sizeof( Quaternion ) * fieldSize, pField->fieldTolerance );
+			break;
+		case FIELD_STRING:
+			AddRun( PREDRUN_STRING, destOffset, srcOffset, 0, 0.0f );
+			break;
+		case FIELD_COLOR32:
+			AddRun( PREDRUN_BYTES, destOffset, srcOffset, 4 * fieldSize, 0.0f );
+			break;
+		case FIELD_BOOLEAN:
+			AddRun( PREDRUN_BYTES, destOffset, srcOffset, sizeof( bool ) * fieldSize, 0.0f );
+			break;
+		case FIELD_INTEGER:
+			AddRun( PREDRUN_BYTES, destOffset, srcOffset, sizeof( int ) * fieldSize, 0.0f );
+			break;
+		case FIELD_SHORT:
+			AddRun( PREDRUN_BYTES, destOffset, srcOffset, sizeof( short ) * fieldSize, 0.0f );
+			break;
+		case FIELD_CHARACTER:
+			AddRun( PREDRUN_BYTES, destOffset, srcOffset, fieldSize, 0.0f );
+			break;
+		case FIELD_EHANDLE:
+			// Handles copy by value, and equal handles resolve to the same entity
+			AddRun( PREDRUN_BYTES, destOffset, srcOffset, sizeof( EHANDLE ) * fieldSize, 0.0f );
+			break;
+		case FIELD_VOID:
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void CPredictionCopyPlan::AddRun( int type, int destOffset, int srcOffset, int size, float tolerance )
+{
+	PredictionCopyRun_t &run = m_Runs[ m_Runs.AddToTail() ];
+	run.destOffset	= destOffset;
+	run.srcOffset	= srcOffset;
+	run.size		= size;
+	run.type		= type;
+	run.tolerance	= ( type == PREDRUN_FLOATS ) ? tolerance : 0.0f;
+}
+
+static int __cdecl PredictionCopyRunLessFunc( const PredictionCopyRun_t *a, const PredictionCopyRun_t *b )
+{
+	return a->destOffset - b->destOffset;
+}
+
+void CPredictionCopyPlan::MergeRuns()
+{
+	m_Runs.Sort( PredictionCopyRunLessFunc );
+
+	int nMerged = 0;
+	for ( int i = 0; i < m_Runs.Count(); i++ )
+	{
+		const PredictionCopyRun_t &run = m_Runs[ i ];
+		if ( nMerged > 0 )
+		{
+			PredictionCopyRun_t &prev = m_Runs[ nMerged - 1 ];
+			if ( run.type != PREDRUN_STRING &&
+				 prev.type == run.type &&
+				 prev.tolerance == run.tolerance &&
+				 prev.destOffset + prev.size == run.destOffset &&
+				 prev.srcOffset + prev.size == run.srcOffset )
+			{
+				prev.size += run.size;
+				continue;
+			}
+		}
+
+		m_Runs[ nMerged++ ] = run;
+	}
+
+	m_Runs.RemoveMultipleFromTail( m_Runs.Count() - nMerged );
+}
+
+void CPredictionCopyPlan::Copy( void *pDest, void const *pSrc ) const
+{
+	Assert( !m_bCompare );
+
+	for ( int i = 0; i < m_Runs.Count(); i++ )
+	{
+		const PredictionCopyRun_t &run = m_Runs[ i ];
+		char *pOut = (char *)pDest + run.destOffset;
+		const char *pIn = (const char *)pSrc + run.srcOffset;
+
+		if ( run.type == PREDRUN_STRING )
+		{
+			memcpy( pOut, pIn, Q_strlen( pIn ) + 1 );
+		}
+		else
+		{
+			memcpy( pOut, pIn, run.size );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same result as the Compare* helpers for a run of floats, four at a
+//			time. With a tolerance, equal infinities fail here where the
+//			helpers pass them, which just defers to the per-field path.
+//-----------------------------------------------------------------------------
+static bool FloatsMatch( const float *pOut, const float *pIn, int count, float tolerance )
+{
+	int i = 0;
+	if ( tolerance > 0.0f )
+	{
+		fltx4 fl4Tolerance = ReplicateX4( tolerance );
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			fltx4 fl4Delta = fabs( SubSIMD( LoadUnalignedSIMD( pOut + i ), LoadUnalignedSIMD( pIn + i ) ) );
+			if ( !IsAllGreaterThanOrEq( fl4Tolerance, fl4Delta ) )
+				return false;
+		}
+
+		for ( ; i < count; i++ )
+		{
+			if ( !( fabs( pOut[ i ] - pIn[ i ] ) <= tolerance ) )
+				return false;
+		}
+	}
+	else
+	{
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			if ( !IsAllEqual( LoadUnalignedSIMD( pOut + i ), LoadUnalignedSIMD( pIn + i ) ) )
+				return false;
+		}
+
+		for ( ; i < count; i++ )
+		{
+			if ( pOut[ i ] != pIn[ i ] )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool CPredictionCopyPlan::Matches( void const *pDest, void const *pSrc ) const
+{
+	Assert( m_bCompare );
+
+	for ( int i = 0; i < m_Runs.Count(); i++ )
+	{
+		const PredictionCopyRun_t &run = m_Runs[ i ];
+		const char *pOut = (const char *)pDest + run.destOffset;
+		const char *pIn = (const char *)pSrc + run.srcOffset;
+
+		switch ( run.type )
+		{
+		case PREDRUN_BYTES:
+			if ( memcmp( pOut, pIn, run.size ) )
+				return false;
+			break;
+		case PREDRUN_FLOATS:
+			if ( !FloatsMatch( (const float *)pOut, (const float *)pIn, run.size / sizeof( float ), run.tolerance ) )
+				return false;
+			break;
+		case PREDRUN_STRING:
+			if ( Q_strcmp( pOut, pIn ) )
+				return false;
+			break;
+		}
+	}
+
+	return true;
+}
+
+#define PREDICTION_COPY_TYPE_COUNT	( PC_NETWORKED_ONLY + 1 )
+
+//-----------------------------------------------------------------------------
+// Purpose: Plans are built on first use, per root datamap
+//-----------------------------------------------------------------------------
+class CPredictionCopyPlanCache
+{
+public:
+	CPredictionCopyPlanCache() : m_Plans( DefLessFunc( datamap_t * ) ) {}
+	~CPredictionCopyPlanCache()
+	{
+		FOR_EACH_MAP_FAST( m_Plans, i )
+		{
+			delete m_Plans[i];
+		}
+	}
+
+	CPredictionCopyPlan *GetPlan( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex, bool bCompare )
+	{
+		Assert( type >= 0 && type < PREDICTION_COPY_TYPE_COUNT );
+
+		int i = m_Plans.Find( dmap );
+		if ( i == m_Plans.InvalidIndex() )
+		{
+			i = m_Plans.Insert( dmap, new PlanSet_t );
+		}
+
+		CPredictionCopyPlan *&pPlan = m_Plans[i]->m_pPlans[ type ][ destOffsetIndex ][ srcOffsetIndex ][ bCompare ? 1 : 0 ];
+		if ( !pPlan )
+		{
+			pPlan = new CPredictionCopyPlan( dmap, type, destOffsetIndex, srcOffsetIndex, bCompare );
+		}
+
+		return pPlan->IsValid() ? pPlan : NULL;
+	}
+
+private:
+	struct PlanSet_t
+	{
+		PlanSet_t()
+		{
+			memset( m_pPlans, 0, sizeof( m_pPlans ) );
+		}
+
+		~PlanSet_t()
+		{
+			CPredictionCopyPlan **ppPlans = &m_pPlans[0][0][0][0];
+			for ( int i = 0; i < (int)( sizeof( m_pPlans ) / sizeof( ppPlans[0] ) ); i++ )
+			{
+				delete ppPlans[i];
+			}
+		}
+
+		CPredictionCopyPlan *m_pPlans[ PREDICTION_COPY_TYPE_COUNT ][ TD_OFFSET_COUNT ][ TD_OFFSET_COUNT ][ 2 ];
+	};
+
+	CUtlMap< datamap_t *, PlanSet_t * > m_Plans;
+};
+
+static CPredictionCopyPlanCache g_PredictionCopyPlans;
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *operation - 
@@ -1382,8 +1746,6 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 //-----------------------------------------------------------------------------
 int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_t *dmap )
 {
-	++g_nChainCount;
-
 	if ( !dmap->chains_validated )
 	{
 		ValidateChains_R( dmap );
@@ -1391,6 +1753,29 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
+	// Plain copies, and compares that only count errors, don't need to look
+	// at each field unless something actually differs
+	if ( !m_pWatchField && !m_bDescribeFields && cl_pred_copyplans.GetBool() )
+	{
+		if ( m_bPerformCopy && !m_bErrorCheck )
+		{
+			CPredictionCopyPlan *pPlan = g_PredictionCopyPlans.GetPlan( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex, false );
+			if ( pPlan )
+			{
+				pPlan->Copy( m_pDest, m_pSrc );
+				return m_nErrorCount;
+			}
+		}
+		else if ( m_bErrorCheck && !m_bPerformCopy )
+		{
+			CPredictionCopyPlan *pPlan = g_PredictionCopyPlans.GetPlan( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex, true );
+			if ( pPlan && pPlan->Matches( m_pDest, m_pSrc ) )
+				return m_nErrorCount;
+		}
+	}
+
+	++g_nChainCount;
+
 	TransferData_R( g_nChainCount, dmap );
 
 	return m_nErrorCount;
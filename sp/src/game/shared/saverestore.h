@@ -23,6 +23,7 @@
 class CSaveRestoreData;
 class CSaveRestoreSegment;
 class CGameSaveRestoreInfo;
+class CSaveRestorePlan;
 struct typedescription_t;
 struct edict_t;
 struct datamap_t;
@@ -150,6 +151,7 @@ private:
 	void			WriteHeader( const char *pname, int size );
 
 	int				DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
+	int				WriteFields( const char *pname, const void *pBaseData, datamap_t *pMap, const CSaveRestorePlan *pPlan );
 	bool 			WriteField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
 	
 	bool 			WriteBasicField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
@@ -274,6 +276,8 @@ private:
 	void			BufferSkipBytes( int bytes );
 	
 	int				DoReadAll( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
+	int				ReadFields( const char *pname, void *pBaseData, datamap_t *pMap, const CSaveRestorePlan *pPlan );
+	void			EmptyFields( void *pBaseData, const CSaveRestorePlan *pPlan );
 	
 	typedescription_t *FindField( const char *pszFieldName, typedescription_t *pFields, int fieldCount, int *pIterator );
 	void			ReadField( const SaveRestoreRecordHeader_t &header, void *pDest, datamap_t *pRootMap, typedescription_t *pField );
@@ -0,0 +1,116 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Headless .dem reader for offline analysis. Maps the file and
+//			walks its commands in place; packet payloads are handed out as
+//			pointers into the mapping, ready for a bf_read.
+//
+//=============================================================================
+
+#ifndef DEMOREADER_H
+#define DEMOREADER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "demofile/demoformat.h"
+#include "tier1/bitbuf.h"
+
+//-----------------------------------------------------------------------------
+// One command from a demo. m_pData points into the reader's mapping and is
+// only valid until the reader is closed.
+//-----------------------------------------------------------------------------
+struct DemoCommand_t
+{
+	int				m_nCommand;			// dem_*
+	int				m_nTick;
+	int				m_nFileOffset;		// offset of the command byte
+
+	// dem_signon and dem_packet only
+	democmdinfo_t	m_Info;
+	int				m_nSequenceIn;
+	int				m_nSequenceOut;
+
+	// dem_usercmd only
+	int				m_nUserCmdSequence;
+
+	// Raw payload: net messages, console text, user command, data or string tables
+	const byte		*m_pData;
+	int				m_nDataLength;
+
+	bool IsPacket() const	{ return m_nCommand == dem_packet || m_nCommand == dem_signon; }
+
+	void StartReading( bf_read &buf ) const
+	{
+		buf.StartReading( m_pData, m_nDataLength );
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Pull iterator over the commands in one demo
+//-----------------------------------------------------------------------------
+class CDemoFileReader
+{
+public:
+	CDemoFileReader();
+	~CDemoFileReader();
+
+	// Maps a file from disk, read only
+	bool	Open( const char *pszFilename );
+
+	// Reads a demo the caller already has in memory. The memory isn't copied
+	// and must outlive the reader.
+	bool	Attach( const void *pData, int nSize );
+
+	void	Close();
+	bool	IsOpen() const						{ return m_pBase != NULL; }
+
+	const demoheader_t &GetHeader() const		{ return m_Header; }
+	int		GetSize() const						{ return m_nSize; }
+
+	// Returns false after dem_stop, at the end of the file, or on a bad or
+	// truncated command (see IsCorrupt). dem_stop itself is returned.
+	bool	NextCommand( DemoCommand_t &cmd );
+
+	// Back to the first command after the header
+	void	Rewind();
+
+	bool	IsCorrupt() const					{ return m_bCorrupt; }
+
+private:
+	bool	ParseHeader();
+	bool	Read( void *pOut, int nBytes );
+	bool	ReadInt( int &nValue );
+	bool	ReadPayload( DemoCommand_t &cmd );
+
+	const byte		*m_pBase;
+	int				m_nSize;
+	int				m_nPos;
+	bool			m_bMapped;
+	bool			m_bStopped;
+	bool			m_bCorrupt;
+	demoheader_t	m_Header;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Receives demos from DemoFile_ProcessParallel. Every call for one
+//			demo comes from the same worker thread, but different demos are
+//			visited concurrently, so implementations must be thread safe
+//			across iDemo.
+//-----------------------------------------------------------------------------
+abstract_class IDemoFileVisitor
+{
+public:
+	// Return false to skip the rest of this demo
+	virtual bool OnDemoStart( int iDemo, const char *pszFilename, const demoheader_t &header ) = 0;
+	virtual bool OnCommand( int iDemo, const DemoCommand_t &cmd ) = 0;
+
+	// bComplete is false when the demo couldn't be opened, was corrupt or was skipped
+	virtual void OnDemoEnd( int iDemo, bool bComplete ) = 0;
+};
+
+// Reads nFiles demos on nThreads worker threads. Only one demo per thread is
+// mapped at a time, so the address space used is bounded by the thread count
+// and the largest demos. Returns the number of demos read to the end.
+int DemoFile_ProcessParallel( const char * const *ppszFilenames, int nFiles, IDemoFileVisitor *pVisitor, int nThreads );
+
+#endif // DEMOREADER_H
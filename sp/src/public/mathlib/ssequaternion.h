@@ -363,5 +363,230 @@ FORCEINLINE fltx4 QuaternionSlerpSIMD( const fltx4 &p, const fltx4 &q, float t )
 
 #endif // ALLOW_SIMD_QUATERNION_MATH
 
+
+//---------------------------------------------------------------------
+// FourQuaternions stores 4 independent quaternions as x x x x y y y y
+// z z z z w w w w, the quaternion counterpart of FourVectors. Every lane
+// is its own quaternion, so unlike the fltx4 functions above nothing here
+// needs horizontal operations, and it is allowed on PC.
+//---------------------------------------------------------------------
+class ALIGN16 FourQuaternions
+{
+public:
+	fltx4 x, y, z, w;
+
+	/// LoadAndSwizzle - load 4 Quaternions into a FourQuaternions, performing transpose op
+	FORCEINLINE void LoadAndSwizzle( const Quaternion &a, const Quaternion &b, const Quaternion &c, const Quaternion &d )
+	{
+		x = LoadUnalignedSIMD( a.Base() );
+		y = LoadUnalignedSIMD( b.Base() );
+		z = LoadUnalignedSIMD( c.Base() );
+		w = LoadUnalignedSIMD( d.Base() );
+		TransposeSIMD( x, y, z, w );
+	}
+
+	/// SwizzleAndStore - transpose back and write the 4 Quaternions out
+	FORCEINLINE void SwizzleAndStore( Quaternion &a, Quaternion &b, Quaternion &c, Quaternion &d ) const
+	{
+		fltx4 ta = x, tb = y, tc = z, td = w;
+		TransposeSIMD( ta, tb, tc, td );
+		StoreUnalignedSIMD( a.Base(), ta );
+		StoreUnalignedSIMD( b.Base(), tb );
+		StoreUnalignedSIMD( c.Base(), tc );
+		StoreUnalignedSIMD( d.Base(), td );
+	}
+
+	/// 4 dot products
+	FORCEINLINE fltx4 operator*( const FourQuaternions &b ) const
+	{
+		fltx4 dot = MulSIMD( x, b.x );
+		dot = MaddSIMD( y, b.y, dot );
+		dot = MaddSIMD( z, b.z, dot );
+		dot = MaddSIMD( w, b.w, dot );
+		return dot;
+	}
+};
+
+
+//---------------------------------------------------------------------
+// sin(x) for x in [0, pi], folded onto [0, pi/2] and evaluated with a
+// Taylor series. Good to about 1e-9, and keeps its relative accuracy near
+// zero, which the slerp weights below depend on.
+//---------------------------------------------------------------------
+FORCEINLINE fltx4 SinZeroToPiSIMD( const fltx4 &radians )
+{
+	fltx4 x = MinSIMD( radians, SubSIMD( ReplicateX4( M_PI_F ), radians ) );
+	fltx4 x2 = MulSIMD( x, x );
+	fltx4 r = ReplicateX4( 1.0f / 6227020800.0f );
+	r = MaddSIMD( r, x2, ReplicateX4( -1.0f / 39916800.0f ) );
+	r = MaddSIMD( r, x2, ReplicateX4( 1.0f / 362880.0f ) );
+	r = MaddSIMD( r, x2, ReplicateX4( -1.0f / 5040.0f ) );
+	r = MaddSIMD( r, x2, ReplicateX4( 1.0f / 120.0f ) );
+	r = MaddSIMD( r, x2, ReplicateX4( -1.0f / 6.0f ) );
+	r = MaddSIMD( r, x2, Four_Ones );
+	return MulSIMD( r, x );
+}
+
+//---------------------------------------------------------------------
+// acos(x) for x in [-1, 1] (Abramowitz & Stegun 4.4.46, error <= 2e-8)
+//---------------------------------------------------------------------
+FORCEINLINE fltx4 ArcCosPolySIMD( const fltx4 &cs )
+{
+	fltx4 negative = CmpLtSIMD( cs, Four_Zeros );
+	fltx4 x = MinSIMD( AndSIMD( cs, LoadAlignedSIMD( g_SIMD_clear_signmask ) ), Four_Ones );
+	fltx4 r = ReplicateX4( -0.0012624911f );
+	r = MaddSIMD( r, x, ReplicateX4( 0.0066700901f ) );
+	r = MaddSIMD( r, x, ReplicateX4( -0.0170881256f ) );
+	r = MaddSIMD( r, x, ReplicateX4( 0.0308918810f ) );
+	r = MaddSIMD( r, x, ReplicateX4( -0.0501743046f ) );
+	r = MaddSIMD( r, x, ReplicateX4( 0.0889789874f ) );
+	r = MaddSIMD( r, x, ReplicateX4( -0.2145988016f ) );
+	r = MaddSIMD( r, x, ReplicateX4( 1.5707963050f ) );
+	r = MulSIMD( r, SqrtSIMD( SubSIMD( Four_Ones, x ) ) );
+	return MaskedAssign( negative, SubSIMD( ReplicateX4( M_PI_F ), r ), r );
+}
+
+
+//---------------------------------------------------------------------
+// Make sure quaternions are within 180 degrees of one another, if not, reverse q
+//---------------------------------------------------------------------
+FORCEINLINE FourQuaternions QuaternionAlignSIMD( const FourQuaternions &p, const FourQuaternions &q )
+{
+	fltx4 cmp = CmpLtSIMD( p * q, Four_Zeros );
+	FourQuaternions result;
+	result.x = MaskedAssign( cmp, NegSIMD( q.x ), q.x );
+	result.y = MaskedAssign( cmp, NegSIMD( q.y ), q.y );
+	result.z = MaskedAssign( cmp, NegSIMD( q.z ), q.z );
+	result.w = MaskedAssign( cmp, NegSIMD( q.w ), q.w );
+	return result;
+}
+
+//---------------------------------------------------------------------
+// Normalize Quaternions. Zero length lanes are left alone.
+//---------------------------------------------------------------------
+FORCEINLINE FourQuaternions QuaternionNormalizeSIMD( const FourQuaternions &q )
+{
+	fltx4 radius = q * q;
+	fltx4 iradius = MaskedAssign( CmpEqSIMD( radius, Four_Zeros ), Four_Ones, ReciprocalSqrtSIMD( radius ) );
+	FourQuaternions result;
+	result.x = MulSIMD( q.x, iradius );
+	result.y = MulSIMD( q.y, iradius );
+	result.z = MulSIMD( q.z, iradius );
+	result.w = MulSIMD( q.w, iradius );
+	return result;
+}
+
+//---------------------------------------------------------------------
+// 0.0 returns p, 1.0 return q.
+//---------------------------------------------------------------------
+FORCEINLINE FourQuaternions QuaternionBlendNoAlignSIMD( const FourQuaternions &p, const FourQuaternions &q, const fltx4 &t )
+{
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	FourQuaternions result;
+	result.x = MaddSIMD( sclp, p.x, MulSIMD( t, q.x ) );
+	result.y = MaddSIMD( sclp, p.y, MulSIMD( t, q.y ) );
+	result.z = MaddSIMD( sclp, p.z, MulSIMD( t, q.z ) );
+	result.w = MaddSIMD( sclp, p.w, MulSIMD( t, q.w ) );
+	return QuaternionNormalizeSIMD( result );
+}
+
+//---------------------------------------------------------------------
+// Blend towards the identity quaternion, 1.0 returns identity
+//---------------------------------------------------------------------
+FORCEINLINE FourQuaternions QuaternionIdentityBlendSIMD( const FourQuaternions &p, const fltx4 &t )
+{
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	FourQuaternions result;
+	result.x = MulSIMD( p.x, sclp );
+	result.y = MulSIMD( p.y, sclp );
+	result.z = MulSIMD( p.z, sclp );
+	fltx4 negative = CmpLtSIMD( p.w, Four_Zeros );
+	result.w = MaddSIMD( p.w, sclp, MaskedAssign( negative, NegSIMD( t ), t ) );
+	return QuaternionNormalizeSIMD( result );
+}
+
+//---------------------------------------------------------------------
+// Quaternion sphereical linear interpolation, per lane t. Matches
+// QuaternionSlerpNoAlign, including its near and opposite special cases.
+//---------------------------------------------------------------------
+FORCEINLINE FourQuaternions QuaternionSlerpNoAlignSIMD( const FourQuaternions &p, const FourQuaternions &q, const fltx4 &t )
+{
+	fltx4 cosom = p * q;
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	fltx4 sclq = t;
+	fltx4 epsilon = ReplicateX4( 0.000001f );
+
+	// lanes that are nearly the same rotation just lerp
+	fltx4 slerp = CmpGtSIMD( SubSIMD( Four_Ones, cosom ), epsilon );
+	if ( IsAnyNegative( slerp ) )
+	{
+		fltx4 omega = ArcCosPolySIMD( cosom );
+		fltx4 oosinom = ReciprocalSIMD( SinZeroToPiSIMD( omega ) );
+		sclp = MaskedAssign( slerp, MulSIMD( SinZeroToPiSIMD( MulSIMD( sclp, omega ) ), oosinom ), sclp );
+		sclq = MaskedAssign( slerp, MulSIMD( SinZeroToPiSIMD( MulSIMD( t, omega ) ), oosinom ), sclq );
+	}
+
+	FourQuaternions result;
+	result.x = MaddSIMD( sclp, p.x, MulSIMD( sclq, q.x ) );
+	result.y = MaddSIMD( sclp, p.y, MulSIMD( sclq, q.y ) );
+	result.z = MaddSIMD( sclp, p.z, MulSIMD( sclq, q.z ) );
+	result.w = MaddSIMD( sclp, p.w, MulSIMD( sclq, q.w ) );
+
+	// lanes that are opposite go through a perpendicular quaternion
+	fltx4 opposite = CmpLeSIMD( AddSIMD( Four_Ones, cosom ), epsilon );
+	if ( IsAnyNegative( opposite ) )
+	{
+		fltx4 halfPi = ReplicateX4( 0.5f * M_PI_F );
+		sclp = SinZeroToPiSIMD( MulSIMD( SubSIMD( Four_Ones, t ), halfPi ) );
+		sclq = SinZeroToPiSIMD( MulSIMD( t, halfPi ) );
+		result.x = MaskedAssign( opposite, SubSIMD( MulSIMD( sclp, p.x ), MulSIMD( sclq, q.y ) ), result.x );
+		result.y = MaskedAssign( opposite, MaddSIMD( sclp, p.y, MulSIMD( sclq, q.x ) ), result.y );
+		result.z = MaskedAssign( opposite, SubSIMD( MulSIMD( sclp, p.z ), MulSIMD( sclq, q.w ) ), result.z );
+		result.w = MaskedAssign( opposite, q.z, result.w );
+	}
+
+	return result;
+}
+
+//---------------------------------------------------------------------
+// Build 4 matrices from 4 quaternions and positions (see QuaternionMatrix)
+//---------------------------------------------------------------------
+FORCEINLINE void QuaternionMatrixSIMD( const FourQuaternions &q, const FourVectors &pos, matrix3x4_t &a, matrix3x4_t &b, matrix3x4_t &c, matrix3x4_t &d )
+{
+	fltx4 x2 = AddSIMD( q.x, q.x );
+	fltx4 y2 = AddSIMD( q.y, q.y );
+	fltx4 z2 = AddSIMD( q.z, q.z );
+	fltx4 xx = MulSIMD( q.x, x2 );
+	fltx4 xy = MulSIMD( q.x, y2 );
+	fltx4 xz = MulSIMD( q.x, z2 );
+	fltx4 yy = MulSIMD( q.y, y2 );
+	fltx4 yz = MulSIMD( q.y, z2 );
+	fltx4 zz = MulSIMD( q.z, z2 );
+	fltx4 wx = MulSIMD( q.w, x2 );
+	fltx4 wy = MulSIMD( q.w, y2 );
+	fltx4 wz = MulSIMD( q.w, z2 );
+
+	fltx4 row0[4] = { SubSIMD( Four_Ones, AddSIMD( yy, zz ) ), SubSIMD( xy, wz ), AddSIMD( xz, wy ), pos.x };
+	fltx4 row1[4] = { AddSIMD( xy, wz ), SubSIMD( Four_Ones, AddSIMD( xx, zz ) ), SubSIMD( yz, wx ), pos.y };
+	fltx4 row2[4] = { SubSIMD( xz, wy ), AddSIMD( yz, wx ), SubSIMD( Four_Ones, AddSIMD( xx, yy ) ), pos.z };
+
+	TransposeSIMD( row0[0], row0[1], row0[2], row0[3] );
+	TransposeSIMD( row1[0], row1[1], row1[2], row1[3] );
+	TransposeSIMD( row2[0], row2[1], row2[2], row2[3] );
+
+	StoreUnalignedSIMD( a[0], row0[0] );
+	StoreUnalignedSIMD( a[1], row1[0] );
+	StoreUnalignedSIMD( a[2], row2[0] );
+	StoreUnalignedSIMD( b[0], row0[1] );
+	StoreUnalignedSIMD( b[1], row1[1] );
+	StoreUnalignedSIMD( b[2], row2[1] );
+	StoreUnalignedSIMD( c[0], row0[2] );
+	StoreUnalignedSIMD( c[1], row1[2] );
+	StoreUnalignedSIMD( c[2], row2[2] );
+	StoreUnalignedSIMD( d[0], row0[3] );
+	StoreUnalignedSIMD( d[1], row1[3] );
+	StoreUnalignedSIMD( d[2], row2[3] );
+}
+
 #endif // SSEQUATMATH_H
 
@@ -10,6 +10,7 @@
 #include "datacache/idatacache.h"
 #include "datacache/imdlcache.h"
 #include "convar.h"
+#include "utlmap.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -72,6 +73,12 @@ mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame ) const
 }
 
 mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame, float &flStall ) const
+{
+	int section;
+	return pAnim( piFrame, flStall, &section );
+}
+
+mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame, float &flStall, int *piSection ) const
 {
 	mstudioanim_t *panim = NULL;
 
@@ -171,6 +178,7 @@ mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame, float &flStall ) const
 		Msg("[%8.3f] stall on %s:%s:%d:%d\n", Plat_FloatTime(), pStudiohdr()->pszName(), pszName(), section, block );
 	}
 
+	*piSection = section;
 	return panim;
 }
 
@@ -712,6 +720,7 @@ CStudioHdr::CStudioHdr( void )
 	// set pointer to bogus value
 	m_nFrameUnlockCounter = 0;
 	m_pFrameUnlockCounter = &m_nFrameUnlockCounter;
+	m_pAnimSeekCache = NULL;
 	Init( NULL );
 }
 
@@ -720,6 +729,7 @@ CStudioHdr::CStudioHdr( const studiohdr_t *pStudioHdr, IMDLCache *mdlcache )
 	// preset pointer to bogus value (it may be overwritten with legitimate data later)
 	m_nFrameUnlockCounter = 0;
 	m_pFrameUnlockCounter = &m_nFrameUnlockCounter;
+	m_pAnimSeekCache = NULL;
 	Init( pStudioHdr, mdlcache );
 }
 
@@ -732,6 +742,7 @@ void CStudioHdr::Init( const studiohdr_t *pStudioHdr, IMDLCache *mdlcache )
 
 	m_pVModel = NULL;
 	m_pStudioHdrCache.RemoveAll();
+	PurgeAnimSeekCache();
 
 	if (m_pStudioHdr == NULL)
 	{
@@ -771,6 +782,140 @@ void CStudioHdr::Init( const studiohdr_t *pStudioHdr, IMDLCache *mdlcache )
 
 void CStudioHdr::Term()
 {
+	PurgeAnimSeekCache();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Animation seek indices, keyed by animation and section
+//-----------------------------------------------------------------------------
+
+class CStudioAnimSeekCache
+{
+public:
+	CStudioAnimSeekCache() : m_Sections( 0, 0, DefLessFunc( unsigned int ) ) {}
+	~CStudioAnimSeekCache() { m_Sections.PurgeAndDeleteElements(); }
+
+	CUtlMap< unsigned int, CStudioAnimSeekSection * > m_Sections;
+};
+
+void CStudioHdr::PurgeAnimSeekCache()
+{
+	delete m_pAnimSeekCache;
+	m_pAnimSeekCache = NULL;
+}
+
+const CStudioAnimSeekSection *CStudioHdr::GetAnimSeekSection( int iAnimation, int iSection, const mstudioanimdesc_t &animdesc, const mstudioanim_t *panim ) const
+{
+	// Frames in this section; the last frame of a sectioned animation is
+	// stored on its own, so don't count on it being in the previous section.
+	int nFrames = animdesc.numframes;
+	if ( animdesc.sectionframes != 0 && animdesc.numframes > animdesc.sectionframes )
+	{
+		nFrames = MIN( animdesc.sectionframes, animdesc.numframes - 1 - iSection * animdesc.sectionframes );
+	}
+
+	if ( nFrames < ANIMSEEK_MIN_FRAMES || !panim || iSection >= ( 1 << 12 ) )
+		return NULL;
+
+	unsigned int key = ( (unsigned int)iAnimation << 12 ) | (unsigned int)iSection;
+
+	AUTO_LOCK( m_AnimSeekMutex );
+
+	if ( !m_pAnimSeekCache )
+	{
+		m_pAnimSeekCache = new CStudioAnimSeekCache;
+	}
+
+	CUtlMap< unsigned int, CStudioAnimSeekSection * > &sections = m_pAnimSeekCache->m_Sections;
+	unsigned short i = sections.Find( key );
+	if ( i == sections.InvalidIndex() )
+	{
+		CStudioAnimSeekSection *pSection = new CStudioAnimSeekSection;
+		pSection->Build( panim, nFrames );
+		i = sections.Insert( key, pSection );
+	}
+
+	const CStudioAnimSeekSection *pSection = sections[ i ];
+	return pSection->NumSeekPoints() ? pSection : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the run holding every ANIMSEEK_FRAMES'th frame of one stream
+//-----------------------------------------------------------------------------
+bool CStudioAnimSeekSection::BuildStream( const mstudioanimvalue_t *panimvalue, mstudioanimseekpoint_t *pSeekPoints ) const
+{
+	const mstudioanimvalue_t *pRun = panimvalue;
+	int nRunFrame = 0;
+
+	for ( int i = 0; i < m_nSeekPoints; i++ )
+	{
+		int frame = i * ANIMSEEK_FRAMES;
+		while ( nRunFrame + pRun->num.total <= frame )
+		{
+			if ( pRun->num.total == 0 )
+				return false; // stream ends early, leave it to the linear walk
+
+			nRunFrame += pRun->num.total;
+			pRun += pRun->num.valid + 1;
+		}
+
+		int offset = pRun - panimvalue;
+		if ( offset > 0xFFFF || nRunFrame > 0xFFFF )
+			return false;
+
+		pSeekPoints[ i ].offset = (unsigned short)offset;
+		pSeekPoints[ i ].frame = (unsigned short)nRunFrame;
+	}
+
+	return true;
+}
+
+void CStudioAnimSeekSection::Build( const mstudioanim_t *panim, int nFrames )
+{
+	m_nSeekPoints = ( nFrames - 1 ) / ANIMSEEK_FRAMES + 1;
+	m_StreamStart.RemoveAll();
+	m_SeekPoints.RemoveAll();
+
+	int nIndexed = 0;
+	for ( ; panim && panim->bone < 255; panim = panim->pNext() )
+	{
+		for ( int component = 0; component < 6; component++ )
+		{
+			int iStream = m_StreamStart.AddToTail( -1 );
+
+			const mstudioanim_valueptr_t *pValues = NULL;
+			if ( component < 3 && ( panim->flags & STUDIO_ANIM_ANIMROT ) )
+			{
+				pValues = panim->pRotV();
+			}
+			else if ( component >= 3 && ( panim->flags & STUDIO_ANIM_ANIMPOS ) )
+			{
+				pValues = panim->pPosV();
+			}
+
+			const mstudioanimvalue_t *panimvalue = pValues ? pValues->pAnimvalue( component % 3 ) : NULL;
+			if ( !panimvalue )
+				continue;
+
+			int iFirst = m_SeekPoints.AddMultipleToTail( m_nSeekPoints );
+			if ( BuildStream( panimvalue, &m_SeekPoints[ iFirst ] ) )
+			{
+				m_StreamStart[ iStream ] = iFirst;
+				++nIndexed;
+			}
+			else
+			{
+				m_SeekPoints.RemoveMultipleFromTail( m_nSeekPoints );
+			}
+		}
+	}
+
+	if ( !nIndexed )
+	{
+		m_nSeekPoints = 0;
+		m_StreamStart.Purge();
+		m_SeekPoints.Purge();
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -711,6 +711,7 @@ struct mstudioanimdesc_t
 	int					animblock;
 	int					animindex;	 // non-zero when anim data isn't in sections
 	mstudioanim_t *pAnimBlock( int block, int index ) const; // returns pointer to a specific anim block (local or external)
+	mstudioanim_t *pAnim( int *piFrame, float &flStall, int *piSection ) const; // also returns the section the data came from
 	mstudioanim_t *pAnim( int *piFrame, float &flStall ) const; // returns pointer to data and new frame index
 	mstudioanim_t *pAnim( int *piFrame ) const; // returns pointer to data and new frame index
 
@@ -2329,6 +2330,51 @@ private:
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Seek index for the run length encoded value streams of one section
+//			of a long animation. Every ANIMSEEK_FRAMES frames it records where
+//			the run holding that frame starts, so decoding a late frame doesn't
+//			walk the run list from the start of the stream.
+//-----------------------------------------------------------------------------
+
+#define ANIMSEEK_FRAMES			32
+#define ANIMSEEK_MIN_FRAMES		( 2 * ANIMSEEK_FRAMES )	// shorter sections aren't worth indexing
+
+struct mstudioanimseekpoint_t
+{
+	unsigned short		offset;		// mstudioanimvalue_t's from the start of the stream to the run
+	unsigned short		frame;		// first frame of that run
+};
+
+class CStudioAnimSeekSection
+{
+public:
+	CStudioAnimSeekSection() : m_nSeekPoints( 0 ) {}
+
+	void Build( const mstudioanim_t *panim, int nFrames );
+
+	// Checkpoints for one stream, NULL if it isn't indexed. iAnimBone is the
+	// position of the bone in the section's mstudioanim_t list, component is
+	// 0-2 for rotation and 3-5 for position.
+	inline const mstudioanimseekpoint_t *pSeekPoints( int iAnimBone, int component ) const
+	{
+		int iStream = iAnimBone * 6 + component;
+		if ( iStream >= m_StreamStart.Count() || m_StreamStart[ iStream ] < 0 )
+			return NULL;
+		return &m_SeekPoints[ m_StreamStart[ iStream ] ];
+	}
+	inline int NumSeekPoints() const { return m_nSeekPoints; }
+
+private:
+	bool BuildStream( const mstudioanimvalue_t *panimvalue, mstudioanimseekpoint_t *pSeekPoints ) const;
+
+	int										m_nSeekPoints;		// per stream
+	CUtlVector< int >						m_StreamStart;		// into m_SeekPoints, -1 if not indexed
+	CUtlVector< mstudioanimseekpoint_t >	m_SeekPoints;
+};
+
+class CStudioAnimSeekCache;
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -2689,7 +2735,16 @@ public:
 	mutable	int			m_nPerfAnimationLayers;
 #endif
 
+public:
+	// Seek index for one section of a long animation, built on first use.
+	// Returns NULL if the section is too short to need one.
+	const CStudioAnimSeekSection *GetAnimSeekSection( int iAnimation, int iSection, const mstudioanimdesc_t &animdesc, const mstudioanim_t *panim ) const;
+
+private:
+	void PurgeAnimSeekCache();
 
+	mutable CStudioAnimSeekCache	*m_pAnimSeekCache;
+	mutable CThreadFastMutex		m_AnimSeekMutex;
 };
 
 /*
@@ -217,6 +217,14 @@ public:
 	void			WriteBitVec3Normal( const Vector& fa );
 	void			WriteBitAngles( const QAngle& fa );
 
+	// Runs of the above. The bits are identical to calling the single value
+	// version for each element, but room is checked once for the whole run
+	// and the bits are stored through a CBitWriteAccumulator.
+	void			WriteBitAngleArray( const float *pValues, int nCount, int numbits );
+	void			WriteBitCoordArray( const float *pValues, int nCount );
+	void			WriteBitCoordMPArray( const float *pValues, int nCount, bool bIntegral, bool bLowPrecision );
+	void			WriteBitNormalArray( const float *pValues, int nCount );
+
 
 // Byte functions.
 public:
@@ -592,6 +600,12 @@ public:
 	void			ReadBitVec3Normal( Vector& fa );
 	void			ReadBitAngles( QAngle& fa );
 
+	// Runs of the above, matching the bf_write array functions
+	void			ReadBitAngleArray( float *pOut, int nCount, int numbits );
+	void			ReadBitCoordArray( float *pOut, int nCount );
+	void			ReadBitCoordMPArray( float *pOut, int nCount, bool bIntegral, bool bLowPrecision );
+	void			ReadBitNormalArray( float *pOut, int nCount );
+
 	// Faster for comparisons but do not fully decode float values
 	unsigned int	ReadBitCoordBits();
 	unsigned int	ReadBitCoordMPBits( bool bIntegral, bool bLowPrecision );
@@ -803,6 +817,150 @@ BITBUF_INLINE int bf_read::CompareBits( bf_read * RESTRICT other, int numbits )
 }
 
 
+//-----------------------------------------------------------------------------
+// Writes a run of fields into a bf_write through a 64-bit accumulator,
+// storing a dword whenever 32 bits have collected. There are no overflow
+// checks: the caller makes sure the buffer has room for the whole run
+// before starting, and must call Flush() when done.
+//-----------------------------------------------------------------------------
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator( bf_write *pBuf );
+
+	void			WriteUBitLong( unsigned int data, int numbits );
+	void			WriteOneBit( int nValue ) { WriteUBitLong( nValue ? 1 : 0, 1 ); }
+
+	// Stores the partial dword and moves the buffer's write position
+	void			Flush();
+
+private:
+	bf_write		*m_pBuf;
+	unsigned long	*m_pOut;
+	uint64			m_nAccum;
+	int				m_nAccumBits;
+	int				m_iCurBit;
+};
+
+BITBUF_INLINE CBitWriteAccumulator::CBitWriteAccumulator( bf_write *pBuf )
+{
+	extern unsigned long g_ExtraMasks[33];
+
+	m_pBuf = pBuf;
+	m_iCurBit = pBuf->m_iCurBit;
+	m_pOut = &pBuf->m_pData[ m_iCurBit >> 5 ];
+	m_nAccumBits = m_iCurBit & 31;
+
+	// Keep the bits already written to the current dword
+	m_nAccum = m_nAccumBits ? ( LoadLittleDWord( m_pOut, 0 ) & g_ExtraMasks[ m_nAccumBits ] ) : 0;
+}
+
+BITBUF_INLINE void CBitWriteAccumulator::WriteUBitLong( unsigned int data, int numbits )
+{
+	extern unsigned long g_ExtraMasks[33];
+
+	Assert( numbits > 0 && numbits <= 32 );
+	Assert( m_iCurBit + numbits <= m_pBuf->m_nDataBits );
+
+	// Like bf_write::WriteUBitLong, only the low numbits of data are written
+	m_nAccum |= (uint64)( data & g_ExtraMasks[ numbits ] ) << m_nAccumBits;
+	m_nAccumBits += numbits;
+	m_iCurBit += numbits;
+
+	if ( m_nAccumBits >= 32 )
+	{
+		StoreLittleDWord( m_pOut, 0, (unsigned long)m_nAccum );
+		++m_pOut;
+		m_nAccum >>= 32;
+		m_nAccumBits -= 32;
+	}
+}
+
+BITBUF_INLINE void CBitWriteAccumulator::Flush()
+{
+	extern unsigned long g_ExtraMasks[33];
+
+	if ( m_nAccumBits )
+	{
+		// Bits past the write position are left as they were, as bf_write does
+		unsigned long dword = LoadLittleDWord( m_pOut, 0 ) & ~g_ExtraMasks[ m_nAccumBits ];
+		StoreLittleDWord( m_pOut, 0, dword | (unsigned long)m_nAccum );
+	}
+
+	m_pBuf->m_iCurBit = m_iCurBit;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reads a run of fields from a bf_read through a 64-bit accumulator that is
+// refilled a dword at a time. As with CBitWriteAccumulator the caller checks
+// once that the buffer holds enough bits, and calls Finish() when done.
+//-----------------------------------------------------------------------------
+class CBitReadAccumulator
+{
+public:
+	CBitReadAccumulator( bf_read *pBuf );
+
+	unsigned int	ReadUBitLong( int numbits );
+	int				ReadOneBit() { return ReadUBitLong( 1 ); }
+
+	// Moves the buffer's read position past everything read
+	void			Finish();
+
+private:
+	bf_read			*m_pBuf;
+	const unsigned long *m_pIn;
+	uint64			m_nAccum;
+	int				m_nAccumBits;
+	int				m_iCurBit;
+};
+
+BITBUF_INLINE CBitReadAccumulator::CBitReadAccumulator( bf_read *pBuf )
+{
+	m_pBuf = pBuf;
+	m_iCurBit = pBuf->m_iCurBit;
+	m_pIn = (const unsigned long *)pBuf->m_pData + ( m_iCurBit >> 5 );
+	m_nAccum = 0;
+	m_nAccumBits = 0;
+
+	// The current dword has been partly read, so it's in the buffer
+	int iStartBit = m_iCurBit & 31;
+	if ( iStartBit )
+	{
+		m_nAccum = LoadLittleDWord( m_pIn, 0 ) >> iStartBit;
+		m_nAccumBits = 32 - iStartBit;
+		++m_pIn;
+	}
+}
+
+BITBUF_INLINE unsigned int CBitReadAccumulator::ReadUBitLong( int numbits )
+{
+	extern unsigned long g_ExtraMasks[33];
+
+	Assert( numbits > 0 && numbits <= 32 );
+	Assert( m_iCurBit + numbits <= m_pBuf->m_nDataBits );
+
+	// Only touch the next dword once bits from it are needed
+	if ( m_nAccumBits < numbits )
+	{
+		m_nAccum |= (uint64)LoadLittleDWord( m_pIn, 0 ) << m_nAccumBits;
+		m_nAccumBits += 32;
+		++m_pIn;
+	}
+
+	unsigned int data = (unsigned int)m_nAccum & g_ExtraMasks[ numbits ];
+	m_nAccum >>= numbits;
+	m_nAccumBits -= numbits;
+	m_iCurBit += numbits;
+	return data;
+}
+
+BITBUF_INLINE void CBitReadAccumulator::Finish()
+{
+	m_pBuf->m_iCurBit = m_iCurBit;
+}
+
+
 #endif
 
 
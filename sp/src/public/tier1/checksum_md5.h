@@ -44,6 +44,10 @@ char *MD5_Print(unsigned char *digest, int hashlen );
 /// bothering with the context object.
 void MD5_ProcessSingleBuffer( const void *p, int len, MD5Value_t &md5Result );
 
+/// Calculates the MD5 of each of nBuffers separate buffers, several at a time
+/// where the CPU has the SIMD for it. pResults[i] is the MD5 of ppBuffers[i].
+void MD5_ProcessMultipleBuffers( const void * const *ppBuffers, const int *pnLengths, int nBuffers, MD5Value_t *pResults );
+
 unsigned int MD5_PseudoRandom(unsigned int nSeed);
 
 /// Returns true if the values match.
@@ -66,7 +66,7 @@ public:
 	static void SetErrorReportFunc( MemoryPoolReportFunc_t func );
 
 	// returns number of allocated blocks
-	int Count() { return m_BlocksAllocated; }
+	int Count() const { return m_BlocksAllocated; }
 	int PeakCount() { return m_PeakAlloc; }
 
 protected:
@@ -106,24 +106,70 @@ protected:
 
 
 //-----------------------------------------------------------------------------
-// 
+// Purpose: Thread safe pool. Each thread keeps a small magazine of free
+//			blocks per pool and only takes the pool's lock to refill or flush
+//			it a batch at a time, so threads allocating and freeing from the
+//			same pool rarely meet. A block freed on another thread than the
+//			one that allocated it just goes into the freeing thread's
+//			magazine.
+//
+//			Blocks sitting in magazines still count as allocated in Count().
+//			GROW_NONE pools skip the magazines so that one thread can't hold
+//			blocks another one needs.
 //-----------------------------------------------------------------------------
+struct MemoryPoolMTStats_t
+{
+	int		m_nAllocs;
+	int		m_nFrees;
+	int		m_nCached;		// free blocks held in the threads' magazines
+	int		m_nRefills;		// times a magazine went to the pool for blocks
+	int		m_nFlushes;		// times a full magazine gave blocks back
+	int		m_nContended;	// times the pool's lock was already held
+};
+
+struct MemoryPoolMagazine_t;
+
 class CMemoryPoolMT : public CUtlMemoryPool
 {
 public:
-	CMemoryPoolMT(int blockSize, int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, const char *pszAllocOwner = NULL) : CUtlMemoryPool( blockSize, numElements, growMode, pszAllocOwner) {}
+	CMemoryPoolMT( int blockSize, int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, const char *pszAllocOwner = NULL, int nAlignment = 0 );
+	~CMemoryPoolMT();
 
+	void*		Alloc();
+	void*		Alloc( size_t amount );
+	void*		AllocZero();
+	void*		AllocZero( size_t amount );
+	void		Free( void *pMem );
 
-	void*		Alloc()	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Alloc(); }
-	void*		Alloc( size_t amount )	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Alloc( amount ); }
-	void*		AllocZero()	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::AllocZero(); }	
-	void*		AllocZero( size_t amount )	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::AllocZero( amount ); }
-	void		Free(void *pMem) { AUTO_LOCK( m_mutex ); CUtlMemoryPool::Free( pMem ); }
+	// Frees everything. No other thread may be using the pool.
+	void		Clear();
+
+	void		GetStats( MemoryPoolMTStats_t &stats );
+
+	// Gives the calling thread's cached blocks back to every pool in this
+	// module and frees its cache for another thread. Exiting threads do this
+	// on their own; call it from threads that stop using the pools for a
+	// while.
+	static void	FlushThreadCache();
+
+	// Thread caches this module has made, and how many threads hold one
+	static int	GetThreadCacheCount( int *pnInUse = NULL );
+
+	// Prints the stats of every thread safe pool in this module
+	static void	ReportStats( MemoryPoolReportFunc_t func );
 
-	// Frees everything
-	void		Clear() { AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Clear(); }
 private:
-	CThreadFastMutex m_mutex; // @TODO: Rework to use tslist (toml 7/6/2007)
+	MemoryPoolMagazine_t	*GetMagazine();
+	void		Refill( MemoryPoolMagazine_t *pMagazine );
+	void		Flush( MemoryPoolMagazine_t *pMagazine, int nBlocks );
+	void		ReclaimMagazines( bool bFree );
+	void		Lock();
+	void		Unlock()	{ m_mutex.Unlock(); }
+
+	CThreadFastMutex	m_mutex;
+	int					m_iMagazine;	// slot in each thread's cache, -1 when not cached
+	int					m_nBatch;		// blocks moved per refill or flush
+	MemoryPoolMTStats_t	m_Stats;		// shared part, under m_mutex
 };
 
 
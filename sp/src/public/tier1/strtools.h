@@ -58,6 +58,11 @@ int V_stricmp( const char *s1, const char *s2 );
 int	V_strncmp( const char *s1, const char *s2, int count );
 int V_strnicmp( const char *s1, const char *s2, int n );
 
+// Turns the SSE2 paths through the compare, case, search and path functions
+// on or off, for benchmarking and checking them against the byte at a time
+// loops. Returns the previous setting; always false without SSE2.
+bool V_SetStringSIMDEnabled( bool bEnabled );
+
 #ifdef POSIX
 
 inline char *strupr( char *start )
@@ -0,0 +1,654 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Concurrent hash table for lookups shared between threads
+//
+// $NoKeywords: $
+//===========================================================================//
+
+#ifndef UTLCONCURRENTHASH_H
+#define UTLCONCURRENTHASH_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier1/mempool.h"
+#include "tier1/generichash.h"
+#include "tier1/epochreclaimer.h"
+
+
+//=============================================================================
+//
+// Concurrent Hash
+//
+// For tables that are read far more than they're written, from any thread.
+// Open addressing with linear probing over a power of 2 array of pointers to
+// pooled entries.
+//
+// Find() takes no locks and never waits on a writer. Insert() and Remove()
+// lock one of NUM_STRIPES stripes picked by the key's hash, so writers of
+// the same key are serialized, and claim slots with compare-and-swap so
+// writers on other stripes share the array without a table lock. Removing
+// leaves a tombstone that later inserts can reuse.
+//
+// Growing is incremental. Once a table is half used a bigger one is hung off
+// it and new entries go there; every write moves a chunk of the old slots
+// across before doing its own work, and readers look in the old table and
+// then the new one until the last chunk is in.
+//
+// Removed entries and replaced tables are handed to a CEpochReclaimer and
+// freed once no reader can still be looking at them. Values can't be changed
+// in place; Remove() and Insert() to replace one.
+//
+//=============================================================================
+
+// HashItem() only gives 16 bits for most key sizes, which would cap the
+// table at 64K distinct hashes, so keys that fit in 8 bytes hash all of them
+template < class KEYTYPE >
+class CUtlConcurrentHashDefaultFuncs
+{
+public:
+	static uint32 Hash( const KEYTYPE &key )
+	{
+		if ( sizeof( key ) <= 8 )
+			return MurmurHash2( &key, sizeof( key ), 0 );
+		return HashItem( key );
+	}
+
+	static bool Compare( const KEYTYPE &lhs, const KEYTYPE &rhs )
+	{
+		return lhs == rhs;
+	}
+};
+
+template < class KEYTYPE, class T, class HashFuncs = CUtlConcurrentHashDefaultFuncs< KEYTYPE > >
+class CUtlConcurrentHash
+{
+public:
+	CUtlConcurrentHash( int nInitialSlots = 0, int nEntriesPerBlob = 256 );
+	~CUtlConcurrentHash();
+
+	// Retrieval. Lock-free, copies the value out if pData is given
+	bool Find( const KEYTYPE &key, T *pData = NULL ) const;
+	bool HasElement( const KEYTYPE &key ) const	{ return Find( key ); }
+
+	// Retrieval without the copy. Call it with a CEpochReadGuard on Reclaimer()
+	// open; the pointer is good until that guard closes
+	T const *FindInEpoch( const KEYTYPE &key ) const;
+
+	// Find or add. Returns true if data went in, otherwise copies the value
+	// that was already there to pExisting
+	bool Insert( const KEYTYPE &key, const T &data, T *pExisting = NULL );
+
+	// Removal. Safe alongside readers and other writers
+	bool Remove( const KEYTYPE &key );
+	void RemoveAll();
+
+	int Count() const							{ return m_nCount; }
+	int NumSlots() const;
+
+	const CEpochReclaimer &Reclaimer() const	{ return m_Reclaimer; }
+
+	// Frees removed entries and old tables no reader can still see. Writes do
+	// this as they go; call it after a burst of removes to give memory back
+	void Reclaim()								{ m_Reclaimer.TryReclaim(); }
+
+private:
+	enum
+	{
+		STRIPE_BITS = 6,
+		NUM_STRIPES = ( 1 << STRIPE_BITS ),
+		MIGRATE_CHUNK = 64,
+		MIN_SLOTS = 4 * NUM_STRIPES,
+	};
+
+	struct Entry_t
+	{
+		uint32 m_nHash;
+		KEYTYPE m_Key;
+		T m_Data;
+	};
+
+	struct Table_t
+	{
+		int m_nSlots;
+		volatile int m_nUsed;			// entries and tombstones
+		volatile int m_nInserters;		// writers placing entries in this table
+		volatile int m_nMigrateNext;	// first slot no mover has claimed
+		volatile int m_nMigrated;
+		volatile bool m_bDrained;
+		Table_t * volatile m_pNext;
+		Entry_t * volatile m_pSlots[1];
+	};
+
+	struct Stripe_t
+	{
+		CThreadFastMutex m_Mutex;
+		byte m_Pad[ 64 - sizeof( CThreadFastMutex ) ];
+	};
+
+	static Entry_t *Tombstone()					{ return (Entry_t *)1; }
+	static Entry_t *Moved()						{ return (Entry_t *)2; }
+	static bool IsEntry( Entry_t *pSlot )		{ return (uintp)pSlot > 2; }
+	static int StripeIndex( uint32 nHash )		{ return nHash >> ( 32 - STRIPE_BITS ); }
+
+	// Slots come from the low bits and stripes from the top ones, so the
+	// hash funcs' bits are spread over both
+	static uint32 HashKey( const KEYTYPE &key )
+	{
+		uint32 nHash = HashFuncs::Hash( key );
+		nHash ^= nHash >> 16;
+		nHash *= 0x85ebca6b;
+		nHash ^= nHash >> 13;
+		nHash *= 0xc2b2ae35;
+		nHash ^= nHash >> 16;
+		return nHash;
+	}
+
+	// Spin for a bit, then give up the timeslice to whoever we're waiting on
+	static void Backoff( int &nSpins )			{ if ( ++nSpins < 64 ) ThreadPause(); else ThreadSleep( 0 ); }
+
+	Table_t *AllocTable( int nSlots );
+	static void FreeTable( void *pTable, void *pContext );
+	static void FreeEntry( void *pEntry, void *pContext );
+
+	int FindSlot( Table_t *pTable, uint32 nHash, const KEYTYPE &key, Entry_t **ppEntry ) const;
+	Entry_t *FindEntry( uint32 nHash, const KEYTYPE &key ) const;
+	bool PlaceEntry( Table_t *pTable, Entry_t *pEntry );
+	bool InsertEntry( Entry_t *pEntry );
+
+	void StartResize( Table_t *pTable );
+	void HelpResize( bool bFinish );
+	void MigrateSlot( Table_t *pOld, Table_t *pNew, int iSlot );
+
+	Table_t * volatile m_pTable;
+	CInterlockedInt m_nCount;
+	int m_nMinSlots;
+	CMemoryPoolMT m_EntryMemory;
+	CEpochReclaimer m_Reclaimer;
+	Stripe_t m_Stripes[ NUM_STRIPES ];
+};
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::CUtlConcurrentHash( int nInitialSlots, int nEntriesPerBlob ) :
+	m_EntryMemory( sizeof( Entry_t ), nEntriesPerBlob, UTLMEMORYPOOL_GROW_SLOW, MEM_ALLOC_CLASSNAME( Entry_t ) )
+{
+	m_nCount = 0;
+	m_nMinSlots = MIN_SLOTS;
+	while ( m_nMinSlots < nInitialSlots )
+	{
+		m_nMinSlots *= 2;
+	}
+	m_pTable = AllocTable( m_nMinSlots );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Deconstructor. No other thread may be using the table
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::~CUtlConcurrentHash()
+{
+	// An unfinished move leaves each entry in exactly one of the two tables
+	Table_t *pTable = m_pTable;
+	while ( pTable )
+	{
+		for ( int i = 0; i < pTable->m_nSlots; ++i )
+		{
+			if ( IsEntry( pTable->m_pSlots[i] ) )
+			{
+				FreeEntry( pTable->m_pSlots[i], this );
+			}
+		}
+
+		Table_t *pNext = pTable->m_pNext;
+		FreeTable( pTable, NULL );
+		pTable = pNext;
+	}
+
+	m_Reclaimer.ReclaimAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// Tables and entries
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+typename CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::Table_t *CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::AllocTable( int nSlots )
+{
+	int nBytes = sizeof( Table_t ) + ( nSlots - 1 ) * sizeof( Entry_t * );
+	Table_t *pTable = (Table_t *)MemAlloc_AllocAligned( nBytes, 64 );
+	memset( (void *)pTable, 0, nBytes );
+	pTable->m_nSlots = nSlots;
+	return pTable;
+}
+
+template < class KEYTYPE, class T, class HashFuncs >
+void CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::FreeTable( void *pTable, void *pContext )
+{
+	MemAlloc_FreeAligned( pTable );
+}
+
+template < class KEYTYPE, class T, class HashFuncs >
+void CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::FreeEntry( void *pEntry, void *pContext )
+{
+	Entry_t *pFree = (Entry_t *)pEntry;
+	Destruct( &pFree->m_Data );
+	Destruct( &pFree->m_Key );
+	( (CUtlConcurrentHash *)pContext )->m_EntryMemory.Free( pFree );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Probes one table for a key. Empty slots end a probe; tombstones
+//			and moved slots don't, as the key may have gone in past them.
+//			Hands back the entry that matched, since without the stripe the
+//			slot may be a tombstone or moved by the time it's read again
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+int CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::FindSlot( Table_t *pTable, uint32 nHash, const KEYTYPE &key, Entry_t **ppEntry ) const
+{
+	int nMask = pTable->m_nSlots - 1;
+	int iSlot = nHash & nMask;
+	for ( int nProbe = 0; nProbe <= nMask; ++nProbe, iSlot = ( iSlot + 1 ) & nMask )
+	{
+		Entry_t *pEntry = pTable->m_pSlots[ iSlot ];
+		if ( !pEntry )
+			break;
+
+		if ( IsEntry( pEntry ) && pEntry->m_nHash == nHash && HashFuncs::Compare( pEntry->m_Key, key ) )
+		{
+			*ppEntry = pEntry;
+			return iSlot;
+		}
+	}
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks through the current table and any it's being moved into.
+//			A slot is only marked moved once its entry is in the next table,
+//			so an entry is always in one or the other.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+typename CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::Entry_t *CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::FindEntry( uint32 nHash, const KEYTYPE &key ) const
+{
+	for ( Table_t *pTable = m_pTable; pTable; pTable = pTable->m_pNext )
+	{
+		Entry_t *pEntry;
+		if ( FindSlot( pTable, nHash, key, &pEntry ) >= 0 )
+			return pEntry;
+
+		ThreadMemoryBarrier();
+	}
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Retrieval
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+bool CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::Find( const KEYTYPE &key, T *pData ) const
+{
+	uint32 nHash = HashKey( key );
+	CEpochReadGuard guard( m_Reclaimer );
+	Entry_t *pEntry = FindEntry( nHash, key );
+	if ( !pEntry )
+		return false;
+
+	if ( pData )
+	{
+		*pData = pEntry->m_Data;
+	}
+	return true;
+}
+
+template < class KEYTYPE, class T, class HashFuncs >
+T const *CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::FindInEpoch( const KEYTYPE &key ) const
+{
+	Entry_t *pEntry = FindEntry( HashKey( key ), key );
+	return pEntry ? &pEntry->m_Data : NULL;
+}
+
+template < class KEYTYPE, class T, class HashFuncs >
+int CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::NumSlots() const
+{
+	CEpochReadGuard guard( m_Reclaimer );
+	return m_pTable->m_nSlots;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Claims an empty slot, or a tombstone, along the entry's probe.
+//			The caller holds the entry's stripe, so the key isn't already in
+//			the table and nobody else can be placing it.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+bool CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::PlaceEntry( Table_t *pTable, Entry_t *pEntry )
+{
+	int nMask = pTable->m_nSlots - 1;
+	int iSlot = pEntry->m_nHash & nMask;
+	for ( int nProbe = 0; nProbe <= nMask; ++nProbe, iSlot = ( iSlot + 1 ) & nMask )
+	{
+		Entry_t *pSlot = pTable->m_pSlots[ iSlot ];
+		if ( !pSlot )
+		{
+			if ( ThreadInterlockedAssignPointerIf( (void * volatile *)&pTable->m_pSlots[ iSlot ], pEntry, NULL ) )
+			{
+				ThreadInterlockedIncrement( &pTable->m_nUsed );
+				return true;
+			}
+			pSlot = pTable->m_pSlots[ iSlot ];
+		}
+
+		if ( pSlot == Tombstone() && ThreadInterlockedAssignPointerIf( (void * volatile *)&pTable->m_pSlots[ iSlot ], pEntry, Tombstone() ) )
+			return true;
+	}
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Places a new entry in the newest table. Writers count themselves
+//			in before looking for a next table, so a resize can tell when the
+//			last of those who missed it are done with the old one.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+bool CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::InsertEntry( Entry_t *pEntry )
+{
+	Table_t *pTable = m_pTable;
+	for ( ;; )
+	{
+		ThreadInterlockedIncrement( &pTable->m_nInserters );
+		Table_t *pNext = pTable->m_pNext;
+		if ( !pNext )
+			break;
+
+		ThreadInterlockedDecrement( &pTable->m_nInserters );
+		pTable = pNext;
+	}
+
+	bool bPlaced = PlaceEntry( pTable, pEntry );
+	ThreadInterlockedDecrement( &pTable->m_nInserters );
+	return bPlaced;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Insert data into the hash table given its key, unless the key is
+//			already there.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+bool CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::Insert( const KEYTYPE &key, const T &data, T *pExisting )
+{
+	uint32 nHash = HashKey( key );
+	CEpochReadGuard guard( m_Reclaimer );
+	for ( ;; )
+	{
+		HelpResize( false );
+
+		// Make room before taking the stripe: start growing a half used
+		// table, or finish moving into a new one that has filled up meanwhile
+		Table_t *pTable = m_pTable;
+		Table_t *pNext = pTable->m_pNext;
+		if ( !pNext )
+		{
+			if ( pTable->m_nUsed * 2 >= pTable->m_nSlots )
+			{
+				StartResize( pTable );
+				continue;
+			}
+		}
+		else if ( pNext->m_nUsed * 2 >= pNext->m_nSlots )
+		{
+			HelpResize( true );
+			continue;
+		}
+
+		Stripe_t &stripe = m_Stripes[ StripeIndex( nHash ) ];
+		stripe.m_Mutex.Lock();
+
+		Entry_t *pFound = FindEntry( nHash, key );
+		if ( pFound )
+		{
+			if ( pExisting )
+			{
+				*pExisting = pFound->m_Data;
+			}
+			stripe.m_Mutex.Unlock();
+			return false;
+		}
+
+		Entry_t *pEntry = (Entry_t *)m_EntryMemory.Alloc();
+		pEntry->m_nHash = nHash;
+		CopyConstruct( &pEntry->m_Key, key );
+		CopyConstruct( &pEntry->m_Data, data );
+
+		bool bPlaced = InsertEntry( pEntry );
+		if ( bPlaced )
+		{
+			++m_nCount;
+		}
+		stripe.m_Mutex.Unlock();
+
+		if ( bPlaced )
+			return true;
+
+		// Nowhere to put it. Nobody has seen it, so it can go straight away
+		FreeEntry( pEntry, this );
+		HelpResize( true );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Removes a key, leaving a tombstone in its slot
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+bool CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::Remove( const KEYTYPE &key )
+{
+	uint32 nHash = HashKey( key );
+	CEpochReadGuard guard( m_Reclaimer );
+	HelpResize( false );
+
+	Stripe_t &stripe = m_Stripes[ StripeIndex( nHash ) ];
+	stripe.m_Mutex.Lock();
+
+	Entry_t *pRemoved = NULL;
+	for ( Table_t *pTable = m_pTable; pTable; pTable = pTable->m_pNext )
+	{
+		int iSlot = FindSlot( pTable, nHash, key, &pRemoved );
+		if ( iSlot >= 0 )
+		{
+			pTable->m_pSlots[ iSlot ] = Tombstone();
+			--m_nCount;
+			break;
+		}
+	}
+
+	stripe.m_Mutex.Unlock();
+
+	if ( !pRemoved )
+		return false;
+
+	m_Reclaimer.Retire( pRemoved, &FreeEntry, this );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Remove all elements from the hash. Holding every stripe, hangs an
+//			empty table off the current one as a resize would and makes it
+//			current; readers already in the old table may still see its
+//			entries until they leave.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+void CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::RemoveAll()
+{
+	CEpochReadGuard guard( m_Reclaimer );
+	for ( ;; )
+	{
+		HelpResize( true );
+
+		for ( int i = 0; i < NUM_STRIPES; ++i )
+		{
+			m_Stripes[i].m_Mutex.Lock();
+		}
+
+		Table_t *pTable = m_pTable;
+		Table_t *pEmpty = AllocTable( m_nMinSlots );
+		bool bSwapped = ThreadInterlockedAssignPointerIf( (void * volatile *)&pTable->m_pNext, pEmpty, NULL );
+		if ( bSwapped )
+		{
+			// Movers that picked up these slots will find tombstones once
+			// they get a stripe
+			for ( int i = 0; i < pTable->m_nSlots; ++i )
+			{
+				Entry_t *pEntry = pTable->m_pSlots[i];
+				if ( IsEntry( pEntry ) )
+				{
+					pTable->m_pSlots[i] = Tombstone();
+					m_Reclaimer.Retire( pEntry, &FreeEntry, this );
+				}
+			}
+
+			m_nCount = 0;
+			if ( ThreadInterlockedAssignPointerIf( (void * volatile *)&m_pTable, pEmpty, pTable ) )
+			{
+				m_Reclaimer.Retire( pTable, &FreeTable );
+			}
+		}
+
+		for ( int i = NUM_STRIPES - 1; i >= 0; --i )
+		{
+			m_Stripes[i].m_Mutex.Unlock();
+		}
+
+		if ( bSwapped )
+			return;
+
+		// A resize got in first; finish it and go again
+		FreeTable( pEmpty, NULL );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Hangs a new table off pTable, sized for four times the entries
+//			there are now. A table heavy with tombstones may get no bigger.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+void CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::StartResize( Table_t *pTable )
+{
+	// Each stripe may have one entry on its way into the old table
+	int nSlots = m_nMinSlots;
+	while ( nSlots < 4 * ( m_nCount + NUM_STRIPES ) )
+	{
+		nSlots *= 2;
+	}
+
+	Table_t *pNew = AllocTable( nSlots );
+	if ( !ThreadInterlockedAssignPointerIf( (void * volatile *)&pTable->m_pNext, pNew, NULL ) )
+	{
+		FreeTable( pNew, NULL );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves a chunk of the current table into the next one, if there's
+//			a resize on, or with bFinish the rest of it and waits for it to be
+//			done. Call it without holding a stripe.
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+void CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::HelpResize( bool bFinish )
+{
+	Table_t *pOld = m_pTable;
+	Table_t *pNew = pOld->m_pNext;
+	if ( !pNew )
+		return;
+
+	// Writers that started placing into the old table before the new one
+	// appeared have to be done before its slots can be moved
+	int nSpins = 0;
+	if ( !pOld->m_bDrained )
+	{
+		ThreadMemoryBarrier();
+		while ( pOld->m_nInserters != 0 )
+		{
+			if ( !bFinish )
+				return;
+
+			Backoff( nSpins );
+		}
+		pOld->m_bDrained = true;
+	}
+
+	for ( ;; )
+	{
+		int iStart = ThreadInterlockedExchangeAdd( &pOld->m_nMigrateNext, (int)MIGRATE_CHUNK );
+		if ( iStart >= pOld->m_nSlots )
+			break;
+
+		int iEnd = MIN( iStart + (int)MIGRATE_CHUNK, pOld->m_nSlots );
+		for ( int iSlot = iStart; iSlot < iEnd; ++iSlot )
+		{
+			MigrateSlot( pOld, pNew, iSlot );
+		}
+
+		if ( ThreadInterlockedExchangeAdd( &pOld->m_nMigrated, iEnd - iStart ) + ( iEnd - iStart ) == pOld->m_nSlots )
+		{
+			// Last chunk in; the new table takes over
+			if ( ThreadInterlockedAssignPointerIf( (void * volatile *)&m_pTable, pNew, pOld ) )
+			{
+				m_Reclaimer.Retire( pOld, &FreeTable );
+			}
+			break;
+		}
+
+		if ( !bFinish )
+			break;
+	}
+
+	if ( bFinish )
+	{
+		// Others may still be moving chunks they claimed
+		while ( m_pTable == pOld )
+		{
+			Backoff( nSpins );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves one slot's entry under its stripe, so a remove of the same
+//			key can't slip between the copy and the mark
+//-----------------------------------------------------------------------------
+template < class KEYTYPE, class T, class HashFuncs >
+void CUtlConcurrentHash<KEYTYPE,T,HashFuncs>::MigrateSlot( Table_t *pOld, Table_t *pNew, int iSlot )
+{
+	Entry_t *pEntry = pOld->m_pSlots[ iSlot ];
+	if ( !IsEntry( pEntry ) )
+		return;
+
+	Stripe_t &stripe = m_Stripes[ StripeIndex( pEntry->m_nHash ) ];
+	stripe.m_Mutex.Lock();
+	if ( pOld->m_pSlots[ iSlot ] == pEntry )
+	{
+		Verify( PlaceEntry( pNew, pEntry ) );
+		ThreadMemoryBarrier();
+		pOld->m_pSlots[ iSlot ] = Moved();
+	}
+	stripe.m_Mutex.Unlock();
+}
+
+
+#endif // UTLCONCURRENTHASH_H
@@ -22,6 +22,8 @@
 // forward declarations
 //-----------------------------------------------------------------------------
 class CUtlSymbolTable;
+class CUtlHashSymbolTable;
+class CUtlHashSymbolTableMT;
 class CUtlSymbolTableMT;
 
 
@@ -67,10 +69,10 @@ protected:
 	static void Initialize();
 	
 	// returns the current symbol table
-	static CUtlSymbolTableMT* CurrTable();
+	static CUtlHashSymbolTableMT* CurrTable();
 		
 	// The standard global symbol table
-	static CUtlSymbolTableMT* s_pSymbolTable; 
+	static CUtlHashSymbolTableMT* s_pSymbolTable; 
 
 	static bool s_bAllowStaticSymbolTable;
 
@@ -171,6 +173,124 @@ private:
 	friend class CLess;
 };
 
+
+//-----------------------------------------------------------------------------
+// CUtlHashSymbolTable:
+// description:
+//    Same interface and ids as CUtlSymbolTable (ids are handed out in
+//    insertion order), but strings are found through an open addressing
+//    hash instead of a tree of string compares. Find and String may be
+//    called from any number of threads while a single thread calls
+//    AddString: nothing a reader can reach is moved or freed before
+//    RemoveAll.
+//-----------------------------------------------------------------------------
+class CUtlHashSymbolTable
+{
+public:
+	// constructor, destructor
+	CUtlHashSymbolTable( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlHashSymbolTable();
+
+	// Finds and/or creates a symbol based on the string
+	CUtlSymbol AddString( const char* pString );
+
+	// Finds the symbol for pString
+	CUtlSymbol Find( const char* pString ) const;
+
+	// Look up the string associated with a particular symbol
+	const char* String( CUtlSymbol id ) const;
+
+	// Remove all symbols in the table. Not safe with concurrent readers.
+	void  RemoveAll();
+
+	int GetNumStrings( void ) const
+	{
+		return m_nStrings;
+	}
+
+private:
+	enum
+	{
+		PAGE_BITS = 8,
+		PAGE_SIZE = 1 << PAGE_BITS,
+		MAX_STRINGS = UTL_INVAL_SYMBOL,
+		MAX_PAGES = ( MAX_STRINGS + PAGE_SIZE - 1 ) / PAGE_SIZE,
+	};
+
+	// Each slot is the top 16 bits of the string's hash and its id + 1, or
+	// 0 when empty
+	struct Table_t
+	{
+		uint32 m_nMask;
+		uint32 m_Slots[1];
+	};
+
+	uint32 HashString( const char *pString ) const;
+	UtlSymId_t FindInTable( const Table_t *pTable, const char *pString, uint32 nHash ) const;
+	static void InsertIntoTable( Table_t *pTable, uint32 nHash, UtlSymId_t id );
+	static Table_t *AllocTable( int nSlots );
+	Table_t *GrowTable( const Table_t *pTable ) const;
+	const char *CopyString( const char *pString );
+
+	Table_t * volatile m_pTable;
+	const char ** volatile m_pPages[MAX_PAGES];	// id -> string, pages never move
+	volatile int m_nStrings;
+	bool m_bInsensitive;
+
+	// Writer only
+	CUtlVector<Table_t*> m_RetiredTables;		// outgrown, but readers may still be in them
+	CUtlVector<char*> m_StringPools;
+	char *m_pPoolSpace;
+	int m_nPoolSpaceLeft;
+};
+
+//-----------------------------------------------------------------------------
+// CUtlHashSymbolTableMT:
+// description:
+//    Thread safe hashed symbol table. Lookups don't lock; AddString only
+//    locks when the string isn't in the table yet.
+//-----------------------------------------------------------------------------
+class CUtlHashSymbolTableMT : private CUtlHashSymbolTable
+{
+public:
+	CUtlHashSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false )
+		: CUtlHashSymbolTable( growSize, initSize, caseInsensitive )
+	{
+	}
+
+	CUtlSymbol AddString( const char* pString )
+	{
+		CUtlSymbol result = CUtlHashSymbolTable::Find( pString );
+		if ( !result.IsValid() && pString )
+		{
+			m_lock.Lock();
+			result = CUtlHashSymbolTable::AddString( pString );
+			m_lock.Unlock();
+		}
+		return result;
+	}
+
+	CUtlSymbol Find( const char* pString ) const
+	{
+		return CUtlHashSymbolTable::Find( pString );
+	}
+
+	const char* String( CUtlSymbol id ) const
+	{
+		return CUtlHashSymbolTable::String( id );
+	}
+	
+private:
+	CThreadFastMutex m_lock;
+};
+
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT:
+// description:
+//    Thread safe tree symbol table. Prebuilt libraries (dmxloader) have
+//    static instances of this with its layout and inline bodies compiled in,
+//    so it has to stay as it is; new code wants CUtlHashSymbolTableMT.
+//-----------------------------------------------------------------------------
 class CUtlSymbolTableMT : private CUtlSymbolTable
 {
 public:
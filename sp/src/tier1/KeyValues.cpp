@@ -18,6 +18,7 @@
 #include <KeyValues.h>
 #include "filesystem.h"
 #include <vstdlib/IKeyValuesSystem.h>
+#include "tier0/icommandline.h"
 
 #include <Color.h>
 #include <stdlib.h>
@@ -26,8 +27,22 @@
 #include "utlvector.h"
 #include "utlbuffer.h"
 #include "utlhash.h"
+#include "utlhashtable.h"
 #include "UtlSortVector.h"
+#include "utlmap.h"
 #include "convar.h"
+#include "checksum_crc.h"
+#include "tier0/threadtools.h"
+#include "utlconcurrenthash.h"
+#include "epochreclaimer.h"
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#define KEYVALUES_SIMD_SCAN
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -40,6 +55,21 @@ const char *(*KeyValues::s_pfGetStringForSymbol)( int symbol ) = &KeyValues::Get
 CKeyValuesGrowableStringTable *KeyValues::s_pGrowableStringTable = NULL;
 
 #define KEYVALUES_TOKEN_SIZE	4096
+
+#define KEYVALUES_COMPILED_ID				MAKEID( 'K', 'V', 'C', '1' )
+#define KEYVALUES_COMPILED_VERSION			2
+#define KEYVALUES_COMPILED_EXTENSION		".kvc"
+
+#define KEYVALUES_COMPILED_ESCAPES			0x1
+#define KEYVALUES_COMPILED_CONDITIONALS		0x2
+
+// Lookups that walk at least this many children give the node a hashed index
+#define KEYVALUES_INDEX_THRESHOLD			32
+
+#define KEYVALUES_INDEX_PARENT				0x1		// has an entry in the child index tables
+#define KEYVALUES_INDEX_CHILD				0x2		// is referenced by its parent's index
+#define KEYVALUES_INDEX_SHARED				0x4		// edited behind our index, never index it again
+
 static char s_pTokenBuf[KEYVALUES_TOKEN_SIZE];
 
 
@@ -449,8 +479,7 @@ void KeyValues::Init()
 	m_bHasEscapeSequences = false;
 	m_bEvaluateConditionals = true;
 
-	// for future proof
-	memset( unused, 0, sizeof(unused) );
+	m_nChildIndexFlags = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -468,6 +497,8 @@ KeyValues::~KeyValues()
 //-----------------------------------------------------------------------------
 void KeyValues::RemoveEverything()
 {
+	DestroyChildIndex();
+
 	KeyValues *dat;
 	KeyValues *datNext = NULL;
 	for ( dat = m_pSub; dat != NULL; dat = datNext )
@@ -518,6 +549,197 @@ const char *KeyValues::GetName( void ) const
 	return s_pfGetStringForSymbol( m_iKeyName );
 }
 
+//-----------------------------------------------------------------------------
+// Scanners for the in-memory tokenizer. Whitespace is what isspace() accepts
+// in the C locale, to match CUtlBuffer::EatWhiteSpace.
+//-----------------------------------------------------------------------------
+static inline bool IsKeyValuesSpace( unsigned char c )
+{
+	return c == ' ' || ( c >= '\t' && c <= '\r' );
+}
+
+static inline bool IsKeyValuesTokenEnd( unsigned char c )
+{
+	return c == 0 || c == '"' || c == '{' || c == '}' || IsKeyValuesSpace( c );
+}
+
+// Can strtol or strtod consume anything starting at this character?
+static inline bool IsKeyValuesNumberStart( unsigned char c )
+{
+	return ( c >= '0' && c <= '9' ) || c == '-' || c == '+' || c == '.' ||
+		c == 'i' || c == 'I' || c == 'n' || c == 'N' || IsKeyValuesSpace( c );
+}
+
+#ifdef KEYVALUES_SIMD_SCAN
+static FORCEINLINE int LowestBit( int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+
+// Bit i is set where byte i is whitespace
+static FORCEINLINE int SpaceMask( __m128i v )
+{
+	__m128i spaces = _mm_cmpeq_epi8( v, _mm_set1_epi8( ' ' ) );
+	__m128i ctrl = _mm_sub_epi8( v, _mm_set1_epi8( '\t' ) );
+	ctrl = _mm_cmpeq_epi8( _mm_min_epu8( ctrl, _mm_set1_epi8( '\r' - '\t' ) ), ctrl );
+	return _mm_movemask_epi8( _mm_or_si128( spaces, ctrl ) );
+}
+#endif
+
+static const char *SkipKeyValuesSpace( const char *p, const char *pEnd )
+{
+#ifdef KEYVALUES_SIMD_SCAN
+	while ( pEnd - p >= 16 )
+	{
+		int nMask = ~SpaceMask( _mm_loadu_si128( (const __m128i *)p ) ) & 0xFFFF;
+		if ( nMask )
+			return p + LowestBit( nMask );
+		p += 16;
+	}
+#endif
+	while ( p < pEnd && IsKeyValuesSpace( *p ) )
+	{
+		++p;
+	}
+	return p;
+}
+
+static const char *FindKeyValuesTokenEnd( const char *p, const char *pEnd )
+{
+#ifdef KEYVALUES_SIMD_SCAN
+	while ( pEnd - p >= 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)p );
+		__m128i stop = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi8( v, _mm_setzero_si128() ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '"' ) ) ),
+			_mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( '{' ) ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '}' ) ) ) );
+		int nMask = _mm_movemask_epi8( stop ) | SpaceMask( v );
+		if ( nMask )
+			return p + LowestBit( nMask );
+		p += 16;
+	}
+#endif
+	while ( p < pEnd && !IsKeyValuesTokenEnd( *p ) )
+	{
+		++p;
+	}
+	return p;
+}
+
+// Finds the closing quote or the first escape character, whichever is first
+static const char *FindKeyValuesQuoteEnd( const char *p, const char *pEnd, char cEscape )
+{
+#ifdef KEYVALUES_SIMD_SCAN
+	__m128i quote = _mm_set1_epi8( '"' );
+	__m128i escape = _mm_set1_epi8( cEscape );
+	while ( pEnd - p >= 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)p );
+		int nMask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, quote ), _mm_cmpeq_epi8( v, escape ) ) );
+		if ( nMask )
+			return p + LowestBit( nMask );
+		p += 16;
+	}
+#endif
+	while ( p < pEnd && *p != '"' && *p != cEscape )
+	{
+		++p;
+	}
+	return p;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads a token straight out of the buffer's memory. Gives the same
+//			results as the CUtlBuffer walk in ReadToken, which it falls back to
+//			for quoted strings with escape characters in them.
+//-----------------------------------------------------------------------------
+static const char *ReadTokenFromMemory( CUtlBuffer &buf, const char *pBase, int nSize, CUtlCharConversion *pConv, bool &wasQuoted, bool &wasConditional, bool &bFallback )
+{
+	const char *pEnd = pBase + nSize;
+	const char *p = pBase;
+	bFallback = false;
+
+	// eating white spaces and remarks loop
+	while ( true )
+	{
+		p = SkipKeyValuesSpace( p, pEnd );
+		if ( p == pEnd )
+		{
+			// The buffer walk runs off the end here and invalidates the buffer
+			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nSize );
+			buf.EatWhiteSpace();
+			return NULL;
+		}
+
+		if ( pEnd - p < 2 || p[0] != '/' || p[1] != '/' )
+			break;
+
+		const char *pNewLine = (const char *)memchr( p + 2, '\n', pEnd - p - 2 );
+		if ( !pNewLine )
+		{
+			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nSize );
+			buf.EatWhiteSpace();
+			return NULL;
+		}
+		p = pNewLine + 1;
+	}
+
+	if ( *p == '"' )
+	{
+		wasQuoted = true;
+		const char *pClose = FindKeyValuesQuoteEnd( p + 1, pEnd, pConv->GetEscapeChar() );
+		if ( pClose == pEnd || *pClose != '"' )
+		{
+			// Escape sequence or unterminated string, let CUtlBuffer handle it
+			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, p - pBase );
+			bFallback = true;
+			return NULL;
+		}
+
+		int nLength = MIN( (int)( pClose - p - 1 ), KEYVALUES_TOKEN_SIZE - 1 );
+		V_memcpy( s_pTokenBuf, p + 1, nLength );
+		s_pTokenBuf[nLength] = 0;
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, pClose + 1 - pBase );
+		return s_pTokenBuf;
+	}
+
+	if ( *p == '{' || *p == '}' )
+	{
+		// it's a control char, just add this one char and stop reading
+		s_pTokenBuf[0] = *p;
+		s_pTokenBuf[1] = 0;
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, p + 1 - pBase );
+		return s_pTokenBuf;
+	}
+
+	// read in the token until we hit a whitespace or a control character
+	const char *pTokenEnd = FindKeyValuesTokenEnd( p, pEnd );
+	int nLength = pTokenEnd - p;
+
+	const char *pOpen = (const char *)memchr( p, '[', nLength );
+	if ( pOpen && memchr( pOpen + 1, ']', pTokenEnd - pOpen - 1 ) )
+	{
+		wasConditional = true;
+	}
+
+	if ( nLength > KEYVALUES_TOKEN_SIZE - 1 )
+	{
+		nLength = KEYVALUES_TOKEN_SIZE - 1;
+		g_KeyValuesErrorStack.ReportError(" ReadToken overflow" );
+	}
+
+	V_memcpy( s_pTokenBuf, p, nLength );
+	s_pTokenBuf[nLength] = 0;
+	buf.SeekGet( CUtlBuffer::SEEK_CURRENT, pTokenEnd - pBase );
+	return s_pTokenBuf;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Read a single token from buffer (0 terminated)
 //-----------------------------------------------------------------------------
@@ -530,6 +752,21 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	if ( !buf.IsValid() )
 		return NULL; 
 
+	// Text that's already in memory is scanned in place
+	int nRemaining = buf.GetBytesRemaining();
+	const char *pMemory = ( buf.IsText() && nRemaining > 0 ) ? (const char *)buf.PeekGet( nRemaining, 0 ) : NULL;
+	if ( pMemory )
+	{
+		bool bFallback;
+		CUtlCharConversion *pConv = m_bHasEscapeSequences ? GetCStringCharConversion() : GetNoEscCharConversion();
+		const char *pToken = ReadTokenFromMemory( buf, pMemory, nRemaining, pConv, wasQuoted, wasConditional, bFallback );
+		if ( !bFallback )
+			return pToken;
+
+		buf.GetDelimitedString( pConv, s_pTokenBuf, KEYVALUES_TOKEN_SIZE );
+		return s_pTokenBuf;
+	}
+
 	// eating white spaces and remarks loop
 	while ( true )
 	{
@@ -654,7 +891,39 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 
 	filesystem->Close( f );	// close file after reading
 
-	if ( bRetOK )
+	// The compiled form lives next to the text and isn't covered by sv_pure, so
+	// it's opt-in. It is only used when it was built from exactly this text.
+	static bool s_bCompiledEnabled = !!CommandLine()->FindParm( "-keyvalues_compiled" );
+	const bool bUseCompiled = s_bCompiledEnabled && pathID != NULL && !m_pSub && !m_pPeer;
+
+	if ( bRetOK && bUseCompiled )
+	{
+		buffer[fileSize] = 0; // null terminate file as EOF
+		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
+
+		CRC32_t textCRC = CRC32_ProcessSingleBuffer( buffer, fileSize );
+		char szCompiled[MAX_PATH];
+		V_snprintf( szCompiled, sizeof( szCompiled ), "%s" KEYVALUES_COMPILED_EXTENSION, resourceName );
+
+		CUtlBuffer compiled;
+		if ( !filesystem->ReadFile( szCompiled, pathID, compiled ) || !ReadAsCompiled( compiled, fileSize, textCRC ) )
+		{
+			bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+			// #include and #base pull in files the CRC doesn't cover, and Unicode
+			// text would hide them from the search
+			bool bUnicode = fileSize > 2 && (uint8)buffer[0] == 0xFF && (uint8)buffer[1] == 0xFE;
+			if ( bRetOK && !bUnicode && !V_stristr( buffer, "#include" ) && !V_stristr( buffer, "#base" ) )
+			{
+				compiled.Purge();
+				if ( WriteAsCompiled( compiled, fileSize, textCRC ) )
+				{
+					filesystem->WriteFile( szCompiled, pathID, compiled );
+				}
+			}
+		}
+	}
+	else if ( bRetOK )
 	{
 		buffer[fileSize] = 0; // null terminate file as EOF
 		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
@@ -877,17 +1146,415 @@ void KeyValues::SaveKeyToFile( KeyValues *dat, IBaseFileSystem *filesystem, File
 				char buf[48];
 				Q_snprintf(buf, sizeof( buf ), "%f", dat->m_flValue);
 
-				INTERNALWRITE(buf, Q_strlen(buf));
-				INTERNALWRITE("\"\n", 2);
-				break;
+				INTERNALWRITE(buf, Q_strlen(buf));
+				INTERNALWRITE("\"\n", 2);
+				break;
+			}
+		case TYPE_COLOR:
+			DevMsg(1, "KeyValues::RecursiveSaveToFile: TODO, missing code for TYPE_COLOR.\n");
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Child index. Nodes with many children (sound scripts, item schemas, big
+// lists) get a symbol to first child hash so lookups don't walk the list.
+// The sibling list is still the real data and iteration order comes from
+// it; the index is only trusted while its first child still matches the
+// list and none of its children was renamed or relinked behind its back.
+// Checking it never follows a pointer the index holds, and appends find the
+// tail by walking the list.
+//
+// Lookups take no locks. Indices are published in a concurrent hash, and one
+// that's dropped while a reader may still hold it is retired to an epoch
+// reclaimer. Building, dropping and the child to parent map, which lets a
+// rename find the index it breaks, are serialized by one mutex.
+//
+// Each module has its own copy of this code and its own tables, and engine
+// binaries built before the index can edit our nodes without knowing about
+// it. So every so often the list is walked and checked against the index;
+// the walk costs no more than the lookups made since the last one. A node
+// that fails the check, or whose hit has lost its name, was edited by code
+// that can't see the index, maybe freeing children the index still points
+// to, so it's never indexed again and its lookups walk the list like they
+// used to.
+//-----------------------------------------------------------------------------
+struct KeyValuesChildIndex_t
+{
+	CUtlHashtable< int, KeyValues * >	m_Children;		// first child with each name
+	KeyValues							*m_pFirst;
+	KeyValues							*m_pLast;		// only compared, the list may have freed it
+	int									m_nCount;
+	int									m_nValidGeneration;
+	CInterlockedInt						m_nGeneration;	// bumped when a child is renamed or relinked
+	CInterlockedInt						m_nLookups;		// since the list was last checked
+};
+
+struct KeyValuesChildIndexTables_t
+{
+	CUtlConcurrentHash< const KeyValues *, KeyValuesChildIndex_t * >	m_Indices;
+	CUtlHashtable< const KeyValues *, const KeyValues * >			m_Parents;	// indexed child to parent
+	CThreadFastMutex												m_Mutex;
+	CEpochReclaimer													m_Reclaimer;
+};
+
+// Allocated on first use and never freed, so static KeyValues can still be
+// destroyed safely at shutdown
+static KeyValuesChildIndexTables_t * volatile s_pChildIndexTables;
+
+static KeyValuesChildIndexTables_t *GetChildIndexTables()
+{
+	if ( !s_pChildIndexTables )
+	{
+		KeyValuesChildIndexTables_t *pTables = new KeyValuesChildIndexTables_t;
+		if ( ThreadInterlockedCompareExchangePointer( (void * volatile *)&s_pChildIndexTables, pTables, NULL ) != NULL )
+		{
+			delete pTables;
+		}
+	}
+	return s_pChildIndexTables;
+}
+
+static void FreeChildIndex( void *pIndex, void *pContext )
+{
+	delete (KeyValuesChildIndex_t *)pIndex;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns our index if it still matches the list. pExpectedLast is
+//			the last child, found by walking the list, or NULL if unknown.
+//			Must be called with a CEpochReadGuard open on the reclaimer.
+//-----------------------------------------------------------------------------
+KeyValuesChildIndex_t *KeyValues::GetChildIndex( KeyValues *pExpectedLast ) const
+{
+	if ( !( m_nChildIndexFlags & KEYVALUES_INDEX_PARENT ) || !s_pChildIndexTables )
+		return NULL;
+
+	KeyValuesChildIndex_t *pIndex = NULL;
+	if ( !s_pChildIndexTables->m_Indices.Find( this, &pIndex ) )
+		return NULL;
+
+	// Renames and relinks by code that knows about the index only bump the
+	// generation; anything else means the list was edited behind our back
+	bool bShared = pIndex->m_pFirst != m_pSub || ( pExpectedLast && pIndex->m_pLast != pExpectedLast );
+	if ( !bShared && ++pIndex->m_nLookups >= pIndex->m_nCount )
+	{
+		pIndex->m_nLookups = 0;
+		bShared = !ChildIndexMatchesList( pIndex );
+	}
+
+	if ( bShared || pIndex->m_nGeneration != pIndex->m_nValidGeneration )
+	{
+		DestroyChildIndex( pIndex, bShared );
+		return NULL;
+	}
+
+	return pIndex;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Walks the list and checks every child against the index: its name
+//			must be indexed, the first child with each name must be the one
+//			indexed, and the count must match. Only the list's own nodes are
+//			read, so every indexed child has to turn up in it.
+//-----------------------------------------------------------------------------
+bool KeyValues::ChildIndexMatchesList( KeyValuesChildIndex_t *pIndex ) const
+{
+	CUtlHashtable< int > seen;
+	seen.Reserve( pIndex->m_Children.Count() );
+
+	int nCount = 0;
+	for ( KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer, ++nCount )
+	{
+		KeyValues *pFirst = pIndex->m_Children.Get( dat->m_iKeyName, NULL );
+		if ( !pFirst )
+			return false;
+
+		// The indexed child has to come before any other with its name
+		if ( pFirst == dat )
+		{
+			seen.Insert( dat->m_iKeyName );
+		}
+		else if ( seen.Find( dat->m_iKeyName ) == seen.InvalidHandle() )
+		{
+			return false;
+		}
+
+		if ( nCount >= pIndex->m_nCount )
+			return false;
+	}
+
+	return nCount == pIndex->m_nCount && seen.Count() == pIndex->m_Children.Count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks a child up through the index. Returns false if there's no
+//			index, in which case the caller has to walk the list.
+//-----------------------------------------------------------------------------
+bool KeyValues::FindKeyInChildIndex( int keySymbol, KeyValues *&pFound ) const
+{
+	if ( !( m_nChildIndexFlags & KEYVALUES_INDEX_PARENT ) || !s_pChildIndexTables )
+		return false;
+
+	CEpochReadGuard guard( s_pChildIndexTables->m_Reclaimer );
+	KeyValuesChildIndex_t *pIndex = GetChildIndex( NULL );
+	if ( !pIndex )
+		return false;
+
+	// A child renamed behind our back gives the node away too
+	pFound = pIndex->m_Children.Get( keySymbol, NULL );
+	if ( pFound && pFound->m_iKeyName != keySymbol )
+	{
+		DestroyChildIndex( pIndex, true );
+		return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the index from the list. Const because it's only a cache;
+//			lookups build it once they've walked far enough.
+//-----------------------------------------------------------------------------
+void KeyValues::BuildChildIndex() const
+{
+	if ( !m_pSub || ( m_nChildIndexFlags & KEYVALUES_INDEX_SHARED ) )
+		return;
+
+	KeyValuesChildIndexTables_t *pTables = GetChildIndexTables();
+
+	// Filled in before it's published, so readers only see finished indices
+	KeyValuesChildIndex_t *pIndex = new KeyValuesChildIndex_t;
+	pIndex->m_nCount = 0;
+	for ( KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		++pIndex->m_nCount;
+	}
+	pIndex->m_Children.Reserve( pIndex->m_nCount );
+
+	// Insert keeps the existing entry, so duplicate names resolve to the
+	// first child like the walk does
+	for ( KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		pIndex->m_Children.Insert( dat->m_iKeyName, dat );
+		pIndex->m_pLast = dat;
+	}
+
+	pIndex->m_pFirst = m_pSub;
+	pIndex->m_nValidGeneration = 0;
+	pIndex->m_nGeneration = 0;
+	pIndex->m_nLookups = 0;
+
+	AUTO_LOCK( pTables->m_Mutex );
+	KeyValuesChildIndex_t *pExisting = NULL;
+	if ( !pTables->m_Indices.Insert( this, pIndex, &pExisting ) )
+	{
+		// Another reader built one first
+		if ( m_nChildIndexFlags & KEYVALUES_INDEX_PARENT )
+		{
+			delete pIndex;
+			return;
+		}
+
+		// Left behind when our flag was cleared by another module's code
+		ReleaseChildIndex( pExisting );
+		pTables->m_Indices.Insert( this, pIndex );
+	}
+
+	for ( KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		dat->m_nChildIndexFlags |= KEYVALUES_INDEX_CHILD;
+		pTables->m_Parents[ pTables->m_Parents.Insert( dat, this ) ] = this;
+	}
+	m_nChildIndexFlags |= KEYVALUES_INDEX_PARENT;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops our index. If pExpected is given, only if that's still the
+//			one published, so readers that find the same stale index drop it
+//			once between them. bShared stops us ever building another.
+//-----------------------------------------------------------------------------
+void KeyValues::DestroyChildIndex( KeyValuesChildIndex_t *pExpected, bool bShared ) const
+{
+	if ( !( m_nChildIndexFlags & KEYVALUES_INDEX_PARENT ) || !s_pChildIndexTables )
+		return;
+
+	AUTO_LOCK( s_pChildIndexTables->m_Mutex );
+	if ( bShared )
+	{
+		m_nChildIndexFlags |= KEYVALUES_INDEX_SHARED;
+	}
+
+	KeyValuesChildIndex_t *pIndex = NULL;
+	bool bFound = s_pChildIndexTables->m_Indices.Find( this, &pIndex );
+	if ( pExpected && pIndex != pExpected )
+		return;
+
+	m_nChildIndexFlags &= ~KEYVALUES_INDEX_PARENT;
+	if ( bFound )
+	{
+		ReleaseChildIndex( pIndex );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Unpublishes an index, lets go of the children it marked, and
+//			retires it. Must be called with the tables' mutex held.
+//-----------------------------------------------------------------------------
+void KeyValues::ReleaseChildIndex( KeyValuesChildIndex_t *pIndex ) const
+{
+	KeyValuesChildIndexTables_t *pTables = s_pChildIndexTables;
+	pTables->m_Indices.Remove( this );
+
+	for ( KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		UtlHashHandle_t hParent = pTables->m_Parents.Find( dat );
+		if ( hParent != pTables->m_Parents.InvalidHandle() && pTables->m_Parents[hParent] == this )
+		{
+			pTables->m_Parents.RemoveAndAdvance( hParent );
+			dat->m_nChildIndexFlags &= ~KEYVALUES_INDEX_CHILD;
+		}
+	}
+
+	pTables->m_Reclaimer.Retire( pIndex, FreeChildIndex );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tells our parent's index that we were renamed or relinked
+//-----------------------------------------------------------------------------
+void KeyValues::InvalidateParentChildIndex() const
+{
+	if ( !s_pChildIndexTables )
+		return;
+
+	AUTO_LOCK( s_pChildIndexTables->m_Mutex );
+	const KeyValues *pParent = s_pChildIndexTables->m_Parents.Get( this, NULL );
+	KeyValuesChildIndex_t *pIndex = NULL;
+	if ( pParent && s_pChildIndexTables->m_Indices.Find( pParent, &pIndex ) )
+	{
+		++pIndex->m_nGeneration;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Appends pSubkey after pLastChild, or as the first child if
+//			pLastChild is NULL
+//-----------------------------------------------------------------------------
+void KeyValues::LinkSubKeyToList( KeyValues *pSubkey, KeyValues *pLastChild )
+{
+	if ( pLastChild )
+	{
+		pLastChild->m_pPeer = pSubkey;
+	}
+	else
+	{
+		m_pSub = pSubkey;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Appends pSubkey after pLastChild, or as the first child if
+//			pLastChild is NULL, and adds it to the index
+//-----------------------------------------------------------------------------
+void KeyValues::LinkSubKey( KeyValues *pSubkey, KeyValues *pLastChild )
+{
+	if ( !( m_nChildIndexFlags & KEYVALUES_INDEX_PARENT ) || !s_pChildIndexTables )
+	{
+		LinkSubKeyToList( pSubkey, pLastChild );
+		return;
+	}
+
+	// Checked against the list before the new child is in it
+	CEpochReadGuard guard( s_pChildIndexTables->m_Reclaimer );
+	KeyValuesChildIndex_t *pIndex = pLastChild ? GetChildIndex( pLastChild ) : NULL;
+	LinkSubKeyToList( pSubkey, pLastChild );
+	if ( !pIndex )
+	{
+		DestroyChildIndex();
+		return;
+	}
+
+	pIndex->m_Children.Insert( pSubkey->m_iKeyName, pSubkey );
+	pIndex->m_pLast = pSubkey;
+	++pIndex->m_nCount;
+
+	AUTO_LOCK( s_pChildIndexTables->m_Mutex );
+	pSubkey->m_nChildIndexFlags |= KEYVALUES_INDEX_CHILD;
+	s_pChildIndexTables->m_Parents[ s_pChildIndexTables->m_Parents.Insert( pSubkey, this ) ] = this;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Unlinks pSubkey, which follows pPrevChild or is the first child
+//			if pPrevChild is NULL, and takes it out of the index
+//-----------------------------------------------------------------------------
+void KeyValues::UnlinkSubKey( KeyValues *pSubkey, KeyValues *pPrevChild )
+{
+	if ( ( m_nChildIndexFlags & KEYVALUES_INDEX_PARENT ) && s_pChildIndexTables )
+	{
+		CEpochReadGuard guard( s_pChildIndexTables->m_Reclaimer );
+		KeyValuesChildIndex_t *pIndex = GetChildIndex( NULL );
+		if ( pIndex )
+		{
+			// A later child with the same name takes over the entry
+			int iKeyName = pSubkey->m_iKeyName;
+			UtlHashHandle_t hChild = pIndex->m_Children.Find( iKeyName );
+			if ( hChild != pIndex->m_Children.InvalidHandle() && pIndex->m_Children[hChild] == pSubkey )
+			{
+				KeyValues *pNext = pSubkey->m_pPeer;
+				while ( pNext && pNext->m_iKeyName != iKeyName )
+				{
+					pNext = pNext->m_pPeer;
+				}
+
+				if ( pNext )
+				{
+					pIndex->m_Children[hChild] = pNext;
+				}
+				else
+				{
+					pIndex->m_Children.Remove( iKeyName );
+				}
+			}
+
+			if ( pIndex->m_pLast == pSubkey )
+			{
+				pIndex->m_pLast = pPrevChild;
 			}
-		case TYPE_COLOR:
-			DevMsg(1, "KeyValues::RecursiveSaveToFile: TODO, missing code for TYPE_COLOR.\n");
-			break;
+			if ( pIndex->m_pFirst == pSubkey )
+			{
+				pIndex->m_pFirst = pSubkey->m_pPeer;
+			}
+			--pIndex->m_nCount;
+		}
+	}
 
-		default:
-			break;
+	if ( pPrevChild )
+	{
+		pPrevChild->m_pPeer = pSubkey->m_pPeer;
+	}
+	else
+	{
+		m_pSub = pSubkey->m_pPeer;
+	}
+
+	pSubkey->m_pPeer = NULL;
+	if ( ( pSubkey->m_nChildIndexFlags & KEYVALUES_INDEX_CHILD ) && s_pChildIndexTables )
+	{
+		AUTO_LOCK( s_pChildIndexTables->m_Mutex );
+		UtlHashHandle_t hParent = s_pChildIndexTables->m_Parents.Find( pSubkey );
+		if ( hParent != s_pChildIndexTables->m_Parents.InvalidHandle() && s_pChildIndexTables->m_Parents[hParent] == this )
+		{
+			s_pChildIndexTables->m_Parents.RemoveAndAdvance( hParent );
 		}
+		pSubkey->m_nChildIndexFlags &= ~KEYVALUES_INDEX_CHILD;
+	}
+
+	if ( !m_pSub )
+	{
+		DestroyChildIndex();
 	}
 }
 
@@ -896,13 +1563,23 @@ void KeyValues::SaveKeyToFile( KeyValues *dat, IBaseFileSystem *filesystem, File
 //-----------------------------------------------------------------------------
 KeyValues *KeyValues::FindKey(int keySymbol) const
 {
-	for (KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
+	KeyValues *dat;
+	if ( FindKeyInChildIndex( keySymbol, dat ) )
+		return dat;
+
+	int nVisited = 0;
+	for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer, ++nVisited)
 	{
 		if (dat->m_iKeyName == keySymbol)
-			return dat;
+			break;
 	}
 
-	return NULL;
+	if ( nVisited >= KEYVALUES_INDEX_THRESHOLD )
+	{
+		BuildChildIndex();
+	}
+
+	return dat;
 }
 
 //-----------------------------------------------------------------------------
@@ -941,15 +1618,32 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 
 	KeyValues *lastItem = NULL;
 	KeyValues *dat;
-	// find the searchStr in the current peer list
-	for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
+	if ( FindKeyInChildIndex( iSearchStr, dat ) )
+	{
+		// The index doesn't vouch for the tail, so walk to it before appending
+		if ( !dat && bCreate )
+		{
+			lastItem = FindLastSubKey();
+		}
+	}
+	else
 	{
-		lastItem = dat;	// record the last item looked at (for if we need to append to the end of the list)
+		// find the searchStr in the current peer list
+		int nVisited = 0;
+		for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer, ++nVisited)
+		{
+			lastItem = dat;	// record the last item looked at (for if we need to append to the end of the list)
+
+			// symbol compare
+			if (dat->m_iKeyName == iSearchStr)
+			{
+				break;
+			}
+		}
 
-		// symbol compare
-		if (dat->m_iKeyName == iSearchStr)
+		if ( nVisited >= KEYVALUES_INDEX_THRESHOLD )
 		{
-			break;
+			BuildChildIndex();
 		}
 	}
 
@@ -971,15 +1665,8 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 			dat->UsesConditionals( m_bEvaluateConditionals != 0 );
 
 			// insert new key at end of list
-			if (lastItem)
-			{
-				lastItem->m_pPeer = dat;
-			}
-			else
-			{
-				m_pSub = dat;
-			}
 			dat->m_pPeer = NULL;
+			LinkSubKey( dat, lastItem );
 
 			// a key graduates to be a submsg as soon as it's m_pSub is set
 			// this should be the only place m_pSub is set
@@ -1066,7 +1753,6 @@ void KeyValues::AddSubkeyUsingKnownLastChild( KeyValues *pSubkey, KeyValues *pLa
 	if ( pLastChild == NULL )
 	{
 		Assert( m_pSub == NULL );
-		m_pSub = pSubkey;
 	}
 	else
 	{
@@ -1082,9 +1768,9 @@ void KeyValues::AddSubkeyUsingKnownLastChild( KeyValues *pSubkey, KeyValues *pLa
 //			}
 //			Assert( pTempDat == pLastChild );
 //		#endif
-
-		pLastChild->SetNextKey( pSubkey );
 	}
+
+	LinkSubKey( pSubkey, pLastChild );
 }
 
 
@@ -1098,20 +1784,7 @@ void KeyValues::AddSubKey( KeyValues *pSubkey )
 	Assert( pSubkey->m_pPeer == NULL );
 
 	// add into subkey list
-	if ( m_pSub == NULL )
-	{
-		m_pSub = pSubkey;
-	}
-	else
-	{
-		KeyValues *pTempDat = m_pSub;
-		while ( pTempDat->GetNextKey() != NULL )
-		{
-			pTempDat = pTempDat->GetNextKey();
-		}
-
-		pTempDat->SetNextKey( pSubkey );
-	}
+	LinkSubKey( pSubkey, FindLastSubKey() );
 }
 
 
@@ -1125,27 +1798,21 @@ void KeyValues::RemoveSubKey(KeyValues *subKey)
 		return;
 
 	// check the list pointer
-	if (m_pSub == subKey)
-	{
-		m_pSub = subKey->m_pPeer;
-	}
-	else
+	KeyValues *kv = NULL;
+	if (m_pSub != subKey)
 	{
 		// look through the list
-		KeyValues *kv = m_pSub;
-		while (kv->m_pPeer)
+		for (kv = m_pSub; kv && kv->m_pPeer != subKey; kv = kv->m_pPeer)
+			;
+
+		if (!kv)
 		{
-			if (kv->m_pPeer == subKey)
-			{
-				kv->m_pPeer = subKey->m_pPeer;
-				break;
-			}
-			
-			kv = kv->m_pPeer;
+			subKey->m_pPeer = NULL;
+			return;
 		}
 	}
 
-	subKey->m_pPeer = NULL;
+	UnlinkSubKey( subKey, kv );
 }
 
 
@@ -1172,6 +1839,12 @@ KeyValues *KeyValues::FindLastSubKey()
 //-----------------------------------------------------------------------------
 void KeyValues::SetNextKey( KeyValues *pDat )
 {
+	// Our parent's index can't see this
+	if ( m_nChildIndexFlags & KEYVALUES_INDEX_CHILD )
+	{
+		InvalidateParentChildIndex();
+	}
+
 	m_pPeer = pDat;
 }
 
@@ -1641,6 +2314,12 @@ void KeyValues::SetFloat( const char *keyName, float value )
 
 void KeyValues::SetName( const char * setName )
 {
+	// Our parent's index can't see this
+	if ( m_nChildIndexFlags & KEYVALUES_INDEX_CHILD )
+	{
+		InvalidateParentChildIndex();
+	}
+
 	m_iKeyName = s_pfGetSymbolForString( setName, true );
 }
 
@@ -1886,6 +2565,7 @@ bool KeyValues::IsEmpty(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::Clear( void )
 {
+	DestroyChildIndex();
 	delete m_pSub;
 	m_pSub = NULL;
 	m_iDataType = TYPE_NONE;
@@ -2337,22 +3017,31 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 			int len = Q_strlen( value );
 
 			// Here, let's determine if we got a float or an int....
-			char* pIEnd;	// pos where int scan ended
-			char* pFEnd;	// pos where float scan ended
+			char* pIEnd = (char *)value;	// pos where int scan ended
+			char* pFEnd = (char *)value;	// pos where float scan ended
 			const char* pSEnd = value + len ; // pos where token ends
 
-			int ival = strtol( value, &pIEnd, 10 );
-			float fval = (float)strtod( value, &pFEnd );
-			bool bOverflow = ( ival == LONG_MAX || ival == LONG_MIN ) && errno == ERANGE;
-#ifdef POSIX
-			// strtod supports hex representation in strings under posix but we DON'T
-			// want that support in keyvalues, so undo it here if needed
-			if ( len > 1 &&  tolower(value[1]) == 'x' )
+			int ival = 0;
+			float fval = 0.0f;
+			bool bOverflow = false;
+
+			// Most values are paths and names; only run the conversions when the
+			// first character could start a number (strtod also takes inf and nan)
+			if ( IsKeyValuesNumberStart( *value ) )
 			{
-				fval = 0.0f;
-				pFEnd = (char *)value;
-			}
+				ival = strtol( value, &pIEnd, 10 );
+				fval = (float)strtod( value, &pFEnd );
+				bOverflow = ( ival == LONG_MAX || ival == LONG_MIN ) && errno == ERANGE;
+#ifdef POSIX
+				// strtod supports hex representation in strings under posix but we DON'T
+				// want that support in keyvalues, so undo it here if needed
+				if ( len > 1 &&  tolower(value[1]) == 'x' )
+				{
+					fval = 0.0f;
+					pFEnd = (char *)value;
+				}
 #endif
+			}
 				
 			if ( *value == 0 )
 			{
@@ -2420,16 +3109,8 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 		else
 		{
 			//this->RemoveSubKey( dat );
-			if ( pLastChild == NULL )
-			{
-				Assert( m_pSub == dat );
-				m_pSub = NULL;
-			}
-			else
-			{
-				Assert( pLastChild->m_pPeer == dat );
-				pLastChild->m_pPeer = NULL;
-			}
+			Assert( pLastChild ? pLastChild->m_pPeer == dat : m_pSub == dat );
+			UnlinkSubKey( dat, pLastChild );
 
 			dat->deleteThis();
 			dat = NULL;
@@ -2639,6 +3320,320 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 	return buffer.IsValid();
 }
 
+//-----------------------------------------------------------------------------
+// Compiled form: a header, the key names used in the file, then the tree as
+// peer lists. Each node is a type byte and a name index followed by its
+// value, or by its own peer list for sections. TYPE_NUMTYPES ends a list.
+//-----------------------------------------------------------------------------
+static bool CollectCompiledNames( KeyValues *pKV, CUtlMap< int, unsigned short > &names, CUtlVector< int > &symbols, int nStackDepth )
+{
+	if ( nStackDepth > 100 )
+		return false;
+
+	for ( ; pKV != NULL; pKV = pKV->GetNextKey() )
+	{
+		int nSymbol = pKV->GetNameSymbol();
+		if ( names.Find( nSymbol ) == names.InvalidIndex() )
+		{
+			if ( symbols.Count() > 0xFFFF )
+				return false;
+			names.Insert( nSymbol, (unsigned short)symbols.AddToTail( nSymbol ) );
+		}
+
+		switch ( pKV->GetDataType() )
+		{
+		case KeyValues::TYPE_NONE:
+			if ( !CollectCompiledNames( pKV->GetFirstSubKey(), names, symbols, nStackDepth + 1 ) )
+				return false;
+			break;
+
+		case KeyValues::TYPE_STRING:
+		case KeyValues::TYPE_INT:
+		case KeyValues::TYPE_FLOAT:
+		case KeyValues::TYPE_COLOR:
+		case KeyValues::TYPE_UINT64:
+			break;
+
+		default:
+			// Pointers and wide strings never come from text
+			return false;
+		}
+	}
+	return true;
+}
+
+static void WriteCompiledPeers( KeyValues *pKV, CUtlBuffer &buffer, const CUtlMap< int, unsigned short > &names )
+{
+	for ( ; pKV != NULL; pKV = pKV->GetNextKey() )
+	{
+		KeyValues::types_t type = pKV->GetDataType();
+		buffer.PutUnsignedChar( type );
+		buffer.PutUnsignedShort( names[ names.Find( pKV->GetNameSymbol() ) ] );
+
+		switch ( type )
+		{
+		case KeyValues::TYPE_NONE:
+			WriteCompiledPeers( pKV->GetFirstSubKey(), buffer, names );
+			break;
+
+		case KeyValues::TYPE_STRING:
+			buffer.PutString( pKV->GetString() );
+			break;
+
+		case KeyValues::TYPE_INT:
+			buffer.PutInt( pKV->GetInt() );
+			break;
+
+		case KeyValues::TYPE_FLOAT:
+			buffer.PutFloat( pKV->GetFloat() );
+			break;
+
+		case KeyValues::TYPE_COLOR:
+			{
+				Color color = pKV->GetColor();
+				buffer.PutUnsignedChar( color.r() );
+				buffer.PutUnsignedChar( color.g() );
+				buffer.PutUnsignedChar( color.b() );
+				buffer.PutUnsignedChar( color.a() );
+				break;
+			}
+
+		case KeyValues::TYPE_UINT64:
+			buffer.PutInt64( (int64)pKV->GetUint64() );
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	buffer.PutUnsignedChar( KeyValues::TYPE_NUMTYPES );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A compiled tree has its [$WIN32] style conditionals already
+//			evaluated, so it's tagged with which of them held where it was
+//			built, and only read back where the same ones hold
+//-----------------------------------------------------------------------------
+static int GetCompiledConditionalSet( int nFlags )
+{
+	if ( !( nFlags & KEYVALUES_COMPILED_CONDITIONALS ) )
+		return 0;
+
+	static const char *s_pszConditionals[] = { "$X360", "$WIN32", "$WINDOWS", "$OSX", "$LINUX", "$POSIX" };
+
+	int nSet = 0;
+	for ( int i = 0; i < ARRAYSIZE( s_pszConditionals ); ++i )
+	{
+		if ( EvaluateConditional( s_pszConditionals[i] ) )
+		{
+			nSet |= ( 1 << i );
+		}
+	}
+	return nSet;
+}
+
+bool KeyValues::WriteAsCompiled( CUtlBuffer &buffer, int nTextSize, CRC32_t textCRC )
+{
+	if ( buffer.IsText() || !buffer.IsValid() )
+		return false;
+
+	CUtlMap< int, unsigned short > names( DefLessFunc( int ) );
+	CUtlVector< int > symbols;
+	if ( !CollectCompiledNames( this, names, symbols, 0 ) )
+		return false;
+
+	int nFlags = ( m_bHasEscapeSequences ? KEYVALUES_COMPILED_ESCAPES : 0 ) | ( m_bEvaluateConditionals ? KEYVALUES_COMPILED_CONDITIONALS : 0 );
+
+	buffer.PutInt( KEYVALUES_COMPILED_ID );
+	buffer.PutInt( KEYVALUES_COMPILED_VERSION );
+	buffer.PutInt( nTextSize );
+	buffer.PutUnsignedInt( textCRC );
+	buffer.PutInt( nFlags );
+	buffer.PutInt( GetCompiledConditionalSet( nFlags ) );
+
+	buffer.PutInt( symbols.Count() );
+	for ( int i = 0; i < symbols.Count(); ++i )
+	{
+		buffer.PutString( s_pfGetStringForSymbol( symbols[i] ) );
+	}
+
+	WriteCompiledPeers( this, buffer, names );
+	return buffer.IsValid();
+}
+
+// Points at a string in a binary buffer and skips it, or returns NULL
+static const char *GetCompiledString( CUtlBuffer &buffer, int &nLength )
+{
+	int nRemaining = buffer.GetBytesRemaining();
+	const char *pString = ( nRemaining > 0 ) ? (const char *)buffer.PeekGet( nRemaining, 0 ) : NULL;
+	const char *pTerminator = pString ? (const char *)memchr( pString, 0, nRemaining ) : NULL;
+	if ( !pTerminator )
+		return NULL;
+
+	nLength = pTerminator - pString;
+	buffer.SeekGet( CUtlBuffer::SEEK_CURRENT, nLength + 1 );
+	return pString;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads one peer list. Returns NULL for an empty list or on error;
+//			errors leave the buffer invalid. Every key gets the parse settings
+//			in nFlags, as keys created by the text parser inherit them.
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::ReadCompiledPeers( CUtlBuffer &buffer, const CUtlVector< int > &symbols, int nFlags, int nStackDepth )
+{
+	if ( nStackDepth > 100 )
+	{
+		buffer.SeekGet( CUtlBuffer::SEEK_TAIL, -1 );
+		return NULL;
+	}
+
+	KeyValues *pFirst = NULL;
+	KeyValues *pLast = NULL;
+	while ( buffer.IsValid() )
+	{
+		types_t type = (types_t)buffer.GetUnsignedChar();
+		if ( type == TYPE_NUMTYPES || !buffer.IsValid() )
+			break;
+
+		unsigned short nName = buffer.GetUnsignedShort();
+		if ( nName >= symbols.Count() )
+		{
+			buffer.SeekGet( CUtlBuffer::SEEK_TAIL, -1 );
+			break;
+		}
+
+		KeyValues *dat = new KeyValues( NULL );
+		dat->m_iKeyName = symbols[nName];
+		dat->m_iDataType = type;
+		dat->m_bHasEscapeSequences = ( nFlags & KEYVALUES_COMPILED_ESCAPES ) != 0;
+		dat->m_bEvaluateConditionals = ( nFlags & KEYVALUES_COMPILED_CONDITIONALS ) != 0;
+		if ( pLast )
+		{
+			pLast->m_pPeer = dat;
+		}
+		else
+		{
+			pFirst = dat;
+		}
+		pLast = dat;
+
+		switch ( type )
+		{
+		case TYPE_NONE:
+			dat->m_pSub = ReadCompiledPeers( buffer, symbols, nFlags, nStackDepth + 1 );
+			break;
+
+		case TYPE_STRING:
+			{
+				int nLength;
+				const char *pString = GetCompiledString( buffer, nLength );
+				if ( !pString )
+				{
+					buffer.SeekGet( CUtlBuffer::SEEK_TAIL, -1 );
+					break;
+				}
+				dat->m_sValue = new char[nLength + 1];
+				Q_memcpy( dat->m_sValue, pString, nLength + 1 );
+				break;
+			}
+
+		case TYPE_INT:
+			dat->m_iValue = buffer.GetInt();
+			break;
+
+		case TYPE_FLOAT:
+			dat->m_flValue = buffer.GetFloat();
+			break;
+
+		case TYPE_COLOR:
+			dat->m_Color[0] = buffer.GetUnsignedChar();
+			dat->m_Color[1] = buffer.GetUnsignedChar();
+			dat->m_Color[2] = buffer.GetUnsignedChar();
+			dat->m_Color[3] = buffer.GetUnsignedChar();
+			break;
+
+		case TYPE_UINT64:
+			dat->m_sValue = new char[sizeof(uint64)];
+			*((uint64 *)dat->m_sValue) = buffer.GetInt64();
+			break;
+
+		default:
+			buffer.SeekGet( CUtlBuffer::SEEK_TAIL, -1 );
+			break;
+		}
+	}
+
+	return pFirst;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Replaces this key and its peers with a compiled tree, the way
+//			LoadFromBuffer would have filled them from the source text
+//-----------------------------------------------------------------------------
+bool KeyValues::ReadAsCompiled( CUtlBuffer &buffer, int nTextSize, CRC32_t textCRC )
+{
+	if ( buffer.IsText() || !buffer.IsValid() )
+		return false;
+
+	int nFlags = ( m_bHasEscapeSequences ? KEYVALUES_COMPILED_ESCAPES : 0 ) | ( m_bEvaluateConditionals ? KEYVALUES_COMPILED_CONDITIONALS : 0 );
+
+	if ( buffer.GetInt() != KEYVALUES_COMPILED_ID || buffer.GetInt() != KEYVALUES_COMPILED_VERSION )
+		return false;
+
+	if ( buffer.GetInt() != nTextSize || buffer.GetUnsignedInt() != textCRC || buffer.GetInt() != nFlags )
+		return false;
+
+	if ( buffer.GetInt() != GetCompiledConditionalSet( nFlags ) )
+		return false;
+
+	int nNames = buffer.GetInt();
+	if ( !buffer.IsValid() || nNames < 0 || nNames > 0x10000 || nNames > buffer.GetBytesRemaining() )
+		return false;
+
+	// Each distinct name goes through the symbol table once, not once per key
+	CUtlVector< int > symbols;
+	symbols.SetCount( nNames );
+	for ( int i = 0; i < nNames; ++i )
+	{
+		int nLength;
+		const char *pName = GetCompiledString( buffer, nLength );
+		if ( !pName )
+			return false;
+		symbols[i] = s_pfGetSymbolForString( pName, true );
+	}
+
+	KeyValues *pFirst = ReadCompiledPeers( buffer, symbols, nFlags, 0 );
+	if ( !buffer.IsValid() )
+	{
+		if ( pFirst )
+		{
+			pFirst->deleteThis();
+		}
+		return false;
+	}
+
+	// An empty file leaves us alone, like it does for the text parser
+	if ( !pFirst )
+		return true;
+
+	RemoveEverything();
+
+	m_iKeyName = pFirst->m_iKeyName;
+	m_iDataType = pFirst->m_iDataType;
+	m_sValue = pFirst->m_sValue;
+	m_pValue = pFirst->m_pValue;
+	m_pSub = pFirst->m_pSub;
+	m_pPeer = pFirst->m_pPeer;
+
+	pFirst->m_sValue = NULL;
+	pFirst->m_pSub = NULL;
+	pFirst->m_pPeer = NULL;
+	pFirst->deleteThis();
+	return true;
+}
+
 #include "tier0/memdbgoff.h"
 
 //-----------------------------------------------------------------------------
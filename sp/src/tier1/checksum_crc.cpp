@@ -7,6 +7,8 @@
 #include "basetypes.h"
 #include "commonmacros.h"
 #include "checksum_crc.h"
+#include "processor_detect.h"
+#include "tier0/threadtools.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -15,6 +17,21 @@
 #define CRC32_XOR_VALUE  0xFFFFFFFFUL
 
 #define NUM_BYTES 256
+
+// Bytes consumed per step by the sliced table loop
+#define CRC32_SLICES 16
+
+// Below this the carry-less multiply setup costs more than it saves
+#define CRC32_PCLMUL_MIN_BYTES 64
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#define CRC32_PCLMUL
+
+// checksum_crc_pclmul.cpp. Folds nBuffer bytes, a multiple of 16 and at
+// least CRC32_PCLMUL_MIN_BYTES, into the CRC register.
+CRC32_t CRC32_FoldPCLMUL( CRC32_t ulCrc, const unsigned char *pb, int nBuffer );
+#endif
+
 static const CRC32_t pulCRCTable[NUM_BYTES] =
 {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba,
@@ -98,83 +115,119 @@ CRC32_t	CRC32_GetTableEntry( unsigned int slot )
 	return pulCRCTable[(unsigned char)slot];
 }
 
-void CRC32_ProcessBuffer(CRC32_t *pulCRC, const void *pBuffer, int nBuffer)
+//-----------------------------------------------------------------------------
+// Slicing by 16: s_SlicedTables[k][i] is the CRC of byte i followed by k zero
+// bytes, so sixteen lookups advance the CRC by sixteen bytes at once. Built
+// from pulCRCTable the first time a CRC is taken.
+//-----------------------------------------------------------------------------
+static CRC32_t s_SlicedTables[CRC32_SLICES][NUM_BYTES];
+
+static void CRC32_BuildSlicedTables()
+{
+	for ( int i = 0; i < NUM_BYTES; i++ )
+	{
+		CRC32_t ulCrc = pulCRCTable[i];
+		s_SlicedTables[0][i] = ulCrc;
+		for ( int k = 1; k < CRC32_SLICES; k++ )
+		{
+			ulCrc = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
+			s_SlicedTables[k][i] = ulCrc;
+		}
+	}
+}
+
+static CRC32_t CRC32_ProcessBufferSliced( CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
+{
+	// Byte at a time up to a 4 byte boundary
+	while ( nBuffer > 0 && ( (size_t)pb & 3 ) )
+	{
+		ulCrc = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
+		nBuffer--;
+	}
+
+	while ( nBuffer >= CRC32_SLICES )
+	{
+		CRC32_t ul0 = LittleLong( ((const CRC32_t *)pb)[0] ) ^ ulCrc;
+		CRC32_t ul1 = LittleLong( ((const CRC32_t *)pb)[1] );
+		CRC32_t ul2 = LittleLong( ((const CRC32_t *)pb)[2] );
+		CRC32_t ul3 = LittleLong( ((const CRC32_t *)pb)[3] );
+
+		ulCrc = s_SlicedTables[15][ul0 & 0xff] ^ s_SlicedTables[14][(ul0 >> 8) & 0xff] ^
+				s_SlicedTables[13][(ul0 >> 16) & 0xff] ^ s_SlicedTables[12][ul0 >> 24] ^
+				s_SlicedTables[11][ul1 & 0xff] ^ s_SlicedTables[10][(ul1 >> 8) & 0xff] ^
+				s_SlicedTables[9][(ul1 >> 16) & 0xff] ^ s_SlicedTables[8][ul1 >> 24] ^
+				s_SlicedTables[7][ul2 & 0xff] ^ s_SlicedTables[6][(ul2 >> 8) & 0xff] ^
+				s_SlicedTables[5][(ul2 >> 16) & 0xff] ^ s_SlicedTables[4][ul2 >> 24] ^
+				s_SlicedTables[3][ul3 & 0xff] ^ s_SlicedTables[2][(ul3 >> 8) & 0xff] ^
+				s_SlicedTables[1][(ul3 >> 16) & 0xff] ^ s_SlicedTables[0][ul3 >> 24];
+
+		pb += CRC32_SLICES;
+		nBuffer -= CRC32_SLICES;
+	}
+
+	while ( nBuffer-- > 0 )
+	{
+		ulCrc = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
+	}
+
+	return ulCrc;
+}
+
+#ifdef CRC32_PCLMUL
+static CRC32_t CRC32_ProcessBufferPCLMUL( CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
 {
-	CRC32_t ulCrc = *pulCRC;
-	unsigned char *pb = (unsigned char *)pBuffer;
-    unsigned int nFront;
-    int nMain;
-
-JustAfew:
-
-    switch (nBuffer)
-    {
-    case 7:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 6:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 5:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 4:
-        ulCrc ^= LittleLong( *(CRC32_t *)pb );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-		*pulCRC = ulCrc;
-        return;
-
-    case 3:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 2:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 1:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 0:
-		*pulCRC = ulCrc;
-        return;
-    }
-
-    // We may need to do some alignment work up front, and at the end, so that
-    // the main loop is aligned and only has to worry about 8 byte at a time.
-    //
-    // The low-order two bits of pb and nBuffer in total control the
-    // upfront work.
-    //
-    nFront = ((unsigned int)pb) & 3;
-    nBuffer -= nFront;
-    switch (nFront)
-    {
-    case 3:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    case 2:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    case 1:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    }
-
-    nMain = nBuffer >> 3;
-    while (nMain--)
-    {
-        ulCrc ^= LittleLong( *(CRC32_t *)pb );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc ^= LittleLong( *(CRC32_t *)(pb + 4) );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        pb += 8;
-    }
-
-    nBuffer &= 7;
-    goto JustAfew;
+	if ( nBuffer >= CRC32_PCLMUL_MIN_BYTES )
+	{
+		int nFolded = nBuffer & ~15;
+		ulCrc = CRC32_FoldPCLMUL( ulCrc, pb, nFolded );
+		pb += nFolded;
+		nBuffer -= nFolded;
+	}
+
+	return CRC32_ProcessBufferSliced( ulCrc, pb, nBuffer );
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// The implementation is picked on the first call. Racing first calls just
+// build the same tables and pick the same function twice.
+//-----------------------------------------------------------------------------
+typedef CRC32_t (*CRC32ProcessBufferFn_t)( CRC32_t ulCrc, const unsigned char *pb, int nBuffer );
+
+static CRC32_t CRC32_ProcessBufferFirstCall( CRC32_t ulCrc, const unsigned char *pb, int nBuffer );
+static CRC32ProcessBufferFn_t volatile s_pfnCRC32ProcessBuffer = CRC32_ProcessBufferFirstCall;
+static const char * volatile s_pszCRC32Implementation = "slicing-by-16";
+
+static CRC32_t CRC32_ProcessBufferFirstCall( CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
+{
+	CRC32_BuildSlicedTables();
+
+	CRC32ProcessBufferFn_t pfnProcessBuffer = CRC32_ProcessBufferSliced;
+#ifdef CRC32_PCLMUL
+	if ( CheckPCLMULQDQTechnology() )
+	{
+		pfnProcessBuffer = CRC32_ProcessBufferPCLMUL;
+		s_pszCRC32Implementation = "pclmulqdq";
+	}
+#endif
+
+	// The tables have to be visible before the function that reads them
+	ThreadMemoryBarrier();
+	s_pfnCRC32ProcessBuffer = pfnProcessBuffer;
+	return pfnProcessBuffer( ulCrc, pb, nBuffer );
+}
+
+void CRC32_ProcessBuffer( CRC32_t *pulCRC, const void *pBuffer, int nBuffer )
+{
+	*pulCRC = s_pfnCRC32ProcessBuffer( *pulCRC, (const unsigned char *)pBuffer, nBuffer );
+}
+
+const char *CRC32_GetImplementationName()
+{
+	// Make sure the choice has been made
+	CRC32_t ulCrc;
+	CRC32_Init( &ulCrc );
+	CRC32_ProcessBuffer( &ulCrc, NULL, 0 );
+
+	return s_pszCRC32Implementation;
 }
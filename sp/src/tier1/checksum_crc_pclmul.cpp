@@ -0,0 +1,130 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: CRC32 folding with the carry-less multiply instruction. Built
+//			with PCLMULQDQ enabled and only called once processor_detect has
+//			found it, so nothing else belongs in this file.
+//
+//			See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+//			Instruction", Gopal et al, Intel 2009. The constants are for the
+//			bit reflected CRC32 polynomial in pulCRCTable.
+//
+//=============================================================================//
+
+#include "basetypes.h"
+#include "checksum_crc.h"
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#if defined( _MSC_VER )
+#define CRC32_ALIGN16( _decl )	__declspec( align( 16 ) ) _decl
+#else
+#define CRC32_ALIGN16( _decl )	_decl __attribute__( ( aligned( 16 ) ) )
+#endif
+
+// x^(4*128+32) and x^(4*128-32), folding 64 bytes ahead
+static const CRC32_ALIGN16( uint64 s_K1K2[2] ) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+// x^(128+32) and x^(128-32), folding 16 bytes ahead
+static const CRC32_ALIGN16( uint64 s_K3K4[2] ) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+// x^64, reducing 96 bits to 64
+static const CRC32_ALIGN16( uint64 s_K5K0[2] ) = { 0x0163cd6124ULL, 0 };
+// The polynomial and its Barrett constant
+static const CRC32_ALIGN16( uint64 s_Poly[2] ) = { 0x01db710641ULL, 0x01f7011641ULL };
+
+//-----------------------------------------------------------------------------
+// Purpose: Folds nBuffer bytes into the CRC register. nBuffer must be a
+//			multiple of 16 and at least 64.
+//-----------------------------------------------------------------------------
+CRC32_t CRC32_FoldPCLMUL( CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128( (const __m128i *)( pb + 0x00 ) );
+	x2 = _mm_loadu_si128( (const __m128i *)( pb + 0x10 ) );
+	x3 = _mm_loadu_si128( (const __m128i *)( pb + 0x20 ) );
+	x4 = _mm_loadu_si128( (const __m128i *)( pb + 0x30 ) );
+	x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( (int)ulCrc ) );
+
+	pb += 64;
+	nBuffer -= 64;
+
+	// Four lanes of 16 bytes, each folded 64 bytes ahead
+	x0 = _mm_load_si128( (const __m128i *)s_K1K2 );
+	while ( nBuffer >= 64 )
+	{
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x6 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+		x7 = _mm_clmulepi64_si128( x3, x0, 0x00 );
+		x8 = _mm_clmulepi64_si128( x4, x0, 0x00 );
+
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x2 = _mm_clmulepi64_si128( x2, x0, 0x11 );
+		x3 = _mm_clmulepi64_si128( x3, x0, 0x11 );
+		x4 = _mm_clmulepi64_si128( x4, x0, 0x11 );
+
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x5 ), _mm_loadu_si128( (const __m128i *)( pb + 0x00 ) ) );
+		x2 = _mm_xor_si128( _mm_xor_si128( x2, x6 ), _mm_loadu_si128( (const __m128i *)( pb + 0x10 ) ) );
+		x3 = _mm_xor_si128( _mm_xor_si128( x3, x7 ), _mm_loadu_si128( (const __m128i *)( pb + 0x20 ) ) );
+		x4 = _mm_xor_si128( _mm_xor_si128( x4, x8 ), _mm_loadu_si128( (const __m128i *)( pb + 0x30 ) ) );
+
+		pb += 64;
+		nBuffer -= 64;
+	}
+
+	// Fold the four lanes into one
+	x0 = _mm_load_si128( (const __m128i *)s_K3K4 );
+
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x3 ), x5 );
+
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x4 ), x5 );
+
+	// Then any 16 byte blocks left
+	while ( nBuffer >= 16 )
+	{
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, _mm_loadu_si128( (const __m128i *)pb ) ), x5 );
+
+		pb += 16;
+		nBuffer -= 16;
+	}
+
+	// 128 bits down to 64
+	x2 = _mm_clmulepi64_si128( x1, x0, 0x10 );
+	x3 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+	x1 = _mm_srli_si128( x1, 8 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	x0 = _mm_loadl_epi64( (const __m128i *)s_K5K0 );
+
+	x2 = _mm_srli_si128( x1, 4 );
+	x1 = _mm_and_si128( x1, x3 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_load_si128( (const __m128i *)s_Poly );
+
+	x2 = _mm_and_si128( x1, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x10 );
+	x2 = _mm_and_si128( x2, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	return (CRC32_t)_mm_cvtsi128_si32( _mm_srli_si128( x1, 4 ) );
+}
+
+#endif
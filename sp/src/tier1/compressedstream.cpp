@@ -0,0 +1,710 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Framed block compression over CUtlBuffers and file handles.
+//
+//===========================================================================//
+
+#include "tier1/compressedstream.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+#include "tier1/lzss.h"
+#include "tier1/snappy.h"
+#include "filesystem.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define COMPRESSEDSTREAM_MIN_BLOCK_SIZE		256
+
+static const char *s_pszCompressedStreamCodecNames[] =
+{
+	"store",
+	"lzss",
+	"snappy",
+};
+
+COMPILE_TIME_ASSERT( ARRAYSIZE( s_pszCompressedStreamCodecNames ) == COMPRESSEDSTREAM_CODEC_COUNT );
+COMPILE_TIME_ASSERT( sizeof( CompressedStreamHeader_t ) == 12 );
+COMPILE_TIME_ASSERT( sizeof( CompressedStreamFrame_t ) == 8 );
+
+const char *CompressedStreamCodecName( CompressedStreamCodec_t codec )
+{
+	if ( codec < 0 || codec >= COMPRESSEDSTREAM_CODEC_COUNT )
+		return "unknown";
+
+	return s_pszCompressedStreamCodecNames[ codec ];
+}
+
+static int ClampBlockSize( int nBlockSize )
+{
+	return clamp( nBlockSize, COMPRESSEDSTREAM_MIN_BLOCK_SIZE, COMPRESSEDSTREAM_MAX_BLOCK_SIZE );
+}
+
+// LZSS gives up rather than grow past its input, which is then stored
+static int MaxPayloadSize( CompressedStreamCodec_t codec, int nSize )
+{
+	if ( codec == COMPRESSEDSTREAM_CODEC_SNAPPY )
+		return MAX( nSize, (int)snappy::MaxCompressedLength( nSize ) );
+
+	return nSize;
+}
+
+int CompressedStreamMaxFrameSize( CompressedStreamCodec_t codec, int nSize )
+{
+	return sizeof( CompressedStreamFrame_t ) + MaxPayloadSize( codec, nSize );
+}
+
+// Makes room for nBytes past the put position, which binary buffers that
+// can't grow may not have
+static bool ReserveBuffer( CUtlBuffer &buf, int nBytes )
+{
+	Assert( !buf.IsText() );
+	buf.EnsureCapacity( buf.TellPut() + nBytes );
+	return ( buf.Size() - buf.TellPut() >= nBytes );
+}
+
+static void WriteHeader( void *pDest, CompressedStreamCodec_t codec, int nBlockSize )
+{
+	CompressedStreamHeader_t header;
+	header.m_nId = COMPRESSEDSTREAM_ID;
+	header.m_nVersion = COMPRESSEDSTREAM_VERSION;
+	header.m_nCodec = (uint8)codec;
+	header.m_nReserved = 0;
+	header.m_nBlockSize = LittleDWord( (uint32)nBlockSize );
+	memcpy( pDest, &header, sizeof( header ) );
+}
+
+static bool ParseHeader( const void *pSource, CompressedStreamCodec_t &codec, int &nBlockSize )
+{
+	CompressedStreamHeader_t header;
+	memcpy( &header, pSource, sizeof( header ) );
+
+	uint32 nHeaderBlockSize = LittleDWord( header.m_nBlockSize );
+	if ( header.m_nId != COMPRESSEDSTREAM_ID || header.m_nVersion != COMPRESSEDSTREAM_VERSION ||
+		header.m_nCodec >= COMPRESSEDSTREAM_CODEC_COUNT || nHeaderBlockSize == 0 || nHeaderBlockSize > COMPRESSEDSTREAM_MAX_BLOCK_SIZE )
+		return false;
+
+	codec = (CompressedStreamCodec_t)header.m_nCodec;
+	nBlockSize = (int)nHeaderBlockSize;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads a frame header into host order and checks its sizes against
+//			the stream's, so nothing past it is trusted blindly
+//-----------------------------------------------------------------------------
+static bool ParseFrame( const void *pSource, CompressedStreamCodec_t codec, int nBlockSize, CompressedStreamFrame_t &frame )
+{
+	memcpy( &frame, pSource, sizeof( frame ) );
+	frame.m_nSize = LittleDWord( frame.m_nSize );
+	frame.m_nPayloadSize = LittleDWord( frame.m_nPayloadSize );
+
+	uint32 nPayloadSize = frame.m_nPayloadSize & ~COMPRESSEDSTREAM_FRAME_STORED;
+	if ( frame.m_nSize > (uint32)nBlockSize )
+		return false;
+
+	if ( frame.m_nPayloadSize & COMPRESSEDSTREAM_FRAME_STORED )
+		return ( nPayloadSize == frame.m_nSize && nPayloadSize != 0 );
+
+	if ( frame.m_nSize == 0 )
+		return ( nPayloadSize == 0 );
+
+	return ( codec != COMPRESSEDSTREAM_CODEC_STORE && nPayloadSize != 0 && nPayloadSize <= (uint32)MaxPayloadSize( codec, frame.m_nSize ) );
+}
+
+static int FramePayloadSize( const CompressedStreamFrame_t &frame )
+{
+	return (int)( frame.m_nPayloadSize & ~COMPRESSEDSTREAM_FRAME_STORED );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Encodes a block as a frame at pDest, which must have room for
+//			CompressedStreamMaxFrameSize() bytes. Returns the frame's size
+//-----------------------------------------------------------------------------
+static int EncodeFrame( CompressedStreamCodec_t codec, const byte *pData, int nBytes, byte *pDest )
+{
+	byte *pPayload = pDest + sizeof( CompressedStreamFrame_t );
+	uint32 nPayloadSize = 0;
+
+	switch ( codec )
+	{
+	case COMPRESSEDSTREAM_CODEC_LZSS:
+		{
+			CLZSS lzss;
+			unsigned int nCompressed;
+			if ( lzss.CompressNoAlloc( pData, nBytes, pPayload, &nCompressed ) )
+			{
+				nPayloadSize = nCompressed;
+			}
+		}
+		break;
+
+	case COMPRESSEDSTREAM_CODEC_SNAPPY:
+		{
+			size_t nCompressed;
+			snappy::RawCompress( (const char *)pData, nBytes, (char *)pPayload, &nCompressed );
+			if ( nCompressed < (size_t)nBytes )
+			{
+				nPayloadSize = (uint32)nCompressed;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	if ( !nPayloadSize )
+	{
+		memcpy( pPayload, pData, nBytes );
+		nPayloadSize = (uint32)nBytes | COMPRESSEDSTREAM_FRAME_STORED;
+	}
+
+	CompressedStreamFrame_t frame;
+	frame.m_nSize = LittleDWord( (uint32)nBytes );
+	frame.m_nPayloadSize = LittleDWord( nPayloadSize );
+	memcpy( pDest, &frame, sizeof( frame ) );
+
+	return sizeof( frame ) + ( nPayloadSize & ~COMPRESSEDSTREAM_FRAME_STORED );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes a frame checked by ParseFrame() into m_nSize bytes at pDest
+//-----------------------------------------------------------------------------
+static bool DecodeFrame( CompressedStreamCodec_t codec, const CompressedStreamFrame_t &frame, const byte *pPayload, byte *pDest )
+{
+	int nPayloadSize = FramePayloadSize( frame );
+	if ( frame.m_nPayloadSize & COMPRESSEDSTREAM_FRAME_STORED )
+	{
+		memcpy( pDest, pPayload, nPayloadSize );
+		return true;
+	}
+
+	switch ( codec )
+	{
+	case COMPRESSEDSTREAM_CODEC_LZSS:
+		{
+			if ( nPayloadSize < (int)sizeof( lzss_header_t ) || CLZSS::GetActualSize( pPayload ) != frame.m_nSize )
+				return false;
+
+			CLZSS lzss;
+			return ( lzss.SafeUncompress( pPayload, nPayloadSize, pDest, frame.m_nSize ) == frame.m_nSize );
+		}
+
+	case COMPRESSEDSTREAM_CODEC_SNAPPY:
+		{
+			size_t nSize;
+			if ( !snappy::GetUncompressedLength( (const char *)pPayload, nPayloadSize, &nSize ) || nSize != frame.m_nSize )
+				return false;
+
+			return snappy::RawUncompress( (const char *)pPayload, nPayloadSize, (char *)pDest );
+		}
+
+	default:
+		return false;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Writer
+//-----------------------------------------------------------------------------
+CCompressedStreamWriter::CCompressedStreamWriter( CUtlBuffer &out, CompressedStreamCodec_t codec, int nBlockSize )
+{
+	m_pBuffer = &out;
+	m_pFileSystem = NULL;
+	m_hFile = NULL;
+	Init( codec, nBlockSize );
+}
+
+CCompressedStreamWriter::CCompressedStreamWriter( IBaseFileSystem *pFileSystem, FileHandle_t hFile, CompressedStreamCodec_t codec, int nBlockSize )
+{
+	m_pBuffer = NULL;
+	m_pFileSystem = pFileSystem;
+	m_hFile = hFile;
+	Init( codec, nBlockSize );
+}
+
+CCompressedStreamWriter::~CCompressedStreamWriter()
+{
+	// Without the end frame a reader will take the stream as cut short
+	Assert( m_bFinished || m_bError );
+}
+
+void CCompressedStreamWriter::Init( CompressedStreamCodec_t codec, int nBlockSize )
+{
+	Assert( codec >= 0 && codec < COMPRESSEDSTREAM_CODEC_COUNT );
+	m_Codec = codec;
+	m_nBlockSize = ClampBlockSize( nBlockSize );
+	m_nBlockUsed = 0;
+	m_nBytesIn = 0;
+	m_nBytesOut = 0;
+	m_bFinished = false;
+	m_bError = false;
+
+	byte header[ sizeof( CompressedStreamHeader_t ) ];
+	WriteHeader( header, m_Codec, m_nBlockSize );
+	Emit( header, sizeof( header ) );
+}
+
+bool CCompressedStreamWriter::Emit( const void *pData, int nBytes )
+{
+	if ( m_bError )
+		return false;
+
+	if ( m_pBuffer )
+	{
+		m_pBuffer->Put( pData, nBytes );
+		m_bError = !m_pBuffer->IsValid();
+	}
+	else
+	{
+		m_bError = ( m_pFileSystem->Write( pData, nBytes, m_hFile ) != nBytes );
+	}
+
+	m_nBytesOut += nBytes;
+	return !m_bError;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buffers get the frame encoded at their put position; files get it
+//			through the one frame sized scratch block
+//-----------------------------------------------------------------------------
+bool CCompressedStreamWriter::WriteBlock( const byte *pData, int nBytes )
+{
+	int nMaxFrameSize = CompressedStreamMaxFrameSize( m_Codec, nBytes );
+	m_nBytesIn += nBytes;
+
+	if ( !m_pBuffer )
+	{
+		m_Frame.EnsureCapacity( CompressedStreamMaxFrameSize( m_Codec, m_nBlockSize ) );
+		int nFrameSize = EncodeFrame( m_Codec, pData, nBytes, m_Frame.Base() );
+		return Emit( m_Frame.Base(), nFrameSize );
+	}
+
+	if ( !ReserveBuffer( *m_pBuffer, nMaxFrameSize ) )
+	{
+		m_bError = true;
+		return false;
+	}
+
+	int nFrameSize = EncodeFrame( m_Codec, pData, nBytes, (byte *)m_pBuffer->PeekPut() );
+	m_pBuffer->SeekPut( CUtlBuffer::SEEK_CURRENT, nFrameSize );
+	m_nBytesOut += nFrameSize;
+	return true;
+}
+
+bool CCompressedStreamWriter::Write( const void *pData, int nBytes )
+{
+	Assert( !m_bFinished );
+	if ( m_bError || m_bFinished )
+		return false;
+
+	const byte *pSource = (const byte *)pData;
+	while ( nBytes > 0 )
+	{
+		if ( m_nBlockUsed == 0 && nBytes >= m_nBlockSize )
+		{
+			if ( !WriteBlock( pSource, m_nBlockSize ) )
+				return false;
+
+			pSource += m_nBlockSize;
+			nBytes -= m_nBlockSize;
+			continue;
+		}
+
+		m_Block.EnsureCapacity( m_nBlockSize );
+		int nCopy = MIN( nBytes, m_nBlockSize - m_nBlockUsed );
+		memcpy( m_Block.Base() + m_nBlockUsed, pSource, nCopy );
+		m_nBlockUsed += nCopy;
+		pSource += nCopy;
+		nBytes -= nCopy;
+
+		if ( m_nBlockUsed == m_nBlockSize )
+		{
+			m_nBlockUsed = 0;
+			if ( !WriteBlock( m_Block.Base(), m_nBlockSize ) )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool CCompressedStreamWriter::Finish()
+{
+	if ( m_bFinished )
+		return !m_bError;
+
+	m_bFinished = true;
+	if ( m_nBlockUsed && !m_bError )
+	{
+		WriteBlock( m_Block.Base(), m_nBlockUsed );
+		m_nBlockUsed = 0;
+	}
+
+	CompressedStreamFrame_t end;
+	end.m_nSize = 0;
+	end.m_nPayloadSize = 0;
+	return Emit( &end, sizeof( end ) );
+}
+
+int CCompressedStreamWriter::GetMemoryUsed() const
+{
+	return m_Block.NumAllocated() + m_Frame.NumAllocated();
+}
+
+
+//-----------------------------------------------------------------------------
+// Reader
+//-----------------------------------------------------------------------------
+CCompressedStreamReader::CCompressedStreamReader( CUtlBuffer &in )
+{
+	m_pBuffer = &in;
+	m_pFileSystem = NULL;
+	m_hFile = NULL;
+	Init();
+}
+
+CCompressedStreamReader::CCompressedStreamReader( IBaseFileSystem *pFileSystem, FileHandle_t hFile )
+{
+	m_pBuffer = NULL;
+	m_pFileSystem = pFileSystem;
+	m_hFile = hFile;
+	Init();
+}
+
+void CCompressedStreamReader::Init()
+{
+	m_Codec = COMPRESSEDSTREAM_CODEC_STORE;
+	m_nBlockSize = 0;
+	m_pCurrent = NULL;
+	m_nCurrentSize = 0;
+	m_nCurrentPos = 0;
+	m_bEnd = false;
+	m_bError = !ReadHeader();
+}
+
+bool CCompressedStreamReader::ReadHeader()
+{
+	byte header[ sizeof( CompressedStreamHeader_t ) ];
+	if ( m_pBuffer )
+	{
+		if ( m_pBuffer->GetBytesRemaining() < (int)sizeof( header ) )
+			return false;
+
+		memcpy( header, m_pBuffer->PeekGet(), sizeof( header ) );
+		m_pBuffer->SeekGet( CUtlBuffer::SEEK_CURRENT, sizeof( header ) );
+	}
+	else if ( m_pFileSystem->Read( header, sizeof( header ), m_hFile ) != sizeof( header ) )
+	{
+		return false;
+	}
+
+	return ParseHeader( header, m_Codec, m_nBlockSize );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Points at the next frame's payload: in place for a buffer, read
+//			into the scratch block for a file. A stored payload from a file
+//			goes straight into the decoded block
+//-----------------------------------------------------------------------------
+bool CCompressedStreamReader::ReadFrame( CompressedStreamFrame_t &frame, const byte **ppPayload )
+{
+	if ( m_pBuffer )
+	{
+		int nRemaining = m_pBuffer->GetBytesRemaining() - sizeof( frame );
+		if ( nRemaining < 0 || !ParseFrame( m_pBuffer->PeekGet(), m_Codec, m_nBlockSize, frame ) )
+			return false;
+
+		int nPayloadSize = FramePayloadSize( frame );
+		if ( nPayloadSize > nRemaining )
+			return false;
+
+		*ppPayload = nPayloadSize ? (const byte *)m_pBuffer->PeekGet( sizeof( frame ) ) : NULL;
+		m_pBuffer->SeekGet( CUtlBuffer::SEEK_CURRENT, sizeof( frame ) + nPayloadSize );
+		return true;
+	}
+
+	byte header[ sizeof( CompressedStreamFrame_t ) ];
+	if ( m_pFileSystem->Read( header, sizeof( header ), m_hFile ) != sizeof( header ) || !ParseFrame( header, m_Codec, m_nBlockSize, frame ) )
+		return false;
+
+	int nPayloadSize = FramePayloadSize( frame );
+	if ( !nPayloadSize )
+	{
+		*ppPayload = NULL;
+		return true;
+	}
+
+	CUtlMemory< byte > *pDest = &m_Frame;
+	if ( frame.m_nPayloadSize & COMPRESSEDSTREAM_FRAME_STORED )
+	{
+		pDest = &m_Block;
+		m_Block.EnsureCapacity( m_nBlockSize );
+	}
+	else
+	{
+		m_Frame.EnsureCapacity( MaxPayloadSize( m_Codec, m_nBlockSize ) );
+	}
+
+	if ( m_pFileSystem->Read( pDest->Base(), nPayloadSize, m_hFile ) != nPayloadSize )
+		return false;
+
+	*ppPayload = pDest->Base();
+	return true;
+}
+
+const void *CCompressedStreamReader::NextBlock( int *pnBytes )
+{
+	*pnBytes = 0;
+	if ( m_bEnd || m_bError )
+		return NULL;
+
+	CompressedStreamFrame_t frame;
+	const byte *pPayload;
+	if ( !ReadFrame( frame, &pPayload ) )
+	{
+		m_bError = true;
+		return NULL;
+	}
+
+	if ( frame.m_nSize == 0 )
+	{
+		m_bEnd = true;
+		return NULL;
+	}
+
+	if ( frame.m_nPayloadSize & COMPRESSEDSTREAM_FRAME_STORED )
+	{
+		*pnBytes = frame.m_nSize;
+		return pPayload;
+	}
+
+	m_Block.EnsureCapacity( m_nBlockSize );
+	if ( !DecodeFrame( m_Codec, frame, pPayload, m_Block.Base() ) )
+	{
+		m_bError = true;
+		return NULL;
+	}
+
+	*pnBytes = frame.m_nSize;
+	return m_Block.Base();
+}
+
+int CCompressedStreamReader::Read( void *pDest, int nBytes )
+{
+	int nRead = 0;
+	while ( nRead < nBytes )
+	{
+		if ( m_nCurrentPos == m_nCurrentSize )
+		{
+			m_pCurrent = (const byte *)NextBlock( &m_nCurrentSize );
+			m_nCurrentPos = 0;
+			if ( !m_pCurrent )
+				break;
+		}
+
+		int nCopy = MIN( nBytes - nRead, m_nCurrentSize - m_nCurrentPos );
+		memcpy( (byte *)pDest + nRead, m_pCurrent + m_nCurrentPos, nCopy );
+		m_nCurrentPos += nCopy;
+		nRead += nCopy;
+	}
+
+	return nRead;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Each frame is decoded straight into the destination buffer
+//-----------------------------------------------------------------------------
+bool CCompressedStreamReader::ReadAll( CUtlBuffer &out )
+{
+	// Whatever Read() left of the block it was in
+	if ( m_nCurrentPos < m_nCurrentSize )
+	{
+		out.Put( m_pCurrent + m_nCurrentPos, m_nCurrentSize - m_nCurrentPos );
+		m_nCurrentPos = m_nCurrentSize;
+	}
+
+	while ( !m_bEnd && !m_bError )
+	{
+		CompressedStreamFrame_t frame;
+		const byte *pPayload;
+		if ( !ReadFrame( frame, &pPayload ) )
+		{
+			m_bError = true;
+			break;
+		}
+
+		if ( frame.m_nSize == 0 )
+		{
+			m_bEnd = true;
+			break;
+		}
+
+		if ( !ReserveBuffer( out, frame.m_nSize ) || !DecodeFrame( m_Codec, frame, pPayload, (byte *)out.PeekPut() ) )
+		{
+			m_bError = true;
+			break;
+		}
+		out.SeekPut( CUtlBuffer::SEEK_CURRENT, frame.m_nSize );
+	}
+
+	return !m_bError;
+}
+
+int CCompressedStreamReader::GetMemoryUsed() const
+{
+	return m_Block.NumAllocated() + m_Frame.NumAllocated();
+}
+
+
+//-----------------------------------------------------------------------------
+// Whole buffers across the thread pool
+//-----------------------------------------------------------------------------
+struct CompressStreamJob_t
+{
+	CompressedStreamCodec_t m_Codec;
+	const byte *m_pData;
+	int m_nBytes;
+	byte *m_pDest;			// worst case frame sized slot
+	int m_nFrameSize;
+};
+
+static void ProcessCompressStreamJob( CompressStreamJob_t &job )
+{
+	job.m_nFrameSize = EncodeFrame( job.m_Codec, job.m_pData, job.m_nBytes, job.m_pDest );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Every block is encoded into its own worst case slot in the output,
+//			then the frames are closed up behind each other
+//-----------------------------------------------------------------------------
+bool CompressStreamParallel( CUtlBuffer &in, CUtlBuffer &out, CompressedStreamCodec_t codec, int nBlockSize )
+{
+	Assert( codec >= 0 && codec < COMPRESSEDSTREAM_CODEC_COUNT );
+	nBlockSize = ClampBlockSize( nBlockSize );
+
+	int nBytes = in.GetBytesRemaining();
+	const byte *pData = nBytes ? (const byte *)in.PeekGet() : NULL;
+	int nBlocks = ( nBytes + nBlockSize - 1 ) / nBlockSize;
+
+	int64 nReserve = sizeof( CompressedStreamHeader_t ) + (int64)nBlocks * CompressedStreamMaxFrameSize( codec, nBlockSize ) + sizeof( CompressedStreamFrame_t );
+	if ( nReserve > INT_MAX || !ReserveBuffer( out, (int)nReserve ) )
+		return false;
+
+	byte *pBase = (byte *)out.PeekPut();
+	WriteHeader( pBase, codec, nBlockSize );
+
+	CUtlVector< CompressStreamJob_t > jobs;
+	jobs.SetCount( nBlocks );
+	for ( int i = 0; i < nBlocks; ++i )
+	{
+		CompressStreamJob_t &job = jobs[i];
+		job.m_Codec = codec;
+		job.m_pData = pData + i * nBlockSize;
+		job.m_nBytes = MIN( nBlockSize, nBytes - i * nBlockSize );
+		job.m_pDest = pBase + sizeof( CompressedStreamHeader_t ) + i * CompressedStreamMaxFrameSize( codec, nBlockSize );
+	}
+
+	ParallelProcess( "CompressStreamParallel", jobs.Base(), jobs.Count(), &ProcessCompressStreamJob );
+
+	int nOut = sizeof( CompressedStreamHeader_t );
+	for ( int i = 0; i < nBlocks; ++i )
+	{
+		if ( jobs[i].m_pDest != pBase + nOut )
+		{
+			memmove( pBase + nOut, jobs[i].m_pDest, jobs[i].m_nFrameSize );
+		}
+		nOut += jobs[i].m_nFrameSize;
+	}
+
+	memset( pBase + nOut, 0, sizeof( CompressedStreamFrame_t ) );
+	nOut += sizeof( CompressedStreamFrame_t );
+
+	out.SeekPut( CUtlBuffer::SEEK_CURRENT, nOut );
+	in.SeekGet( CUtlBuffer::SEEK_CURRENT, nBytes );
+	return true;
+}
+
+struct DecompressStreamJob_t
+{
+	CompressedStreamCodec_t m_Codec;
+	CompressedStreamFrame_t m_Frame;
+	const byte *m_pPayload;
+	int m_nOffset;
+	byte *m_pDest;
+	bool m_bOK;
+};
+
+static void ProcessDecompressStreamJob( DecompressStreamJob_t &job )
+{
+	job.m_bOK = DecodeFrame( job.m_Codec, job.m_Frame, job.m_pPayload, job.m_pDest );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The frame headers are walked first; their raw sizes place every
+//			block in the output, and then the blocks decode side by side
+//-----------------------------------------------------------------------------
+bool DecompressStreamParallel( CUtlBuffer &in, CUtlBuffer &out )
+{
+	int nAvailable = in.GetBytesRemaining();
+	if ( nAvailable < (int)sizeof( CompressedStreamHeader_t ) )
+		return false;
+
+	const byte *pStream = (const byte *)in.PeekGet();
+	CompressedStreamCodec_t codec;
+	int nBlockSize;
+	if ( !ParseHeader( pStream, codec, nBlockSize ) )
+		return false;
+
+	CUtlVector< DecompressStreamJob_t > jobs;
+	int nPos = sizeof( CompressedStreamHeader_t );
+	int64 nTotal = 0;
+	for ( ;; )
+	{
+		CompressedStreamFrame_t frame;
+		if ( nAvailable - nPos < (int)sizeof( frame ) || !ParseFrame( pStream + nPos, codec, nBlockSize, frame ) )
+			return false;
+
+		nPos += sizeof( frame );
+		if ( frame.m_nSize == 0 )
+			break;
+
+		int nPayloadSize = FramePayloadSize( frame );
+		if ( nAvailable - nPos < nPayloadSize || nTotal + frame.m_nSize > INT_MAX )
+			return false;
+
+		DecompressStreamJob_t &job = jobs[ jobs.AddToTail() ];
+		job.m_Codec = codec;
+		job.m_Frame = frame;
+		job.m_pPayload = pStream + nPos;
+		job.m_nOffset = (int)nTotal;
+
+		nPos += nPayloadSize;
+		nTotal += frame.m_nSize;
+	}
+
+	if ( !ReserveBuffer( out, (int)nTotal ) )
+		return false;
+
+	byte *pBase = (byte *)out.PeekPut();
+	for ( int i = 0; i < jobs.Count(); ++i )
+	{
+		jobs[i].m_pDest = pBase + jobs[i].m_nOffset;
+	}
+
+	ParallelProcess( "DecompressStreamParallel", jobs.Base(), jobs.Count(), &ProcessDecompressStreamJob );
+
+	for ( int i = 0; i < jobs.Count(); ++i )
+	{
+		if ( !jobs[i].m_bOK )
+			return false;
+	}
+
+	out.SeekPut( CUtlBuffer::SEEK_CURRENT, (int)nTotal );
+	in.SeekGet( CUtlBuffer::SEEK_CURRENT, nPos );
+	return true;
+}
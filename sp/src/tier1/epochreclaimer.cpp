@@ -0,0 +1,108 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Epoch based reclamation for lock-free readers.
+//
+//===========================================================================//
+
+#include "tier1/epochreclaimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+CEpochReclaimer::CEpochReclaimer()
+{
+	memset( m_Readers, 0, sizeof( m_Readers ) );
+	m_nEpoch = 0;
+}
+
+CEpochReclaimer::~CEpochReclaimer()
+{
+	Assert( CountReaders( 0 ) == 0 && CountReaders( 1 ) == 0 );
+	FreeRetired( 0 );
+	FreeRetired( 1 );
+}
+
+int CEpochReclaimer::CountReaders( int nParity ) const
+{
+	int nReaders = 0;
+	for ( int i = 0; i < NUM_READER_STRIPES; ++i )
+	{
+		nReaders += m_Readers[ nParity * NUM_READER_STRIPES + i ].m_nCount;
+	}
+	return nReaders;
+}
+
+void CEpochReclaimer::FreeRetired( int nParity )
+{
+	CUtlVector< Retired_t > &retired = m_Retired[ nParity ];
+	for ( int i = 0; i < retired.Count(); ++i )
+	{
+		retired[i].m_pfnFree( retired[i].m_pObject, retired[i].m_pContext );
+	}
+	retired.RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Queues an object that readers may still be looking at
+//-----------------------------------------------------------------------------
+void CEpochReclaimer::Retire( void *pObject, RetireFunc_t pfnFree, void *pContext )
+{
+	bool bReclaim;
+	{
+		AUTO_LOCK( m_Mutex );
+		CUtlVector< Retired_t > &retired = m_Retired[ m_nEpoch & 1 ];
+		Retired_t &entry = retired[ retired.AddToTail() ];
+		entry.m_pObject = pObject;
+		entry.m_pfnFree = pfnFree;
+		entry.m_pContext = pContext;
+		bReclaim = ( retired.Count() >= RECLAIM_THRESHOLD );
+	}
+
+	if ( bReclaim )
+	{
+		TryReclaim();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Objects retired in the epoch before the current one can go once
+//			the readers counted against that epoch have left; readers of the
+//			current epoch entered after they were unlinked. Then the epoch
+//			moves on, and the emptied list takes its retirements.
+//-----------------------------------------------------------------------------
+bool CEpochReclaimer::TryReclaim()
+{
+	AUTO_LOCK( m_Mutex );
+	int nPrevious = ( m_nEpoch + 1 ) & 1;
+	if ( CountReaders( nPrevious ) != 0 )
+		return false;
+
+	FreeRetired( nPrevious );
+	ThreadInterlockedIncrement( &m_nEpoch );
+	return true;
+}
+
+void CEpochReclaimer::ReclaimAll()
+{
+	// Two advances take everything retired so far through a drained epoch
+	for ( int nAdvanced = 0; nAdvanced < 2; )
+	{
+		if ( TryReclaim() )
+		{
+			++nAdvanced;
+		}
+		else
+		{
+			ThreadSleep( 0 );
+		}
+	}
+}
+
+int CEpochReclaimer::NumRetired() const
+{
+	AUTO_LOCK( m_Mutex );
+	return m_Retired[ 0 ].Count() + m_Retired[ 1 ].Count();
+}
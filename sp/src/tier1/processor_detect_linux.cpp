@@ -33,6 +33,14 @@ bool CheckSSE2Technology(void)
     return edx & 0x04000000;
 }
 
+bool CheckPCLMULQDQTechnology(void)
+{
+    unsigned long eax,ebx,ecx,edx;
+    cpuid(1,eax,ebx,ecx,edx);
+
+    return ecx & 0x2;
+}
+
 bool Check3DNowTechnology(void)
 {
     unsigned long eax, unused;
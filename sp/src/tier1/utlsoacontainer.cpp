@@ -0,0 +1,358 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: CSOAContainer storage and its SIMD fill, copy and arithmetic
+//			functions.
+//
+//			Each attribute gets its own run of memory. A row of it is
+//			m_nNumQuadsPerRow groups of four elements, stored as a fltx4, a
+//			FourVectors or four ints or pointers, and the rows of every slice
+//			follow one another with no gaps.
+//
+//=============================================================================//
+
+#include "tier1/utlsoacontainer.h"
+#include "tier1/utlvector.h"
+#include "vstdlib/jobthread.h"
+#include <stdarg.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Every attribute starts on this boundary, wide enough for 8 floats
+#define SOA_ALIGNMENT ( SOA_BLOCK_WIDTH * sizeof( float ) )
+
+// Bytes for one group of four elements of each type, indexed by EAttributeDataType
+static const size_t s_nQuadSizeInBytes[] =
+{
+	sizeof( fltx4 ),										// ATTRDATATYPE_FLOAT
+	sizeof( FourVectors ),									// ATTRDATATYPE_4V
+	4 * sizeof( int ),										// ATTRDATATYPE_INT
+	4 * sizeof( void * ),									// ATTRDATATYPE_POINTER
+};
+
+// Bytes per element of each type, indexed by EAttributeDataType
+static const size_t s_nElementSizeInBytes[] =
+{
+	sizeof( float ),										// ATTRDATATYPE_FLOAT
+	sizeof( Vector ),										// ATTRDATATYPE_4V
+	sizeof( int ),											// ATTRDATATYPE_INT
+	sizeof( void * ),										// ATTRDATATYPE_POINTER
+};
+
+CSOAContainer::CSOAContainer( int nCols, int nRows, ... )
+{
+	Init();
+
+	va_list args;
+	va_start( args, nRows );
+	for ( ;; )
+	{
+		int nAttrIdx = va_arg( args, int );
+		if ( nAttrIdx == -1 )
+			break;
+
+		EAttributeDataType nDataType = (EAttributeDataType)va_arg( args, int );
+		SetAttributeType( nAttrIdx, nDataType );
+	}
+	va_end( args );
+
+	AllocateData( nCols, nRows );
+}
+
+CSOAContainer::~CSOAContainer( void )
+{
+	Purge();
+}
+
+void CSOAContainer::Purge( void )
+{
+	if ( m_pDataMemory )
+	{
+		MemAlloc_FreeAligned( m_pDataMemory );
+	}
+	Init();
+}
+
+size_t CSOAContainer::ElementSize( void ) const
+{
+	size_t nSize = 0;
+	for ( int i = 0; i < MAX_SOA_FIELDS; i++ )
+	{
+		if ( m_nFieldPresentMask & ( 1 << i ) )
+		{
+			nSize += s_nElementSizeInBytes[ m_nDataType[i] ];
+		}
+	}
+	return nSize;
+}
+
+void CSOAContainer::AllocateData( int nNCols, int nNRows, int nSlices )
+{
+	Assert( !m_pDataMemory );
+	Assert( nNCols > 0 && nNRows > 0 && nSlices > 0 );
+
+	m_nColumns = nNCols;
+	m_nRows = nNRows;
+	m_nSlices = nSlices;
+	m_nPaddedColumns = ( nNCols + SOA_BLOCK_WIDTH - 1 ) & ~( SOA_BLOCK_WIDTH - 1 );
+	m_nNumQuadsPerRow = m_nPaddedColumns / 4;
+
+	// Lay the attributes out one after another. Rows are whole 8 wide blocks, so
+	// every attribute stays aligned without any extra padding.
+	size_t nTotalSize = 0;
+	for ( int i = 0; i < MAX_SOA_FIELDS; i++ )
+	{
+		if ( m_nFieldPresentMask & ( 1 << i ) )
+		{
+			m_nStrideInBytes[i] = s_nQuadSizeInBytes[ m_nDataType[i] ];
+			m_nRowStrideInBytes[i] = m_nNumQuadsPerRow * m_nStrideInBytes[i];
+			m_nSliceStrideInBytes[i] = m_nRows * m_nRowStrideInBytes[i];
+			Assert( ( m_nRowStrideInBytes[i] % SOA_ALIGNMENT ) == 0 );
+
+			m_pAttributePtrs[i] = (uint8 *)nTotalSize;
+			nTotalSize += m_nSlices * m_nSliceStrideInBytes[i];
+		}
+		else
+		{
+			m_nStrideInBytes[i] = 0;
+			m_nRowStrideInBytes[i] = 0;
+			m_nSliceStrideInBytes[i] = 0;
+			m_pAttributePtrs[i] = NULL;
+		}
+	}
+
+	if ( !nTotalSize )
+		return;
+
+	// Zeroed so the padding columns hold something sane for the SIMD ops
+	m_pDataMemory = (uint8 *)MemAlloc_AllocAligned( nTotalSize, SOA_ALIGNMENT );
+	memset( m_pDataMemory, 0, nTotalSize );
+	for ( int i = 0; i < MAX_SOA_FIELDS; i++ )
+	{
+		if ( m_nFieldPresentMask & ( 1 << i ) )
+		{
+			m_pAttributePtrs[i] = m_pDataMemory + (size_t)m_pAttributePtrs[i];
+		}
+	}
+}
+
+void CSOAContainer::CopyAttrFrom( CSOAContainer const &other, int nAttributeIdx )
+{
+	Assert( other.m_nDataType[nAttributeIdx] == m_nDataType[nAttributeIdx] );
+	Assert( other.m_nPaddedColumns == m_nPaddedColumns );
+	Assert( other.m_nRows == m_nRows );
+	Assert( other.m_nSlices == m_nSlices );
+	memcpy( RowPtr( nAttributeIdx, 0 ), other.ConstRowPtr( nAttributeIdx, 0 ), m_nSlices * m_nSliceStrideInBytes[nAttributeIdx] );
+}
+
+void CSOAContainer::CopyAttrToAttr( int nSrcAttributeIndex, int nDestAttributeIndex )
+{
+	Assert( m_nDataType[nSrcAttributeIndex] == m_nDataType[nDestAttributeIndex] );
+	memcpy( RowPtr( nDestAttributeIndex, 0 ), ConstRowPtr( nSrcAttributeIndex, 0 ), m_nSlices * m_nSliceStrideInBytes[nSrcAttributeIndex] );
+}
+
+void CSOAContainer::RandomizeAttribute( int nAttr, float flMin, float flMax ) const
+{
+	fltx4 flScale = ReplicateX4( flMax - flMin );
+	fltx4 flBias = ReplicateX4( flMin );
+	int nQuads = NumRowsAllSlices() * m_nNumQuadsPerRow;
+
+	if ( m_nDataType[nAttr] == ATTRDATATYPE_4V )
+	{
+		FourVectors *pData = reinterpret_cast<FourVectors *>( RowPtr( nAttr, 0 ) );
+		for ( int i = 0; i < nQuads; i++ )
+		{
+			pData[i].x = MaddSIMD( RandSIMD(), flScale, flBias );
+			pData[i].y = MaddSIMD( RandSIMD(), flScale, flBias );
+			pData[i].z = MaddSIMD( RandSIMD(), flScale, flBias );
+		}
+	}
+	else
+	{
+		Assert( m_nDataType[nAttr] == ATTRDATATYPE_FLOAT );
+		fltx4 *pData = reinterpret_cast<fltx4 *>( RowPtr( nAttr, 0 ) );
+		for ( int i = 0; i < nQuads; i++ )
+		{
+			pData[i] = MaddSIMD( RandSIMD(), flScale, flBias );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Bilinear fill. flValueXY is the value at column X, row Y of the
+//			corners, and every slice gets the same values.
+//-----------------------------------------------------------------------------
+void CSOAContainer::FillAttrWithInterpolatedValues( int nAttr, float flValue00, float flValue10, float flValue01, float flValue11 ) const
+{
+	Assert( m_nDataType[nAttr] == ATTRDATATYPE_FLOAT );
+
+	fltx4 flColumnStep = ReplicateX4( ( m_nColumns > 1 ) ? 1.0f / ( m_nColumns - 1 ) : 0.0f );
+	float flRowStep = ( m_nRows > 1 ) ? 1.0f / ( m_nRows - 1 ) : 0.0f;
+
+	for ( int nSlice = 0; nSlice < m_nSlices; nSlice++ )
+	{
+		for ( int nRow = 0; nRow < m_nRows; nRow++ )
+		{
+			float flY = nRow * flRowStep;
+			fltx4 flLeft = ReplicateX4( flValue00 + ( flValue01 - flValue00 ) * flY );
+			fltx4 flRight = ReplicateX4( flValue10 + ( flValue11 - flValue10 ) * flY );
+			fltx4 flDelta = SubSIMD( flRight, flLeft );
+
+			fltx4 *pOut = reinterpret_cast<fltx4 *>( RowPtr( nAttr, nRow, nSlice ) );
+			fltx4 flColumn = g_SIMD_0123;
+			for ( int i = 0; i < m_nNumQuadsPerRow; i++ )
+			{
+				pOut[i] = MaddSIMD( flDelta, MulSIMD( flColumn, flColumnStep ), flLeft );
+				flColumn = AddSIMD( flColumn, Four_Fours );
+			}
+		}
+	}
+}
+
+void CSOAContainer::FillAttrWithInterpolatedValues( int nAttr, Vector flValue00, Vector flValue10,
+													Vector const &flValue01, Vector const &flValue11 ) const
+{
+	Assert( m_nDataType[nAttr] == ATTRDATATYPE_4V );
+
+	fltx4 flColumnStep = ReplicateX4( ( m_nColumns > 1 ) ? 1.0f / ( m_nColumns - 1 ) : 0.0f );
+	float flRowStep = ( m_nRows > 1 ) ? 1.0f / ( m_nRows - 1 ) : 0.0f;
+
+	for ( int nSlice = 0; nSlice < m_nSlices; nSlice++ )
+	{
+		for ( int nRow = 0; nRow < m_nRows; nRow++ )
+		{
+			float flY = nRow * flRowStep;
+			FourVectors left, delta;
+			left.DuplicateVector( flValue00 + ( flValue01 - flValue00 ) * flY );
+			delta.DuplicateVector( flValue10 + ( flValue11 - flValue10 ) * flY );
+			delta -= left;
+
+			FourVectors *pOut = reinterpret_cast<FourVectors *>( RowPtr( nAttr, nRow, nSlice ) );
+			fltx4 flColumn = g_SIMD_0123;
+			for ( int i = 0; i < m_nNumQuadsPerRow; i++ )
+			{
+				fltx4 flX = MulSIMD( flColumn, flColumnStep );
+				pOut[i].x = MaddSIMD( delta.x, flX, left.x );
+				pOut[i].y = MaddSIMD( delta.y, flX, left.y );
+				pOut[i].z = MaddSIMD( delta.z, flX, left.z );
+				flColumn = AddSIMD( flColumn, Four_Fours );
+			}
+		}
+	}
+}
+
+void CSOAContainer::MulAdd( int nDestAttr, int nAttrA, int nAttrB, int nAttrC ) const
+{
+	Transform( nDestAttr, nAttrA, nAttrB, nAttrC, SOAMulAddOp_t() );
+}
+
+void CSOAContainer::ScaleBias( int nDestAttr, int nSrcAttr, float flScale, float flBias ) const
+{
+	Transform( nDestAttr, nSrcAttr, -1, -1, SOAScaleBiasOp_t( flScale, flBias ) );
+}
+
+void CSOAContainer::Clamp( int nDestAttr, int nSrcAttr, float flMin, float flMax ) const
+{
+	Transform( nDestAttr, nSrcAttr, -1, -1, SOAClampOp_t( flMin, flMax ) );
+}
+
+void CSOAContainer::Lerp( int nDestAttr, int nAttrA, int nAttrB, int nAttrT ) const
+{
+	Transform( nDestAttr, nAttrA, nAttrB, nAttrT, SOALerpOp_t() );
+}
+
+void CSOAContainer::Lerp( int nDestAttr, int nAttrA, int nAttrB, float flT ) const
+{
+	Transform( nDestAttr, nAttrA, nAttrB, -1, SOALerpConstantOp_t( flT ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Loads scattered source elements four at a time. Indices count
+//			real elements, column fastest, not padded ones.
+//-----------------------------------------------------------------------------
+void CSOAContainer::Gather( int nDestAttr, CSOAContainer const &src, int nSrcAttr, int nIndexAttr ) const
+{
+	Assert( m_nDataType[nDestAttr] == ATTRDATATYPE_FLOAT );
+	Assert( m_nDataType[nIndexAttr] == ATTRDATATYPE_INT );
+	Assert( src.m_nDataType[nSrcAttr] == ATTRDATATYPE_FLOAT );
+
+	int nSrcElements = src.NumElements();
+	int nSrcColumns = src.m_nColumns;
+	uint8 const *pSrcBase = src.m_pAttributePtrs[nSrcAttr];
+	size_t nSrcRowStride = src.m_nRowStrideInBytes[nSrcAttr];
+
+	ALIGN16 float flGathered[4] ALIGN16_POST;
+	int nQuads = NumRowsAllSlices() * m_nNumQuadsPerRow;
+	int const *pIndices = reinterpret_cast<int const *>( ConstRowPtr( nIndexAttr, 0 ) );
+	fltx4 *pDest = reinterpret_cast<fltx4 *>( RowPtr( nDestAttr, 0 ) );
+	for ( int i = 0; i < nQuads; i++ )
+	{
+		for ( int j = 0; j < 4; j++ )
+		{
+			int nIndex = pIndices[j];
+			if ( nIndex >= 0 && nIndex < nSrcElements )
+			{
+				// Source rows of all slices follow one another, so this is a 2d lookup
+				int nRow = nIndex / nSrcColumns;
+				flGathered[j] = reinterpret_cast<float const *>( pSrcBase + nRow * nSrcRowStride )[ nIndex - nRow * nSrcColumns ];
+			}
+			else
+			{
+				flGathered[j] = 0.0f;
+			}
+		}
+		pDest[i] = LoadAlignedSIMD( flGathered );
+		pIndices += 4;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Parallel row blocks
+//-----------------------------------------------------------------------------
+struct SOARowBlock_t
+{
+	CSOAContainer const *m_pContainer;
+	SOARowBlockFunc_t m_pfnProcess;
+	void *m_pContext;
+	int m_nStartRow;
+	int m_nEndRow;
+};
+
+static void ProcessSOARowBlock( SOARowBlock_t &block )
+{
+	block.m_pfnProcess( block.m_pContainer, block.m_pContext, block.m_nStartRow, block.m_nEndRow );
+}
+
+void CSOAContainer::ParallelForRowBlocks( SOARowBlockFunc_t pfnProcess, void *pContext, int nRowsPerBlock ) const
+{
+	int nTotalRows = NumRowsAllSlices();
+	if ( nTotalRows <= 0 )
+		return;
+
+	if ( nRowsPerBlock <= 0 )
+	{
+		// A few blocks per thread evens out threads that start late
+		int nThreads = g_pThreadPool ? g_pThreadPool->NumThreads() + 1 : 1;
+		nRowsPerBlock = MAX( 1, nTotalRows / ( nThreads * 4 ) );
+	}
+
+	CUtlVector<SOARowBlock_t> blocks;
+	blocks.EnsureCapacity( ( nTotalRows + nRowsPerBlock - 1 ) / nRowsPerBlock );
+	for ( int nStartRow = 0; nStartRow < nTotalRows; nStartRow += nRowsPerBlock )
+	{
+		SOARowBlock_t &block = blocks[ blocks.AddToTail() ];
+		block.m_pContainer = this;
+		block.m_pfnProcess = pfnProcess;
+		block.m_pContext = pContext;
+		block.m_nStartRow = nStartRow;
+		block.m_nEndRow = MIN( nStartRow + nRowsPerBlock, nTotalRows );
+	}
+
+	if ( blocks.Count() == 1 )
+	{
+		ProcessSOARowBlock( blocks[0] );
+		return;
+	}
+
+	ParallelProcess( "CSOAContainer::ParallelForRowBlocks", blocks.Base(), blocks.Count(), &ProcessSOARowBlock );
+}